@@ -178,6 +178,7 @@ ApplicationWindow {
         moveContentsDialog: moveContentsDialog
         rearrangeContentsIntoGridDialog: rearrangeContentsIntoGridDialog
         texturedFillSettingsDialog: texturedFillSettingsDialog
+        undoHistoryDialog: undoHistoryDialog
         aboutDialog: aboutDialog
         saveChangesDialog: saveChangesDialog
         addGuidesDialog: addGuidesDialog
@@ -500,6 +501,13 @@ ApplicationWindow {
         canvas: window.canvas
     }
 
+    Ui.UndoHistoryDialog {
+        id: undoHistoryDialog
+        parent: Overlay.overlay
+        anchors.centerIn: parent
+        project: projectManager.project
+    }
+
     Ui.AboutDialog {
         id: aboutDialog
         parent: Overlay.overlay
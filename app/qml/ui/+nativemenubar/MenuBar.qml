@@ -38,6 +38,7 @@ Item {
     property var imageSizePopup
     property var moveContentsDialog
     property var texturedFillSettingsDialog
+    property var undoHistoryDialog
     property var aboutDialog
     property SaveChangesDialog saveChangesDialog
     property AddGuidesDialog addGuidesDialog
@@ -180,7 +181,7 @@ Item {
                 objectName: "undoMenuItem"
                 text: qsTr("Undo")
                 // See Shortcuts.qml for why we do it this way.
-                enabled: project && canvas && (project.undoStack.canUndo || canvas.hasModifiedSelection)
+                enabled: project && canvas && (project.canUndo || canvas.hasModifiedSelection)
                 onTriggered: canvas.undo()
             }
 
@@ -191,6 +192,14 @@ Item {
                 onTriggered: project.undoStack.redo()
             }
 
+            Platform.MenuItem {
+                objectName: "undoHistoryMenuItem"
+                //: Opens a dialog that lists the changes that can be undone and how much memory they use.
+                text: qsTr("Undo History...")
+                enabled: project
+                onTriggered: undoHistoryDialog.open()
+            }
+
             // https://bugreports.qt.io/browse/QTBUG-67310
             Platform.MenuSeparator {}
 
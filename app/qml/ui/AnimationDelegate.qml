@@ -66,6 +66,7 @@ EditableDelegate {
         x: 3
         parent: root.leftSectionLayout
         project: root.project
+        canvas: root.canvas
         animationPlayback: AnimationPlayback {
             objectName: root.objectName + "AnimationPlayback"
             animation: root.editing ? animationSystem.editAnimation : model.animation
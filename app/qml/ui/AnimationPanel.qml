@@ -103,6 +103,7 @@ Panel {
                 id: spriteImageContainer
                 objectName: "animationPreviewContainer"
                 project: root.project
+                canvas: root.canvas
                 animationPlayback: root.animationPlayback
             }
         }
@@ -213,6 +214,7 @@ Panel {
             delegate: AnimationDelegate {
                 width: animationListView.width
                 project: root.project
+                canvas: root.canvas
                 editing: animationSettingsPopup.animationIndex === index
 
                 onRenamed: root.canvas.forceActiveFocus()
@@ -15,6 +15,8 @@ ColumnLayout {
         settings.gesturesEnabled = enableGesturesCheckBox.checked
         settings.penToolRightClickBehaviour = penToolRightClickBehaviourComboBox.currentValue
         settings.autoSwatchEnabled = enableAutoSwatchCheckBox.checked
+        settings.undoMemoryBudget = undoMemoryBudgetSpinBox.value
+        settings.inMemoryUndoCommandCount = inMemoryUndoCommandCountSpinBox.value
 
         for (var i = 0; i < shortcutModel.count; ++i) {
             var row = shortcutModel.get(i)
@@ -30,6 +32,8 @@ ColumnLayout {
         penToolRightClickBehaviourComboBox.currentIndex =
             penToolRightClickBehaviourComboBox.indexOfValue(settings.penToolRightClickBehaviour)
         enableAutoSwatchCheckBox.checked = settings.autoSwatchEnabled
+        undoMemoryBudgetSpinBox.value = settings.undoMemoryBudget
+        inMemoryUndoCommandCountSpinBox.value = settings.inMemoryUndoCommandCount
 
         for (var i = 0; i < shortcutModel.count; ++i) {
             var row = shortcutModel.get(i)
@@ -140,6 +144,43 @@ ColumnLayout {
                 ToolTip.timeout: UiConstants.toolTipTimeout
             }
 
+            Label {
+                text: qsTr("Undo memory budget (MB)")
+            }
+            SpinBox {
+                id: undoMemoryBudgetSpinBox
+                objectName: "undoMemoryBudgetSpinBox"
+                from: 0
+                to: 65536
+                editable: true
+                stepSize: 128
+                value: settings.undoMemoryBudget
+
+                ToolTip.text: qsTr("Older changes are compressed and then discarded once the undo history "
+                    + "of a project uses more memory than this. Zero means no limit.")
+                ToolTip.visible: hovered
+                ToolTip.delay: UiConstants.toolTipDelay
+                ToolTip.timeout: UiConstants.toolTipTimeout
+            }
+
+            Label {
+                text: qsTr("Changes kept in memory")
+            }
+            SpinBox {
+                id: inMemoryUndoCommandCountSpinBox
+                objectName: "inMemoryUndoCommandCountSpinBox"
+                from: 1
+                to: 1024
+                editable: true
+                value: settings.inMemoryUndoCommandCount
+
+                ToolTip.text: qsTr("Changes older than this many are moved out of memory and into a "
+                    + "temporary file, which they're read back from when they're undone.")
+                ToolTip.visible: hovered
+                ToolTip.delay: UiConstants.toolTipDelay
+                ToolTip.timeout: UiConstants.toolTipTimeout
+            }
+
             Label {
                 text: qsTr("Shortcuts")
                 font.bold: true
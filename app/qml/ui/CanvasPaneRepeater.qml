@@ -63,6 +63,7 @@ Repeater {
         canvas: root.canvas
         pane: canvas.paneAt(index)
         paneIndex: index
+        renderer: CanvasPaneItem.SceneGraphRenderer
         x: isFirstPane ? 0 : Math.floor(parent.width - width)
         width: Math.floor(paneItem.pane.size * parent.width)
         height: parent.height
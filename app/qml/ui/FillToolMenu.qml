@@ -46,4 +46,19 @@ Menu {
         checked: canvas && canvas.lastFillToolUsed === ImageCanvas.TexturedFillTool
         onTriggered: canvas.tool = ImageCanvas.TexturedFillTool
     }
+
+    MenuSeparator {
+        visible: greedyFillAllLayersMenuItem.visible
+        height: visible ? implicitHeight : 0
+    }
+    MenuItem {
+        id: greedyFillAllLayersMenuItem
+        objectName: "greedyFillAllLayersMenuItem"
+        text: qsTr("Shift-Fill All Layers")
+        checkable: true
+        checked: canvas && canvas.greedyFillAllLayers
+        visible: canvas && canvas.project && canvas.project.type === Project.LayeredImageType
+        height: visible ? implicitHeight : 0
+        onTriggered: canvas.greedyFillAllLayers = checked
+    }
 }
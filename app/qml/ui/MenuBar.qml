@@ -42,6 +42,7 @@ Controls.MenuBar {
     property var imageSizePopup
     property var moveContentsDialog
     property var texturedFillSettingsDialog
+    property var undoHistoryDialog
     property var aboutDialog
     property SaveChangesDialog saveChangesDialog
     property AddGuidesDialog addGuidesDialog
@@ -207,7 +208,7 @@ Controls.MenuBar {
             objectName: "undoMenuItem"
             text: qsTr("Undo")
             // See Shortcuts.qml for why we do it this way.
-            enabled: project && canvas && (project.undoStack.canUndo || canvas.hasModifiedSelection)
+            enabled: project && canvas && (project.canUndo || canvas.hasModifiedSelection)
             onTriggered: canvas.undo()
         }
 
@@ -218,6 +219,14 @@ Controls.MenuBar {
             onTriggered: project.undoStack.redo()
         }
 
+        MenuItem {
+            objectName: "undoHistoryMenuItem"
+            //: Opens a dialog that lists the changes that can be undone and how much memory they use.
+            text: qsTr("Undo History...")
+            enabled: project
+            onTriggered: undoHistoryDialog.open()
+        }
+
         MenuSeparator {}
 
         MenuItem {
@@ -80,7 +80,7 @@ Item {
         //     selection is confirmed (or "undone"; see ImageCanvas::interceptUndo()).
         // Since these conflict with each other, we cheat a little bit and allow
         // undos as long as the selection contents have been modified have to add the || canvas.hasModifiedSelection.
-        enabled: canvasHasActiveFocus && project && (project.undoStack.canUndo || canvas.hasModifiedSelection)
+        enabled: canvasHasActiveFocus && project && (project.canUndo || canvas.hasModifiedSelection)
         onActivated: canvas.undo()
     }
 
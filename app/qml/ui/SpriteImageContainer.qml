@@ -31,12 +31,14 @@ Item {
     implicitHeight: spriteImage.implicitHeight * spriteImage.scale
 
     property var project
+    property ImageCanvas canvas
     property AnimationPlayback animationPlayback
 
     SpriteImage {
         id: spriteImage
         objectName: root.objectName + "SpriteImage"
         project: root.project
+        canvas: root.canvas
         animationPlayback: root.animationPlayback
         scale: animationPlayback ? animationPlayback.scale : 1.0
         smooth: false
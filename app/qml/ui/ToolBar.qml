@@ -124,7 +124,7 @@ ToolBarBase {
             Ui.IconToolButton {
                 objectName: "undoToolButton"
                 text: "\uf0e2"
-                enabled: projectLoaded && (project.undoStack.canUndo || canvas.hasModifiedSelection)
+                enabled: projectLoaded && (project.canUndo || canvas.hasModifiedSelection)
 
                 ToolTip.text: qsTr("Undo the last canvas operation")
 
@@ -0,0 +1,113 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+import QtQuick
+import QtQuick.Layouts
+import QtQuick.Controls
+
+import Slate
+
+import "." as Ui
+
+// Shows how much memory each change in the undo history uses
+// and how long it took to apply, to help track down slow sessions.
+Dialog {
+    id: root
+    objectName: "undoHistoryDialog"
+    title: qsTr("Undo History")
+    modal: true
+    dim: false
+    focus: true
+    standardButtons: Dialog.Close
+    width: Math.max(implicitWidth, 480)
+    height: 480
+
+    property Project project
+
+    function formatByteCount(byteCount) {
+        if (byteCount >= 1024 * 1024)
+            return qsTr("%1 MB").arg((byteCount / (1024 * 1024)).toFixed(1))
+        if (byteCount >= 1024)
+            return qsTr("%1 KB").arg((byteCount / 1024).toFixed(1))
+        return qsTr("%1 B").arg(byteCount)
+    }
+
+    contentItem: ColumnLayout {
+        spacing: 12
+
+        Label {
+            objectName: "undoHistoryTotalLabel"
+            // Calculating the total walks the whole history, so only do it while it's visible.
+            text: root.visible && root.project
+                ? qsTr("Total: %1").arg(root.formatByteCount(root.project.undoPayloadByteCount))
+                : ""
+            font.bold: true
+
+            Layout.fillWidth: true
+        }
+
+        ListView {
+            id: undoHistoryListView
+            objectName: "undoHistoryListView"
+            boundsBehavior: ListView.StopAtBounds
+            clip: true
+            model: UndoHistoryModel {
+                // Only keep the model up to date while it's visible.
+                project: root.visible ? root.project : null
+            }
+            delegate: RowLayout {
+                width: undoHistoryListView.width
+                spacing: 12
+                // Changes that have been undone can still be redone, so they're
+                // still in the history, but they're not part of the image.
+                opacity: model.undone ? 0.5 : 1
+
+                required property var model
+
+                Label {
+                    text: model.text
+                    elide: Label.ElideRight
+
+                    Layout.fillWidth: true
+                }
+                Label {
+                    text: Qt.formatTime(model.creationTime, "hh:mm:ss")
+                }
+                Label {
+                    //: The time it took to apply a change, in milliseconds.
+                    text: qsTr("%1 ms").arg(model.applyDuration.toFixed(1))
+                    horizontalAlignment: Label.AlignRight
+
+                    Layout.preferredWidth: 80
+                }
+                Label {
+                    text: root.formatByteCount(model.payloadByteCount)
+                    horizontalAlignment: Label.AlignRight
+
+                    Layout.preferredWidth: 80
+                }
+            }
+
+            Layout.fillWidth: true
+            Layout.fillHeight: true
+
+            ScrollBar.vertical: ScrollBar {}
+        }
+    }
+}
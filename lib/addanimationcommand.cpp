@@ -52,6 +52,11 @@ int AddAnimationCommand::id() const
     return -1;
 }
 
+qint64 AddAnimationCommand::payloadByteCount() const
+{
+    return mName.size() * qint64(sizeof(QChar));
+}
+
 QDebug operator<<(QDebug debug, const AddAnimationCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -50,6 +50,11 @@ int AddGuidesCommand::id() const
     return -1;
 }
 
+qint64 AddGuidesCommand::payloadByteCount() const
+{
+    return mGuides.size() * qint64(sizeof(Guide));
+}
+
 QDebug operator<<(QDebug debug, const AddGuidesCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -62,6 +62,12 @@ bool AddLayerCommand::modifiesContents() const
     return true;
 }
 
+qint64 AddLayerCommand::payloadByteCount() const
+{
+    // We only own the layer while it's not in the project.
+    return mLayerGuard ? mLayerGuard->image()->sizeInBytes() : 0;
+}
+
 QDebug operator<<(QDebug debug, const AddLayerCommand *command)
 {
     QDebugStateSaver saver(debug);
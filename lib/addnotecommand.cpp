@@ -50,6 +50,11 @@ int AddNoteCommand::id() const
     return -1;
 }
 
+qint64 AddNoteCommand::payloadByteCount() const
+{
+    return mNote.text().size() * qint64(sizeof(QChar));
+}
+
 QDebug operator<<(QDebug debug, const AddNoteCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -337,6 +337,46 @@ void ApplicationSettings::setPenToolRightClickBehaviour(int penToolRightClickBeh
     emit penToolRightClickBehaviourChanged();
 }
 
+int ApplicationSettings::defaultUndoMemoryBudget() const
+{
+    return 1024;
+}
+
+int ApplicationSettings::undoMemoryBudget() const
+{
+    return contains("undoMemoryBudget")
+        ? value("undoMemoryBudget").value<int>() : defaultUndoMemoryBudget();
+}
+
+void ApplicationSettings::setUndoMemoryBudget(int undoMemoryBudget)
+{
+    if (this->undoMemoryBudget() == undoMemoryBudget)
+        return;
+
+    setValue("undoMemoryBudget", QVariant(undoMemoryBudget));
+    emit undoMemoryBudgetChanged();
+}
+
+int ApplicationSettings::defaultInMemoryUndoCommandCount() const
+{
+    return 16;
+}
+
+int ApplicationSettings::inMemoryUndoCommandCount() const
+{
+    return contains("inMemoryUndoCommandCount")
+        ? value("inMemoryUndoCommandCount").value<int>() : defaultInMemoryUndoCommandCount();
+}
+
+void ApplicationSettings::setInMemoryUndoCommandCount(int inMemoryUndoCommandCount)
+{
+    if (this->inMemoryUndoCommandCount() == inMemoryUndoCommandCount)
+        return;
+
+    setValue("inMemoryUndoCommandCount", QVariant(inMemoryUndoCommandCount));
+    emit inMemoryUndoCommandCountChanged();
+}
+
 void ApplicationSettings::resetShortcutsToDefaults()
 {
     static QVector<QString> allShortcuts;
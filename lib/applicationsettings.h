@@ -49,6 +49,8 @@ class SLATE_EXPORT ApplicationSettings : public QSettings
     Q_PROPERTY(QColor checkerColour1 READ checkerColour1 WRITE setCheckerColour1 NOTIFY checkerColour1Changed)
     Q_PROPERTY(QColor checkerColour2 READ checkerColour2 WRITE setCheckerColour2 NOTIFY checkerColour2Changed)
     Q_PROPERTY(int penToolRightClickBehaviour READ penToolRightClickBehaviour WRITE setPenToolRightClickBehaviour NOTIFY penToolRightClickBehaviourChanged)
+    Q_PROPERTY(int undoMemoryBudget READ undoMemoryBudget WRITE setUndoMemoryBudget NOTIFY undoMemoryBudgetChanged)
+    Q_PROPERTY(int inMemoryUndoCommandCount READ inMemoryUndoCommandCount WRITE setInMemoryUndoCommandCount NOTIFY inMemoryUndoCommandCountChanged)
     Q_PROPERTY(QString language READ language WRITE setLanguage NOTIFY languageChanged)
 
     Q_PROPERTY(QString newShortcut READ newShortcut WRITE setNewShortcut NOTIFY newShortcutChanged)
@@ -153,6 +155,18 @@ public:
     int penToolRightClickBehaviour() const;
     void setPenToolRightClickBehaviour(int penToolRightClickBehaviour);
 
+    // The amount of memory (in megabytes) that each project's undo history can use
+    // before older changes are compressed and then discarded. Zero means no limit.
+    int defaultUndoMemoryBudget() const;
+    int undoMemoryBudget() const;
+    void setUndoMemoryBudget(int undoMemoryBudget);
+
+    // The amount of most recent changes in each project's undo history that are kept in memory.
+    // Older changes have their images moved into a file, which they're read back from when undone.
+    int defaultInMemoryUndoCommandCount() const;
+    int inMemoryUndoCommandCount() const;
+    void setInMemoryUndoCommandCount(int inMemoryUndoCommandCount);
+
     Q_INVOKABLE void resetShortcutsToDefaults();
 
     QString defaultNewShortcut() const;
@@ -333,6 +347,8 @@ signals:
     void checkerColour1Changed();
     void checkerColour2Changed();
     void penToolRightClickBehaviourChanged();
+    void undoMemoryBudgetChanged();
+    void inMemoryUndoCommandCountChanged();
 
     void quitShortcutChanged();
     void newShortcutChanged();
@@ -27,12 +27,12 @@
 Q_LOGGING_CATEGORY(lcApplyGreedyPixelFillCommand, "app.undo.applyGreedyPixelFillCommand")
 
 ApplyGreedyPixelFillCommand::ApplyGreedyPixelFillCommand(ImageCanvas *canvas, int layerIndex, const QImage &previousImage,
-    const QImage &newImage, UndoCommand *parent) :
+    const QImage &newImage, quint32 texturedFillSeed, UndoCommand *parent) :
     UndoCommand(parent),
     mCanvas(canvas),
     mLayerIndex(layerIndex),
-    mPreviousImage(previousImage),
-    mNewImage(newImage)
+    mDelta(previousImage, newImage),
+    mTexturedFillSeed(texturedFillSeed)
 {
     qCDebug(lcApplyGreedyPixelFillCommand) << "constructed" << this;
 }
@@ -40,13 +40,13 @@ ApplyGreedyPixelFillCommand::ApplyGreedyPixelFillCommand(ImageCanvas *canvas, in
 void ApplyGreedyPixelFillCommand::undo()
 {
     qCDebug(lcApplyGreedyPixelFillCommand) << "undoing" << this;
-    mCanvas->replaceImage(mLayerIndex, mPreviousImage);
+    mCanvas->applyImageDelta(mLayerIndex, mDelta, ImageDelta::PreviousVersion);
 }
 
 void ApplyGreedyPixelFillCommand::redo()
 {
     qCDebug(lcApplyGreedyPixelFillCommand) << "redoing" << this;
-    mCanvas->replaceImage(mLayerIndex, mNewImage);
+    mCanvas->applyImageDelta(mLayerIndex, mDelta, ImageDelta::NewVersion);
 }
 
 int ApplyGreedyPixelFillCommand::id() const
@@ -59,6 +59,26 @@ bool ApplyGreedyPixelFillCommand::modifiesContents() const
     return true;
 }
 
+qint64 ApplyGreedyPixelFillCommand::payloadByteCount() const
+{
+    return mDelta.byteCount();
+}
+
+void ApplyGreedyPixelFillCommand::spillPayload(const QSharedPointer<UndoSpillFile> &spillFile)
+{
+    mDelta.spill(spillFile);
+}
+
+void ApplyGreedyPixelFillCommand::releasePayload()
+{
+    mDelta = ImageDelta();
+}
+
+quint32 ApplyGreedyPixelFillCommand::texturedFillSeed() const
+{
+    return mTexturedFillSeed;
+}
+
 QDebug operator<<(QDebug debug, const ApplyGreedyPixelFillCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -67,6 +87,8 @@ QDebug operator<<(QDebug debug, const ApplyGreedyPixelFillCommand *command)
 
     debug.nospace() << "(ApplyGreedyPixelFillCommand"
         << " layerIndex=" << command->mLayerIndex
+        << " delta=" << command->mDelta
+        << " texturedFillSeed=" << command->mTexturedFillSeed
         << ")";
     return debug;
 }
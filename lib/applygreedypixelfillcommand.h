@@ -24,6 +24,7 @@
 #include <QImage>
 
 #include "slate-global.h"
+#include "imagedelta.h"
 #include "undocommand.h"
 
 class ImageCanvas;
@@ -31,8 +32,9 @@ class ImageCanvas;
 class SLATE_EXPORT ApplyGreedyPixelFillCommand : public UndoCommand
 {
 public:
+    // texturedFillSeed is the seed that a textured fill was generated with, so that it can be reproduced.
     ApplyGreedyPixelFillCommand(ImageCanvas *canvas, int layerIndex,const QImage &previousImage,
-        const QImage &newImage, UndoCommand *parent = nullptr);
+        const QImage &newImage, quint32 texturedFillSeed = 0, UndoCommand *parent = nullptr);
 
     void undo() override;
     void redo() override;
@@ -41,13 +43,20 @@ public:
 
     bool modifiesContents() const override;
 
+    qint64 payloadByteCount() const override;
+    void spillPayload(const QSharedPointer<UndoSpillFile> &spillFile) override;
+    void releasePayload() override;
+
+    quint32 texturedFillSeed() const;
+
 private:
     friend QDebug operator<<(QDebug debug, const ApplyGreedyPixelFillCommand *command);
 
     ImageCanvas *mCanvas;
     int mLayerIndex;
-    QImage mPreviousImage;
-    QImage mNewImage;
+    // Only the filled pixels are stored, rather than the whole image before and after.
+    ImageDelta mDelta;
+    quint32 mTexturedFillSeed;
 };
 
 #endif // APPLYGREEDYPIXELFILLCOMMAND_H
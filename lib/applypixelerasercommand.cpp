@@ -25,32 +25,28 @@
 
 Q_LOGGING_CATEGORY(lcApplyPixelEraserCommand, "app.undo.applyPixelEraserCommand")
 
-ApplyPixelEraserCommand::ApplyPixelEraserCommand(ImageCanvas *canvas, int layerIndex, const QVector<QPoint> &scenePositions,
-    const QVector<QColor> &previousColours, UndoCommand *parent) :
+ApplyPixelEraserCommand::ApplyPixelEraserCommand(ImageCanvas *canvas, int layerIndex, const PackedPixels &previousPixels,
+    UndoCommand *parent) :
     UndoCommand(parent),
     mCanvas(canvas),
-    mLayerIndex(layerIndex)
+    mLayerIndex(layerIndex),
+    mPreviousPixels(previousPixels)
 {
-    mScenePositions = scenePositions;
-    mPreviousColours = previousColours;
-
     qCDebug(lcApplyPixelEraserCommand) << "constructed" << this;
 }
 
 void ApplyPixelEraserCommand::undo()
 {
     qCDebug(lcApplyPixelEraserCommand) << "undoing" << this;
-    for (int i = 0; i < mScenePositions.size(); ++i) {
-        mCanvas->applyPixelPenTool(mLayerIndex, mScenePositions.at(i), mPreviousColours.at(i));
-    }
+    uniteMergedPreviousPixels();
+    mCanvas->applyPackedPixels(mLayerIndex, { mPreviousPixels });
 }
 
 void ApplyPixelEraserCommand::redo()
 {
     qCDebug(lcApplyPixelEraserCommand) << "redoing" << this;
-    for (int i = 0; i < mScenePositions.size(); ++i) {
-        mCanvas->applyPixelPenTool(mLayerIndex, mScenePositions.at(i), QColor(Qt::transparent));
-    }
+    uniteMergedPreviousPixels();
+    mCanvas->applyPackedPixels(mLayerIndex, { mPreviousPixels }, Qt::transparent);
 }
 
 int ApplyPixelEraserCommand::id() const
@@ -65,15 +61,10 @@ bool ApplyPixelEraserCommand::mergeWith(const QUndoCommand *other)
         return false;
     }
 
-    // Duplicate pixel; we can just discard the other command.
-    if (otherCommand->mScenePositions.size() == 1 && mScenePositions.contains(otherCommand->mScenePositions.first())) {
-        return true;
-    }
-
-    // A unique pixel that we haven't touched yet; add it.
+    // The other command has already erased its pixels, so we only need to know
+    // what they were before; see uniteMergedPreviousPixels().
     qCDebug(lcApplyPixelEraserCommand) << "\nmerging:\n    " << otherCommand << "\nwith:\n    " << this;
-    mScenePositions.append(otherCommand->mScenePositions);
-    mPreviousColours.append(otherCommand->mPreviousColours);
+    mMergedPreviousPixels.append(otherCommand->mPreviousPixels);
     return true;
 }
 
@@ -82,6 +73,38 @@ bool ApplyPixelEraserCommand::modifiesContents() const
     return true;
 }
 
+qint64 ApplyPixelEraserCommand::payloadByteCount() const
+{
+    qint64 byteCount = mPreviousPixels.byteCount();
+    for (const PackedPixels &previousPixels : mMergedPreviousPixels)
+        byteCount += previousPixels.byteCount();
+    return byteCount;
+}
+
+void ApplyPixelEraserCommand::releasePayload()
+{
+    mPreviousPixels = PackedPixels();
+    mMergedPreviousPixels.clear();
+}
+
+void ApplyPixelEraserCommand::macroEnded()
+{
+    uniteMergedPreviousPixels();
+}
+
+void ApplyPixelEraserCommand::uniteMergedPreviousPixels()
+{
+    if (mMergedPreviousPixels.isEmpty())
+        return;
+
+    // Pixels that were erased more than once keep the value they had before
+    // the first erase, so that undoing restores them.
+    mMergedPreviousPixels.prepend(mPreviousPixels);
+    mPreviousPixels = PackedPixels::united(mMergedPreviousPixels);
+    mMergedPreviousPixels.clear();
+    qCDebug(lcApplyPixelEraserCommand) << "united merged pixels of" << this;
+}
+
 QDebug operator<<(QDebug debug, const ApplyPixelEraserCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -90,8 +113,7 @@ QDebug operator<<(QDebug debug, const ApplyPixelEraserCommand *command)
 
     debug.nospace() << "(ApplyPixelEraserCommand"
         << " layerIndex=" << command->mLayerIndex
-        << ", scenePositions=" << command->mScenePositions
-        << ", previousColours=" << command->mPreviousColours
+        << ", previousPixels=" << command->mPreviousPixels
         << ")";
     return debug;
 }
@@ -20,19 +20,18 @@
 #ifndef APPLYPIXELERASERCOMMAND_H
 #define APPLYPIXELERASERCOMMAND_H
 
-#include <QColor>
 #include <QDebug>
-#include <QPoint>
 #include <QVector>
 
 #include "imagecanvas.h"
+#include "packedpixels.h"
 #include "slate-global.h"
 #include "undocommand.h"
 
 class SLATE_EXPORT ApplyPixelEraserCommand : public UndoCommand
 {
 public:
-    ApplyPixelEraserCommand(ImageCanvas *canvas, int layerIndex, const QVector<QPoint> &scenePositions, const QVector<QColor> &previousColours,
+    ApplyPixelEraserCommand(ImageCanvas *canvas, int layerIndex, const PackedPixels &previousPixels,
         UndoCommand *parent = nullptr);
 
     void undo() override;
@@ -42,14 +41,23 @@ public:
     bool mergeWith(const QUndoCommand *other) override;
 
     bool modifiesContents() const override;
+    qint64 payloadByteCount() const override;
+    void releasePayload() override;
+    void macroEnded() override;
 
 private:
     friend QDebug operator<<(QDebug debug, const ApplyPixelEraserCommand *command);
 
+    void uniteMergedPreviousPixels();
+
     ImageCanvas *mCanvas;
     int mLayerIndex;
-    QVector<QPoint> mScenePositions;
-    QVector<QColor> mPreviousColours;
+    // The erased pixels as they were before the first erase that touched them.
+    PackedPixels mPreviousPixels;
+    // The previous pixels of each erase that was merged into this command since
+    // mPreviousPixels was last updated, in order. Uniting them once when the stroke
+    // is finished is much cheaper than doing so for every segment of it.
+    QVector<PackedPixels> mMergedPreviousPixels;
 };
 
 
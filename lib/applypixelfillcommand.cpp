@@ -25,13 +25,15 @@
 
 Q_LOGGING_CATEGORY(lcApplyPixelFillCommand, "app.undo.applyPixelFillCommand")
 
-ApplyPixelFillCommand::ApplyPixelFillCommand(ImageCanvas *canvas, int layerIndex,
-    const QImage &previousImage, const QImage &newImage, UndoCommand *parent) :
+// Only the area within the mask's bounds is compared, so the cost of
+// creating the command depends on the size of the fill, not the image.
+ApplyPixelFillCommand::ApplyPixelFillCommand(ImageCanvas *canvas, int layerIndex, const QImage &previousImage,
+    const PixelFillMask &mask, const QImage &filledArea, quint32 texturedFillSeed, UndoCommand *parent) :
     UndoCommand(parent),
     mCanvas(canvas),
     mLayerIndex(layerIndex),
-    mPreviousImage(previousImage),
-    mNewImage(newImage)
+    mDelta(previousImage.copy(mask.bounds), filledArea, mask.bounds.topLeft()),
+    mTexturedFillSeed(texturedFillSeed)
 {
     qCDebug(lcApplyPixelFillCommand) << "constructed" << this;
 }
@@ -39,13 +41,13 @@ ApplyPixelFillCommand::ApplyPixelFillCommand(ImageCanvas *canvas, int layerIndex
 void ApplyPixelFillCommand::undo()
 {
     qCDebug(lcApplyPixelFillCommand) << "undoing" << this;
-    mCanvas->replaceImage(mLayerIndex, mPreviousImage);
+    mCanvas->applyImageDelta(mLayerIndex, mDelta, ImageDelta::PreviousVersion);
 }
 
 void ApplyPixelFillCommand::redo()
 {
     qCDebug(lcApplyPixelFillCommand) << "redoing" << this;
-    mCanvas->replaceImage(mLayerIndex, mNewImage);
+    mCanvas->applyImageDelta(mLayerIndex, mDelta, ImageDelta::NewVersion);
 }
 
 int ApplyPixelFillCommand::id() const
@@ -58,6 +60,26 @@ bool ApplyPixelFillCommand::modifiesContents() const
     return true;
 }
 
+qint64 ApplyPixelFillCommand::payloadByteCount() const
+{
+    return mDelta.byteCount();
+}
+
+void ApplyPixelFillCommand::spillPayload(const QSharedPointer<UndoSpillFile> &spillFile)
+{
+    mDelta.spill(spillFile);
+}
+
+void ApplyPixelFillCommand::releasePayload()
+{
+    mDelta = ImageDelta();
+}
+
+quint32 ApplyPixelFillCommand::texturedFillSeed() const
+{
+    return mTexturedFillSeed;
+}
+
 QDebug operator<<(QDebug debug, const ApplyPixelFillCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -66,6 +88,8 @@ QDebug operator<<(QDebug debug, const ApplyPixelFillCommand *command)
 
     debug.nospace() << "(ApplyPixelFillCommand"
         << " layerIndex=" << command->mLayerIndex
+        << " delta=" << command->mDelta
+        << " texturedFillSeed=" << command->mTexturedFillSeed
         << ")";
     return debug;
 }
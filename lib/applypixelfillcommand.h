@@ -23,7 +23,9 @@
 #include <QDebug>
 #include <QImage>
 
+#include "fillalgorithms.h"
 #include "slate-global.h"
+#include "imagedelta.h"
 #include "undocommand.h"
 
 class ImageCanvas;
@@ -31,8 +33,11 @@ class ImageCanvas;
 class SLATE_EXPORT ApplyPixelFillCommand : public UndoCommand
 {
 public:
+    // filledArea is the area of previousImage that mask bounds, after being filled.
+    // texturedFillSeed is the seed that a textured fill was generated with, so that it can be reproduced.
     ApplyPixelFillCommand(ImageCanvas *canvas, int layerIndex, const QImage &previousImage,
-        const QImage &newImage, UndoCommand *parent = nullptr);
+        const PixelFillMask &mask, const QImage &filledArea, quint32 texturedFillSeed = 0,
+        UndoCommand *parent = nullptr);
 
     void undo() override;
     void redo() override;
@@ -41,13 +46,20 @@ public:
 
     bool modifiesContents() const override;
 
+    qint64 payloadByteCount() const override;
+    void spillPayload(const QSharedPointer<UndoSpillFile> &spillFile) override;
+    void releasePayload() override;
+
+    quint32 texturedFillSeed() const;
+
 private:
     friend QDebug operator<<(QDebug debug, const ApplyPixelFillCommand *command);
 
     ImageCanvas *mCanvas;
     int mLayerIndex;
-    QImage mPreviousImage;
-    QImage mNewImage;
+    // Only the filled pixels are stored, rather than the whole image before and after.
+    ImageDelta mDelta;
+    quint32 mTexturedFillSeed;
 };
 
 #endif // APPLYPIXELFILLCOMMAND_H
@@ -27,8 +27,9 @@
 
 Q_LOGGING_CATEGORY(lcApplyPixelLineCommand, "app.undo.applyPixelLineCommand")
 
-// The undo command for lines needs the project image before and after
-// the line was drawn on it.
+// The undo command for lines only stores the tiles that the line touched, as they were
+// before it was drawn. Subsequent segments of the same stroke are merged into it,
+// so that a stroke only ever stores one copy of each tile it touched.
 ApplyPixelLineCommand::ApplyPixelLineCommand(ImageCanvas *canvas, int layerIndex, QImage &currentProjectImage, const QPointF &point1, const QPointF &point2,
         const QPointF &newLastPixelPenReleaseScenePos, const QPointF &oldLastPixelPenReleaseScenePos,
         QPainter::CompositionMode mode, UndoCommand *parent) :
@@ -46,25 +47,34 @@ ApplyPixelLineCommand::ApplyPixelLineCommand(ImageCanvas *canvas, int layerIndex
         // line rect offset to scene space and clipped to subimage bounds
         const QRect subImageLineRect = subImage.bounds.intersected(lineRect.translated(offset));
 
-        SubImageData subImageData;
-        subImageData.subImage = subImage;
-        subImageData.lineRect = subImageLineRect;
-        subImageData.imageWithoutLine = currentProjectImage.copy(subImageLineRect);
+        storeTilesBeforeStroke(currentProjectImage, subImageLineRect);
 
-        QPainter painter(&currentProjectImage);
-        // Clip drawing to subimage
-        painter.setClipRect(subImageLineRect);
-        // Draw line with offset to subimage
-        mCanvas->drawLine(&painter, point1 + offset, point2 + offset, mode);
-        painter.end();
+        // Draw line with offset to subimage, clipped to subimage
+        mCanvas->drawLine(&currentProjectImage, subImageLineRect, point1 + offset, point2 + offset, mode);
 
-        subImageData.imageWithLine = currentProjectImage.copy(subImageLineRect);
-        subImageDatas.append(subImageData);
+        mLastSegmentArea |= subImageLineRect;
     }
+    mStrokeArea = mLastSegmentArea;
 
     qCDebug(lcApplyPixelLineCommand) << "constructed" << this;
 }
 
+// Restores the tiles (if necessary) so that they can be drawn onto the image.
+// Sets ok to false if any of them couldn't be restored.
+static QHash<QPoint, QImage> tileImages(const QHash<QPoint, UndoImage> &tiles, bool *ok)
+{
+    *ok = true;
+    QHash<QPoint, QImage> images;
+    images.reserve(tiles.size());
+    for (auto it = tiles.constBegin(); it != tiles.constEnd(); ++it) {
+        bool restored = false;
+        images.insert(it.key(), it.value().image(&restored));
+        if (!restored)
+            *ok = false;
+    }
+    return images;
+}
+
 ApplyPixelLineCommand::~ApplyPixelLineCommand()
 {
     qCDebug(lcApplyPixelLineCommand) << "destructed" << this;
@@ -73,17 +83,36 @@ ApplyPixelLineCommand::~ApplyPixelLineCommand()
 void ApplyPixelLineCommand::undo()
 {
     qCDebug(lcApplyPixelLineCommand) << "undoing" << this;
-    for (auto const &subImageData : std::as_const(subImageDatas)) {
-        mCanvas->applyPixelLineTool(mLayerIndex, subImageData.imageWithoutLine, subImageData.lineRect, mOldLastPixelPenReleaseScenePos);
+    if (mTilesAfterStroke.isEmpty()) {
+        // This is the first time we've been undone, so the image still contains the finished stroke.
+        const QImage *image = mCanvas->imageForLayerAt(mLayerIndex);
+        for (auto it = mTilesBeforeStroke.constBegin(); it != mTilesBeforeStroke.constEnd(); ++it)
+            mTilesAfterStroke.insert(it.key(), UndoImage(image->copy(QRect(it.key(), it.value().size())), lcApplyPixelLineCommand));
     }
+
+    bool restored = false;
+    const QHash<QPoint, QImage> tilesBeforeStroke = tileImages(mTilesBeforeStroke, &restored);
+    if (!restored)
+        return;
+
+    mCanvas->applyPixelLineTool(mLayerIndex, tilesBeforeStroke, mStrokeArea, mOldLastPixelPenReleaseScenePos);
 }
 
 void ApplyPixelLineCommand::redo()
 {
     qCDebug(lcApplyPixelLineCommand) << "redoing" << this;
-    for (auto const &subImageData : std::as_const(subImageDatas)) {
-        mCanvas->applyPixelLineTool(mLayerIndex, subImageData.imageWithLine, subImageData.lineRect, mNewLastPixelPenReleaseScenePos);
+    if (mTilesAfterStroke.isEmpty()) {
+        // The line was already drawn when we were constructed; we just need to let the canvas know about it.
+        mCanvas->applyPixelLineTool(mLayerIndex, QHash<QPoint, QImage>(), mLastSegmentArea, mNewLastPixelPenReleaseScenePos);
+        return;
     }
+
+    bool restored = false;
+    const QHash<QPoint, QImage> tilesAfterStroke = tileImages(mTilesAfterStroke, &restored);
+    if (!restored)
+        return;
+
+    mCanvas->applyPixelLineTool(mLayerIndex, tilesAfterStroke, mStrokeArea, mNewLastPixelPenReleaseScenePos);
 }
 
 int ApplyPixelLineCommand::id() const
@@ -91,9 +120,50 @@ int ApplyPixelLineCommand::id() const
     return ApplyPixelLineCommandId;
 }
 
-bool ApplyPixelLineCommand::mergeWith(const QUndoCommand *)
+bool ApplyPixelLineCommand::mergeWith(const QUndoCommand *other)
+{
+    const ApplyPixelLineCommand *otherCommand = dynamic_cast<const ApplyPixelLineCommand*>(other);
+    if (!otherCommand)
+        return false;
+
+    if (otherCommand->mCanvas != mCanvas || otherCommand->mLayerIndex != mLayerIndex)
+        return false;
+
+    // Once we've been undone, our tiles no longer represent the stroke in progress.
+    if (!mTilesAfterStroke.isEmpty())
+        return false;
+
+    qCDebug(lcApplyPixelLineCommand) << "\nmerging:\n    " << otherCommand << "\nwith:\n    " << this;
+    // Our copies of tiles that we share with the other command are older, so keep them.
+    for (auto it = otherCommand->mTilesBeforeStroke.constBegin(); it != otherCommand->mTilesBeforeStroke.constEnd(); ++it) {
+        if (!mTilesBeforeStroke.contains(it.key()))
+            mTilesBeforeStroke.insert(it.key(), it.value());
+    }
+    mLastSegmentArea = otherCommand->mLastSegmentArea;
+    mStrokeArea |= otherCommand->mStrokeArea;
+    mNewLastPixelPenReleaseScenePos = otherCommand->mNewLastPixelPenReleaseScenePos;
+    return true;
+}
+
+// Copies the tiles of image that intersect area, unless we already have them.
+void ApplyPixelLineCommand::storeTilesBeforeStroke(const QImage &image, const QRect &area)
 {
-    return false;
+    const QRect imageArea = area.intersected(image.rect());
+    if (imageArea.isEmpty())
+        return;
+
+    const int firstTileX = (imageArea.left() / tileSize) * tileSize;
+    const int firstTileY = (imageArea.top() / tileSize) * tileSize;
+    for (int y = firstTileY; y <= imageArea.bottom(); y += tileSize) {
+        for (int x = firstTileX; x <= imageArea.right(); x += tileSize) {
+            const QPoint tileTopLeft(x, y);
+            if (mTilesBeforeStroke.contains(tileTopLeft))
+                continue;
+
+            const QRect tileRect = QRect(tileTopLeft, QSize(tileSize, tileSize)).intersected(image.rect());
+            mTilesBeforeStroke.insert(tileTopLeft, UndoImage(image.copy(tileRect), lcApplyPixelLineCommand));
+        }
+    }
 }
 
 bool ApplyPixelLineCommand::modifiesContents() const
@@ -101,6 +171,38 @@ bool ApplyPixelLineCommand::modifiesContents() const
     return true;
 }
 
+qint64 ApplyPixelLineCommand::payloadByteCount() const
+{
+    qint64 byteCount = 0;
+    for (const UndoImage &tile : mTilesBeforeStroke)
+        byteCount += tile.byteCount();
+    for (const UndoImage &tile : mTilesAfterStroke)
+        byteCount += tile.byteCount();
+    return byteCount;
+}
+
+void ApplyPixelLineCommand::compressPayload()
+{
+    for (UndoImage &tile : mTilesBeforeStroke)
+        tile.compress();
+    for (UndoImage &tile : mTilesAfterStroke)
+        tile.compress();
+}
+
+void ApplyPixelLineCommand::spillPayload(const QSharedPointer<UndoSpillFile> &spillFile)
+{
+    for (UndoImage &tile : mTilesBeforeStroke)
+        tile.spill(spillFile);
+    for (UndoImage &tile : mTilesAfterStroke)
+        tile.spill(spillFile);
+}
+
+void ApplyPixelLineCommand::releasePayload()
+{
+    mTilesBeforeStroke.clear();
+    mTilesAfterStroke.clear();
+}
+
 QDebug operator<<(QDebug debug, const ApplyPixelLineCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -109,7 +211,8 @@ QDebug operator<<(QDebug debug, const ApplyPixelLineCommand *command)
 
     debug.nospace() << "(ApplyPixelLineCommand"
         << " layerIndex=" << command->mLayerIndex
-//        << ", lineRect" << command->mLineRect
+        << ", strokeArea=" << command->mStrokeArea
+        << ", tiles=" << command->mTilesBeforeStroke.size()
         << ", newLastPixelPenReleaseScenePos=" << command->mNewLastPixelPenReleaseScenePos
         << ", oldLastPixelPenReleaseScenePos=" << command->mOldLastPixelPenReleaseScenePos
         << ")";
@@ -21,15 +21,20 @@
 #define APPLYPIXELLINECOMMAND_H
 
 #include <QDebug>
+#include <QHash>
 #include <QPointF>
 
 #include "imagecanvas.h"
 #include "slate-global.h"
 #include "undocommand.h"
+#include "undoimage.h"
 
 class SLATE_EXPORT ApplyPixelLineCommand : public UndoCommand
 {
 public:
+    // The width and height of the tiles that are stored before a stroke touches them.
+    static constexpr int tileSize = 64;
+
     ApplyPixelLineCommand(ImageCanvas *canvas, int layerIndex, QImage &currentProjectImage, const QPointF &point1, const QPointF &point2,
         const QPointF &newLastPixelPenReleaseScenePos, const QPointF &oldLastPixelPenReleaseScenePos,
         QPainter::CompositionMode mode, UndoCommand *parent = nullptr);
@@ -42,6 +47,10 @@ public:
     bool mergeWith(const QUndoCommand *other) override;
 
     bool modifiesContents() const override;
+    qint64 payloadByteCount() const override;
+    void compressPayload() override;
+    void spillPayload(const QSharedPointer<UndoSpillFile> &spillFile) override;
+    void releasePayload() override;
 
 private:
     friend QDebug operator<<(QDebug debug, const ApplyPixelLineCommand *command);
@@ -51,13 +60,18 @@ private:
     QPointF mNewLastPixelPenReleaseScenePos;
     QPointF mOldLastPixelPenReleaseScenePos;
 
-    struct SubImageData {
-        ImageCanvas::SubImage subImage;
-        QRect lineRect;
-        QImage imageWithoutLine;
-        QImage imageWithLine;
-    };
-    QList<SubImageData> subImageDatas;
+    void storeTilesBeforeStroke(const QImage &image, const QRect &area);
+
+    // The area drawn to by the most recent segment of the stroke.
+    QRect mLastSegmentArea;
+    // The area drawn to by the whole stroke.
+    QRect mStrokeArea;
+    // Copies of every tile (keyed by their top-left corner) that the stroke has touched,
+    // taken before the stroke first drew to them.
+    QHash<QPoint, UndoImage> mTilesBeforeStroke;
+    // Copies of the same tiles after the stroke. These are taken when the command is
+    // first undone, as the stroke's segments can keep being merged into it until then.
+    QHash<QPoint, UndoImage> mTilesAfterStroke;
 };
 
 
@@ -25,33 +25,27 @@
 
 Q_LOGGING_CATEGORY(lcApplyPixelPenCommand, "app.undo.applyPixelPenCommand")
 
-ApplyPixelPenCommand::ApplyPixelPenCommand(ImageCanvas *canvas, int layerIndex, const QVector<QPoint> &scenePositions,
-    const QVector<QColor> &previousColours, const QColor &colour, UndoCommand *parent) :
+ApplyPixelPenCommand::ApplyPixelPenCommand(ImageCanvas *canvas, int layerIndex, const PackedPixels &previousPixels,
+    const QColor &colour, UndoCommand *parent) :
     UndoCommand(parent),
     mCanvas(canvas),
     mLayerIndex(layerIndex),
+    mPreviousPixels(previousPixels),
     mColour(colour)
 {
-    mScenePositions = scenePositions;
-    mPreviousColours = previousColours;
-
     qCDebug(lcApplyPixelPenCommand) << "constructed" << this;
 }
 
 void ApplyPixelPenCommand::undo()
 {
     qCDebug(lcApplyPixelPenCommand) << "undoing" << this;
-    for (int i = 0; i < mScenePositions.size(); ++i) {
-        mCanvas->applyPixelPenTool(mLayerIndex, mScenePositions.at(i), mPreviousColours.at(i), i == mScenePositions.size() - 1);
-    }
+    mCanvas->applyPackedPixels(mLayerIndex, { mPreviousPixels }, QColor(), true);
 }
 
 void ApplyPixelPenCommand::redo()
 {
     qCDebug(lcApplyPixelPenCommand) << "redoing" << this;
-    for (int i = 0; i < mScenePositions.size(); ++i) {
-        mCanvas->applyPixelPenTool(mLayerIndex, mScenePositions.at(i), mColour, i == mScenePositions.size() - 1);
-    }
+    mCanvas->applyPackedPixels(mLayerIndex, { mPreviousPixels }, mColour, true);
 }
 
 int ApplyPixelPenCommand::id() const
@@ -70,8 +64,8 @@ bool ApplyPixelPenCommand::mergeWith(const QUndoCommand *other)
         return false;
     }
 
-    // Duplicate scene positions; we can just discard the other command.
-    if (otherCommand->mScenePositions == mScenePositions) {
+    // Duplicate pixels; we can just discard the other command.
+    if (otherCommand->mPreviousPixels == mPreviousPixels) {
         qCDebug(lcApplyPixelPenCommand) << "merging duplicate pixel pen commands";
         return true;
     }
@@ -84,14 +78,23 @@ bool ApplyPixelPenCommand::modifiesContents() const
     return true;
 }
 
+qint64 ApplyPixelPenCommand::payloadByteCount() const
+{
+    return mPreviousPixels.byteCount();
+}
+
+void ApplyPixelPenCommand::releasePayload()
+{
+    mPreviousPixels = PackedPixels();
+}
+
 QDebug operator<<(QDebug debug, const ApplyPixelPenCommand *command)
 {
     QDebugStateSaver saver(debug);
     if (!command)
         return debug << "ApplyPixelPenCommand(0x0)";
 
-    debug.nospace() << "(ApplyPixelPenCommand scenePositions=" << command->mScenePositions
-        << ", previousColours=" << command->mPreviousColours
+    debug.nospace() << "(ApplyPixelPenCommand previousPixels=" << command->mPreviousPixels
         << ", colour=" << command->mColour
         << ")";
     return debug;
@@ -22,17 +22,16 @@
 
 #include <QColor>
 #include <QDebug>
-#include <QPoint>
-#include <QVector>
 
 #include "imagecanvas.h"
+#include "packedpixels.h"
 #include "slate-global.h"
 #include "undocommand.h"
 
 class SLATE_EXPORT ApplyPixelPenCommand : public UndoCommand
 {
 public:
-    ApplyPixelPenCommand(ImageCanvas *canvas, int layerIndex, const QVector<QPoint> &scenePositions, const QVector<QColor> &previousColours,
+    ApplyPixelPenCommand(ImageCanvas *canvas, int layerIndex, const PackedPixels &previousPixels,
         const QColor &colour, UndoCommand *parent = nullptr);
 
     void undo() override;
@@ -42,14 +41,15 @@ public:
     bool mergeWith(const QUndoCommand *other) override;
 
     bool modifiesContents() const override;
+    qint64 payloadByteCount() const override;
+    void releasePayload() override;
 
 private:
     friend QDebug operator<<(QDebug debug, const ApplyPixelPenCommand *command);
 
     ImageCanvas *mCanvas;
     int mLayerIndex;
-    QVector<QPoint> mScenePositions;
-    QVector<QColor> mPreviousColours;
+    PackedPixels mPreviousPixels;
     QColor mColour;
 };
 
@@ -41,17 +41,13 @@ ApplyTileCanvasPixelFillCommand::ApplyTileCanvasPixelFillCommand(TileCanvas *can
 void ApplyTileCanvasPixelFillCommand::undo()
 {
     qCDebug(lcApplyTileCanvasPixelFillCommand) << "undoing" << this;
-    for (int i = 0; i < mScenePositions.size(); ++i) {
-        mCanvas->applyPixelPenTool(-1, mScenePositions.at(i), mPreviousColour);
-    }
+    mCanvas->applyPixelPenTool(-1, mScenePositions, { mPreviousColour });
 }
 
 void ApplyTileCanvasPixelFillCommand::redo()
 {
     qCDebug(lcApplyTileCanvasPixelFillCommand) << "redoing" << this;
-    for (int i = 0; i < mScenePositions.size(); ++i) {
-        mCanvas->applyPixelPenTool(-1, mScenePositions.at(i), mColour);
-    }
+    mCanvas->applyPixelPenTool(-1, mScenePositions, { mColour });
 }
 
 int ApplyTileCanvasPixelFillCommand::id() const
@@ -64,6 +60,11 @@ bool ApplyTileCanvasPixelFillCommand::modifiesContents() const
     return true;
 }
 
+qint64 ApplyTileCanvasPixelFillCommand::payloadByteCount() const
+{
+    return mScenePositions.size() * qint64(sizeof(QPoint));
+}
+
 QDebug operator<<(QDebug debug, const ApplyTileCanvasPixelFillCommand *command)
 {
     QDebugStateSaver saver(debug);
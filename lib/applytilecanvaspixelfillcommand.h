@@ -42,6 +42,7 @@ public:
     int id() const override;
 
     bool modifiesContents() const override;
+    qint64 payloadByteCount() const override;
 
 private:
     friend QDebug operator<<(QDebug debug, const ApplyTileCanvasPixelFillCommand *command);
@@ -77,6 +77,11 @@ bool ApplyTileEraserCommand::mergeWith(const QUndoCommand *other)
     return true;
 }
 
+qint64 ApplyTileEraserCommand::payloadByteCount() const
+{
+    return mTilePositions.size() * qint64(sizeof(QPoint)) + mPreviousIds.size() * qint64(sizeof(int));
+}
+
 QDebug operator<<(QDebug debug, const ApplyTileEraserCommand *command)
 {
     QDebugStateSaver saver(debug);
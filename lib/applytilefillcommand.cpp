@@ -64,6 +64,11 @@ bool ApplyTileFillCommand::mergeWith(const QUndoCommand *)
     return false;
 }
 
+qint64 ApplyTileFillCommand::payloadByteCount() const
+{
+    return mTilePositions.size() * qint64(sizeof(QPoint));
+}
+
 QDebug operator<<(QDebug debug, const ApplyTileFillCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -81,6 +81,11 @@ bool ApplyTilePenCommand::mergeWith(const QUndoCommand *other)
     return true;
 }
 
+qint64 ApplyTilePenCommand::payloadByteCount() const
+{
+    return mTilePositions.size() * qint64(sizeof(QPoint)) + mPreviousIds.size() * qint64(sizeof(int));
+}
+
 QDebug operator<<(QDebug debug, const ApplyTilePenCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -40,6 +40,7 @@ public:
 
     int id() const override;
     bool mergeWith(const QUndoCommand *other) override;
+    qint64 payloadByteCount() const override;
 
 private:
     friend QDebug operator<<(QDebug debug, const ApplyTilePenCommand *command);
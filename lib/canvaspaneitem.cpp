@@ -20,6 +20,7 @@
 #include "canvaspaneitem.h"
 
 #include "canvaspane.h"
+#include "canvaspanenode.h"
 #include "guide.h"
 #include "imagecanvas.h"
 #include "imageutils.h"
@@ -27,12 +28,71 @@
 #include "project.h"
 
 #include <QPainter>
+#include <QSGOpacityNode>
+#include <QtMath>
+
+Q_LOGGING_CATEGORY(lcCanvasPaneItem, "app.canvasPaneItem")
 
 /*
     This class is a purely visual respresentation of a canvas pane;
     ImageCanvas contains all of the state that will be painted, and this class paints it.
 */
 
+/*
+    The node returned by CanvasPaneItem::updatePaintNode().
+
+    QQuickPaintedItem keeps a pointer to the node it creates for PainterRenderer
+    (e.g. for textureProvider()), so we must never delete that node ourselves.
+    Instead, it lives under an opacity node that hides it while SceneGraphRenderer
+    is used, and is deleted along with the rest of our nodes by the scene graph.
+*/
+class CanvasPaneRootNode : public QSGNode
+{
+public:
+    CanvasPaneRootNode()
+    {
+        appendChildNode(&mPainterNodeParent);
+        mPainterNodeParent.setFlag(QSGNode::OwnedByParent, false);
+    }
+
+    QSGNode *painterNode() const
+    {
+        return mPainterNodeParent.firstChild();
+    }
+
+    // node is null if QQuickPaintedItem deleted its node (which removes it from us).
+    void setPainterNode(QSGNode *node)
+    {
+        if (node && !node->parent())
+            mPainterNodeParent.appendChildNode(node);
+    }
+
+    void setPainterNodeVisible(bool visible)
+    {
+        mPainterNodeParent.setOpacity(visible ? 1.0 : 0.0);
+    }
+
+    CanvasPaneNode *sceneGraphNode() const
+    {
+        return mSceneGraphNode;
+    }
+
+    void setSceneGraphNode(CanvasPaneNode *node)
+    {
+        if (node == mSceneGraphNode)
+            return;
+
+        delete mSceneGraphNode;
+        mSceneGraphNode = node;
+        if (mSceneGraphNode)
+            appendChildNode(mSceneGraphNode);
+    }
+
+private:
+    QSGOpacityNode mPainterNodeParent;
+    CanvasPaneNode *mSceneGraphNode = nullptr;
+};
+
 CanvasPaneItem::CanvasPaneItem(QQuickItem *parent) :
     QQuickPaintedItem(parent)
 {
@@ -93,6 +153,21 @@ void CanvasPaneItem::setPaneIndex(int paneIndex)
     emit paneIndexChanged();
 }
 
+CanvasPaneItem::Renderer CanvasPaneItem::renderer() const
+{
+    return mRenderer;
+}
+
+void CanvasPaneItem::setRenderer(Renderer renderer)
+{
+    if (renderer == mRenderer)
+        return;
+
+    mRenderer = renderer;
+    update();
+    emit rendererChanged();
+}
+
 bool CanvasPaneItem::isRectVisible(const QRect &sceneRect) const
 {
     const QRect ourViewport(QPoint(0, 0), QSize(mCanvas->size().width() * mPane->size(), mCanvas->height()));
@@ -100,6 +175,16 @@ bool CanvasPaneItem::isRectVisible(const QRect &sceneRect) const
     return ourViewport.intersects(sceneRect);
 }
 
+int CanvasPaneItem::fullPaintCount() const
+{
+    return mFullPaintCount;
+}
+
+int CanvasPaneItem::uploadedTileCount() const
+{
+    return mUploadedTileCount.loadRelaxed();
+}
+
 void CanvasPaneItem::itemChange(QQuickItem::ItemChange change, const QQuickItem::ItemChangeData &value)
 {
     if (change == ItemVisibleHasChanged) {
@@ -115,6 +200,7 @@ void CanvasPaneItem::itemChange(QQuickItem::ItemChange change, const QQuickItem:
 void CanvasPaneItem::connectToCanvas()
 {
     connect(mCanvas, &ImageCanvas::contentPaintRequested, this, &CanvasPaneItem::onContentPaintRequested);
+    connect(mCanvas, &ImageCanvas::contentAreaPaintRequested, this, &CanvasPaneItem::onContentAreaPaintRequested);
 
     // Fixes a problem where the second pane wasn't rendered when splitting the screen.
     update();
@@ -129,23 +215,124 @@ void CanvasPaneItem::onContentPaintRequested(int paneIndex)
 {
     if (paneIndex == -1 || paneIndex == mPaneIndex) {
         // Only schedule a re-paint if we were the pane it was requested for.
+        mFullContentPaintRequested = true;
         update();
     }
 }
 
+void CanvasPaneItem::onContentAreaPaintRequested(const QRect &sceneArea)
+{
+    if (!mPane)
+        return;
+
+    // Textures of tiles that aren't visible need to be uploaded again too once they are.
+    if (mRenderer == SceneGraphRenderer)
+        mDirtySceneRegion += sceneArea;
+
+    // Map the area from scene coordinates to our own, and only schedule a re-paint if it's visible.
+    const int integerZoomLevel = mPane->integerZoomLevel();
+    const QRect zoomedArea(sceneArea.topLeft() * integerZoomLevel + mPane->integerOffset(),
+        sceneArea.size() * integerZoomLevel);
+    const QRect visibleArea = zoomedArea.intersected(QRect(0, 0, qCeil(width()), qCeil(height())));
+    if (!visibleArea.isEmpty())
+        update(visibleArea);
+}
+
 void CanvasPaneItem::paint(QPainter *painter)
 {
     if (!mCanvas->project() || !mCanvas->project()->hasLoaded())
         return;
 
+    // QQuickPaintedItem only clips the painter when specific areas were passed to update().
+    const QRectF paintedArea = painter->hasClipping() ? painter->clipBoundingRect() : boundingRect();
+    if (paintedArea.contains(boundingRect())) {
+        ++mFullPaintCount;
+        qCDebug(lcCanvasPaneItem) << "painting all of" << objectName() << "- total full paints:" << mFullPaintCount;
+    } else {
+        qCDebug(lcCanvasPaneItem) << "painting" << paintedArea << "of" << objectName();
+    }
+
+    const QRect visibleSceneArea = sceneAreaWithin(paintedArea.intersected(boundingRect()).toAlignedRect());
+    if (visibleSceneArea.isEmpty())
+        return;
+
     PaneDrawingHelper paneDrawingHelper(mCanvas, painter, mPane, mPaneIndex);
 
+    // Only draw the part of the canvas that is visible, so that the cost of painting
+    // depends on the size of the pane rather than the size of the image multiplied by the zoom level.
+    const int integerZoomLevel = mPane->integerZoomLevel();
+    const QRect zoomedVisibleSceneArea(visibleSceneArea.topLeft() * integerZoomLevel,
+        visibleSceneArea.size() * integerZoomLevel);
+
     // Draw the checkered pixmap that acts as an indicator for transparency.
-    // We use the unbounded canvas size here, otherwise the drawn area is too small past a certain zoom level.
-    const QSize zoomedCanvasSize = mPane->zoomedSize(mCanvas->currentProjectImage()->size());
-    painter->drawTiledPixmap(0, 0, zoomedCanvasSize.width(), zoomedCanvasSize.height(), mCanvas->mCheckerPixmap);
+    // The offset keeps the checkers aligned as if the entire canvas was drawn.
+    painter->drawTiledPixmap(zoomedVisibleSceneArea, mCanvas->mCheckerPixmap, zoomedVisibleSceneArea.topLeft());
 
     const QImage image = mCanvas->contentImage();
-    const QSize zoomedImageSize = mPane->zoomedSize(image.size());
-    painter->drawImage(QRectF(QPointF(0, 0), zoomedImageSize), image, QRectF(0, 0, image.width(), image.height()));
+    painter->drawImage(zoomedVisibleSceneArea, image, visibleSceneArea);
+}
+
+QSGNode *CanvasPaneItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data)
+{
+    CanvasPaneRootNode *rootNode = static_cast<CanvasPaneRootNode*>(oldNode);
+    if (!rootNode)
+        rootNode = new CanvasPaneRootNode;
+
+    const bool fullContentPaintRequested = mFullContentPaintRequested;
+    mFullContentPaintRequested = false;
+    const QRegion dirtySceneRegion = mDirtySceneRegion;
+    mDirtySceneRegion = QRegion();
+
+    rootNode->setPainterNodeVisible(mRenderer == PainterRenderer);
+    if (mRenderer == PainterRenderer) {
+        // We don't need the textures of the other renderer anymore.
+        rootNode->setSceneGraphNode(nullptr);
+        rootNode->setPainterNode(QQuickPaintedItem::updatePaintNode(rootNode->painterNode(), data));
+        return rootNode;
+    }
+
+    if (!mCanvas || !mPane || !mCanvas->project() || !mCanvas->project()->hasLoaded() || width() <= 0 || height() <= 0) {
+        rootNode->setSceneGraphNode(nullptr);
+        return rootNode;
+    }
+
+    const QImage image = mCanvas->contentImage();
+    CanvasPaneNode *node = rootNode->sceneGraphNode();
+    if (!node) {
+        node = new CanvasPaneNode(window());
+        rootNode->setSceneGraphNode(node);
+    } else if (image.cacheKey() != node->contentImageCacheKey()) {
+        // Full paints are also requested for e.g. panning, so only upload everything
+        // again if the content changed without us knowing which parts did.
+        if (fullContentPaintRequested || dirtySceneRegion.isEmpty())
+            node->invalidateTiles();
+        else
+            node->invalidateTiles(dirtySceneRegion);
+    }
+
+    const QRect visibleSceneArea = sceneAreaWithin(boundingRect().toAlignedRect());
+    const int uploadedTileCount = node->sync(image, mCanvas->mCheckerImage, visibleSceneArea,
+        mPane->integerZoomLevel(), mPane->integerOffset());
+    mUploadedTileCount.fetchAndAddRelaxed(uploadedTileCount);
+    qCDebug(lcCanvasPaneItem) << "synced scene graph node of" << objectName() << "- uploaded"
+        << uploadedTileCount << "tiles for visible scene area" << visibleSceneArea;
+    return rootNode;
+}
+
+// Returns the area of the canvas (in scene coordinates) that is covered by itemArea.
+QRect CanvasPaneItem::sceneAreaWithin(const QRect &itemArea) const
+{
+    const int integerZoomLevel = mPane->integerZoomLevel();
+    const QPoint integerOffset = mPane->integerOffset();
+    // Round outwards so that partially visible scene pixels are included.
+    const QPoint sceneTopLeft(
+        qFloor(qreal(itemArea.left() - integerOffset.x()) / integerZoomLevel),
+        qFloor(qreal(itemArea.top() - integerOffset.y()) / integerZoomLevel));
+    const QPoint sceneBottomRight(
+        qCeil(qreal(itemArea.left() + itemArea.width() - integerOffset.x()) / integerZoomLevel),
+        qCeil(qreal(itemArea.top() + itemArea.height() - integerOffset.y()) / integerZoomLevel));
+    // We use the unbounded canvas size here, otherwise the drawn area is too small past a certain zoom level.
+    const QRect canvasSceneArea(QPoint(0, 0), mCanvas->currentProjectImage()->size());
+    return QRect(sceneTopLeft, QSize(sceneBottomRight.x() - sceneTopLeft.x(), sceneBottomRight.y() - sceneTopLeft.y()))
+        .intersected(canvasSceneArea);
 }
@@ -20,10 +20,15 @@
 #ifndef CANVASPANEITEM_H
 #define CANVASPANEITEM_H
 
+#include <QAtomicInt>
+#include <QLoggingCategory>
 #include <QQuickPaintedItem>
+#include <QRegion>
 
 #include "slate-global.h"
 
+Q_DECLARE_LOGGING_CATEGORY(lcCanvasPaneItem)
+
 class CanvasPane;
 class Guide;
 class ImageCanvas;
@@ -35,11 +40,22 @@ class SLATE_EXPORT CanvasPaneItem : public QQuickPaintedItem
     Q_PROPERTY(ImageCanvas *canvas READ canvas WRITE setCanvas NOTIFY canvasChanged)
     Q_PROPERTY(CanvasPane *pane READ pane WRITE setPane NOTIFY paneChanged)
     Q_PROPERTY(int paneIndex READ paneIndex WRITE setPaneIndex NOTIFY paneIndexChanged)
+    Q_PROPERTY(Renderer renderer READ renderer WRITE setRenderer NOTIFY rendererChanged)
     QML_ELEMENT
     Q_MOC_INCLUDE("canvaspane.h")
     Q_MOC_INCLUDE("imagecanvas.h")
 
 public:
+    enum Renderer {
+        // Rasterises the visible area with QPainter (into a framebuffer object)
+        // whenever it changes. Subclasses that reimplement paint() need this.
+        PainterRenderer,
+        // Keeps the content as tiled textures (see CanvasPaneNode) that are
+        // only uploaded when they change, and lets the scene graph zoom them.
+        SceneGraphRenderer
+    };
+    Q_ENUM(Renderer)
+
     explicit CanvasPaneItem(QQuickItem *parent = nullptr);
     ~CanvasPaneItem() override;
 
@@ -54,26 +70,49 @@ public:
     int paneIndex() const;
     void setPaneIndex(int paneIndex);
 
+    Renderer renderer() const;
+    void setRenderer(Renderer renderer);
+
     Q_INVOKABLE bool isRectVisible(const QRect &sceneRect) const;
 
+    // The number of times that the entire item (as opposed to only
+    // the areas that were modified) has been painted.
+    int fullPaintCount() const;
+    // The number of content tiles that SceneGraphRenderer has uploaded as textures.
+    int uploadedTileCount() const;
+
 signals:
     void canvasChanged();
     void paneChanged();
     void paneIndexChanged();
+    void rendererChanged();
 
 protected:
+    QRect sceneAreaWithin(const QRect &itemArea) const;
+
     void itemChange(QQuickItem::ItemChange change, const QQuickItem::ItemChangeData &value) override;
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data) override;
 
     void connectToCanvas();
     void disconnectFromCanvas();
 
 protected slots:
     void onContentPaintRequested(int paneIndex);
+    void onContentAreaPaintRequested(const QRect &sceneArea);
 
 protected:
     ImageCanvas *mCanvas = nullptr;
     CanvasPane *mPane = nullptr;
     int mPaneIndex = -1;
+    int mFullPaintCount = 0;
+    Renderer mRenderer = PainterRenderer;
+    // The areas of the content that SceneGraphRenderer needs to upload again.
+    QRegion mDirtySceneRegion;
+    // Set when a paint of the entire content was requested, which could mean
+    // that all of it changed (or e.g. that the pane was panned).
+    bool mFullContentPaintRequested = false;
+    // Written on the render thread and read on the GUI thread.
+    QAtomicInt mUploadedTileCount = 0;
 };
 
 #endif
@@ -0,0 +1,162 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "canvaspanenode.h"
+
+#include <QPainter>
+#include <QQuickWindow>
+#include <QSGImageNode>
+#include <QSGTexture>
+
+CanvasPaneNode::CanvasPaneNode(QQuickWindow *window) :
+    mWindow(window),
+    mCheckerNode(nullptr),
+    mCheckerTexture(nullptr),
+    mCheckerImageCacheKey(0),
+    mContentImageCacheKey(0),
+    mTilesWide(0)
+{
+}
+
+CanvasPaneNode::~CanvasPaneNode()
+{
+    // The image nodes don't own their textures, and are deleted by QSGNode.
+    qDeleteAll(mTileTextures);
+    delete mCheckerTexture;
+}
+
+qint64 CanvasPaneNode::contentImageCacheKey() const
+{
+    return mContentImageCacheKey;
+}
+
+void CanvasPaneNode::invalidateTiles()
+{
+    qDeleteAll(mTileTextures);
+    mTileTextures.clear();
+}
+
+void CanvasPaneNode::invalidateTiles(const QRegion &sceneRegion)
+{
+    const QRect contentBounds(QPoint(0, 0), mContentImageSize);
+    for (const QRect &sceneRect : sceneRegion) {
+        const QRect area = sceneRect.intersected(contentBounds);
+        if (area.isEmpty())
+            continue;
+
+        for (int tileY = area.top() / tileSize; tileY <= area.bottom() / tileSize; ++tileY) {
+            for (int tileX = area.left() / tileSize; tileX <= area.right() / tileSize; ++tileX)
+                delete mTileTextures.take(tileY * mTilesWide + tileX);
+        }
+    }
+}
+
+int CanvasPaneNode::sync(const QImage &contentImage, const QImage &checkerImage,
+    const QRect &visibleSceneArea, int zoomLevel, const QPoint &offset)
+{
+    if (contentImage.size() != mContentImageSize) {
+        invalidateTiles();
+        mContentImageSize = contentImage.size();
+        mTilesWide = (mContentImageSize.width() + tileSize - 1) / tileSize;
+    }
+    mContentImageCacheKey = contentImage.cacheKey();
+
+    // The visible tiles can change with every pan or zoom, and nodes are cheap
+    // compared to textures, so just recreate them.
+    for (QSGImageNode *tileNode : std::as_const(mTileNodes)) {
+        removeChildNode(tileNode);
+        delete tileNode;
+    }
+    mTileNodes.clear();
+
+    const QRect zoomedVisibleSceneArea(visibleSceneArea.topLeft() * zoomLevel, visibleSceneArea.size() * zoomLevel);
+    syncChecker(checkerImage, zoomedVisibleSceneArea.translated(offset), zoomedVisibleSceneArea.topLeft());
+
+    const QRect visibleContentArea = visibleSceneArea.intersected(QRect(QPoint(0, 0), mContentImageSize));
+    if (visibleContentArea.isEmpty())
+        return 0;
+
+    int uploadedTileCount = 0;
+    for (int tileY = visibleContentArea.top() / tileSize; tileY <= visibleContentArea.bottom() / tileSize; ++tileY) {
+        for (int tileX = visibleContentArea.left() / tileSize; tileX <= visibleContentArea.right() / tileSize; ++tileX) {
+            const QRect rect = tileRect(tileX, tileY);
+            QSGTexture *&texture = mTileTextures[tileY * mTilesWide + tileX];
+            if (!texture) {
+                texture = mWindow->createTextureFromImage(contentImage.copy(rect));
+                ++uploadedTileCount;
+            }
+
+            const QRect visibleTileArea = rect.intersected(visibleContentArea);
+            QSGImageNode *tileNode = mWindow->createImageNode();
+            tileNode->setTexture(texture);
+            tileNode->setOwnsTexture(false);
+            tileNode->setFiltering(QSGTexture::Nearest);
+            tileNode->setSourceRect(QRectF(visibleTileArea.translated(-rect.topLeft())));
+            tileNode->setRect(QRectF(visibleTileArea.topLeft() * zoomLevel + offset, visibleTileArea.size() * zoomLevel));
+            appendChildNode(tileNode);
+            mTileNodes.append(tileNode);
+        }
+    }
+    return uploadedTileCount;
+}
+
+void CanvasPaneNode::syncChecker(const QImage &checkerImage, const QRect &itemArea, const QPoint &canvasPos)
+{
+    if (checkerImage.isNull())
+        return;
+
+    // The texture is larger than the area it covers by the size of the checker image,
+    // so that we can offset into it to keep the checkers aligned with the canvas when panning.
+    const QSize checkerSize = checkerImage.size();
+    const QSize requiredSize = itemArea.size() + checkerSize;
+    if (!mCheckerTexture || checkerImage.cacheKey() != mCheckerImageCacheKey
+            || requiredSize.width() > mCheckerTexture->textureSize().width()
+            || requiredSize.height() > mCheckerTexture->textureSize().height()) {
+        QImage image(requiredSize.expandedTo(mCheckerTexture ? mCheckerTexture->textureSize() : QSize()),
+            QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+        QPainter painter(&image);
+        // Brush patterns start at the painter's origin, so this tiles it from the top-left.
+        painter.fillRect(image.rect(), QBrush(checkerImage));
+        painter.end();
+
+        delete mCheckerTexture;
+        mCheckerTexture = mWindow->createTextureFromImage(image);
+        mCheckerImageCacheKey = checkerImage.cacheKey();
+
+        if (!mCheckerNode) {
+            mCheckerNode = mWindow->createImageNode();
+            mCheckerNode->setOwnsTexture(false);
+            mCheckerNode->setFiltering(QSGTexture::Nearest);
+            // Go underneath the content.
+            prependChildNode(mCheckerNode);
+        }
+        mCheckerNode->setTexture(mCheckerTexture);
+    }
+
+    const QPoint checkerOffset(canvasPos.x() % checkerSize.width(), canvasPos.y() % checkerSize.height());
+    mCheckerNode->setSourceRect(QRectF(checkerOffset, itemArea.size()));
+    mCheckerNode->setRect(QRectF(itemArea));
+}
+
+QRect CanvasPaneNode::tileRect(int tileX, int tileY) const
+{
+    return QRect(tileX * tileSize, tileY * tileSize, tileSize, tileSize)
+        .intersected(QRect(QPoint(0, 0), mContentImageSize));
+}
@@ -0,0 +1,77 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CANVASPANENODE_H
+#define CANVASPANENODE_H
+
+#include <QHash>
+#include <QImage>
+#include <QRegion>
+#include <QSGNode>
+#include <QVector>
+
+class QQuickWindow;
+class QSGImageNode;
+class QSGTexture;
+
+/*
+    The scene graph node used by CanvasPaneItem's SceneGraphRenderer.
+
+    The content image is kept as a grid of textures, each drawn by its own image node.
+    Tiles are only uploaded again when they've been invalidated, and zooming is done
+    by the scene graph (with nearest filtering), so panning, zooming and drawing small
+    areas don't require the content to be rasterised again.
+
+    Lives on the render thread; CanvasPaneItem calls sync() from updatePaintNode().
+*/
+class CanvasPaneNode : public QSGNode
+{
+public:
+    // Larger than ApplyPixelLineCommand::tileSize, as each tile is a separate node (and draw call).
+    static constexpr int tileSize = 256;
+
+    explicit CanvasPaneNode(QQuickWindow *window);
+    ~CanvasPaneNode() override;
+
+    qint64 contentImageCacheKey() const;
+
+    void invalidateTiles();
+    void invalidateTiles(const QRegion &sceneRegion);
+
+    // Updates the nodes so that the visible area of contentImage is drawn at zoomLevel
+    // over the checkered transparency indicator. Returns the amount of tiles that were uploaded.
+    int sync(const QImage &contentImage, const QImage &checkerImage, const QRect &visibleSceneArea,
+        int zoomLevel, const QPoint &offset);
+
+private:
+    void syncChecker(const QImage &checkerImage, const QRect &itemArea, const QPoint &canvasPos);
+    QRect tileRect(int tileX, int tileY) const;
+
+    QQuickWindow *mWindow;
+    QSGImageNode *mCheckerNode;
+    QSGTexture *mCheckerTexture;
+    qint64 mCheckerImageCacheKey;
+    QSize mContentImageSize;
+    qint64 mContentImageCacheKey;
+    int mTilesWide;
+    QHash<int, QSGTexture*> mTileTextures;
+    QVector<QSGImageNode*> mTileNodes;
+};
+
+#endif // CANVASPANENODE_H
@@ -29,8 +29,8 @@ ChangeImageCanvasSizeCommand::ChangeImageCanvasSizeCommand(ImageProject *project
     const QImage &newImage, UndoCommand *parent) :
     UndoCommand(parent),
     mProject(project),
-    mPreviousImage(previousImage),
-    mNewImage(newImage)
+    mPreviousImage(previousImage, lcChangeImageCanvasSizeCommand),
+    mNewImage(newImage, lcChangeImageCanvasSizeCommand)
 {
     qCDebug(lcChangeImageCanvasSizeCommand) << "constructed" << this;
 }
@@ -38,13 +38,23 @@ ChangeImageCanvasSizeCommand::ChangeImageCanvasSizeCommand(ImageProject *project
 void ChangeImageCanvasSizeCommand::undo()
 {
     qCDebug(lcChangeImageCanvasSizeCommand) << "undoing" << this;
-    mProject->setImage(mPreviousImage);
+    bool restored = false;
+    const QImage previousImage = mPreviousImage.image(&restored);
+    if (!restored)
+        return;
+
+    mProject->setImage(previousImage);
 }
 
 void ChangeImageCanvasSizeCommand::redo()
 {
     qCDebug(lcChangeImageCanvasSizeCommand) << "redoing" << this;
-    mProject->setImage(mNewImage);
+    bool restored = false;
+    const QImage newImage = mNewImage.image(&restored);
+    if (!restored)
+        return;
+
+    mProject->setImage(newImage);
 }
 
 int ChangeImageCanvasSizeCommand::id() const
@@ -57,6 +67,29 @@ bool ChangeImageCanvasSizeCommand::modifiesContents() const
     return true;
 }
 
+qint64 ChangeImageCanvasSizeCommand::payloadByteCount() const
+{
+    return mPreviousImage.byteCount() + mNewImage.unsharedByteCount();
+}
+
+void ChangeImageCanvasSizeCommand::compressPayload()
+{
+    mPreviousImage.compress();
+    mNewImage.compress();
+}
+
+void ChangeImageCanvasSizeCommand::spillPayload(const QSharedPointer<UndoSpillFile> &spillFile)
+{
+    mPreviousImage.spill(spillFile);
+    mNewImage.spill(spillFile);
+}
+
+void ChangeImageCanvasSizeCommand::releasePayload()
+{
+    mPreviousImage.clear();
+    mNewImage.clear();
+}
+
 QDebug operator<<(QDebug debug, const ChangeImageCanvasSizeCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -29,8 +29,8 @@ ChangeImageSizeCommand::ChangeImageSizeCommand(ImageProject *project, const QIma
     const QImage &newImage, UndoCommand *parent) :
     UndoCommand(parent),
     mProject(project),
-    mPreviousImage(previousImage),
-    mNewImage(newImage)
+    mPreviousImage(previousImage, lcChangeImageSizeCommand),
+    mNewImage(newImage, lcChangeImageSizeCommand)
 {
     qCDebug(lcChangeImageSizeCommand) << "constructed" << this;
 }
@@ -38,13 +38,23 @@ ChangeImageSizeCommand::ChangeImageSizeCommand(ImageProject *project, const QIma
 void ChangeImageSizeCommand::undo()
 {
     qCDebug(lcChangeImageSizeCommand) << "undoing" << this;
-    mProject->setImage(mPreviousImage);
+    bool restored = false;
+    const QImage previousImage = mPreviousImage.image(&restored);
+    if (!restored)
+        return;
+
+    mProject->setImage(previousImage);
 }
 
 void ChangeImageSizeCommand::redo()
 {
     qCDebug(lcChangeImageSizeCommand) << "redoing" << this;
-    mProject->setImage(mNewImage);
+    bool restored = false;
+    const QImage newImage = mNewImage.image(&restored);
+    if (!restored)
+        return;
+
+    mProject->setImage(newImage);
 }
 
 int ChangeImageSizeCommand::id() const
@@ -57,6 +67,29 @@ bool ChangeImageSizeCommand::modifiesContents() const
     return true;
 }
 
+qint64 ChangeImageSizeCommand::payloadByteCount() const
+{
+    return mPreviousImage.byteCount() + mNewImage.unsharedByteCount();
+}
+
+void ChangeImageSizeCommand::compressPayload()
+{
+    mPreviousImage.compress();
+    mNewImage.compress();
+}
+
+void ChangeImageSizeCommand::spillPayload(const QSharedPointer<UndoSpillFile> &spillFile)
+{
+    mPreviousImage.spill(spillFile);
+    mNewImage.spill(spillFile);
+}
+
+void ChangeImageSizeCommand::releasePayload()
+{
+    mPreviousImage.clear();
+    mNewImage.clear();
+}
+
 QDebug operator<<(QDebug debug, const ChangeImageSizeCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -0,0 +1,73 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "changelayerblendmodecommand.h"
+
+#include <QLoggingCategory>
+
+#include "imagelayer.h"
+#include "layeredimageproject.h"
+
+Q_LOGGING_CATEGORY(lcChangeLayerBlendModeCommand, "app.undo.changeLayerBlendModeCommand")
+
+ChangeLayerBlendModeCommand::ChangeLayerBlendModeCommand(LayeredImageProject *project, int layerIndex, ImageLayer::BlendMode previousBlendMode,
+    ImageLayer::BlendMode newBlendMode, UndoCommand *parent) :
+    UndoCommand(parent),
+    mProject(project),
+    mLayerIndex(layerIndex),
+    mPreviousBlendMode(previousBlendMode),
+    mNewBlendMode(newBlendMode)
+{
+    qCDebug(lcChangeLayerBlendModeCommand) << "constructed" << this;
+}
+
+void ChangeLayerBlendModeCommand::undo()
+{
+    qCDebug(lcChangeLayerBlendModeCommand) << "undoing" << this;
+    mProject->layerAt(mLayerIndex)->setBlendMode(mPreviousBlendMode);
+}
+
+void ChangeLayerBlendModeCommand::redo()
+{
+    qCDebug(lcChangeLayerBlendModeCommand) << "redoing" << this;
+    mProject->layerAt(mLayerIndex)->setBlendMode(mNewBlendMode);
+}
+
+int ChangeLayerBlendModeCommand::id() const
+{
+    return -1;
+}
+
+bool ChangeLayerBlendModeCommand::modifiesContents() const
+{
+    return true;
+}
+
+QDebug operator<<(QDebug debug, const ChangeLayerBlendModeCommand *command)
+{
+    QDebugStateSaver saver(debug);
+    if (!command)
+        return debug << "ChangeLayerBlendModeCommand(0x0)";
+
+    debug.nospace() << "(ChangeLayerBlendModeCommand layerIndex=" << command->mLayerIndex
+        << " previousBlendMode=" << command->mPreviousBlendMode
+        << " newBlendMode=" << command->mNewBlendMode
+        << ")";
+    return debug;
+}
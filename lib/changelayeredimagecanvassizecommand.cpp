@@ -29,8 +29,8 @@ ChangeLayeredImageCanvasSizeCommand::ChangeLayeredImageCanvasSizeCommand(Layered
     const QVector<QImage> &previousImages, const QVector<QImage> &newImages, UndoCommand *parent) :
     UndoCommand(parent),
     mProject(project),
-    mPreviousImages(previousImages),
-    mNewImages(newImages)
+    mPreviousImages(UndoImage::fromImages(previousImages, lcChangeLayeredImageCanvasSizeCommand)),
+    mNewImages(UndoImage::fromImages(newImages, lcChangeLayeredImageCanvasSizeCommand))
 {
     qCDebug(lcChangeLayeredImageCanvasSizeCommand) << "constructed" << this;
 }
@@ -38,13 +38,23 @@ ChangeLayeredImageCanvasSizeCommand::ChangeLayeredImageCanvasSizeCommand(Layered
 void ChangeLayeredImageCanvasSizeCommand::undo()
 {
     qCDebug(lcChangeLayeredImageCanvasSizeCommand) << "undoing" << this;
-    mProject->doSetCanvasSize(mPreviousImages);
+    bool restored = false;
+    const QVector<QImage> previousImages = UndoImage::toImages(mPreviousImages, &restored);
+    if (!restored)
+        return;
+
+    mProject->doSetCanvasSize(previousImages);
 }
 
 void ChangeLayeredImageCanvasSizeCommand::redo()
 {
     qCDebug(lcChangeLayeredImageCanvasSizeCommand) << "redoing" << this;
-    mProject->doSetCanvasSize(mNewImages);
+    bool restored = false;
+    const QVector<QImage> newImages = UndoImage::toImages(mNewImages, &restored);
+    if (!restored)
+        return;
+
+    mProject->doSetCanvasSize(newImages);
 }
 
 int ChangeLayeredImageCanvasSizeCommand::id() const
@@ -57,6 +67,38 @@ bool ChangeLayeredImageCanvasSizeCommand::modifiesContents() const
     return true;
 }
 
+qint64 ChangeLayeredImageCanvasSizeCommand::payloadByteCount() const
+{
+    qint64 byteCount = 0;
+    for (const UndoImage &image : mPreviousImages)
+        byteCount += image.byteCount();
+    for (const UndoImage &image : mNewImages)
+        byteCount += image.unsharedByteCount();
+    return byteCount;
+}
+
+void ChangeLayeredImageCanvasSizeCommand::compressPayload()
+{
+    for (UndoImage &image : mPreviousImages)
+        image.compress();
+    for (UndoImage &image : mNewImages)
+        image.compress();
+}
+
+void ChangeLayeredImageCanvasSizeCommand::spillPayload(const QSharedPointer<UndoSpillFile> &spillFile)
+{
+    for (UndoImage &image : mPreviousImages)
+        image.spill(spillFile);
+    for (UndoImage &image : mNewImages)
+        image.spill(spillFile);
+}
+
+void ChangeLayeredImageCanvasSizeCommand::releasePayload()
+{
+    mPreviousImages.clear();
+    mNewImages.clear();
+}
+
 QDebug operator<<(QDebug debug, const ChangeLayeredImageCanvasSizeCommand *)
 {
     debug.nospace() << "(ChangeLayeredImageCanvasSizeCommand)";
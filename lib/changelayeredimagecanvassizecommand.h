@@ -26,6 +26,7 @@
 
 #include "slate-global.h"
 #include "undocommand.h"
+#include "undoimage.h"
 
 class LayeredImageProject;
 
@@ -41,13 +42,17 @@ public:
     int id() const override;
 
     bool modifiesContents() const override;
+    qint64 payloadByteCount() const override;
+    void compressPayload() override;
+    void spillPayload(const QSharedPointer<UndoSpillFile> &spillFile) override;
+    void releasePayload() override;
 
 private:
     friend QDebug operator<<(QDebug debug, const ChangeLayeredImageCanvasSizeCommand *command);
 
     LayeredImageProject *mProject;
-    QVector<QImage> mPreviousImages;
-    QVector<QImage> mNewImages;
+    QVector<UndoImage> mPreviousImages;
+    QVector<UndoImage> mNewImages;
 };
 
 #endif // CHANGELAYEREDIMAGECANVASSIZECOMMAND_H
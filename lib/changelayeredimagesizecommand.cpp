@@ -29,8 +29,8 @@ ChangeLayeredImageSizeCommand::ChangeLayeredImageSizeCommand(LayeredImageProject
     const QVector<QImage> &previousImages, const QVector<QImage> &newImages, UndoCommand *parent) :
     UndoCommand(parent),
     mProject(project),
-    mPreviousImages(previousImages),
-    mNewImages(newImages)
+    mPreviousImages(UndoImage::fromImages(previousImages, lcChangeLayeredImageSizeCommand)),
+    mNewImages(UndoImage::fromImages(newImages, lcChangeLayeredImageSizeCommand))
 {
     qCDebug(lcChangeLayeredImageSizeCommand) << "constructed" << this;
 }
@@ -38,13 +38,23 @@ ChangeLayeredImageSizeCommand::ChangeLayeredImageSizeCommand(LayeredImageProject
 void ChangeLayeredImageSizeCommand::undo()
 {
     qCDebug(lcChangeLayeredImageSizeCommand) << "undoing" << this;
-    mProject->doSetImageSize(mPreviousImages);
+    bool restored = false;
+    const QVector<QImage> previousImages = UndoImage::toImages(mPreviousImages, &restored);
+    if (!restored)
+        return;
+
+    mProject->doSetImageSize(previousImages);
 }
 
 void ChangeLayeredImageSizeCommand::redo()
 {
     qCDebug(lcChangeLayeredImageSizeCommand) << "redoing" << this;
-    mProject->doSetImageSize(mNewImages);
+    bool restored = false;
+    const QVector<QImage> newImages = UndoImage::toImages(mNewImages, &restored);
+    if (!restored)
+        return;
+
+    mProject->doSetImageSize(newImages);
 }
 
 int ChangeLayeredImageSizeCommand::id() const
@@ -57,6 +67,38 @@ bool ChangeLayeredImageSizeCommand::modifiesContents() const
     return true;
 }
 
+qint64 ChangeLayeredImageSizeCommand::payloadByteCount() const
+{
+    qint64 byteCount = 0;
+    for (const UndoImage &image : mPreviousImages)
+        byteCount += image.byteCount();
+    for (const UndoImage &image : mNewImages)
+        byteCount += image.unsharedByteCount();
+    return byteCount;
+}
+
+void ChangeLayeredImageSizeCommand::compressPayload()
+{
+    for (UndoImage &image : mPreviousImages)
+        image.compress();
+    for (UndoImage &image : mNewImages)
+        image.compress();
+}
+
+void ChangeLayeredImageSizeCommand::spillPayload(const QSharedPointer<UndoSpillFile> &spillFile)
+{
+    for (UndoImage &image : mPreviousImages)
+        image.spill(spillFile);
+    for (UndoImage &image : mNewImages)
+        image.spill(spillFile);
+}
+
+void ChangeLayeredImageSizeCommand::releasePayload()
+{
+    mPreviousImages.clear();
+    mNewImages.clear();
+}
+
 QDebug operator<<(QDebug debug, const ChangeLayeredImageSizeCommand *)
 {
     debug.nospace() << "(ChangeLayeredImageSizeCommand)";
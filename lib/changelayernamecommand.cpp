@@ -54,6 +54,11 @@ int ChangeLayerNameCommand::id() const
     return -1;
 }
 
+qint64 ChangeLayerNameCommand::payloadByteCount() const
+{
+    return (mPreviousName.size() + mNewName.size()) * qint64(sizeof(QChar));
+}
+
 QDebug operator<<(QDebug debug, const ChangeLayerNameCommand *command)
 {
     QDebugStateSaver saver(debug);
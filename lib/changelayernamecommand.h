@@ -37,6 +37,7 @@ public:
     void redo() override;
 
     int id() const override;
+    qint64 payloadByteCount() const override;
 
 private:
     friend QDebug operator<<(QDebug debug, const ChangeLayerNameCommand *command);
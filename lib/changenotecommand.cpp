@@ -52,6 +52,11 @@ int ChangeNoteCommand::id() const
     return -1;
 }
 
+qint64 ChangeNoteCommand::payloadByteCount() const
+{
+    return (mOldNote.text().size() + mNewNote.text().size()) * qint64(sizeof(QChar));
+}
+
 QDebug operator<<(QDebug debug, const ChangeNoteCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -54,6 +54,11 @@ int ChangeTileCanvasSizeCommand::id() const
     return -1;
 }
 
+qint64 ChangeTileCanvasSizeCommand::payloadByteCount() const
+{
+    return mPreviousTiles.size() * qint64(sizeof(int));
+}
+
 QDebug operator<<(QDebug debug, const ChangeTileCanvasSizeCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -0,0 +1,377 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "compositing.h"
+
+#include <QtMath>
+
+// SSE2 is part of the x86-64 baseline, so there's no need for runtime detection.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SLATE_COMPOSITING_SSE2
+#include <emmintrin.h>
+#endif
+
+// Multiplies each channel of pixel by alpha / 255, rounding the same way that QPainter does.
+static inline quint32 byteMul(quint32 pixel, quint32 alpha)
+{
+    quint32 redBlue = (pixel & 0xff00ff) * alpha;
+    redBlue = (redBlue + ((redBlue >> 8) & 0xff00ff) + 0x800080) >> 8;
+    redBlue &= 0xff00ff;
+
+    quint32 alphaGreen = ((pixel >> 8) & 0xff00ff) * alpha;
+    alphaGreen = alphaGreen + ((alphaGreen >> 8) & 0xff00ff) + 0x800080;
+    alphaGreen &= 0xff00ff00;
+
+    return alphaGreen | redBlue;
+}
+
+static void sourceOverScalar(quint32 *destination, const quint32 *source, int count, quint32 constAlpha)
+{
+    for (int i = 0; i < count; ++i) {
+        quint32 sourcePixel = source[i];
+        if (constAlpha != 255)
+            sourcePixel = byteMul(sourcePixel, constAlpha);
+
+        const quint32 sourceAlpha = sourcePixel >> 24;
+        if (sourceAlpha == 255)
+            destination[i] = sourcePixel;
+        else if (sourceAlpha != 0)
+            destination[i] = sourcePixel + byteMul(destination[i], 255 - sourceAlpha);
+    }
+}
+
+// The equivalent of qt_div_255(): x / 255, rounded, for x up to 255 * 255.
+static inline int div255(int x)
+{
+    return (x + (x >> 8) + 0x80) >> 8;
+}
+
+// The alpha of the result of every separable blend mode other than add.
+static inline int mixAlpha(int destinationAlpha, int sourceAlpha)
+{
+    return 255 - div255((255 - sourceAlpha) * (255 - destinationAlpha));
+}
+
+static inline int multiply(int destination, int source, int destinationAlpha, int sourceAlpha)
+{
+    return div255(source * destination + source * (255 - destinationAlpha) + destination * (255 - sourceAlpha));
+}
+
+static inline int screen(int destination, int source, int, int)
+{
+    return 255 - div255((255 - source) * (255 - destination));
+}
+
+static inline int overlay(int destination, int source, int destinationAlpha, int sourceAlpha)
+{
+    const int uncovered = source * (255 - destinationAlpha) + destination * (255 - sourceAlpha);
+    if (2 * destination < destinationAlpha)
+        return div255(2 * source * destination + uncovered);
+    return div255(sourceAlpha * destinationAlpha - 2 * (destinationAlpha - destination) * (sourceAlpha - source) + uncovered);
+}
+
+template <int (*channelOp)(int, int, int, int)>
+static void separableBlendScalar(quint32 *destination, const quint32 *source, int count, quint32 constAlpha)
+{
+    for (int i = 0; i < count; ++i) {
+        quint32 sourcePixel = source[i];
+        if (constAlpha != 255)
+            sourcePixel = byteMul(sourcePixel, constAlpha);
+
+        const int sourceAlpha = qAlpha(sourcePixel);
+        // Every mode leaves the destination as it is where the source is transparent.
+        if (sourceAlpha == 0)
+            continue;
+
+        const quint32 destinationPixel = destination[i];
+        const int destinationAlpha = qAlpha(destinationPixel);
+        destination[i] = qRgba(
+            channelOp(qRed(destinationPixel), qRed(sourcePixel), destinationAlpha, sourceAlpha),
+            channelOp(qGreen(destinationPixel), qGreen(sourcePixel), destinationAlpha, sourceAlpha),
+            channelOp(qBlue(destinationPixel), qBlue(sourcePixel), destinationAlpha, sourceAlpha),
+            mixAlpha(destinationAlpha, sourceAlpha));
+    }
+}
+
+static void addScalar(quint32 *destination, const quint32 *source, int count, quint32 constAlpha)
+{
+    for (int i = 0; i < count; ++i) {
+        quint32 sourcePixel = source[i];
+        if (constAlpha != 255)
+            sourcePixel = byteMul(sourcePixel, constAlpha);
+
+        const quint32 destinationPixel = destination[i];
+        destination[i] = qRgba(
+            qMin(qRed(destinationPixel) + qRed(sourcePixel), 255),
+            qMin(qGreen(destinationPixel) + qGreen(sourcePixel), 255),
+            qMin(qBlue(destinationPixel) + qBlue(sourcePixel), 255),
+            qMin(qAlpha(destinationPixel) + qAlpha(sourcePixel), 255));
+    }
+}
+
+#ifdef SLATE_COMPOSITING_SSE2
+// The SSE2 equivalent of byteMul(), for four pixels; alpha must hold a 16-bit multiplier for each channel.
+static inline __m128i byteMulSse2(__m128i pixels, __m128i alpha)
+{
+    const __m128i redBlueMask = _mm_set1_epi32(0x00ff00ff);
+    const __m128i half = _mm_set1_epi16(0x0080);
+
+    __m128i alphaGreen = _mm_srli_epi16(pixels, 8);
+    __m128i redBlue = _mm_and_si128(pixels, redBlueMask);
+    alphaGreen = _mm_mullo_epi16(alphaGreen, alpha);
+    redBlue = _mm_mullo_epi16(redBlue, alpha);
+
+    alphaGreen = _mm_add_epi16(alphaGreen, _mm_srli_epi16(alphaGreen, 8));
+    alphaGreen = _mm_add_epi16(alphaGreen, half);
+    alphaGreen = _mm_andnot_si128(redBlueMask, alphaGreen);
+
+    redBlue = _mm_add_epi16(redBlue, _mm_srli_epi16(redBlue, 8));
+    redBlue = _mm_add_epi16(redBlue, half);
+    redBlue = _mm_srli_epi16(redBlue, 8);
+
+    return _mm_or_si128(alphaGreen, redBlue);
+}
+
+static void sourceOverSse2(quint32 *destination, const quint32 *source, int count, quint32 constAlpha)
+{
+    const __m128i alphaMask = _mm_set1_epi32(0xff000000);
+    const __m128i constAlphaVector = _mm_set1_epi16(qint16(constAlpha));
+    const __m128i max = _mm_set1_epi16(255);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i sourcePixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+        if (constAlpha != 255)
+            sourcePixels = byteMulSse2(sourcePixels, constAlphaVector);
+
+        const __m128i sourceAlpha = _mm_and_si128(sourcePixels, alphaMask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(sourceAlpha, _mm_setzero_si128())) == 0xffff)
+            continue;
+
+        __m128i *destinationPixels = reinterpret_cast<__m128i*>(destination + i);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(sourceAlpha, alphaMask)) == 0xffff) {
+            _mm_storeu_si128(destinationPixels, sourcePixels);
+            continue;
+        }
+
+        // Put 255 - alpha into both 16-bit halves of each pixel.
+        __m128i inverseAlpha = _mm_srli_epi32(sourcePixels, 24);
+        inverseAlpha = _mm_or_si128(inverseAlpha, _mm_slli_epi32(inverseAlpha, 16));
+        inverseAlpha = _mm_sub_epi16(max, inverseAlpha);
+
+        const __m128i blended = byteMulSse2(_mm_loadu_si128(destinationPixels), inverseAlpha);
+        _mm_storeu_si128(destinationPixels, _mm_add_epi8(sourcePixels, blended));
+    }
+
+    sourceOverScalar(destination + i, source + i, count - i, constAlpha);
+}
+
+/*
+    The separable blend modes are done in 16 bits per channel, two pixels per register.
+    The 16-bit multiplications and additions wrap around, but as every result (before dividing
+    by 255) is within 0 and 255 * 255 for premultiplied pixels, the wrapped intermediate
+    values still produce the same results as the scalar code.
+*/
+static inline __m128i div255Sse2(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_srli_epi16(x, 8));
+    x = _mm_add_epi16(x, _mm_set1_epi16(0x0080));
+    return _mm_srli_epi16(x, 8);
+}
+
+static inline __m128i multiplySse2(__m128i destination, __m128i source, __m128i destinationAlpha, __m128i sourceAlpha)
+{
+    const __m128i max = _mm_set1_epi16(255);
+    __m128i result = _mm_mullo_epi16(source, destination);
+    result = _mm_add_epi16(result, _mm_mullo_epi16(source, _mm_sub_epi16(max, destinationAlpha)));
+    result = _mm_add_epi16(result, _mm_mullo_epi16(destination, _mm_sub_epi16(max, sourceAlpha)));
+    return div255Sse2(result);
+}
+
+static inline __m128i screenSse2(__m128i destination, __m128i source, __m128i, __m128i)
+{
+    const __m128i max = _mm_set1_epi16(255);
+    const __m128i product = _mm_mullo_epi16(_mm_sub_epi16(max, source), _mm_sub_epi16(max, destination));
+    return _mm_sub_epi16(max, div255Sse2(product));
+}
+
+static inline __m128i overlaySse2(__m128i destination, __m128i source, __m128i destinationAlpha, __m128i sourceAlpha)
+{
+    const __m128i max = _mm_set1_epi16(255);
+    const __m128i uncovered = _mm_add_epi16(
+        _mm_mullo_epi16(source, _mm_sub_epi16(max, destinationAlpha)),
+        _mm_mullo_epi16(destination, _mm_sub_epi16(max, sourceAlpha)));
+
+    const __m128i dark = _mm_slli_epi16(_mm_mullo_epi16(source, destination), 1);
+    const __m128i light = _mm_sub_epi16(_mm_mullo_epi16(sourceAlpha, destinationAlpha),
+        _mm_slli_epi16(_mm_mullo_epi16(_mm_sub_epi16(destinationAlpha, destination), _mm_sub_epi16(sourceAlpha, source)), 1));
+    const __m128i useDark = _mm_cmplt_epi16(_mm_slli_epi16(destination, 1), destinationAlpha);
+    const __m128i result = _mm_or_si128(_mm_and_si128(useDark, dark), _mm_andnot_si128(useDark, light));
+    return div255Sse2(_mm_add_epi16(result, uncovered));
+}
+
+// Copies the alpha of each of the two pixels into all of its channels.
+static inline __m128i broadcastAlphaSse2(__m128i pixels)
+{
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+template <__m128i (*channelOp)(__m128i, __m128i, __m128i, __m128i)>
+static inline __m128i separableBlendPairSse2(__m128i destination, __m128i source)
+{
+    const __m128i max = _mm_set1_epi16(255);
+    const __m128i alphaChannels = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+    const __m128i destinationAlpha = broadcastAlphaSse2(destination);
+    const __m128i sourceAlpha = broadcastAlphaSse2(source);
+    const __m128i colour = channelOp(destination, source, destinationAlpha, sourceAlpha);
+    const __m128i alpha = _mm_sub_epi16(max, div255Sse2(
+        _mm_mullo_epi16(_mm_sub_epi16(max, sourceAlpha), _mm_sub_epi16(max, destinationAlpha))));
+    return _mm_or_si128(_mm_and_si128(alphaChannels, alpha), _mm_andnot_si128(alphaChannels, colour));
+}
+
+template <__m128i (*channelOp)(__m128i, __m128i, __m128i, __m128i), int (*scalarChannelOp)(int, int, int, int)>
+static void separableBlendSse2(quint32 *destination, const quint32 *source, int count, quint32 constAlpha)
+{
+    const __m128i constAlphaVector = _mm_set1_epi16(qint16(constAlpha));
+    const __m128i zero = _mm_setzero_si128();
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i sourcePixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+        if (constAlpha != 255)
+            sourcePixels = byteMulSse2(sourcePixels, constAlphaVector);
+
+        const __m128i sourceAlpha = _mm_and_si128(sourcePixels, _mm_set1_epi32(0xff000000));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(sourceAlpha, zero)) == 0xffff)
+            continue;
+
+        __m128i *destinationPixels = reinterpret_cast<__m128i*>(destination + i);
+        const __m128i destinationPixelsValue = _mm_loadu_si128(destinationPixels);
+        const __m128i low = separableBlendPairSse2<channelOp>(
+            _mm_unpacklo_epi8(destinationPixelsValue, zero), _mm_unpacklo_epi8(sourcePixels, zero));
+        const __m128i high = separableBlendPairSse2<channelOp>(
+            _mm_unpackhi_epi8(destinationPixelsValue, zero), _mm_unpackhi_epi8(sourcePixels, zero));
+        // Pixels with a transparent source blend to themselves, so there's no need to special-case them.
+        _mm_storeu_si128(destinationPixels, _mm_packus_epi16(low, high));
+    }
+
+    separableBlendScalar<scalarChannelOp>(destination + i, source + i, count - i, constAlpha);
+}
+
+static void addSse2(quint32 *destination, const quint32 *source, int count, quint32 constAlpha)
+{
+    const __m128i constAlphaVector = _mm_set1_epi16(qint16(constAlpha));
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i sourcePixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+        if (constAlpha != 255)
+            sourcePixels = byteMulSse2(sourcePixels, constAlphaVector);
+
+        __m128i *destinationPixels = reinterpret_cast<__m128i*>(destination + i);
+        _mm_storeu_si128(destinationPixels, _mm_adds_epu8(_mm_loadu_si128(destinationPixels), sourcePixels));
+    }
+
+    addScalar(destination + i, source + i, count - i, constAlpha);
+}
+#endif
+
+bool Compositing::isSimdAvailable()
+{
+#ifdef SLATE_COMPOSITING_SSE2
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Compositing::blend(QImage *destination, const QImage &source, qreal opacity,
+    ImageLayer::BlendMode blendMode, Implementation implementation)
+{
+    Q_ASSERT(destination);
+    Q_ASSERT(destination->format() == QImage::Format_ARGB32_Premultiplied);
+
+    // QPainter rounds opacity to 1/256ths before scaling it to 0-255; do the same so that our results match.
+    const quint32 constAlpha = quint32((qBound(0, qRound(opacity * 256), 256) * 255) >> 8);
+    if (constAlpha == 0 || source.isNull())
+        return;
+
+    // This is a shallow copy if the format is already correct.
+    const QImage premultipliedSource = source.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    const int width = qMin(destination->width(), premultipliedSource.width());
+    const int height = qMin(destination->height(), premultipliedSource.height());
+
+    // Opacity is applied by scaling the source before blending it, which
+    // (for every mode except add) is the same as interpolating between
+    // the destination and the fully opaque result.
+    void (*blendFunction)(quint32 *, const quint32 *, int, quint32) = nullptr;
+    const bool useSimd = implementation == SimdImplementation && isSimdAvailable();
+    switch (blendMode) {
+    case ImageLayer::NormalBlendMode:
+        blendFunction = sourceOverScalar;
+#ifdef SLATE_COMPOSITING_SSE2
+        if (useSimd)
+            blendFunction = sourceOverSse2;
+#endif
+        break;
+    case ImageLayer::MultiplyBlendMode:
+        blendFunction = separableBlendScalar<multiply>;
+#ifdef SLATE_COMPOSITING_SSE2
+        if (useSimd)
+            blendFunction = separableBlendSse2<multiplySse2, multiply>;
+#endif
+        break;
+    case ImageLayer::ScreenBlendMode:
+        blendFunction = separableBlendScalar<screen>;
+#ifdef SLATE_COMPOSITING_SSE2
+        if (useSimd)
+            blendFunction = separableBlendSse2<screenSse2, screen>;
+#endif
+        break;
+    case ImageLayer::OverlayBlendMode:
+        blendFunction = separableBlendScalar<overlay>;
+#ifdef SLATE_COMPOSITING_SSE2
+        if (useSimd)
+            blendFunction = separableBlendSse2<overlaySse2, overlay>;
+#endif
+        break;
+    case ImageLayer::AddBlendMode:
+        blendFunction = addScalar;
+#ifdef SLATE_COMPOSITING_SSE2
+        if (useSimd)
+            blendFunction = addSse2;
+#endif
+        break;
+    }
+#ifndef SLATE_COMPOSITING_SSE2
+    Q_UNUSED(useSimd);
+#endif
+    Q_ASSERT(blendFunction);
+
+    for (int y = 0; y < height; ++y) {
+        blendFunction(reinterpret_cast<quint32*>(destination->scanLine(y)),
+            reinterpret_cast<const quint32*>(premultipliedSource.constScanLine(y)), width, constAlpha);
+    }
+}
+
+void Compositing::sourceOver(QImage *destination, const QImage &source, qreal opacity, Implementation implementation)
+{
+    blend(destination, source, opacity, ImageLayer::NormalBlendMode, implementation);
+}
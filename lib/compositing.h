@@ -0,0 +1,55 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COMPOSITING_H
+#define COMPOSITING_H
+
+#include <QImage>
+
+#include "imagelayer.h"
+#include "slate-global.h"
+
+/*
+    Blends layer images together.
+
+    Everything operates on Format_ARGB32_Premultiplied images, and the results
+    don't depend on which implementation is used. Normal blending is identical to
+    QPainter's CompositionMode_SourceOver (with the same opacity), and the other
+    blend modes use the same formulas as QPainter's equivalent composition modes.
+*/
+namespace Compositing {
+    enum Implementation {
+        // Plain C++, one pixel at a time.
+        ScalarImplementation,
+        // SSE2 (four pixels at a time) where it's available, otherwise scalar.
+        SimdImplementation
+    };
+
+    SLATE_EXPORT bool isSimdAvailable();
+
+    // Blends source onto destination with opacity and blendMode, with both images aligned at their top-left corner.
+    // destination must be Format_ARGB32_Premultiplied; source is converted to it if necessary.
+    SLATE_EXPORT void blend(QImage *destination, const QImage &source, qreal opacity = 1.0,
+        ImageLayer::BlendMode blendMode = ImageLayer::NormalBlendMode, Implementation implementation = SimdImplementation);
+    // Equivalent to blend() with ImageLayer::NormalBlendMode.
+    SLATE_EXPORT void sourceOver(QImage *destination, const QImage &source, qreal opacity = 1.0,
+        Implementation implementation = SimdImplementation);
+}
+
+#endif // COMPOSITING_H
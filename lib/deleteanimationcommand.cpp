@@ -51,6 +51,12 @@ int DeleteAnimationCommand::id() const
     return -1;
 }
 
+qint64 DeleteAnimationCommand::payloadByteCount() const
+{
+    // We only own the animation while it's not in the project.
+    return mAnimationGuard ? qint64(sizeof(Animation)) + mAnimationGuard->name().size() * qint64(sizeof(QChar)) : 0;
+}
+
 QDebug operator<<(QDebug debug, const DeleteAnimationCommand *command)
 {
     QDebugStateSaver saver(debug);
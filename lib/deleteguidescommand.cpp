@@ -50,6 +50,11 @@ int DeleteGuidesCommand::id() const
     return -1;
 }
 
+qint64 DeleteGuidesCommand::payloadByteCount() const
+{
+    return mGuides.size() * qint64(sizeof(Guide));
+}
+
 QDebug operator<<(QDebug debug, const DeleteGuidesCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -30,7 +30,7 @@ DeleteImageCanvasSelectionCommand::DeleteImageCanvasSelectionCommand(ImageCanvas
     mCanvas(canvas),
     mLayerIndex(layerIndex),
     mDeletedArea(area),
-    mDeletedAreaImagePortion(canvas->currentProjectImage()->copy(area))
+    mDeletedAreaImagePortion(canvas->currentProjectImage()->copy(area), lcDeleteImageCanvasSelectionCommand)
 {
     qCDebug(lcDeleteImageCanvasSelectionCommand) << "constructed" << this;
 }
@@ -38,7 +38,12 @@ DeleteImageCanvasSelectionCommand::DeleteImageCanvasSelectionCommand(ImageCanvas
 void DeleteImageCanvasSelectionCommand::undo()
 {
     qCDebug(lcDeleteImageCanvasSelectionCommand) << "undoing" << this;
-    mCanvas->paintImageOntoPortionOfImage(mLayerIndex, mDeletedArea, mDeletedAreaImagePortion);
+    bool restored = false;
+    const QImage deletedAreaImagePortion = mDeletedAreaImagePortion.image(&restored);
+    if (!restored)
+        return;
+
+    mCanvas->paintImageOntoPortionOfImage(mLayerIndex, mDeletedArea, deletedAreaImagePortion);
 }
 
 void DeleteImageCanvasSelectionCommand::redo()
@@ -59,6 +64,26 @@ bool DeleteImageCanvasSelectionCommand::modifiesContents() const
     return true;
 }
 
+qint64 DeleteImageCanvasSelectionCommand::payloadByteCount() const
+{
+    return mDeletedAreaImagePortion.byteCount();
+}
+
+void DeleteImageCanvasSelectionCommand::compressPayload()
+{
+    mDeletedAreaImagePortion.compress();
+}
+
+void DeleteImageCanvasSelectionCommand::spillPayload(const QSharedPointer<UndoSpillFile> &spillFile)
+{
+    mDeletedAreaImagePortion.spill(spillFile);
+}
+
+void DeleteImageCanvasSelectionCommand::releasePayload()
+{
+    mDeletedAreaImagePortion.clear();
+}
+
 QDebug operator<<(QDebug debug, const DeleteImageCanvasSelectionCommand *command)
 {
     QDebugStateSaver saver(debug);
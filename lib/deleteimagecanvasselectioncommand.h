@@ -26,6 +26,7 @@
 
 #include "slate-global.h"
 #include "undocommand.h"
+#include "undoimage.h"
 
 class ImageCanvas;
 
@@ -41,6 +42,10 @@ public:
     int id() const override;
 
     bool modifiesContents() const override;
+    qint64 payloadByteCount() const override;
+    void compressPayload() override;
+    void spillPayload(const QSharedPointer<UndoSpillFile> &spillFile) override;
+    void releasePayload() override;
 
 private:
     friend QDebug operator<<(QDebug debug, const DeleteImageCanvasSelectionCommand *command);
@@ -49,7 +54,7 @@ private:
     int mLayerIndex;
     QRect mDeletedArea;
     // The portion of the image under the selection before it was deleted.
-    QImage mDeletedAreaImagePortion;
+    UndoImage mDeletedAreaImagePortion;
 };
 
 #endif // DELETEIMAGECANVASSELECTIONCOMMAND_H
@@ -61,6 +61,17 @@ bool DeleteLayerCommand::modifiesContents() const
     return true;
 }
 
+qint64 DeleteLayerCommand::payloadByteCount() const
+{
+    // We only own the layer while it's not in the project.
+    return mLayerGuard ? mLayerGuard->image()->sizeInBytes() : 0;
+}
+
+void DeleteLayerCommand::releasePayload()
+{
+    mLayerGuard.reset();
+}
+
 QDebug operator<<(QDebug debug, const DeleteLayerCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -41,6 +41,8 @@ public:
     int id() const override;
 
     bool modifiesContents() const override;
+    qint64 payloadByteCount() const override;
+    void releasePayload() override;
 
 private:
     friend QDebug operator<<(QDebug debug, const DeleteLayerCommand *command);
@@ -50,6 +50,11 @@ int DeleteNoteCommand::id() const
     return -1;
 }
 
+qint64 DeleteNoteCommand::payloadByteCount() const
+{
+    return mNote.text().size() * qint64(sizeof(QChar));
+}
+
 QDebug operator<<(QDebug debug, const DeleteNoteCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -66,6 +66,12 @@ int DuplicateAnimationCommand::id() const
     return -1;
 }
 
+qint64 DuplicateAnimationCommand::payloadByteCount() const
+{
+    // We only own the duplicate while it's not in the project.
+    return mAnimationGuard ? qint64(sizeof(Animation)) + mAnimationGuard->name().size() * qint64(sizeof(QChar)) : 0;
+}
+
 QDebug operator<<(QDebug debug, const DuplicateAnimationCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -63,6 +63,12 @@ bool DuplicateLayerCommand::modifiesContents() const
     return true;
 }
 
+qint64 DuplicateLayerCommand::payloadByteCount() const
+{
+    // We only own the layer while it's not in the project.
+    return mLayerGuard ? mLayerGuard->image()->sizeInBytes() : 0;
+}
+
 QDebug operator<<(QDebug debug, const DuplicateLayerCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -21,16 +21,24 @@
 
 #include <QDebug>
 #include <QColor>
+#include <QAtomicInt>
 #include <QImage>
 #include <QLoggingCategory>
 #include <QRandomGenerator>
-#include <QQueue>
+#include <QtMath>
 
+#include "imageutils.h"
 #include "swatchcolour.h"
 #include "texturedfillparameters.h"
 #include "tile.h"
 #include "tilesetproject.h"
 
+// SSE2 is part of the x86-64 baseline, so there's no need for runtime detection.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SLATE_FILL_SSE2
+#include <emmintrin.h>
+#endif
+
 Q_LOGGING_CATEGORY(lcPixelFloodFill, "app.pixelFloodFill")
 Q_LOGGING_CATEGORY(lcTileFloodFill, "app.tileFloodFill")
 Q_LOGGING_CATEGORY(lcSwatchTexturedFill, "app.swatchTexturedFill")
@@ -60,148 +68,400 @@ QString FillColourProvider::debugName() const
     return "FillColourProvider";
 }
 
-struct ImagePixelMask {
-    explicit ImagePixelMask(int imageHeight, int imageWidth) : mImageWidth{imageWidth}, mData(imageHeight * imageWidth, 0) {}
+bool FillColourProvider::providesUniformColour() const
+{
+    return true;
+}
 
-    int getImageIndex(const QPoint& point) const {
-        return (point.y() * mImageWidth) + point.x();
-    }
+static bool isArgb32Format(QImage::Format format)
+{
+    return format == QImage::Format_RGB32 || format == QImage::Format_ARGB32
+        || format == QImage::Format_ARGB32_Premultiplied;
+}
 
-    void insert(const QPoint& point) {
-        mData[getImageIndex(point)] = 1;
-    }
+// Returns what QImage::setPixelColor() stores for colour in an image of the given format,
+// which must be one that isArgb32Format() accepts.
+static QRgb argb32PixelValue(const QColor &colour, QImage::Format format)
+{
+    QRgba64 rgba64 = colour.rgba64();
+    if (format == QImage::Format_RGB32)
+        rgba64.setAlpha(65535);
+    else if (format == QImage::Format_ARGB32_Premultiplied)
+        rgba64 = rgba64.premultiplied();
+    return rgba64.toArgb32();
+}
 
-    bool contains(const QPoint& point) const {
-        return mData.at(getImageIndex(point)) == 1;
-    }
+void FillColourProvider::pixels(const QColor &baseColour, QImage::Format format, QRgb *pixels, int count) const
+{
+    for (int i = 0; i < count; ++i)
+        pixels[i] = argb32PixelValue(colour(baseColour), format);
+}
+
+bool PixelFillMask::isEmpty() const
+{
+    return bounds.isEmpty();
+}
+
+bool PixelFillMask::contains(const QPoint &pos) const
+{
+    if (!bounds.contains(pos))
+        return false;
+
+    return bits.testBit((pos.y() - bounds.y()) * bounds.width() + pos.x() - bounds.x());
+}
 
-    int size() const {
-        return static_cast<int>(std::count_if(mData.constBegin(), mData.constEnd(), [](int index){ return index == 1;}));
+int PixelFillMask::count() const
+{
+    return bits.count(true);
+}
+
+// Returns image if its pixels are already stored as 32-bit values, otherwise a converted copy.
+// Each QColor corresponds to exactly one value in these formats, so comparing the values
+// is equivalent to comparing the colours returned by pixelColor().
+static QImage thirtyTwoBitImage(const QImage &image)
+{
+    return isArgb32Format(image.format()) ? image : image.convertToFormat(QImage::Format_ARGB32);
+}
+
+// Fills the contiguous area of positions within size for which isTarget(x, y) returns true,
+// starting at startPos, and returns a bit for each position (row by row) that was filled.
+// Each seed is a position that (possibly) still needs filling. The whole span of fillable
+// positions that it's in is filled at once, and then the rows above and below the span are
+// searched for spans of their own, each of which gets one seed.
+template<typename IsTarget>
+static QBitArray spanFloodFill(const QSize &size, const QPoint &startPos, IsTarget isTarget, QRect *filledBounds)
+{
+    const int width = size.width();
+    const int height = size.height();
+    QBitArray filled(width * height);
+    const auto isFillable = [&](int x, int y) {
+        return !filled.testBit(y * width + x) && isTarget(x, y);
+    };
+
+    QVector<QPoint> seeds;
+    seeds.append(startPos);
+    while (!seeds.isEmpty()) {
+        const QPoint seed = seeds.takeLast();
+        const int y = seed.y();
+        if (!isFillable(seed.x(), y))
+            continue;
+
+        int left = seed.x();
+        while (left > 0 && isFillable(left - 1, y))
+            --left;
+
+        int right = seed.x();
+        while (right < width - 1 && isFillable(right + 1, y))
+            ++right;
+
+        filled.fill(true, y * width + left, y * width + right + 1);
+        *filledBounds |= QRect(left, y, right - left + 1, 1);
+
+        for (const int adjacentY : { y - 1, y + 1 }) {
+            if (adjacentY < 0 || adjacentY >= height)
+                continue;
+
+            bool inSpan = false;
+            for (int x = left; x <= right; ++x) {
+                const bool fillable = isFillable(x, adjacentY);
+                if (fillable && !inSpan)
+                    seeds.append(QPoint(x, adjacentY));
+                inSpan = fillable;
+            }
+        }
     }
+    return filled;
+}
 
-    const int mImageWidth;
-    QVector<bool> mData;
-};
+// Appends the position of each bit in filled (which is width bits wide) that is set within bounds.
+static void appendFilledPositions(const QBitArray &filled, int width, const QRect &bounds, QVector<QPoint> &positions)
+{
+    for (int y = bounds.top(); y <= bounds.bottom(); ++y) {
+        for (int x = bounds.left(); x <= bounds.right(); ++x) {
+            if (filled.testBit(y * width + x))
+                positions.append(QPoint(x, y));
+        }
+    }
+}
 
-QImage imagePixelFloodFill(const QImage *image, const QPoint &startPos, const QColor &targetColour,
+PixelFillMask imagePixelFloodFillMask(const QImage *image, const QPoint &startPos, const QColor &targetColour,
     const QColor &replacementColour, const FillColourProvider &fillColourProvider)
 {
     qCDebug(lcPixelFloodFill) << "attempting to fill starting with pixel at" << startPos << "...";
 
-    QImage filledImage = *image;
-    const QRect imageBounds(0, 0, filledImage.width(), filledImage.height());
+    const QRect imageBounds(0, 0, image->width(), image->height());
     if (!imageBounds.contains(startPos)) {
         qCDebug(lcPixelFloodFill).nospace() << "The pixel at " << startPos
             << " is not within the image bounds (" << imageBounds << ")";
-        return QImage();
+        return PixelFillMask();
     }
 
-    if (!fillColourProvider.allowsNoOpFills() && filledImage.pixelColor(startPos) == replacementColour) {
+    const QColor startColour = image->pixelColor(startPos);
+    if (!fillColourProvider.allowsNoOpFills() && startColour == replacementColour) {
         qCDebug(lcPixelFloodFill).nospace() << "The pixel at " << startPos
-            << " (" << filledImage.pixelColor(startPos).name(QColor::HexArgb) << ") "
+            << " (" << startColour.name(QColor::HexArgb) << ") "
             << "is the same as what we want to replace it with (" << replacementColour.name(QColor::HexArgb) << ") "
             << "and the fill colour provider (" << fillColourProvider.debugName() << ") doesn't allow this";
-        return QImage();
+        return PixelFillMask();
     }
 
-    if (filledImage.pixelColor(startPos) != targetColour) {
+    if (startColour != targetColour) {
         qCDebug(lcPixelFloodFill).nospace() << "The pixel at " << startPos
-            << " (" << filledImage.pixelColor(startPos).name(QColor::HexArgb) << ") "
+            << " (" << startColour.name(QColor::HexArgb) << ") "
             << "is not the same as our target colour: " << targetColour.name(QColor::HexArgb);
-        return QImage();
+        return PixelFillMask();
     }
 
     if (!fillColourProvider.canProvideColours()) {
         qCDebug(lcPixelFloodFill).nospace() << "The fill colour provider"
             << &fillColourProvider << "cannot provide colours for us";
-        return QImage();
+        return PixelFillMask();
+    }
+
+    const QImage pixels = thirtyTwoBitImage(*image);
+    const int width = pixels.width();
+    const QRgb targetPixel = reinterpret_cast<const QRgb*>(pixels.constScanLine(startPos.y()))[startPos.x()];
+
+    QRect filledBounds;
+    const QBitArray filled = spanFloodFill(pixels.size(), startPos, [&](int x, int y) {
+        return reinterpret_cast<const QRgb*>(pixels.constScanLine(y))[x] == targetPixel;
+    }, &filledBounds);
+
+    PixelFillMask mask;
+    mask.bounds = filledBounds;
+    mask.bits.resize(filledBounds.width() * filledBounds.height());
+    for (int y = 0; y < filledBounds.height(); ++y) {
+        const int rowIndex = (filledBounds.y() + y) * width + filledBounds.x();
+        const int maskRowIndex = y * filledBounds.width();
+        for (int x = 0; x < filledBounds.width(); ++x) {
+            if (filled.testBit(rowIndex + x))
+                mask.bits.setBit(maskRowIndex + x);
+        }
     }
 
-    QQueue<QPoint> queue;
-    queue.append(startPos);
-
-    ImagePixelMask filledPositions{filledImage.height(), filledImage.width()};
-    filledPositions.insert(startPos);
-    filledImage.setPixelColor(startPos, fillColourProvider.colour(replacementColour));
-
-    for (int i = 0; i < queue.size(); ++i) {
-        QPoint node = queue.at(i);
-        QPoint west = node;
-        QPoint east = node;
+    qCDebug(lcPixelFloodFill) << "... filled" << mask.count() << "pixels within" << filledBounds;
+    return mask;
+}
 
-        while (true) {
-            QPoint newWest = west - QPoint(1, 0);
-            if (imageBounds.contains(newWest) && !filledPositions.contains(newWest) && image->pixelColor(newWest) == targetColour) {
-                west = newWest;
-            } else {
-                break;
+QImage maskedPixelFill(const QImage *image, const PixelFillMask &mask, const QColor &replacementColour,
+    const FillColourProvider &fillColourProvider)
+{
+    QImage filledArea = image->copy(mask.bounds);
+    const int width = mask.bounds.width();
+    if (fillColourProvider.providesUniformColour() && filledArea.depth() == 32) {
+        // Let QImage convert the colour to a pixel value once, and then write that value directly.
+        QImage colourImage(1, 1, filledArea.format());
+        colourImage.setPixelColor(0, 0, fillColourProvider.colour(replacementColour));
+        const QRgb pixel = *reinterpret_cast<const QRgb*>(colourImage.constScanLine(0));
+        for (int y = 0; y < filledArea.height(); ++y) {
+            QRgb *scanLine = reinterpret_cast<QRgb*>(filledArea.scanLine(y));
+            for (int x = 0; x < width; ++x) {
+                if (mask.bits.testBit(y * width + x))
+                    scanLine[x] = pixel;
             }
         }
-
-        while (true) {
-            QPoint newEast = east + QPoint(1, 0);
-            if (imageBounds.contains(newEast) && !filledPositions.contains(newEast) && image->pixelColor(newEast) == targetColour) {
-                east = newEast;
-            } else {
-                break;
+        return filledArea;
+    }
+
+    if (isArgb32Format(filledArea.format())) {
+        // Get the colours for each row's filled pixels in one go.
+        QVector<QRgb> rowPixels(width);
+        for (int y = 0; y < filledArea.height(); ++y) {
+            int rowFilledCount = 0;
+            for (int x = 0; x < width; ++x)
+                rowFilledCount += mask.bits.testBit(y * width + x);
+            fillColourProvider.pixels(replacementColour, filledArea.format(), rowPixels.data(), rowFilledCount);
+
+            QRgb *scanLine = reinterpret_cast<QRgb*>(filledArea.scanLine(y));
+            int rowPixelIndex = 0;
+            for (int x = 0; x < width; ++x) {
+                if (mask.bits.testBit(y * width + x))
+                    scanLine[x] = rowPixels.at(rowPixelIndex++);
             }
         }
+        return filledArea;
+    }
+
+    for (int y = 0; y < filledArea.height(); ++y) {
+        for (int x = 0; x < width; ++x) {
+            if (mask.bits.testBit(y * width + x))
+                filledArea.setPixelColor(x, y, fillColourProvider.colour(replacementColour));
+        }
+    }
+    return filledArea;
+}
 
-        for (int x = west.x(); x <= east.x(); ++x) {
-            const QPoint n = QPoint(x, node.y());
-            // This avoids startPos being added twice.
-            if (!filledPositions.contains(n)) {
-                queue.append(n);
-                filledPositions.insert(n);
-                filledImage.setPixelColor(n, fillColourProvider.colour(replacementColour));
-            }
+QImage imagePixelFloodFillArea(const QImage *image, const QPoint &startPos, const QColor &targetColour,
+    const QColor &replacementColour, PixelFillMask *mask, const FillColourProvider &fillColourProvider)
+{
+    *mask = imagePixelFloodFillMask(image, startPos, targetColour, replacementColour, fillColourProvider);
+    if (mask->isEmpty())
+        return QImage();
 
-            const QPoint north(n - QPoint(0, 1));
-            if (imageBounds.contains(north) && !filledPositions.contains(north) && image->pixelColor(north) == targetColour) {
-                queue.append(north);
-                filledPositions.insert(north);
-                filledImage.setPixelColor(north, fillColourProvider.colour(replacementColour));
-            }
+    return maskedPixelFill(image, *mask, replacementColour, fillColourProvider);
+}
 
-            const QPoint south(n + QPoint(0, 1));
-            if (imageBounds.contains(south) && !filledPositions.contains(south) && image->pixelColor(south) == targetColour) {
-                queue.append(south);
-                filledPositions.insert(south);
-                filledImage.setPixelColor(south, fillColourProvider.colour(replacementColour));
-            }
+// Returns a copy of image with the area at area.topLeft() replaced by filledArea.
+static QImage imageWithFilledArea(const QImage *image, const QRect &area, const QImage &filledArea)
+{
+    QImage filledImage = *image;
+    if (filledImage.depth() < 8) {
+        for (int y = 0; y < filledArea.height(); ++y) {
+            for (int x = 0; x < filledArea.width(); ++x)
+                filledImage.setPixel(area.x() + x, area.y() + y, filledArea.pixelIndex(x, y));
         }
+        return filledImage;
     }
 
-    qCDebug(lcPixelFloodFill) << "... filled" << filledPositions.size() << "pixels.";
+    const int bytesPerPixel = filledImage.depth() / 8;
+    for (int y = 0; y < filledArea.height(); ++y) {
+        memcpy(filledImage.scanLine(area.y() + y) + area.x() * bytesPerPixel,
+            filledArea.constScanLine(y), filledArea.width() * bytesPerPixel);
+    }
     return filledImage;
 }
 
-QImage imageGreedyPixelFill(const QImage *image, const QPoint &startPos, const QColor &targetColour,
+QImage imagePixelFloodFill(const QImage *image, const QPoint &startPos, const QColor &targetColour,
     const QColor &replacementColour, const FillColourProvider &fillColourProvider)
 {
-    const QRect imageBounds(0, 0, image->width(), image->height());
-    if (!imageBounds.contains(startPos)) {
-        qCDebug(lcPixelFloodFill).nospace() << "The pixel at " << startPos
-            << " is not within the image bounds (" << imageBounds << ")";
+    PixelFillMask mask;
+    const QImage filledArea = imagePixelFloodFillArea(image, startPos, targetColour, replacementColour,
+        &mask, fillColourProvider);
+    if (filledArea.isNull())
         return QImage();
+
+    return imageWithFilledArea(image, mask.bounds, filledArea);
+}
+
+// Replaces each pixel in pixels that is targetPixel with replacementPixel,
+// returning the amount of pixels that were replaced.
+static int replacePixelsScalar(QRgb *pixels, int count, QRgb targetPixel, QRgb replacementPixel)
+{
+    int replacedCount = 0;
+    for (int i = 0; i < count; ++i) {
+        if (pixels[i] == targetPixel) {
+            pixels[i] = replacementPixel;
+            ++replacedCount;
+        }
     }
+    return replacedCount;
+}
 
-    if (image->pixelColor(startPos) == replacementColour) {
-        qCDebug(lcPixelFloodFill).nospace() << "The pixel at " << startPos
-            << " (" << image->pixelColor(startPos).name(QColor::HexArgb) << ") "
+#ifdef SLATE_FILL_SSE2
+static int replacePixelsSse2(QRgb *pixels, int count, QRgb targetPixel, QRgb replacementPixel)
+{
+    const __m128i target = _mm_set1_epi32(int(targetPixel));
+    const __m128i replacement = _mm_set1_epi32(int(replacementPixel));
+    int replacedCount = 0;
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i *pixelBlock = reinterpret_cast<__m128i*>(pixels + i);
+        const __m128i blockPixels = _mm_loadu_si128(pixelBlock);
+        const __m128i matches = _mm_cmpeq_epi32(blockPixels, target);
+        const int matchMask = _mm_movemask_ps(_mm_castsi128_ps(matches));
+        if (matchMask == 0)
+            continue;
+
+        _mm_storeu_si128(pixelBlock, _mm_or_si128(_mm_and_si128(matches, replacement),
+            _mm_andnot_si128(matches, blockPixels)));
+        replacedCount += qPopulationCount(quint32(matchMask));
+    }
+    return replacedCount + replacePixelsScalar(pixels + i, count - i, targetPixel, replacementPixel);
+}
+#endif
+
+// Sets value to what image stores for colour (which must have a depth of 32),
+// returning false if colour can't be stored exactly.
+static bool pixelValue(const QImage &image, const QColor &colour, QRgb *value)
+{
+    QImage colourImage(1, 1, image.format());
+    colourImage.setPixelColor(0, 0, colour);
+    *value = *reinterpret_cast<const QRgb*>(colourImage.constScanLine(0));
+    return colourImage.pixelColor(0, 0) == colour;
+}
+
+QImage imageGreedyPixelFill(const QImage *image, const QColor &targetColour,
+    const QColor &replacementColour, const FillColourProvider &fillColourProvider)
+{
+    if (targetColour == replacementColour) {
+        qCDebug(lcPixelFloodFill).nospace() << "The target colour (" << targetColour.name(QColor::HexArgb) << ") "
             << "is the same as what we want to replace it with: " << replacementColour.name(QColor::HexArgb);
         return QImage();
     }
 
+    if (!fillColourProvider.canProvideColours()) {
+        qCDebug(lcPixelFloodFill).nospace() << "The fill colour provider"
+            << &fillColourProvider << "cannot provide colours for us";
+        return QImage();
+    }
+
     QImage filledImage(*image);
-    for (int y = 0; y < image->height(); ++y) {
-        for (int x = 0; x < image->width(); ++x) {
-            if (image->pixelColor(x, y) == targetColour) {
-                filledImage.setPixelColor(x, y, fillColourProvider.colour(replacementColour));
+    QAtomicInt filledCount;
+    if (fillColourProvider.providesUniformColour() && image->depth() == 32) {
+        // If the image can't store targetColour exactly, none of its pixels can be that colour.
+        QRgb targetPixel = 0;
+        if (!pixelValue(*image, targetColour, &targetPixel))
+            return QImage();
+
+        // Like setPixelColor(), this doesn't need to be able to store the replacement colour exactly.
+        QRgb replacementPixel = 0;
+        pixelValue(*image, fillColourProvider.colour(replacementColour), &replacementPixel);
+
+        // Compare and replace the raw pixel values, a block of rows per thread.
+        uchar *bits = filledImage.bits();
+        const qsizetype bytesPerLine = filledImage.bytesPerLine();
+        const int width = filledImage.width();
+        ImageUtils::forEachRowBlock(filledImage.height(), width, [=, &filledCount](int firstRow, int endRow) {
+            int blockFilledCount = 0;
+            for (int y = firstRow; y < endRow; ++y) {
+                QRgb *scanLine = reinterpret_cast<QRgb*>(bits + y * bytesPerLine);
+#ifdef SLATE_FILL_SSE2
+                blockFilledCount += replacePixelsSse2(scanLine, width, targetPixel, replacementPixel);
+#else
+                blockFilledCount += replacePixelsScalar(scanLine, width, targetPixel, replacementPixel);
+#endif
+            }
+            filledCount.fetchAndAddRelaxed(blockFilledCount);
+        });
+    } else if (isArgb32Format(image->format())) {
+        QRgb targetPixel = 0;
+        if (!pixelValue(*image, targetColour, &targetPixel))
+            return QImage();
+
+        // Get the colours for each row's matching pixels in one go. This isn't split across
+        // threads, as the colours (if they're random) should only depend on the provider's seed.
+        const int width = filledImage.width();
+        QVector<QRgb> rowPixels(width);
+        QVector<int> rowMatches;
+        rowMatches.reserve(width);
+        for (int y = 0; y < filledImage.height(); ++y) {
+            QRgb *scanLine = reinterpret_cast<QRgb*>(filledImage.scanLine(y));
+            rowMatches.clear();
+            for (int x = 0; x < width; ++x) {
+                if (scanLine[x] == targetPixel)
+                    rowMatches.append(x);
+            }
+            if (rowMatches.isEmpty())
+                continue;
+
+            fillColourProvider.pixels(replacementColour, filledImage.format(), rowPixels.data(), rowMatches.size());
+            for (int i = 0; i < rowMatches.size(); ++i)
+                scanLine[rowMatches.at(i)] = rowPixels.at(i);
+            filledCount.fetchAndAddRelaxed(rowMatches.size());
+        }
+    } else {
+        for (int y = 0; y < image->height(); ++y) {
+            for (int x = 0; x < image->width(); ++x) {
+                if (image->pixelColor(x, y) == targetColour) {
+                    filledImage.setPixelColor(x, y, fillColourProvider.colour(replacementColour));
+                    filledCount.ref();
+                }
             }
         }
     }
-    return filledImage;
+
+    qCDebug(lcPixelFloodFill) << "greedily filled" << filledCount.loadRelaxed() << "pixels";
+    return filledCount.loadRelaxed() > 0 ? filledImage : QImage();
 }
 
 qreal toRange(qreal randomNumber, qreal min, qreal max)
@@ -212,8 +472,9 @@ qreal toRange(qreal randomNumber, qreal min, qreal max)
 class VarianceTextureFillColourProvider : public FillColourProvider
 {
 public:
-    VarianceTextureFillColourProvider(const TexturedFillParameters &parameters) :
-        mParameters(parameters)
+    VarianceTextureFillColourProvider(const TexturedFillParameters &parameters, quint32 seed) :
+        mParameters(parameters),
+        mRandom(seed)
     {
     }
 
@@ -222,29 +483,36 @@ public:
         return true;
     }
 
-    QColor colour(const QColor &baseColour) const override
+    bool providesUniformColour() const override
     {
-        const auto randomGen = QRandomGenerator::global();
+        return false;
+    }
 
-        const QColor baseColourAsHsl = baseColour.toHsl();
+    QColor colour(const QColor &baseColour) const override
+    {
+        // Every pixel in a fill has the same base colour, so only convert it once.
+        if (baseColour != mBaseColour) {
+            mBaseColour = baseColour;
+            mBaseColourAsHsl = baseColour.toHsl();
+        }
 
-        qreal hue = baseColourAsHsl.hslHueF();
+        qreal hue = mBaseColourAsHsl.hslHueF();
         if (mParameters.hue()->isEnabled()) {
-            const qreal variance = toRange(randomGen->generateDouble(),
+            const qreal variance = toRange(mRandom.generateDouble(),
                 mParameters.hue()->varianceLowerBound(), mParameters.hue()->varianceUpperBound());
             hue = qBound(0.0, hue + variance, 1.0);
         }
 
-        qreal saturation = baseColourAsHsl.hslSaturationF();
+        qreal saturation = mBaseColourAsHsl.hslSaturationF();
         if (mParameters.saturation()->isEnabled()) {
-            const qreal variance = toRange(randomGen->generateDouble(),
+            const qreal variance = toRange(mRandom.generateDouble(),
                 mParameters.saturation()->varianceLowerBound(), mParameters.saturation()->varianceUpperBound());
             saturation = qBound(0.0, saturation + variance, 1.0);
         }
 
-        qreal lightness = baseColourAsHsl.lightnessF();
+        qreal lightness = mBaseColourAsHsl.lightnessF();
         if (mParameters.lightness()->isEnabled()) {
-            const qreal variance = toRange(randomGen->generateDouble(),
+            const qreal variance = toRange(mRandom.generateDouble(),
                 mParameters.lightness()->varianceLowerBound(), mParameters.lightness()->varianceUpperBound());
             lightness = qBound(0.0, lightness + variance, 1.0);
         }
@@ -259,55 +527,79 @@ public:
     }
 
     const TexturedFillParameters &mParameters;
+    mutable QRandomGenerator mRandom;
+    mutable QColor mBaseColour;
+    mutable QColor mBaseColourAsHsl;
 };
 
 class SwatchTextureFillColourProvider : public FillColourProvider
 {
 public:
-    SwatchTextureFillColourProvider(const TexturedFillParameters &parameters) :
-        mParameters(parameters)
+    SwatchTextureFillColourProvider(const TexturedFillParameters &parameters, quint32 seed) :
+        mParameters(parameters),
+        mRandom(seed)
     {
-        if (mParameters.swatch()->colours().isEmpty()) {
+        const QVector<SwatchColour> swatchColours = mParameters.swatch()->colours();
+        if (swatchColours.isEmpty()) {
             qWarning() << "Textured fill swatch is empty!";
             return;
         }
 
-        qCDebug(lcSwatchTexturedFill) << "calculating chances and probability sum";
+        for (const SwatchColour &swatchColour : swatchColours)
+            mColours.append(swatchColour.colour());
+
         qCDebug(lcSwatchTexturedFill) << "swatch probabilities:" << mParameters.swatch()->probabilities();
 
-        const auto probabilities = mParameters.swatch()->probabilities();
-        const int probabilityCount = probabilities.size();
-        mChances.resize(probabilityCount);
-
-        // If there are ten colours, and each one has 100% probability,
-        // then its "chance" is 0.10.
-        // We calculate "chances" as a way of normalising the probabilities
-        // so that we can easily check which one wins.
-        const qreal oneHundredPercentProbability = 1.0 / probabilityCount;
-
-        for (int i = 0; i < probabilityCount; ++i) {
-            const qreal probability = probabilities.at(i);
-            const qreal chance = probability * oneHundredPercentProbability;
-            mChances[i] = chance;
-            mChanceSum += chance;
+        const QVector<qreal> probabilities = mParameters.swatch()->probabilities();
+        qreal probabilitySum = 0;
+        for (const qreal probability : probabilities)
+            probabilitySum += probability;
+
+        if (qFuzzyIsNull(probabilitySum)) {
+            qWarning() << "Sum of probabilities for textured fill swatch colours is zero!";
+            return;
         }
 
-        // I'm not 100% sure, but I think this is necessary.
-        // If the chances are [0.5, 0.1] and the random number is 0.05,
-        // the first one might be chosen more often than it should.
-        // The second number will only be chosen when the number is
-        // greater than the first but less than both combined;
-        // i.e. 0.5001, 0.5999, etc. So I guess technically
-        // the second one can be chosen, but perhaps less often? I dunno.
-        // It seems to work fine without sorting though.
-        // TODO: colours also need to be sorted if we do this, otherwise it won't work correctly.
-//        std::sort(mChances.begin(), mChances.end());
+        // Build an alias table with Vose's method, so that each colour can be chosen in constant time.
+        // Each colour gets a column whose height is its probability, scaled so that the average height
+        // is 1. Columns that are taller than 1 are cut down to top up the ones that are shorter,
+        // so that each column ends up with a height of 1 and contains at most two colours:
+        // its own, and its alias.
+        const int colourCount = probabilities.size();
+        QVector<qreal> heights(colourCount);
+        QVector<int> shortColumns;
+        QVector<int> tallColumns;
+        for (int i = 0; i < colourCount; ++i) {
+            heights[i] = probabilities.at(i) * colourCount / probabilitySum;
+            if (heights.at(i) < 1.0)
+                shortColumns.append(i);
+            else
+                tallColumns.append(i);
+        }
 
-        if (qFuzzyIsNull(mChanceSum))
-            qWarning() << "Sum of chances for textured fill swatch colours is zero!";
+        mAliasProbabilities.resize(colourCount);
+        mAliases.resize(colourCount);
+        while (!shortColumns.isEmpty() && !tallColumns.isEmpty()) {
+            const int shortColumn = shortColumns.takeLast();
+            const int tallColumn = tallColumns.takeLast();
+            mAliasProbabilities[shortColumn] = heights.at(shortColumn);
+            mAliases[shortColumn] = tallColumn;
+
+            heights[tallColumn] -= 1.0 - heights.at(shortColumn);
+            if (heights.at(tallColumn) < 1.0)
+                shortColumns.append(tallColumn);
+            else
+                tallColumns.append(tallColumn);
+        }
+
+        // Whatever is left over is (give or take rounding errors) exactly 1 high.
+        for (const int column : tallColumns + shortColumns) {
+            mAliasProbabilities[column] = 1.0;
+            mAliases[column] = column;
+        }
 
-        qCDebug(lcSwatchTexturedFill) << "chances:" << mChances;
-        qCDebug(lcSwatchTexturedFill) << "chance sum:" << mChanceSum;
+        qCDebug(lcSwatchTexturedFill) << "alias probabilities:" << mAliasProbabilities;
+        qCDebug(lcSwatchTexturedFill) << "aliases:" << mAliases;
     }
 
     bool allowsNoOpFills() const override
@@ -315,6 +607,11 @@ public:
         return true;
     }
 
+    bool providesUniformColour() const override
+    {
+        return false;
+    }
+
     bool canProvideColours() const override
     {
         return mParameters.swatch()->hasNonZeroProbabilitySum();
@@ -322,21 +619,20 @@ public:
 
     QColor colour(const QColor &) const override
     {
-        const auto randomGen = QRandomGenerator::global();
-        const QVector<SwatchColour> swatchColours = mParameters.swatch()->colours();
+        return mColours.at(randomColourIndex());
+    }
 
-        // We can't just use 1 for the maximum, because if there are two colours and
-        // one has 0.3 chance and the other 0.5, then the latter will never
-        // get chosen (1 - 0.3 = 0.7, which is greater than 0.5).
-        qreal randomNumber = toRange(randomGen->generateDouble(), 0, mChanceSum);
-        for (int i = 0; i < mChances.size(); ++i) {
-            const qreal chance = mChances.at(i);
-            if (randomNumber <= chance)
-                return swatchColours.at(i).colour();
-            randomNumber -= chance;
+    void pixels(const QColor &, QImage::Format format, QRgb *pixels, int count) const override
+    {
+        if (format != mColourPixelsFormat) {
+            mColourPixels.clear();
+            for (const QColor &colour : mColours)
+                mColourPixels.append(argb32PixelValue(colour, format));
+            mColourPixelsFormat = format;
         }
 
-        Q_UNREACHABLE();
+        for (int i = 0; i < count; ++i)
+            pixels[i] = mColourPixels.at(randomColourIndex());
     }
 
     QString debugName() const override
@@ -344,92 +640,129 @@ public:
         return "SwatchTextureFillColourProvider";
     }
 
+    int randomColourIndex() const
+    {
+        const int column = mRandom.bounded(int(mAliases.size()));
+        return mRandom.generateDouble() < mAliasProbabilities.at(column) ? column : mAliases.at(column);
+    }
+
     const TexturedFillParameters &mParameters;
-    QVector<qreal> mChances;
-    qreal mChanceSum = 0;
+    mutable QRandomGenerator mRandom;
+    QVector<QColor> mColours;
+    QVector<qreal> mAliasProbabilities;
+    QVector<int> mAliases;
+    // mColours as pixel values in mColourPixelsFormat.
+    mutable QVector<QRgb> mColourPixels;
+    mutable QImage::Format mColourPixelsFormat = QImage::Format_Invalid;
 };
 
-QImage texturedFill(const QImage *image, const QPoint &startPos, const QColor &targetColour,
-    const QColor &replacementColour, const TexturedFillParameters &parameters)
+QImage texturedFillArea(const QImage *image, const QPoint &startPos, const QColor &targetColour,
+    const QColor &replacementColour, const TexturedFillParameters &parameters, quint32 seed, PixelFillMask *mask)
 {
-    if (parameters.type() == TexturedFillParameters::VarianceFillType)
-        return imagePixelFloodFill(image, startPos, targetColour, replacementColour, VarianceTextureFillColourProvider(parameters));
+    if (parameters.type() == TexturedFillParameters::VarianceFillType) {
+        return imagePixelFloodFillArea(image, startPos, targetColour, replacementColour, mask,
+            VarianceTextureFillColourProvider(parameters, seed));
+    }
 
     // Swatch.
-    return imagePixelFloodFill(image, startPos, targetColour, replacementColour, SwatchTextureFillColourProvider(parameters));
+    return imagePixelFloodFillArea(image, startPos, targetColour, replacementColour, mask,
+        SwatchTextureFillColourProvider(parameters, seed));
+}
+
+QImage texturedFill(const QImage *image, const QPoint &startPos, const QColor &targetColour,
+    const QColor &replacementColour, const TexturedFillParameters &parameters, quint32 seed)
+{
+    PixelFillMask mask;
+    const QImage filledArea = texturedFillArea(image, startPos, targetColour, replacementColour,
+        parameters, seed, &mask);
+    if (filledArea.isNull())
+        return QImage();
+
+    return imageWithFilledArea(image, mask.bounds, filledArea);
 }
 
-QImage greedyTexturedFill(const QImage *image, const QPoint &startPos, const QColor &targetColour,
-    const QColor &replacementColour, const TexturedFillParameters &parameters)
+QImage greedyTexturedFill(const QImage *image, const QColor &targetColour,
+    const QColor &replacementColour, const TexturedFillParameters &parameters, quint32 seed)
 {
-    if (parameters.type() == TexturedFillParameters::VarianceFillType)
-        return imageGreedyPixelFill(image, startPos, targetColour, replacementColour, VarianceTextureFillColourProvider(parameters));
+    if (parameters.type() == TexturedFillParameters::VarianceFillType) {
+        return imageGreedyPixelFill(image, targetColour, replacementColour,
+            VarianceTextureFillColourProvider(parameters, seed));
+    }
 
     // Swatch.
-    return imageGreedyPixelFill(image, startPos, targetColour, replacementColour, SwatchTextureFillColourProvider(parameters));
+    return imageGreedyPixelFill(image, targetColour, replacementColour,
+        SwatchTextureFillColourProvider(parameters, seed));
 }
 
-// TODO: convert these to non-recursive algorithms as above
 void tilesetPixelFloodFill(const Tile *tile, const QPoint &pos, const QColor &targetColour,
     const QColor &replacementColour, QVector<QPoint> &filledPositions)
 {
-    qCDebug(lcPixelFloodFill) << "attempting to fill pixel at" << pos << "...";
-
-    if (filledPositions.contains(pos)) {
-        // This tile has already been filled (would this ever happen?)
-        qCDebug(lcPixelFloodFill) << "already filled";
-        return;
-    }
+    qCDebug(lcPixelFloodFill) << "attempting to fill starting with pixel at" << pos << "...";
 
-    if (tile->pixelColor(pos) == replacementColour) {
+    const QColor startColour = tile->pixelColor(pos);
+    if (startColour == replacementColour) {
         qCDebug(lcPixelFloodFill) << "hit the same colour as replacement colour; returning";
         return;
     }
 
-    if (tile->pixelColor(pos) != targetColour) {
+    if (startColour != targetColour) {
         qCDebug(lcPixelFloodFill) << "hit a different colour; returning";
         return;
     }
 
-    qCDebug(lcPixelFloodFill) << "filling!";
-    filledPositions.append(pos);
+    const QImage pixels = thirtyTwoBitImage(tile->image());
+    const QRgb targetPixel = reinterpret_cast<const QRgb*>(pixels.constScanLine(pos.y()))[pos.x()];
 
-    const QRect tileBounds(0, 0, tile->sourceRect().width(), tile->sourceRect().height());
-    const QPoint north = pos - QPoint(0, 1);
-    const QPoint south = pos + QPoint(0, 1);
-    const QPoint east = pos + QPoint(1, 0);
-    const QPoint west = pos - QPoint(1, 0);
+    QRect filledBounds;
+    const QBitArray filled = spanFloodFill(pixels.size(), pos, [&](int x, int y) {
+        return reinterpret_cast<const QRgb*>(pixels.constScanLine(y))[x] == targetPixel;
+    }, &filledBounds);
+    appendFilledPositions(filled, pixels.width(), filledBounds, filledPositions);
 
-    if (tileBounds.contains(north)) {
-        tilesetPixelFloodFill(tile, north, targetColour, replacementColour, filledPositions);
-    } else {
-        qCDebug(lcPixelFloodFill) << north << "is out of bounds" << "( tileBounds =" << tileBounds << ")";
-    }
-    if (tileBounds.contains(south)) {
-        tilesetPixelFloodFill(tile, south, targetColour, replacementColour, filledPositions);
-    } else {
-        qCDebug(lcPixelFloodFill) << south << "is out of bounds" << "( tileBounds =" << tileBounds << ")";
+    qCDebug(lcPixelFloodFill) << "... filled" << filledPositions.size() << "pixels within" << filledBounds;
+}
+
+void tilesetGreedyPixelFill(const Tile *tile, const QColor &targetColour,
+    const QColor &replacementColour, QVector<QPoint> &filledPositions)
+{
+    if (targetColour == replacementColour) {
+        qCDebug(lcPixelFloodFill) << "target colour is the same as replacement colour; returning";
+        return;
     }
-    if (tileBounds.contains(east)) {
-        tilesetPixelFloodFill(tile, east, targetColour, replacementColour, filledPositions);
-    } else {
-        qCDebug(lcPixelFloodFill) << east << "is out of bounds" << "( tileBounds =" << tileBounds << ")";
+
+    const QImage pixels = thirtyTwoBitImage(tile->image());
+    QRgb targetPixel = 0;
+    if (!pixelValue(pixels, targetColour, &targetPixel))
+        return;
+
+    for (int y = 0; y < pixels.height(); ++y) {
+        const QRgb *scanLine = reinterpret_cast<const QRgb*>(pixels.constScanLine(y));
+        for (int x = 0; x < pixels.width(); ++x) {
+            if (scanLine[x] == targetPixel)
+                filledPositions.append(QPoint(x, y));
+        }
     }
-    if (tileBounds.contains(west)) {
-        tilesetPixelFloodFill(tile, west, targetColour, replacementColour, filledPositions);
-    } else {
-        qCDebug(lcPixelFloodFill) << west << "is out of bounds" << "( tileBounds =" << tileBounds << ")";
+}
+
+// Returns the id of each tile in project, row by row.
+static QVector<int> tileIds(const TilesetProject *project)
+{
+    QVector<int> ids;
+    ids.reserve(project->tilesWide() * project->tilesHigh());
+    for (int y = 0; y < project->tilesHigh(); ++y) {
+        for (int x = 0; x < project->tilesWide(); ++x)
+            ids.append(project->tileIdAtTilePos(QPoint(x, y)));
     }
+    return ids;
 }
 
-void tilesetTileFloodFill(const TilesetProject *project, const Tile *tile, const QPoint &tilePos,
+void tilesetTileFloodFill(const TilesetProject *project, const QPoint &tilePos,
     int targetTile, int replacementTile, QVector<QPoint> &filledTilePositions)
 {
-    qCDebug(lcTileFloodFill) << "attempting to fill pixel at" << tilePos << "...";
+    qCDebug(lcTileFloodFill) << "attempting to fill starting with tile at" << tilePos << "...";
 
-    if (filledTilePositions.contains(tilePos)) {
-        // This tile has already been filled (would this ever happen?)
-        qCDebug(lcTileFloodFill) << "already filled";
+    if (!project->isTilePosWithinBounds(tilePos)) {
+        qCDebug(lcTileFloodFill) << tilePos << "is out of bounds";
         return;
     }
 
@@ -440,36 +773,33 @@ void tilesetTileFloodFill(const TilesetProject *project, const Tile *tile, const
     }
 
     if (tileIdAtTilePos != targetTile) {
-        qCDebug(lcTileFloodFill) << "hit a different colour; returning";
+        qCDebug(lcTileFloodFill) << "hit a different tile; returning";
         return;
     }
 
-    qCDebug(lcTileFloodFill) << "filling!";
-    filledTilePositions.append(tilePos);
+    const int tilesWide = project->tilesWide();
+    const QVector<int> ids = tileIds(project);
+    QRect filledBounds;
+    const QBitArray filled = spanFloodFill(QSize(tilesWide, project->tilesHigh()), tilePos, [&](int x, int y) {
+        return ids.at(y * tilesWide + x) == targetTile;
+    }, &filledBounds);
+    appendFilledPositions(filled, tilesWide, filledBounds, filledTilePositions);
 
-    const QPoint north = tilePos - QPoint(0, 1);
-    const QPoint south = tilePos + QPoint(0, 1);
-    const QPoint east = tilePos + QPoint(1, 0);
-    const QPoint west = tilePos - QPoint(1, 0);
+    qCDebug(lcTileFloodFill) << "... filled" << filledTilePositions.size() << "tiles within" << filledBounds;
+}
 
-    if (project->isTilePosWithinBounds(north)) {
-        tilesetTileFloodFill(project, tile, north, targetTile, replacementTile, filledTilePositions);
-    } else {
-        qCDebug(lcTileFloodFill) << north << "is out of bounds";
-    }
-    if (project->isTilePosWithinBounds(south)) {
-        tilesetTileFloodFill(project, tile, south, targetTile, replacementTile, filledTilePositions);
-    } else {
-        qCDebug(lcTileFloodFill) << south << "is out of bounds";
-    }
-    if (project->isTilePosWithinBounds(east)) {
-        tilesetTileFloodFill(project, tile, east, targetTile, replacementTile, filledTilePositions);
-    } else {
-        qCDebug(lcTileFloodFill) << east << "is out of bounds";
+void tilesetGreedyTileFill(const TilesetProject *project, int targetTile, int replacementTile,
+    QVector<QPoint> &filledTilePositions)
+{
+    if (targetTile == replacementTile) {
+        qCDebug(lcTileFloodFill) << "target tile is the same as replacement tile; returning";
+        return;
     }
-    if (project->isTilePosWithinBounds(west)) {
-        tilesetTileFloodFill(project, tile, west, targetTile, replacementTile, filledTilePositions);
-    } else {
-        qCDebug(lcTileFloodFill) << west << "is out of bounds";
+
+    const int tilesWide = project->tilesWide();
+    const QVector<int> ids = tileIds(project);
+    for (int i = 0; i < ids.size(); ++i) {
+        if (ids.at(i) == targetTile)
+            filledTilePositions.append(QPoint(i % tilesWide, i / tilesWide));
     }
 }
@@ -20,11 +20,13 @@
 #ifndef FILLALGORITHMS_H
 #define FILLALGORITHMS_H
 
+#include <QBitArray>
+#include <QImage>
+#include <QRect>
 #include <QString>
 #include <QtContainerFwd>
 
 class QColor;
-class QImage;
 class QPoint;
 
 class TexturedFillParameters;
@@ -46,25 +48,84 @@ public:
     // A general "can we do our job given our inputs" check.
     virtual bool canProvideColours() const;
 
+    // True if colour() always returns the base colour, in which case fills
+    // can write the same pixel value everywhere rather than calling it for each pixel.
+    virtual bool providesUniformColour() const;
+
+    // Sets each of the count values in pixels to what an image of the given format
+    // (Format_RGB32, Format_ARGB32 or Format_ARGB32_Premultiplied) would store for a
+    // colour from colour(). Fills use this where they can, as it lets providers
+    // generate a whole span of colours without the per-pixel overhead of colour().
+    virtual void pixels(const QColor &baseColour, QImage::Format format, QRgb *pixels, int count) const;
+
     virtual QString debugName() const;
 };
 
+// The pixels that were filled: the rect that bounds them, and a bit for each pixel
+// within that rect (row by row) that is set if the pixel was filled.
+struct PixelFillMask
+{
+    QRect bounds;
+    QBitArray bits;
+
+    bool isEmpty() const;
+    bool contains(const QPoint &pos) const;
+    int count() const;
+};
+
+// Finds the contiguous area of targetColour pixels that contains startPos,
+// returning an empty mask if nothing should be filled.
+PixelFillMask imagePixelFloodFillMask(const QImage *image, const QPoint &startPos, const QColor &targetColour,
+    const QColor &replacementColour, const FillColourProvider &fillColourProvider = FillColourProvider());
+
+// Returns a copy of the area of image that mask bounds, with each pixel in the mask set to
+// a colour from fillColourProvider.
+QImage maskedPixelFill(const QImage *image, const PixelFillMask &mask, const QColor &replacementColour,
+    const FillColourProvider &fillColourProvider = FillColourProvider());
+
+// Combines imagePixelFloodFillMask() and maskedPixelFill(): sets mask to the pixels that
+// should be filled, and returns the area of image that it bounds with those pixels filled.
+// Returns a null image if nothing should be filled. Use this rather than imagePixelFloodFill()
+// where only the filled area needs to be committed.
+QImage imagePixelFloodFillArea(const QImage *image, const QPoint &startPos, const QColor &targetColour,
+    const QColor &replacementColour, PixelFillMask *mask, const FillColourProvider &fillColourProvider = FillColourProvider());
+
+// Like imagePixelFloodFillArea(), but returns a copy of the whole image.
 QImage imagePixelFloodFill(const QImage *image, const QPoint &startPos, const QColor &targetColour,
     const QColor &replacementColour, const FillColourProvider &fillColourProvider = FillColourProvider());
 
-QImage imageGreedyPixelFill(const QImage *image, const QPoint &startPos, const QColor &targetColour,
+// Replaces every pixel in image that is targetColour, regardless of whether it's contiguous.
+// Returns a null image if no pixels would change.
+QImage imageGreedyPixelFill(const QImage *image, const QColor &targetColour,
     const QColor &replacementColour, const FillColourProvider &fillColourProvider = FillColourProvider());
 
-QImage texturedFill(const QImage *image, const QPoint &startPos,
-    const QColor &targetColour, const QColor &replacementColour, const TexturedFillParameters &parameters);
+// The random colours that textured fills choose are determined by seed,
+// so the same fill with the same seed always produces the same image.
+QImage texturedFill(const QImage *image, const QPoint &startPos, const QColor &targetColour,
+    const QColor &replacementColour, const TexturedFillParameters &parameters, quint32 seed);
+
+// Like imagePixelFloodFillArea(), for textured fills.
+QImage texturedFillArea(const QImage *image, const QPoint &startPos, const QColor &targetColour,
+    const QColor &replacementColour, const TexturedFillParameters &parameters, quint32 seed, PixelFillMask *mask);
 
-QImage greedyTexturedFill(const QImage *image, const QPoint &startPos,
-    const QColor &targetColour, const QColor &replacementColour, const TexturedFillParameters &parameters);
+QImage greedyTexturedFill(const QImage *image, const QColor &targetColour,
+    const QColor &replacementColour, const TexturedFillParameters &parameters, quint32 seed);
 
+// Appends the position (relative to the tile) of each pixel in the contiguous area
+// of targetColour pixels that contains pos.
 void tilesetPixelFloodFill(const Tile *tile, const QPoint &pos, const QColor &targetColour,
     const QColor &replacementColour, QVector<QPoint> &filledPositions);
 
-void tilesetTileFloodFill(const TilesetProject *project, const Tile *tile, const QPoint &tilePos, int targetTile,
+// Appends the position (relative to the tile) of every targetColour pixel in tile.
+void tilesetGreedyPixelFill(const Tile *tile, const QColor &targetColour,
+    const QColor &replacementColour, QVector<QPoint> &filledPositions);
+
+// Appends the position of each tile in the contiguous area of targetTile tiles that contains tilePos.
+void tilesetTileFloodFill(const TilesetProject *project, const QPoint &tilePos, int targetTile,
     int replacementTile, QVector<QPoint> &filledTilePositions);
 
+// Appends the position of every targetTile tile in project.
+void tilesetGreedyTileFill(const TilesetProject *project, int targetTile, int replacementTile,
+    QVector<QPoint> &filledTilePositions);
+
 #endif // FILLALGORITHMS_H
@@ -27,6 +27,8 @@
 #include <QPainter>
 #include <QQmlEngine>
 #include <QQuickWindow>
+#include <QRandomGenerator>
+#include <QScopedValueRollback>
 #include <QtMath>
 
 #include "addguidescommand.h"
@@ -103,6 +105,14 @@ ImageCanvas::ImageCanvas() :
     mGuidePositionBeforePress(0),
     mPressedGuideIndex(-1),
     mPressedNoteIndex(-1),
+    mContentGeneration(0),
+    mCachedContentImageGeneration(0),
+    mCachedContentImageSourceCacheKey(0),
+    mCachedContentImageOverlayHash(0),
+    mCachedExportedContentImageGeneration(0),
+    mCachedExportedContentImageSourceCacheKey(0),
+    mContentMipmapPyramidGeneration(0),
+    mContentMipmapPyramidNeedsFullUpdate(false),
     mCursorX(0),
     mCursorY(0),
     mCursorPaneX(0),
@@ -119,6 +129,7 @@ ImageCanvas::ImageCanvas() :
     mGesturesEnabled(false),
     mTool(PenTool),
     mToolShape(SquareToolShape),
+    mGreedyFillAllLayers(false),
     mLastFillToolUsed(FillTool),
     mToolSize(1),
     mMaxToolSize(100),
@@ -131,11 +142,18 @@ ImageCanvas::ImageCanvas() :
     mIsSelectionFromPaste(false),
     mConfirmingSelectionModification(false),
     mLastSelectionModificationBeforeImageAdjustment(NoSelectionModification),
+    mSelectionHue(0.0),
+    mSelectionSaturation(0.0),
+    mSelectionLightness(0.0),
+    mSelectionAlpha(0.0),
+    mSelectionAlphaAdjustmentFlags(DefaultAlphaAdjustment),
+    mHslPreviewPixelThreshold(1024 * 1024),
     mLastSelectionModification(NoSelectionModification),
     mHasModifiedSelection(false),
     mAltPressed(false),
     mShiftPressed(false),
     mToolBeforeAltPressed(PenTool),
+    mPaintOnContentsModified(true),
     mSpacePressed(false),
     mHasBlankCursor(false)
 {
@@ -591,6 +609,21 @@ void ImageCanvas::setToolShape(const ImageCanvas::ToolShape &toolShape)
     emit toolShapeChanged();
 }
 
+bool ImageCanvas::isGreedyFillAllLayers() const
+{
+    return mGreedyFillAllLayers;
+}
+
+void ImageCanvas::setGreedyFillAllLayers(bool greedyFillAllLayers)
+{
+    if (greedyFillAllLayers == mGreedyFillAllLayers)
+        return;
+
+    mGreedyFillAllLayers = greedyFillAllLayers;
+
+    emit greedyFillAllLayersChanged();
+}
+
 ImageCanvas::Tool ImageCanvas::lastFillToolUsed() const
 {
     return mLastFillToolUsed;
@@ -713,6 +746,16 @@ bool ImageCanvas::isAdjustingImage() const
     return !mSelectionContentsBeforeImageAdjustment.isNull();
 }
 
+qint64 ImageCanvas::hslPreviewPixelThreshold() const
+{
+    return mHslPreviewPixelThreshold;
+}
+
+void ImageCanvas::setHslPreviewPixelThreshold(qint64 pixelThreshold)
+{
+    mHslPreviewPixelThreshold = pixelThreshold;
+}
+
 QColor ImageCanvas::cursorPixelColour() const
 {
     return mCursorPixelColour;
@@ -1004,14 +1047,14 @@ void ImageCanvas::connectSignals()
     qCDebug(lcImageCanvas) << "connecting signals for" << this << "as we have a new project" << mProject;
 
     connect(mProject, SIGNAL(loadedChanged()), this, SLOT(onLoadedChanged()));
-    connect(mProject, SIGNAL(projectCreated()), this, SLOT(requestContentPaint()));
+    connect(mProject, SIGNAL(projectCreated()), this, SLOT(requestChangedContentPaint()));
     connect(mProject, SIGNAL(projectClosed()), this, SLOT(reset()));
-    connect(mProject, SIGNAL(sizeChanged()), this, SLOT(requestContentPaint()));
+    connect(mProject, SIGNAL(sizeChanged()), this, SLOT(requestChangedContentPaint()));
     connect(mProject, SIGNAL(notesChanged()), this, SLOT(onNotesChanged()));
     connect(mProject, SIGNAL(preProjectSaved()), this, SLOT(saveState()));
     connect(mProject, SIGNAL(aboutToBeginMacro(QString)),
         this, SLOT(onAboutToBeginMacro(QString)));
-    connect(mProject, SIGNAL(contentsModified()), this, SLOT(requestContentPaint()));
+    connect(mProject, SIGNAL(contentsModified()), this, SLOT(onContentsModified()));
 
     connect(window(), SIGNAL(activeFocusItemChanged()), this, SLOT(updateWindowCursorShape()));
 }
@@ -1021,14 +1064,14 @@ void ImageCanvas::disconnectSignals()
     qCDebug(lcImageCanvas) << "disconnecting signals for" << this;
 
     mProject->disconnect(SIGNAL(loadedChanged()), this, SLOT(onLoadedChanged()));
-    mProject->disconnect(SIGNAL(projectCreated()), this, SLOT(requestContentPaint()));
+    mProject->disconnect(SIGNAL(projectCreated()), this, SLOT(requestChangedContentPaint()));
     mProject->disconnect(SIGNAL(projectClosed()), this, SLOT(reset()));
-    mProject->disconnect(SIGNAL(sizeChanged()), this, SLOT(requestContentPaint()));
+    mProject->disconnect(SIGNAL(sizeChanged()), this, SLOT(requestChangedContentPaint()));
     mProject->disconnect(SIGNAL(notesChanged()), this, SLOT(onNotesChanged()));
     mProject->disconnect(SIGNAL(preProjectSaved()), this, SLOT(saveState()));
     mProject->disconnect(SIGNAL(aboutToBeginMacro(QString)),
         this, SLOT(onAboutToBeginMacro(QString)));
-    mProject->disconnect(SIGNAL(contentsModified()), this, SLOT(requestContentPaint()));
+    mProject->disconnect(SIGNAL(contentsModified()), this, SLOT(onContentsModified()));
 
     if (window()) {
         window()->disconnect(SIGNAL(activeFocusItemChanged()), this, SLOT(updateWindowCursorShape()));
@@ -1096,24 +1139,123 @@ int ImageCanvas::currentLayerIndex() const
 
 QImage ImageCanvas::contentImage()
 {
-    mCachedContentImage = getContentImage();
+    if (!isContentImageCacheValid()) {
+        qCDebug(lcImageCanvas) << "recreating content image for generation" << mContentGeneration;
+        mCachedContentImage = getContentImage();
+        mCachedContentImageGeneration = mContentGeneration;
+        mCachedContentImageSourceCacheKey = currentProjectImage()->cacheKey();
+        mCachedContentImageOverlayHash = contentImageOverlayHash();
+    }
     return mCachedContentImage;
 }
 
+QImage ImageCanvas::exportedContentImage()
+{
+    if (!isExportedContentImageCacheValid()) {
+        qCDebug(lcImageCanvas) << "recreating exported content image for generation" << mContentGeneration;
+        mCachedExportedContentImage = getExportedContentImage();
+        mCachedExportedContentImageGeneration = mContentGeneration;
+        mCachedExportedContentImageSourceCacheKey = currentProjectImage()->cacheKey();
+    }
+    return mCachedExportedContentImage;
+}
+
+quint64 ImageCanvas::contentGeneration() const
+{
+    return mContentGeneration;
+}
+
+MipmapPyramid &ImageCanvas::contentMipmapPyramid(MipmapPyramid::DownsampleMode downsampleMode)
+{
+    const QImage image = exportedContentImage();
+    // Only throw away the whole pyramid if requestChangedContentPaint() said so.
+    // If the content changed without a paint request at all, we can't know which
+    // parts of the pyramid are stale.
+    if (image.cacheKey() != mContentMipmapPyramid.sourceCacheKey()
+            && (mContentMipmapPyramidNeedsFullUpdate || mContentMipmapPyramidGeneration == mContentGeneration)) {
+        mContentMipmapPyramid.invalidate();
+    }
+
+    mContentMipmapPyramid.setDownsampleMode(downsampleMode);
+    mContentMipmapPyramid.setSourceImage(image);
+    mContentMipmapPyramidGeneration = mContentGeneration;
+    mContentMipmapPyramidNeedsFullUpdate = false;
+    return mContentMipmapPyramid;
+}
+
+bool ImageCanvas::isContentImageCacheValid() const
+{
+    // Checking the cache key catches modifications to the image that we weren't told about.
+    return !mCachedContentImage.isNull() && mCachedContentImageGeneration == mContentGeneration
+        && mCachedContentImageSourceCacheKey == currentProjectImage()->cacheKey()
+        && mCachedContentImageOverlayHash == contentImageOverlayHash();
+}
+
+bool ImageCanvas::isExportedContentImageCacheValid() const
+{
+    return !mCachedExportedContentImage.isNull() && mCachedExportedContentImageGeneration == mContentGeneration
+        && mCachedExportedContentImageSourceCacheKey == currentProjectImage()->cacheKey();
+}
+
+// Returns a hash of the state that determines what getContentImage() draws over
+// the project's image(s), so that e.g. changing the pen colour while the line
+// preview is visible doesn't result in a stale content image.
+size_t ImageCanvas::contentImageOverlayHash() const
+{
+    const bool drawSelectionPreviewImage = shouldDrawSelectionPreviewImage();
+    const bool lineVisible = isLineVisible();
+    size_t hash = qHashMulti(0, drawSelectionPreviewImage, lineVisible,
+        drawSelectionPreviewImage ? mSelectionPreviewImage.cacheKey() : 0);
+    if (lineVisible) {
+        const QPointF point1 = linePoint1();
+        const QPointF point2 = linePoint2();
+        hash = qHashMulti(hash, point1.x(), point1.y(), point2.x(), point2.y(),
+            penColour().rgba(), mToolSize, int(mToolShape));
+    }
+    return hash;
+}
+
+void ImageCanvas::markContentChanged()
+{
+    ++mContentGeneration;
+}
+
 QImage ImageCanvas::getContentImage()
 {
     QImage image = !shouldDrawSelectionPreviewImage() ? *currentProjectImage() : mSelectionPreviewImage;
     // Draw the pixel-pen-line indicator over the content.
     if (isLineVisible()) {
-        QPainter linePainter(&image);
         // Draw the line on top of what has already been painted using a special composition mode.
         // This ensures that e.g. a translucent red overwrites whatever pixels it
         // lies on, rather than blending with them.
-        drawLine(&linePainter, linePoint1(), linePoint2(), QPainter::CompositionMode_Source);
+        drawLine(&image, image.rect(), linePoint1(), linePoint2(), QPainter::CompositionMode_Source);
     }
     return image;
 }
 
+QImage ImageCanvas::getExportedContentImage()
+{
+    return *currentProjectImage();
+}
+
+void ImageCanvas::snapLinePointsToPixelGrid(QPointF *point1, QPointF *point2) const
+{
+    // Offset odd sized pens to pixel centre to centre pen
+    const QPointF penOffset = (mToolSize % 2 == 1) ? QPointF(0.5, 0.5) : QPointF(0.0, 0.0);
+
+    // Snap points to points to pixel grid
+    if (mToolSize > 1) {
+        *point1 = (*point1 + penOffset).toPoint() - penOffset;
+        *point2 = (*point2 + penOffset).toPoint() - penOffset;
+    }
+    else {
+        // Handle inconsitant width 1 pen behaviour, off pixel centres so results in non-ideal asymetrical lines but
+        // would require either redrawing previous segment as part of stroke or custom line function to prevent spurs
+        *point1 = QPointF(qFloor(point1->x()), qFloor(point1->y()));
+        *point2 = QPointF(qFloor(point2->x()), qFloor(point2->y()));
+    }
+}
+
 void ImageCanvas::drawLine(QPainter *painter, QPointF point1, QPointF point2, const QPainter::CompositionMode mode) const
 {
     painter->save();
@@ -1131,20 +1273,7 @@ void ImageCanvas::drawLine(QPainter *painter, QPointF point1, QPointF point2, co
     }
     painter->setPen(pen);
 
-    // Offset odd sized pens to pixel centre to centre pen
-    const QPointF penOffset = (mToolSize % 2 == 1) ? QPointF(0.5, 0.5) : QPointF(0.0, 0.0);
-
-    // Snap points to points to pixel grid
-    if (mToolSize > 1) {
-        point1 = (point1 + penOffset).toPoint() - penOffset;
-        point2 = (point2 + penOffset).toPoint() - penOffset;
-    }
-    else {
-        // Handle inconsitant width 1 pen behaviour, off pixel centres so results in non-ideal asymetrical lines but
-        // would require either redrawing previous segment as part of stroke or custom line function to prevent spurs
-        point1 = QPointF(qFloor(point1.x()), qFloor(point1.y()));
-        point2 = QPointF(qFloor(point2.x()), qFloor(point2.y()));
-    }
+    snapLinePointsToPixelGrid(&point1, &point2);
 
     const QLineF line(point1, point2);
 
@@ -1160,6 +1289,110 @@ void ImageCanvas::drawLine(QPainter *painter, QPointF point1, QPointF point2, co
     painter->restore();
 }
 
+// Draws the line onto image, clipped to clipRect. Lines that rasteriseLine() can draw
+// are written straight into the image, and the rest are drawn with QPainter.
+void ImageCanvas::drawLine(QImage *image, const QRect &clipRect, const QPointF &point1, const QPointF &point2,
+    QPainter::CompositionMode mode) const
+{
+    if (rasteriseLine(image, clipRect, point1, point2, mode))
+        return;
+
+    QPainter painter(image);
+    painter.setClipRect(clipRect);
+    drawLine(&painter, point1, point2, mode);
+}
+
+static void fillPixelRect(QImage *image, const QRect &rect, QRgb pixel)
+{
+    for (int y = rect.top(); y <= rect.bottom(); ++y) {
+        QRgb *scanLine = reinterpret_cast<QRgb*>(image->scanLine(y));
+        std::fill(scanLine + rect.left(), scanLine + rect.right() + 1, pixel);
+    }
+}
+
+// Writes the line straight into the scan lines of image if the pixels that it covers
+// are known exactly, so that the result is identical to what QPainter would draw:
+// - One-pixel-wide lines are drawn by QPainter's cosmetic stroker, which covers both end
+//   points and every pixel between them for horizontal, vertical and diagonal lines.
+// - Square pens of any size cover a rectangle whose edges are on pixel boundaries when
+//   they're horizontal or vertical, as the end points have been snapped to the pixel grid.
+// Every other line (e.g. round pens, or lines at other angles) returns false and
+// should be drawn with QPainter instead.
+bool ImageCanvas::rasteriseLine(QImage *image, const QRect &clipRect, QPointF point1, QPointF point2,
+    QPainter::CompositionMode mode) const
+{
+    if (image->depth() != 32)
+        return false;
+
+    if (mode != QPainter::CompositionMode_Source && mode != QPainter::CompositionMode_Clear)
+        return false;
+
+    snapLinePointsToPixelGrid(&point1, &point2);
+
+    const QRect clip = clipRect.intersected(image->rect());
+
+    if (mToolSize == 1) {
+        const QPoint start = point1.toPoint();
+        const QPoint end = point2.toPoint();
+        const int dx = end.x() - start.x();
+        const int dy = end.y() - start.y();
+        if (dx != 0 && dy != 0 && qAbs(dx) != qAbs(dy))
+            return false;
+
+        const QRgb pixel = linePixelValue(image->format(), mode);
+        if (dx == 0 || dy == 0) {
+            fillPixelRect(image, QRect(start, end).normalized().intersected(clip), pixel);
+            return true;
+        }
+
+        const int xStep = dx > 0 ? 1 : -1;
+        const int yStep = dy > 0 ? 1 : -1;
+        QPoint pos = start;
+        for (int i = 0; i <= qAbs(dx); ++i, pos += QPoint(xStep, yStep)) {
+            if (clip.contains(pos))
+                reinterpret_cast<QRgb*>(image->scanLine(pos.y()))[pos.x()] = pixel;
+        }
+        return true;
+    }
+
+    if (mToolShape != SquareToolShape)
+        return false;
+
+    if (point1.x() != point2.x() && point1.y() != point2.y())
+        return false;
+
+    // Square caps extend the line by half of the pen's width at each end.
+    const qreal halfWidth = mToolSize / 2.0;
+    const QPoint topLeft(qRound(qMin(point1.x(), point2.x()) - halfWidth),
+        qRound(qMin(point1.y(), point2.y()) - halfWidth));
+    const QPoint bottomRight(qRound(qMax(point1.x(), point2.x()) + halfWidth) - 1,
+        qRound(qMax(point1.y(), point2.y()) + halfWidth) - 1);
+    fillPixelRect(image, QRect(topLeft, bottomRight).intersected(clip), linePixelValue(image->format(), mode));
+    return true;
+}
+
+// Returns the value that QPainter writes to pixels that are fully covered by the pen
+// when drawing a line onto an image of the given format with mode.
+QRgb ImageCanvas::linePixelValue(QImage::Format format, QPainter::CompositionMode mode) const
+{
+    const QColor colour = penColour();
+    if (mLinePixelValue.colour != colour || mLinePixelValue.format != format || mLinePixelValue.mode != mode) {
+        QImage pixelImage(1, 1, format);
+        pixelImage.fill(Qt::transparent);
+        QPainter painter(&pixelImage);
+        painter.setCompositionMode(mode);
+        painter.setPen(QPen(colour, 1));
+        painter.drawPoint(0, 0);
+        painter.end();
+
+        mLinePixelValue.colour = colour;
+        mLinePixelValue.format = format;
+        mLinePixelValue.mode = mode;
+        mLinePixelValue.value = *reinterpret_cast<const QRgb*>(pixelImage.constScanLine(0));
+    }
+    return mLinePixelValue.value;
+}
+
 void ImageCanvas::centrePanes(bool respectSceneCentred)
 {
     if (!mProject)
@@ -1521,6 +1754,7 @@ void ImageCanvas::moveSelectionArea()
 {
 //    qCDebug(lcImageCanvasSelection) << "moving selection area... mIsSelectionFromPaste =" << mIsSelectionFromPaste;
 
+    const QRect oldSelectionArea = mSelectionArea;
     QRect newSelectionArea = mSelectionAreaBeforeLastMove;
     const QPoint distanceMoved(mCursorSceneX - mPressScenePosition.x(), mCursorSceneY - mPressScenePosition.y());
     newSelectionArea.translate(distanceMoved);
@@ -1531,7 +1765,7 @@ void ImageCanvas::moveSelectionArea()
 
     setLastSelectionModification(SelectionMove);
 
-    requestContentPaint();
+    requestSelectionMoveContentAreaPaint(oldSelectionArea);
 }
 
 void ImageCanvas::moveSelectionAreaBy(const QPoint &pixelDistance)
@@ -1541,6 +1775,7 @@ void ImageCanvas::moveSelectionAreaBy(const QPoint &pixelDistance)
     // Moving a selection with the directional keys creates a single move command instantly.
     beginSelectionMove();
 
+    const QRect oldSelectionArea = mSelectionArea;
     const QRect newSelectionArea = mSelectionArea.translated(pixelDistance.x(), pixelDistance.y());
     setSelectionArea(boundSelectionArea(newSelectionArea));
 
@@ -1552,8 +1787,14 @@ void ImageCanvas::moveSelectionAreaBy(const QPoint &pixelDistance)
     setMovingSelection(false);
     mLastValidSelectionArea = mSelectionArea;
 
-    // setSelectionArea() should do this anyway, but just in case..
-    requestContentPaint();
+    requestSelectionMoveContentAreaPaint(oldSelectionArea);
+}
+
+void ImageCanvas::requestSelectionMoveContentAreaPaint(const QRect &oldSelectionArea)
+{
+    // The selection preview image differs from the project image in the area
+    // that was left behind, and we also need to clear the contents from the old location.
+    requestContentAreaPaint(oldSelectionArea.united(mSelectionArea).united(mSelectionAreaBeforeFirstModification));
 }
 
 void ImageCanvas::confirmSelectionModification()
@@ -1627,6 +1868,10 @@ void ImageCanvas::clearSelection()
 {
     qCDebug(lcImageCanvasSelection) << "clearing selection";
 
+    // Anything that was only shown in the selection preview image needs to be repainted.
+    if (shouldDrawSelectionPreviewImage())
+        requestContentAreaPaint(mSelectionArea.united(mSelectionAreaBeforeFirstModification));
+
     setSelectionArea(QRect());
     mPotentiallySelecting = false;
     setHasSelection(false);
@@ -1786,7 +2031,7 @@ void ImageCanvas::panWithSelectionIfAtEdge(ImageCanvas::SelectionPanReason reaso
         updateCursorPos(QPoint(mCursorX, mCursorY));
         updateOrMoveSelectionArea();
 
-        requestContentPaint();
+        requestChangedContentPaint();
     } else {
         // If the mouse isn't over the edge, stop the timer.
         mSelectionEdgePanTimer.stop();
@@ -1928,7 +2173,7 @@ void ImageCanvas::reset()
     // TODO: ^ why?
     mToolsForbiddenReason.clear();
 
-    requestContentPaint();
+    requestChangedContentPaint();
 }
 
 void ImageCanvas::centreView()
@@ -2022,7 +2267,7 @@ void ImageCanvas::paste()
     // paste, we must do it ourselves.
     updateSelectionPreviewImage(SelectionPaste);
 
-    requestContentPaint();
+    requestChangedContentPaint();
 }
 
 void ImageCanvas::deleteSelectionOrContents()
@@ -2060,7 +2305,7 @@ void ImageCanvas::flipSelection(Qt::Orientation orientation)
     } else {
         mSelectionContents = mSelectionContents.mirrored(orientation == Qt::Horizontal, orientation == Qt::Vertical);
         updateSelectionPreviewImage(SelectionFlip);
-        requestContentPaint();
+        requestChangedContentPaint();
     }
 }
 
@@ -2099,7 +2344,7 @@ void ImageCanvas::rotateSelection(int angle)
     setLastSelectionModification(SelectionRotate);
 
     updateSelectionPreviewImage(SelectionRotate);
-    requestContentPaint();
+    requestChangedContentPaint();
 }
 
 // How we do HSL modifications:
@@ -2157,16 +2402,59 @@ void ImageCanvas::modifySelectionHsl(qreal hue, qreal saturation, qreal lightnes
         << mSelectionArea << " with h=" << hue << " s=" << saturation << " l=" << lightness << " a=" << alpha
         << "alpha flags=" << alphaAdjustmentFlags;
 
+    mSelectionHue = hue;
+    mSelectionSaturation = saturation;
+    mSelectionLightness = lightness;
+    mSelectionAlpha = alpha;
+    mSelectionAlphaAdjustmentFlags = alphaAdjustmentFlags;
+
+    const QImage &originalContents = mSelectionContentsBeforeImageAdjustment;
+    const qint64 pixelCount = qint64(originalContents.width()) * originalContents.height();
+    if (pixelCount <= mHslPreviewPixelThreshold) {
+        refineSelectionHsl();
+        return;
+    }
+
+    // The selection is large enough that adjusting all of it would make the sliders
+    // in the dialog lag, so adjust a downsampled copy instead and scale it back up.
+    // Once the adjustments stop for a moment, the full resolution contents are adjusted.
+    if (mDownsampledSelectionContentsBeforeImageAdjustment.isNull()) {
+        const int factor = qCeil(qSqrt(qreal(pixelCount) / qMax<qint64>(1, mHslPreviewPixelThreshold)));
+        const QSize downsampledSize(qMax(1, originalContents.width() / factor), qMax(1, originalContents.height() / factor));
+        mDownsampledSelectionContentsBeforeImageAdjustment = originalContents.scaled(
+            downsampledSize, Qt::IgnoreAspectRatio, Qt::FastTransformation);
+    }
+
+    QImage downsampledContents = mDownsampledSelectionContentsBeforeImageAdjustment;
+    ImageUtils::modifyHsl(downsampledContents, hue, saturation, lightness, alpha, alphaAdjustmentFlags);
+    mSelectionContents = downsampledContents.scaled(originalContents.size(), Qt::IgnoreAspectRatio, Qt::FastTransformation);
+
+    // Set this so that the check in shouldDrawSelectionPreviewImage() evaluates to true.
+    setLastSelectionModification(SelectionHsl);
+
+    updateSelectionPreviewImage(SelectionHsl);
+    requestChangedContentPaint();
+
+    static const int refinementDelay = 150;
+    mSelectionHslRefinementTimer.start(refinementDelay, this);
+}
+
+// Applies the last HSL adjustment to the full resolution selection contents.
+void ImageCanvas::refineSelectionHsl()
+{
+    mSelectionHslRefinementTimer.stop();
+
     // Copy the original so we don't just modify the result of the last adjustment (if any).
     mSelectionContents = mSelectionContentsBeforeImageAdjustment;
 
-    ImageUtils::modifyHsl(mSelectionContents, hue, saturation, lightness, alpha, alphaAdjustmentFlags);
+    ImageUtils::modifyHsl(mSelectionContents, mSelectionHue, mSelectionSaturation, mSelectionLightness,
+        mSelectionAlpha, mSelectionAlphaAdjustmentFlags);
 
     // Set this so that the check in shouldDrawSelectionPreviewImage() evaluates to true.
     setLastSelectionModification(SelectionHsl);
 
     updateSelectionPreviewImage(SelectionHsl);
-    requestContentPaint();
+    requestChangedContentPaint();
 }
 
 void ImageCanvas::endModifyingSelectionHsl(AdjustmentAction adjustmentAction)
@@ -2174,10 +2462,14 @@ void ImageCanvas::endModifyingSelectionHsl(AdjustmentAction adjustmentAction)
     qCDebug(lcImageCanvasSelection) << "ended modification of selection's HSL";
 
     if (adjustmentAction == RollbackAdjustment) {
+        mSelectionHslRefinementTimer.stop();
         mSelectionContents = mSelectionContentsBeforeImageAdjustment;
         setLastSelectionModification(mLastSelectionModificationBeforeImageAdjustment);
         updateSelectionPreviewImage(SelectionHsl);
-        requestContentPaint();
+        requestChangedContentPaint();
+    } else if (mSelectionHslRefinementTimer.isActive()) {
+        // Only a preview of the last adjustment has been applied, so apply it properly.
+        refineSelectionHsl();
     } else {
         // Commit the adjustments. We don't need to request a repaint
         // since nothing has changed since the last one.
@@ -2185,6 +2477,7 @@ void ImageCanvas::endModifyingSelectionHsl(AdjustmentAction adjustmentAction)
     }
 
     mSelectionContentsBeforeImageAdjustment = QImage();
+    mDownsampledSelectionContentsBeforeImageAdjustment = QImage();
     emit adjustingImageChanged();
 }
 
@@ -2275,6 +2568,16 @@ void ImageCanvas::cycleFillTools()
     setTool(mLastFillToolUsed == FillTool ? TexturedFillTool : FillTool);
 }
 
+bool ImageCanvas::PixelCandidateData::isEmpty() const
+{
+    return !mask.contains(1);
+}
+
+PackedPixels ImageCanvas::PixelCandidateData::packedPreviousPixels() const
+{
+    return PackedPixels(bounds, mask, previousPixels);
+}
+
 ImageCanvas::PixelCandidateData ImageCanvas::penEraserPixelCandidates(Tool tool) const
 {
     PixelCandidateData candidateData;
@@ -2283,60 +2586,96 @@ ImageCanvas::PixelCandidateData ImageCanvas::penEraserPixelCandidates(Tool tool)
     topLeft = clampToImageBounds(topLeft);
     QPoint bottomRight(qRound(mCursorSceneFX + mToolSize / 2.0), qRound(mCursorSceneFY + mToolSize / 2.0));
     bottomRight = clampToImageBounds(bottomRight);
-    QPoint scenePos(topLeft);
-    for (; scenePos.y() < bottomRight.y(); ++scenePos.ry()) {
-        for (scenePos.rx() = topLeft.x(); scenePos.x() < bottomRight.x(); ++scenePos.rx()) {
-            const QColor previousColour = currentProjectImage()->pixelColor(scenePos);
+    const QRect bounds(topLeft, QSize(bottomRight.x() - topLeft.x(), bottomRight.y() - topLeft.y()));
+    if (bounds.isEmpty())
+        return candidateData;
+
+    // Read the pixels a scan line at a time rather than through pixelColor().
+    const QImage previousImage = currentProjectImage()->copy(bounds).convertToFormat(QImage::Format_ARGB32);
+    candidateData.bounds = bounds;
+    candidateData.mask.resize(bounds.width() * bounds.height());
+    candidateData.previousPixels.resize(bounds.width() * bounds.height());
+    for (int y = 0; y < bounds.height(); ++y) {
+        const QRgb *scanLine = reinterpret_cast<const QRgb*>(previousImage.constScanLine(y));
+        for (int x = 0; x < bounds.width(); ++x) {
+            const int index = y * bounds.width() + x;
+            const QRgb previousPixel = scanLine[x];
+            candidateData.previousPixels[index] = previousPixel;
             // Let the pen tool draw over the same colour, as the line tool requires
             // a press point to start from, which we don't get if we make this a no-op.
-            if (tool == PenTool || (tool == EraserTool && previousColour != QColor(Qt::transparent))) {
-                candidateData.scenePositions.append(scenePos);
-                candidateData.previousColours.append(previousColour);
-            }
+            candidateData.mask[index] = tool == PenTool || (tool == EraserTool && previousPixel != 0);
         }
     }
 
     return candidateData;
 }
 
-QImage ImageCanvas::fillPixels() const
+QImage ImageCanvas::fillPixels(PixelFillMask *mask) const
 {
     const QPoint scenePos = QPoint(mCursorSceneX, mCursorSceneY);
     if (!isWithinImage(scenePos))
         return QImage();
 
     const QColor previousColour = currentProjectImage()->pixelColor(scenePos);
-    return imagePixelFloodFill(currentProjectImage(), scenePos, previousColour, penColour());
+    return imagePixelFloodFillArea(currentProjectImage(), scenePos, previousColour, penColour(), mask);
 }
 
-QImage ImageCanvas::greedyFillPixels() const
+QImage ImageCanvas::texturedFillPixels(PixelFillMask *mask, quint32 seed) const
 {
     const QPoint scenePos = QPoint(mCursorSceneX, mCursorSceneY);
     if (!isWithinImage(scenePos))
         return QImage();
 
     const QColor previousColour = currentProjectImage()->pixelColor(scenePos);
-    return imageGreedyPixelFill(currentProjectImage(), scenePos, previousColour, penColour());
+    return texturedFillArea(currentProjectImage(), scenePos, previousColour, penColour(), mTexturedFillParameters, seed, mask);
 }
 
-QImage ImageCanvas::texturedFillPixels() const
+QVector<int> ImageCanvas::greedyFillLayerIndices() const
 {
-    const QPoint scenePos = QPoint(mCursorSceneX, mCursorSceneY);
-    if (!isWithinImage(scenePos))
-        return QImage();
-
-    const QColor previousColour = currentProjectImage()->pixelColor(scenePos);
-    return texturedFill(currentProjectImage(), scenePos, previousColour, penColour(), mTexturedFillParameters);
+    return { mProject->currentLayerIndex() };
 }
 
-QImage ImageCanvas::greedyTexturedFillPixels() const
+void ImageCanvas::applyGreedyFill(const QString &macroText, bool textured)
 {
     const QPoint scenePos = QPoint(mCursorSceneX, mCursorSceneY);
     if (!isWithinImage(scenePos))
-        return QImage();
+        return;
 
+    // The target colour always comes from the current layer, even when other layers are filled too.
     const QColor previousColour = currentProjectImage()->pixelColor(scenePos);
-    return greedyTexturedFill(currentProjectImage(), scenePos, previousColour, penColour(), mTexturedFillParameters);
+
+    const quint32 seed = textured ? QRandomGenerator::global()->generate() : 0;
+
+    // Each layer gets its own seed so that filling several layers doesn't give them identical noise.
+    // The per-layer seeds are derived from the fill's seed so the whole fill can still be reproduced.
+    QRandomGenerator layerSeedGenerator(seed);
+
+    struct FilledLayerImage {
+        int layerIndex;
+        QImage image;
+        quint32 seed;
+    };
+    QVector<FilledLayerImage> filledLayerImages;
+    const QVector<int> layerIndices = greedyFillLayerIndices();
+    for (const int layerIndex : layerIndices) {
+        const QImage *layerImage = imageForLayerAt(layerIndex);
+        const quint32 layerSeed = textured ? layerSeedGenerator.generate() : 0;
+        const QImage filledImage = textured
+            ? greedyTexturedFill(layerImage, previousColour, penColour(), mTexturedFillParameters, layerSeed)
+            : imageGreedyPixelFill(layerImage, previousColour, penColour());
+        if (!filledImage.isNull())
+            filledLayerImages.append({ layerIndex, filledImage, layerSeed });
+    }
+
+    if (filledLayerImages.isEmpty())
+        return;
+
+    mProject->beginMacro(macroText);
+    for (const FilledLayerImage &filledLayerImage : std::as_const(filledLayerImages)) {
+        mProject->addChange(new ApplyGreedyPixelFillCommand(this, filledLayerImage.layerIndex,
+            *imageForLayerAt(filledLayerImage.layerIndex), filledLayerImage.image, filledLayerImage.seed));
+    }
+    mProject->endMacro();
 }
 
 ImageCanvas::Tool ImageCanvas::effectiveTool() const
@@ -2370,6 +2709,8 @@ void ImageCanvas::applyCurrentTool()
         // Draw the line on top of what has already been painted using a special composition mode.
         // This ensures that e.g. a translucent red overwrites whatever pixels it
         // lies on, rather than blending with them.
+        // The command requests a paint of the area it drew to when it's redone.
+        const QScopedValueRollback<bool> paintOnContentsModifiedRollback(mPaintOnContentsModified, false);
         mProject->addChange(new ApplyPixelLineCommand(this, mProject->currentLayerIndex(), *currentProjectImage(), linePoint1(), linePoint2(),
             mPressScenePositionF, mLastPixelPenPressScenePositionF, QPainter::CompositionMode_Source));
         break;
@@ -2384,29 +2725,24 @@ void ImageCanvas::applyCurrentTool()
     case EraserTool: {
         mProject->beginMacro(QLatin1String("PixelEraserTool"));
         // Draw the line on top of what has already been painted using a special composition mode to erase pixels.
+        const QScopedValueRollback<bool> paintOnContentsModifiedRollback(mPaintOnContentsModified, false);
         mProject->addChange(new ApplyPixelLineCommand(this, mProject->currentLayerIndex(), *currentProjectImage(), linePoint1(), linePoint2(),
             mPressScenePositionF, mLastPixelPenPressScenePositionF, QPainter::CompositionMode_Clear));
         break;
     }
     case FillTool: {
         if (!mShiftPressed) {
-            const QImage filledImage = fillPixels();
-            if (filledImage.isNull())
+            PixelFillMask mask;
+            const QImage filledArea = fillPixels(&mask);
+            if (filledArea.isNull())
                 return;
 
             mProject->beginMacro(QLatin1String("PixelFillTool"));
             mProject->addChange(new ApplyPixelFillCommand(this, mProject->currentLayerIndex(),
-                *currentProjectImage(), filledImage));
+                *currentProjectImage(), mask, filledArea));
              mProject->endMacro();
         } else {
-            const QImage filledImage = greedyFillPixels();
-            if (filledImage.isNull())
-                return;
-
-            mProject->beginMacro(QLatin1String("GreedyPixelFillTool"));
-            mProject->addChange(new ApplyGreedyPixelFillCommand(this, mProject->currentLayerIndex(),
-                *currentProjectImage(), filledImage));
-             mProject->endMacro();
+            applyGreedyFill(QLatin1String("GreedyPixelFillTool"), false);
         }
         break;
     }
@@ -2418,23 +2754,19 @@ void ImageCanvas::applyCurrentTool()
         }
 
         if (!mShiftPressed) {
-            const QImage filledImage = texturedFillPixels();
-            if (filledImage.isNull())
+            // The seed is stored in the command so that the fill can be reproduced.
+            const quint32 seed = QRandomGenerator::global()->generate();
+            PixelFillMask mask;
+            const QImage filledArea = texturedFillPixels(&mask, seed);
+            if (filledArea.isNull())
                 return;
 
             mProject->beginMacro(QLatin1String("PixelTexturedFillTool"));
             mProject->addChange(new ApplyPixelFillCommand(this, mProject->currentLayerIndex(),
-                *currentProjectImage(), filledImage));
+                *currentProjectImage(), mask, filledArea, seed));
              mProject->endMacro();
         } else {
-            const QImage filledImage = greedyTexturedFillPixels();
-            if (filledImage.isNull())
-                return;
-
-            mProject->beginMacro(QLatin1String("GreedyPixelTexturedFillTool"));
-            mProject->addChange(new ApplyGreedyPixelFillCommand(this, mProject->currentLayerIndex(),
-                *currentProjectImage(), filledImage));
-             mProject->endMacro();
+            applyGreedyFill(QLatin1String("GreedyPixelTexturedFillTool"), true);
         }
         break;
     }
@@ -2454,43 +2786,78 @@ void ImageCanvas::applyCurrentTool()
 }
 
 // This function actually operates on the image.
-void ImageCanvas::applyPixelPenTool(int layerIndex, const QPoint &scenePos, const QColor &colour, bool markAsLastRelease)
+void ImageCanvas::applyPixelPenTool(int layerIndex, const QVector<QPoint> &scenePositions, const QVector<QColor> &colours,
+    bool markAsLastRelease)
 {
-    imageForLayerAt(layerIndex)->setPixelColor(scenePos, colour);
+    if (scenePositions.isEmpty())
+        return;
+
+    Q_ASSERT(colours.size() == 1 || colours.size() == scenePositions.size());
+    QImage *image = imageForLayerAt(layerIndex);
+    QRect changedArea;
+    for (int i = 0; i < scenePositions.size(); ++i) {
+        const QPoint &scenePos = scenePositions.at(i);
+        image->setPixelColor(scenePos, colours.size() == 1 ? colours.first() : colours.at(i));
+        changedArea |= QRect(scenePos, QSize(1, 1));
+    }
     if (markAsLastRelease)
-        mLastPixelPenPressScenePositionF = scenePos;
-    requestContentPaint();
+        mLastPixelPenPressScenePositionF = scenePositions.last();
+    requestContentAreaPaint(changedArea);
 }
 
-void ImageCanvas::applyPixelLineTool(int layerIndex, const QImage &lineImage, const QRect &lineRect,
+// Unlike applyPixelPenTool(), this writes whole runs of pixels at a time.
+void ImageCanvas::applyPackedPixels(int layerIndex, const QVector<PackedPixels> &pixelsList, const QColor &colour,
+    bool markAsLastRelease)
+{
+    if (pixelsList.isEmpty())
+        return;
+
+    QImage *image = imageForLayerAt(layerIndex);
+    QRect changedArea;
+    for (const PackedPixels &pixels : pixelsList) {
+        if (colour.isValid())
+            pixels.fill(image, colour, pixels.bounds());
+        else
+            pixels.write(image, pixels.bounds());
+        changedArea |= pixels.bounds();
+    }
+    if (markAsLastRelease)
+        mLastPixelPenPressScenePositionF = pixelsList.last().lastPosition();
+    requestContentAreaPaint(changedArea);
+}
+
+void ImageCanvas::applyPixelLineTool(int layerIndex, const QHash<QPoint, QImage> &tiles, const QRect &changedArea,
     const QPointF &lastPixelPenReleaseScenePosition)
 {
     mLastPixelPenPressScenePositionF = lastPixelPenReleaseScenePosition;
-    QPainter painter(imageForLayerAt(layerIndex));
-    painter.setCompositionMode(QPainter::CompositionMode_Source);
-    painter.drawImage(lineRect, lineImage);
-    requestContentPaint();
+    if (!tiles.isEmpty()) {
+        QPainter painter(imageForLayerAt(layerIndex));
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        for (auto it = tiles.constBegin(); it != tiles.constEnd(); ++it)
+            painter.drawImage(it.key(), it.value());
+    }
+    requestContentAreaPaint(changedArea);
 }
 
 void ImageCanvas::paintImageOntoPortionOfImage(int layerIndex, const QRect &portion, const QImage &replacementImage)
 {
     QImage *image = imageForLayerAt(layerIndex);
     *image = ImageUtils::paintImageOntoPortionOfImage(*image, portion, replacementImage);
-    requestContentPaint();
+    requestContentAreaPaint(portion);
 }
 
 void ImageCanvas::replacePortionOfImage(int layerIndex, const QRect &portion, const QImage &replacementImage)
 {
     QImage *image = imageForLayerAt(layerIndex);
     *image = ImageUtils::replacePortionOfImage(*image, portion, replacementImage);
-    requestContentPaint();
+    requestContentAreaPaint(portion);
 }
 
 void ImageCanvas::erasePortionOfImage(int layerIndex, const QRect &portion)
 {
     QImage *image = imageForLayerAt(layerIndex);
     *image = ImageUtils::erasePortionOfImage(*image, portion);
-    requestContentPaint();
+    requestContentAreaPaint(portion);
 }
 
 void ImageCanvas::replaceImage(int layerIndex, const QImage &replacementImage)
@@ -2498,7 +2865,16 @@ void ImageCanvas::replaceImage(int layerIndex, const QImage &replacementImage)
     // TODO: could ImageCanvas just be a LayeredImageCanvas with one layer?
     QImage *image = imageForLayerAt(layerIndex);
     *image = replacementImage;
-    requestContentPaint();
+    requestChangedContentPaint();
+}
+
+void ImageCanvas::applyImageDelta(int layerIndex, const ImageDelta &delta, ImageDelta::Version version)
+{
+    QImage *image = imageForLayerAt(layerIndex);
+    if (!delta.apply(image, version))
+        return;
+
+    requestContentAreaPaint(delta.bounds());
 }
 
 void ImageCanvas::doFlipSelection(int layerIndex, const QRect &area, Qt::Orientation orientation)
@@ -2518,7 +2894,7 @@ QRect ImageCanvas::doRotateSelection(int layerIndex, const QRect &area, int angl
     // not when they're being undone and redone.
     if (mHasSelection)
         setSelectionArea(rotatedArea);
-    requestContentPaint();
+    requestContentAreaPaint(area.united(rotatedArea));
     return area.united(rotatedArea);
 }
 
@@ -2631,15 +3007,44 @@ void ImageCanvas::requestContentPaint()
     // It's nice to be able to debug where a paint request comes from;
     // that's the only reason that these functions are slots and the signal isn't
     // just emitted immediately instead.
-    // Note that this function can be called for drawing _and_ e.g. panning, zooming, etc.
+    // Note that this function is called for e.g. panning, zooming, etc., so it must
+    // not invalidate anything derived from the content; see requestChangedContentPaint().
     emit contentPaintRequested(-1);
 }
 
+void ImageCanvas::requestChangedContentPaint()
+{
+    // We weren't told which parts changed, so everything derived from the content has to be recreated.
+    markContentChanged();
+    mContentMipmapPyramidNeedsFullUpdate = true;
+    requestContentPaint();
+}
+
 void ImageCanvas::requestPaneContentPaint(int paneIndex)
 {
     emit contentPaintRequested(paneIndex);
 }
 
+void ImageCanvas::requestContentAreaPaint(const QRect &sceneArea)
+{
+    if (sceneArea.isEmpty())
+        return;
+
+    markContentChanged();
+    mContentMipmapPyramid.invalidate(sceneArea);
+    emit contentAreaPaintRequested(sceneArea);
+}
+
+void ImageCanvas::onContentsModified()
+{
+    if (!mPaintOnContentsModified) {
+        markContentChanged();
+        return;
+    }
+
+    requestChangedContentPaint();
+}
+
 void ImageCanvas::updateWindowCursorShape()
 {
     if (!mProject)
@@ -3200,6 +3605,8 @@ void ImageCanvas::hoverMoveEvent(QHoverEvent *event)
     qCDebug(lcImageCanvasHoverEvents) << "hoverMoveEvent:" << event->position();
     QQuickItem::hoverMoveEvent(event);
 
+    const QRect oldLineRect = normalisedLineRect(linePoint1(), linePoint2());
+
     updateCursorPos(event->position().toPoint());
 
     setContainsMouse(true);
@@ -3211,8 +3618,10 @@ void ImageCanvas::hoverMoveEvent(QHoverEvent *event)
 
     updateWindowCursorShape();
 
-    if (mTool == PenTool && mShiftPressed)
-        requestContentPaint();
+    if (mTool == PenTool && mShiftPressed) {
+        // Only the area covered by the line preview before and after the move needs repainting.
+        requestContentAreaPaint(oldLineRect.united(normalisedLineRect(linePoint1(), linePoint2())));
+    }
 }
 
 void ImageCanvas::hoverLeaveEvent(QHoverEvent *event)
@@ -3346,6 +3755,11 @@ void ImageCanvas::focusOutEvent(QFocusEvent *event)
 
 void ImageCanvas::timerEvent(QTimerEvent *event)
 {
+    if (event->timerId() == mSelectionHslRefinementTimer.timerId()) {
+        refineSelectionHsl();
+        return;
+    }
+
     if (event->timerId() != mSelectionEdgePanTimer.timerId()) {
         QQuickItem::timerEvent(event);
         return;
@@ -21,6 +21,7 @@
 #define IMAGECANVAS_H
 
 #include <QBasicTimer>
+#include <QHash>
 #include <QObject>
 #include <QLoggingCategory>
 #include <QPixmap>
@@ -32,6 +33,9 @@
 #include <QPainter>
 
 #include "canvaspane.h"
+#include "imagedelta.h"
+#include "mipmappyramid.h"
+#include "packedpixels.h"
 #include "ruler.h"
 #include "slate-global.h"
 #include "splitter.h"
@@ -45,6 +49,7 @@ class ImageProject;
 class Project;
 class Tile;
 class Tileset;
+struct PixelFillMask;
 
 class SLATE_EXPORT ImageCanvas : public QQuickItem
 {
@@ -89,6 +94,7 @@ class SLATE_EXPORT ImageCanvas : public QQuickItem
     Q_PROPERTY(bool toolsForbidden READ areToolsForbidden NOTIFY toolsForbiddenChanged FINAL)
     Q_PROPERTY(QString toolsForbiddenReason READ toolsForbiddenReason NOTIFY toolsForbiddenChanged FINAL)
     Q_PROPERTY(ToolShape toolShape READ toolShape WRITE setToolShape NOTIFY toolShapeChanged)
+    Q_PROPERTY(bool greedyFillAllLayers READ isGreedyFillAllLayers WRITE setGreedyFillAllLayers NOTIFY greedyFillAllLayersChanged)
     Q_PROPERTY(QColor penForegroundColour READ penForegroundColour WRITE setPenForegroundColour NOTIFY penForegroundColourChanged)
     Q_PROPERTY(QColor penBackgroundColour READ penBackgroundColour WRITE setPenBackgroundColour NOTIFY penBackgroundColourChanged)
     Q_PROPERTY(TexturedFillParameters *texturedFillParameters READ texturedFillParameters CONSTANT FINAL)
@@ -245,6 +251,10 @@ public:
     ToolShape toolShape() const;
     void setToolShape(const ToolShape &toolShape);
 
+    // If true, greedy (shift) fills replace the target colour in every layer rather than just the current one.
+    bool isGreedyFillAllLayers() const;
+    void setGreedyFillAllLayers(bool greedyFillAllLayers);
+
     Tool lastFillToolUsed() const;
 
     int toolSize() const;
@@ -274,6 +284,12 @@ public:
 
     bool isAdjustingImage() const;
 
+    // While adjusting the HSL of selections with more pixels than this, each adjustment is
+    // first shown at a lower resolution and then refined once the adjustments stop for a moment.
+    // Public for auto test access.
+    qint64 hslPreviewPixelThreshold() const;
+    void setHslPreviewPixelThreshold(qint64 pixelThreshold);
+
     bool hasBlankCursor() const;
 
     bool isAltPressed() const;
@@ -300,9 +316,20 @@ public:
     //
     // This function calls getContentImage() and caches the result so that we have
     // cheap lookup of pixel data, which is useful for e.g. mCursorPixelColour.
+    // The cached image is only recreated when the content generation has changed,
+    // so that every pane and SpriteImage can share it without compositing it again.
     //
     // Public for auto test access.
     QImage contentImage();
+    // Like contentImage(), but without the selection and line previews, so that
+    // it's what the project would export. Used by e.g. SpriteImage.
+    QImage exportedContentImage();
+    // Incremented every time the content could have changed.
+    quint64 contentGeneration() const;
+    // A mipmap pyramid of exportedContentImage(), for views that show the content at less
+    // than its natural size. Only the areas that were repainted since it was
+    // last requested are downsampled again.
+    MipmapPyramid &contentMipmapPyramid(MipmapPyramid::DownsampleMode downsampleMode);
 
     Q_INVOKABLE void undo();
 
@@ -378,6 +405,7 @@ signals:
     void currentPaneChanged();
     void toolChanged();
     void toolShapeChanged();
+    void greedyFillAllLayersChanged();
     void lastFillToolUsedChanged();
     void toolSizeChanged();
     void toolsForbiddenChanged();
@@ -404,6 +432,10 @@ signals:
     // paneIndex is the index of the pane that should be redrawn,
     // or -1 for all panes.
     void contentPaintRequested(int paneIndex);
+    // Like contentPaintRequested(), but only the given area (in scene coordinates)
+    // of each pane needs to be redrawn. Used for e.g. pixels drawn by the pen tool,
+    // so that large images don't need to be redrawn in full for every stroke.
+    void contentAreaPaintRequested(const QRect &sceneArea);
 
     void errorOccurred(const QString &errorMessage);
 
@@ -446,7 +478,12 @@ protected slots:
     // but stuff like panning does not, and hence it should use
     // requestPaneContentPaint() and pass a specific index.
     void requestContentPaint();
+    // Like requestContentPaint(), but for when the content itself changed
+    // in a way that isn't limited to a known area (see requestContentAreaPaint()).
+    void requestChangedContentPaint();
     void requestPaneContentPaint(int paneIndex);
+    void requestContentAreaPaint(const QRect &sceneArea);
+    void onContentsModified();
     void updateWindowCursorShape();
     void onZoomLevelChanged();
     void onPaneIntegerOffsetChanged();
@@ -472,26 +509,46 @@ protected:
     friend class FlipImageCanvasSelectionCommand;
     friend class PasteImageCanvasCommand;
 
+    // The pixels that a tool would change, stored as a rectangle of scene positions
+    // rather than individually, so that it can be filled in a scan line at a time.
     struct PixelCandidateData
     {
-        QVector<QPoint> scenePositions;
-        QVector<QColor> previousColours;
+        // The area that the candidates are within, in scene coordinates.
+        QRect bounds;
+        // One value per pixel in bounds (row by row); non-zero if the pixel is a candidate.
+        QVector<uchar> mask;
+        // The ARGB value of each pixel in bounds (row by row) before the tool is applied.
+        QVector<QRgb> previousPixels;
+
+        bool isEmpty() const;
+        PackedPixels packedPreviousPixels() const;
     };
     virtual PixelCandidateData penEraserPixelCandidates(Tool tool) const;
-    QImage fillPixels() const;
-    QImage greedyFillPixels() const;
-    QImage texturedFillPixels() const;
-    QImage greedyTexturedFillPixels() const;
+    // Return the area of the current image that a fill at the cursor changes, with the fill applied,
+    // and set mask to the filled pixels. A null image is returned if nothing would be filled.
+    QImage fillPixels(PixelFillMask *mask) const;
+    QImage texturedFillPixels(PixelFillMask *mask, quint32 seed) const;
+    // The layers that a greedy fill applies to.
+    virtual QVector<int> greedyFillLayerIndices() const;
+    void applyGreedyFill(const QString &macroText, bool textured);
 
     ImageCanvas::Tool effectiveTool() const;
     ImageCanvas::Tool penRightClickTool() const;
     virtual void applyCurrentTool();
-    virtual void applyPixelPenTool(int layerIndex, const QPoint &scenePos, const QColor &colour, bool markAsLastRelease = false);
-    virtual void applyPixelLineTool(int layerIndex, const QImage &lineImage, const QRect &lineRect, const QPointF &lastPixelPenReleaseScenePosition);
+    // colours contains either one colour for each position, or one colour for all of them.
+    virtual void applyPixelPenTool(int layerIndex, const QVector<QPoint> &scenePositions, const QVector<QColor> &colours,
+        bool markAsLastRelease = false);
+    // Writes each of pixelsList into the layer's image in order, or colour in place of each pixel if it's valid.
+    virtual void applyPackedPixels(int layerIndex, const QVector<PackedPixels> &pixelsList, const QColor &colour = QColor(),
+        bool markAsLastRelease = false);
+    // Copies each tile (keyed by its top-left corner) into the layer's image, and repaints changedArea.
+    virtual void applyPixelLineTool(int layerIndex, const QHash<QPoint, QImage> &tiles, const QRect &changedArea,
+        const QPointF &lastPixelPenReleaseScenePosition);
     void paintImageOntoPortionOfImage(int layerIndex, const QRect &portion, const QImage &replacementImage);
     void replacePortionOfImage(int layerIndex, const QRect &portion, const QImage &replacementImage);
     void erasePortionOfImage(int layerIndex, const QRect &portion);
     virtual void replaceImage(int layerIndex, const QImage &replacementImage);
+    void applyImageDelta(int layerIndex, const ImageDelta &delta, ImageDelta::Version version);
     void doFlipSelection(int layerIndex, const QRect &area, Qt::Orientation orientation);
     QRect doRotateSelection(int layerIndex, const QRect &area, int angle);
 
@@ -521,7 +578,18 @@ protected:
     CanvasPane *hoveredPane(const QPoint &pos);
     QPoint eventPosRelativeToCurrentPane(const QPoint &pos);
     virtual QImage getContentImage();
+    virtual bool isContentImageCacheValid() const;
+    virtual QImage getExportedContentImage();
+    virtual bool isExportedContentImageCacheValid() const;
+    size_t contentImageOverlayHash() const;
+    void markContentChanged();
+    void snapLinePointsToPixelGrid(QPointF *point1, QPointF *point2) const;
     void drawLine(QPainter *painter, QPointF point1, QPointF point2, QPainter::CompositionMode mode) const;
+    void drawLine(QImage *image, const QRect &clipRect, const QPointF &point1, const QPointF &point2,
+        QPainter::CompositionMode mode) const;
+    bool rasteriseLine(QImage *image, const QRect &clipRect, QPointF point1, QPointF point2,
+        QPainter::CompositionMode mode) const;
+    QRgb linePixelValue(QImage::Format format, QPainter::CompositionMode mode) const;
     void centrePanes(bool respectSceneCentred = true);
     enum ResetPaneSizePolicy {
         DontResetPaneSizes,
@@ -569,8 +637,10 @@ protected:
     void updateOrMoveSelectionArea();
     void updateSelectionArea();
     void updateSelectionPreviewImage(SelectionModification reason = NoSelectionModification);
+    void refineSelectionHsl();
     void moveSelectionArea();
     void moveSelectionAreaBy(const QPoint &pixelDistance);
+    void requestSelectionMoveContentAreaPaint(const QRect &oldSelectionArea);
     void confirmSelectionModification();
     QRect clampSelectionArea(const QRect &selectionArea) const;
     QRect boundSelectionArea(const QRect &selectionArea) const;
@@ -652,8 +722,23 @@ protected:
     int mPressedGuideIndex;
     int mPressedNoteIndex;
 
-    // Used for setCursorPixelColour().
+    // Used for setCursorPixelColour() and shared between everything that renders the content.
     QImage mCachedContentImage;
+    quint64 mContentGeneration;
+    quint64 mCachedContentImageGeneration;
+    // The cache key of currentProjectImage() when mCachedContentImage was created.
+    qint64 mCachedContentImageSourceCacheKey;
+    // See contentImageOverlayHash().
+    size_t mCachedContentImageOverlayHash;
+    // The same as the members above, but for exportedContentImage().
+    QImage mCachedExportedContentImage;
+    quint64 mCachedExportedContentImageGeneration;
+    qint64 mCachedExportedContentImageSourceCacheKey;
+    MipmapPyramid mContentMipmapPyramid;
+    // The value of mContentGeneration when mContentMipmapPyramid was last updated.
+    quint64 mContentMipmapPyramidGeneration;
+    // Set by requestChangedContentPaint(), which doesn't say what changed.
+    bool mContentMipmapPyramidNeedsFullUpdate;
 
     // The position of the cursor in view coordinates.
     int mCursorX;
@@ -689,9 +774,21 @@ protected:
 
     Tool mTool;
     ToolShape mToolShape;
+    bool mGreedyFillAllLayers;
     Tool mLastFillToolUsed;
     int mToolSize;
     int mMaxToolSize;
+    // The value that linePixelValue() last returned, and what it was for.
+    struct LinePixelValue
+    {
+        QColor colour;
+        QImage::Format format;
+        QPainter::CompositionMode mode;
+        QRgb value;
+
+        LinePixelValue() : format(QImage::Format_Invalid), mode(QPainter::CompositionMode_SourceOver), value(0) {}
+    };
+    mutable LinePixelValue mLinePixelValue;
     QString mToolsForbiddenReason;
     QColor mPenForegroundColour;
     QColor mPenBackgroundColour;
@@ -729,6 +826,17 @@ protected:
     // The last image that was copied from this canvas.
     QImage mLastCopiedSelectionContents;
     SelectionModification mLastSelectionModificationBeforeImageAdjustment;
+    // A downsampled copy of mSelectionContentsBeforeImageAdjustment used to preview
+    // HSL adjustments of large selections.
+    QImage mDownsampledSelectionContentsBeforeImageAdjustment;
+    // The arguments of the last modifySelectionHsl() call, for refineSelectionHsl().
+    qreal mSelectionHue;
+    qreal mSelectionSaturation;
+    qreal mSelectionLightness;
+    qreal mSelectionAlpha;
+    AlphaAdjustmentFlags mSelectionAlphaAdjustmentFlags;
+    qint64 mHslPreviewPixelThreshold;
+    QBasicTimer mSelectionHslRefinementTimer;
     QBasicTimer mSelectionEdgePanTimer;
     // The type of the last modification that was done to the selection.
     SelectionModification mLastSelectionModification;
@@ -738,6 +846,9 @@ protected:
     bool mAltPressed;
     bool mShiftPressed;
     Tool mToolBeforeAltPressed;
+    // False while a command that requests a paint of the area it modified is being added,
+    // as there is then no need to repaint everything when contentsModified() is emitted.
+    bool mPaintOnContentsModified;
     bool mSpacePressed;
     bool mHasBlankCursor;
 };
@@ -0,0 +1,313 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "imagedelta.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "undospillfile.h"
+
+ImageDelta::ImageDelta() :
+    mFormat(QImage::Format_Invalid),
+    mSpilledSpanCount(0),
+    mSpilledPreviousPixelRunCount(0),
+    mSpilledNewPixelRunCount(0)
+{
+}
+
+static bool canStoreAsSpans(const QImage &image)
+{
+    return image.depth() % 8 == 0 && image.depth() <= 32;
+}
+
+static quint32 readPixel(const uchar *line, int x, int bytesPerPixel)
+{
+    quint32 pixel = 0;
+    std::memcpy(&pixel, line + x * bytesPerPixel, bytesPerPixel);
+    return pixel;
+}
+
+ImageDelta::ImageDelta(const QImage &previousImage, const QImage &newImage, const QPoint &offset) :
+    mFormat(newImage.format()),
+    mSpilledSpanCount(0),
+    mSpilledPreviousPixelRunCount(0),
+    mSpilledNewPixelRunCount(0)
+{
+    Q_ASSERT(previousImage.size() == newImage.size());
+    Q_ASSERT(previousImage.format() == newImage.format());
+
+    if (canStoreAsSpans(newImage))
+        storeSpans(previousImage, newImage);
+    else
+        storeAreaCopies(previousImage, newImage);
+
+    // The area copies are relative to the bounds, so only the positions need to be moved.
+    if (!offset.isNull()) {
+        mBounds.translate(offset);
+        for (Span &span : mSpans) {
+            span.x += offset.x();
+            span.y += offset.y();
+        }
+    }
+}
+
+bool ImageDelta::isEmpty() const
+{
+    return mBounds.isEmpty();
+}
+
+QRect ImageDelta::bounds() const
+{
+    return mBounds;
+}
+
+bool ImageDelta::apply(QImage *image, Version version) const
+{
+    if (isEmpty())
+        return true;
+
+    Q_ASSERT(image->rect().contains(mBounds));
+    Q_ASSERT(image->format() == mFormat);
+
+    if (isSpilled()) {
+        QVector<Span> spans;
+        QVector<PixelRun> previousPixelRuns;
+        QVector<PixelRun> newPixelRuns;
+        if (!readSpilledSpans(&spans, &previousPixelRuns, &newPixelRuns))
+            return false;
+
+        writeSpans(image, spans, version == PreviousVersion ? previousPixelRuns : newPixelRuns);
+    } else if (!mSpans.isEmpty()) {
+        writeSpans(image, mSpans, version == PreviousVersion ? mPreviousPixelRuns : mNewPixelRuns);
+    } else {
+        bool restored = false;
+        const QImage areaCopy = (version == PreviousVersion ? mPreviousAreaCopy : mNewAreaCopy).image(&restored);
+        if (!restored)
+            return false;
+
+        writeAreaCopy(image, areaCopy);
+    }
+    return true;
+}
+
+qint64 ImageDelta::byteCount() const
+{
+    return mSpans.size() * qint64(sizeof(Span))
+        + (mPreviousPixelRuns.size() + mNewPixelRuns.size()) * qint64(sizeof(PixelRun))
+        + mPreviousAreaCopy.byteCount() + mNewAreaCopy.byteCount();
+}
+
+bool ImageDelta::isSpilled() const
+{
+    return !mSpillBlock.isNull();
+}
+
+bool ImageDelta::spill(const QSharedPointer<UndoSpillFile> &spillFile)
+{
+    if (isSpilled())
+        return true;
+
+    if (mSpans.isEmpty())
+        return mPreviousAreaCopy.spill(spillFile) && mNewAreaCopy.spill(spillFile);
+
+    const qsizetype spansSize = mSpans.size() * sizeof(Span);
+    const qsizetype previousPixelRunsSize = mPreviousPixelRuns.size() * sizeof(PixelRun);
+    const qsizetype newPixelRunsSize = mNewPixelRuns.size() * sizeof(PixelRun);
+    QByteArray data(spansSize + previousPixelRunsSize + newPixelRunsSize, Qt::Uninitialized);
+    std::memcpy(data.data(), mSpans.constData(), spansSize);
+    std::memcpy(data.data() + spansSize, mPreviousPixelRuns.constData(), previousPixelRunsSize);
+    std::memcpy(data.data() + spansSize + previousPixelRunsSize, mNewPixelRuns.constData(), newPixelRunsSize);
+
+    const QByteArray compressedData = qCompress(data, 1);
+    const QSharedPointer<UndoSpillBlock> spillBlock = spillFile->write(compressedData);
+    if (!spillBlock)
+        return false;
+
+    mSpillBlock = spillBlock;
+    mSpilledSpanCount = mSpans.size();
+    mSpilledPreviousPixelRunCount = mPreviousPixelRuns.size();
+    mSpilledNewPixelRunCount = mNewPixelRuns.size();
+    // clear() keeps the capacity, so assign empty vectors to free the memory.
+    mSpans = QVector<Span>();
+    mPreviousPixelRuns = QVector<PixelRun>();
+    mNewPixelRuns = QVector<PixelRun>();
+    return true;
+}
+
+bool ImageDelta::readSpilledSpans(QVector<Span> *spans, QVector<PixelRun> *previousPixelRuns,
+    QVector<PixelRun> *newPixelRuns) const
+{
+    const uchar *compressedData = mSpillBlock->map();
+    if (!compressedData)
+        return false;
+
+    // qUncompress() returns an empty array if the data is corrupt.
+    const QByteArray data = qUncompress(compressedData, mSpillBlock->size());
+    mSpillBlock->unmap(compressedData);
+
+    const qsizetype spansSize = mSpilledSpanCount * sizeof(Span);
+    const qsizetype previousPixelRunsSize = mSpilledPreviousPixelRunCount * sizeof(PixelRun);
+    const qsizetype newPixelRunsSize = mSpilledNewPixelRunCount * sizeof(PixelRun);
+    if (data.size() != spansSize + previousPixelRunsSize + newPixelRunsSize) {
+        qWarning().nospace() << "Failed to restore spilled image delta with bounds " << mBounds << ": expected "
+            << spansSize + previousPixelRunsSize + newPixelRunsSize << " bytes but got " << data.size();
+        return false;
+    }
+
+    spans->resize(mSpilledSpanCount);
+    std::memcpy(spans->data(), data.constData(), spansSize);
+    previousPixelRuns->resize(mSpilledPreviousPixelRunCount);
+    std::memcpy(previousPixelRuns->data(), data.constData() + spansSize, previousPixelRunsSize);
+    newPixelRuns->resize(mSpilledNewPixelRunCount);
+    std::memcpy(newPixelRuns->data(), data.constData() + spansSize + previousPixelRunsSize, newPixelRunsSize);
+    return true;
+}
+
+void ImageDelta::storeSpans(const QImage &previousImage, const QImage &newImage)
+{
+    const auto appendPixel = [](QVector<PixelRun> &pixelRuns, quint32 pixel) {
+        if (!pixelRuns.isEmpty() && pixelRuns.last().pixel == pixel) {
+            ++pixelRuns.last().count;
+            return;
+        }
+
+        PixelRun pixelRun;
+        pixelRun.pixel = pixel;
+        pixelRun.count = 1;
+        pixelRuns.append(pixelRun);
+    };
+
+    const int width = newImage.width();
+    const int bytesPerPixel = newImage.depth() / 8;
+    const int bytesPerLine = width * bytesPerPixel;
+    for (int y = 0; y < newImage.height(); ++y) {
+        const uchar *previousLine = previousImage.constScanLine(y);
+        const uchar *newLine = newImage.constScanLine(y);
+        if (std::memcmp(previousLine, newLine, bytesPerLine) == 0)
+            continue;
+
+        int x = 0;
+        while (x < width) {
+            // Skip the pixels that didn't change.
+            while (x < width && readPixel(previousLine, x, bytesPerPixel) == readPixel(newLine, x, bytesPerPixel))
+                ++x;
+            if (x == width)
+                break;
+
+            Span span;
+            span.x = x;
+            span.y = y;
+            for (; x < width; ++x) {
+                const quint32 previousPixel = readPixel(previousLine, x, bytesPerPixel);
+                const quint32 newPixel = readPixel(newLine, x, bytesPerPixel);
+                if (previousPixel == newPixel)
+                    break;
+
+                appendPixel(mPreviousPixelRuns, previousPixel);
+                appendPixel(mNewPixelRuns, newPixel);
+            }
+            span.length = x - span.x;
+            mSpans.append(span);
+            mBounds |= QRect(span.x, span.y, span.length, 1);
+        }
+    }
+}
+
+void ImageDelta::storeAreaCopies(const QImage &previousImage, const QImage &newImage)
+{
+    const bool byteAligned = newImage.depth() % 8 == 0;
+    const int bytesPerPixel = newImage.depth() / 8;
+    for (int y = 0; y < newImage.height(); ++y) {
+        const uchar *previousLine = previousImage.constScanLine(y);
+        const uchar *newLine = newImage.constScanLine(y);
+        for (int x = 0; x < newImage.width(); ++x) {
+            const bool changed = byteAligned
+                ? std::memcmp(previousLine + x * bytesPerPixel, newLine + x * bytesPerPixel, bytesPerPixel) != 0
+                : previousImage.pixelIndex(x, y) != newImage.pixelIndex(x, y);
+            if (changed)
+                mBounds |= QRect(x, y, 1, 1);
+        }
+    }
+
+    if (isEmpty())
+        return;
+
+    mPreviousAreaCopy = previousImage.copy(mBounds);
+    mNewAreaCopy = newImage.copy(mBounds);
+}
+
+void ImageDelta::writeSpans(QImage *image, const QVector<Span> &spans, const QVector<PixelRun> &pixelRuns) const
+{
+    const int bytesPerPixel = image->depth() / 8;
+    int runIndex = 0;
+    // How many pixels of the current run have been written.
+    int writtenRunPixelCount = 0;
+    for (const Span &span : spans) {
+        uchar *line = image->scanLine(span.y);
+        int x = span.x;
+        int remainingSpanPixelCount = span.length;
+        while (remainingSpanPixelCount > 0) {
+            const PixelRun &pixelRun = pixelRuns.at(runIndex);
+            const int count = qMin(remainingSpanPixelCount, pixelRun.count - writtenRunPixelCount);
+            if (bytesPerPixel == 4) {
+                std::fill_n(reinterpret_cast<quint32*>(line) + x, count, pixelRun.pixel);
+            } else {
+                for (int i = 0; i < count; ++i)
+                    std::memcpy(line + (x + i) * bytesPerPixel, &pixelRun.pixel, bytesPerPixel);
+            }
+
+            x += count;
+            remainingSpanPixelCount -= count;
+            writtenRunPixelCount += count;
+            if (writtenRunPixelCount == pixelRun.count) {
+                ++runIndex;
+                writtenRunPixelCount = 0;
+            }
+        }
+    }
+}
+
+void ImageDelta::writeAreaCopy(QImage *image, const QImage &areaCopy) const
+{
+    if (image->depth() % 8 != 0) {
+        for (int y = 0; y < mBounds.height(); ++y) {
+            for (int x = 0; x < mBounds.width(); ++x)
+                image->setPixel(mBounds.x() + x, mBounds.y() + y, areaCopy.pixelIndex(x, y));
+        }
+        return;
+    }
+
+    const int bytesPerPixel = image->depth() / 8;
+    for (int y = 0; y < mBounds.height(); ++y) {
+        std::memcpy(image->scanLine(mBounds.y() + y) + mBounds.x() * bytesPerPixel,
+            areaCopy.constScanLine(y), mBounds.width() * bytesPerPixel);
+    }
+}
+
+QDebug operator<<(QDebug debug, const ImageDelta &imageDelta)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "ImageDelta(bounds=" << imageDelta.mBounds
+        << " spans=" << (imageDelta.isSpilled() ? imageDelta.mSpilledSpanCount : imageDelta.mSpans.size())
+        << " spilled=" << imageDelta.isSpilled()
+        << " byteCount=" << imageDelta.byteCount()
+        << ")";
+    return debug;
+}
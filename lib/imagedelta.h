@@ -0,0 +1,120 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEDELTA_H
+#define IMAGEDELTA_H
+
+#include <QDebug>
+#include <QImage>
+#include <QRect>
+#include <QSharedPointer>
+#include <QVector>
+
+#include "slate-global.h"
+#include "undoimage.h"
+
+class UndoSpillBlock;
+class UndoSpillFile;
+
+/*
+    The pixels that differ between two versions of an image, which can be
+    written back into the image to turn one version into the other.
+
+    Each row's changed pixels are stored as spans, and the previous and new
+    values of those pixels are run-length encoded, so e.g. a fill that replaces
+    one colour with another costs a few bytes per row rather than two copies
+    of the whole image. Formats whose pixels are more than 32 bits or less than
+    a byte are instead stored as copies of the changed area.
+
+    The changes can be moved into an UndoSpillFile when they're unlikely
+    to be needed any time soon, in which case they're read back from it
+    each time they're applied.
+*/
+class SLATE_EXPORT ImageDelta
+{
+public:
+    enum Version {
+        PreviousVersion,
+        NewVersion
+    };
+
+    ImageDelta();
+    // previousImage and newImage must have the same size and format. If they're
+    // an area of a larger image, offset is the position of that area within it.
+    ImageDelta(const QImage &previousImage, const QImage &newImage, const QPoint &offset = QPoint());
+
+    bool isEmpty() const;
+    // The bounding rect of the changed pixels.
+    QRect bounds() const;
+
+    // Writes the changed pixels of the given version into image, which must have
+    // the same format as the images we were created from and contain bounds().
+    // Returns false, leaving image as it is, if the changes couldn't be restored.
+    bool apply(QImage *image, Version version) const;
+
+    // The amount of bytes of memory used to store the changes.
+    qint64 byteCount() const;
+
+    bool isSpilled() const;
+    // Compresses the changes and moves them into spillFile.
+    // Returns false (and keeps the changes in memory) if they couldn't be written.
+    bool spill(const QSharedPointer<UndoSpillFile> &spillFile);
+
+private:
+    friend QDebug operator<<(QDebug debug, const ImageDelta &imageDelta);
+
+    struct Span
+    {
+        int x = 0;
+        int y = 0;
+        int length = 0;
+    };
+
+    struct PixelRun
+    {
+        quint32 pixel = 0;
+        int count = 0;
+    };
+
+    void storeSpans(const QImage &previousImage, const QImage &newImage);
+    void storeAreaCopies(const QImage &previousImage, const QImage &newImage);
+    bool readSpilledSpans(QVector<Span> *spans, QVector<PixelRun> *previousPixelRuns,
+        QVector<PixelRun> *newPixelRuns) const;
+    void writeSpans(QImage *image, const QVector<Span> &spans, const QVector<PixelRun> &pixelRuns) const;
+    void writeAreaCopy(QImage *image, const QImage &areaCopy) const;
+
+    QImage::Format mFormat;
+    QRect mBounds;
+
+    QVector<Span> mSpans;
+    QVector<PixelRun> mPreviousPixelRuns;
+    QVector<PixelRun> mNewPixelRuns;
+
+    // Only used for formats that can't be stored as spans.
+    UndoImage mPreviousAreaCopy;
+    UndoImage mNewAreaCopy;
+
+    // Only used when the spans are spilled; they're stored in the file instead of the vectors above.
+    QSharedPointer<UndoSpillBlock> mSpillBlock;
+    int mSpilledSpanCount;
+    int mSpilledPreviousPixelRunCount;
+    int mSpilledNewPixelRunCount;
+};
+
+#endif // IMAGEDELTA_H
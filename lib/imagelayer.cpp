@@ -21,6 +21,7 @@
 
 #include <QBuffer>
 #include <QJsonObject>
+#include <QMetaEnum>
 
 ImageLayer::ImageLayer()
 {
@@ -104,12 +105,27 @@ void ImageLayer::setVisible(bool visible)
     emit visibleChanged();
 }
 
+ImageLayer::BlendMode ImageLayer::blendMode() const
+{
+    return mBlendMode;
+}
+
+void ImageLayer::setBlendMode(BlendMode blendMode)
+{
+    if (blendMode == mBlendMode)
+        return;
+
+    mBlendMode = blendMode;
+    emit blendModeChanged();
+}
+
 ImageLayer *ImageLayer::clone()
 {
     ImageLayer *layer = new ImageLayer;
     layer->setName(mName + QLatin1String(" copy"));
     layer->setVisible(mVisible);
     layer->setOpacity(mOpacity);
+    layer->setBlendMode(mBlendMode);
     layer->mImage = mImage;
     return layer;
 }
@@ -119,6 +135,10 @@ void ImageLayer::read(const QJsonObject &jsonObject)
     setName(jsonObject.value("name").toString());
     setOpacity(jsonObject.value("opacity").toDouble());
     setVisible(jsonObject.value("visible").toBool());
+    // Projects saved before blend modes were added don't have one.
+    const int blendMode = QMetaEnum::fromType<BlendMode>().keyToValue(
+        qPrintable(jsonObject.value("blendMode").toString()));
+    setBlendMode(blendMode != -1 ? static_cast<BlendMode>(blendMode) : NormalBlendMode);
 
     const QString base64ImageData = jsonObject.value("imageData").toString();
     QByteArray imageData = QByteArray::fromBase64(base64ImageData.toLatin1());
@@ -130,6 +150,7 @@ void ImageLayer::write(QJsonObject &jsonObject)
     jsonObject["name"] = mName;
     jsonObject["opacity"] = mOpacity;
     jsonObject["visible"] = mVisible;
+    jsonObject["blendMode"] = QString::fromLatin1(QMetaEnum::fromType<BlendMode>().valueToKey(mBlendMode));
 
     QByteArray imageData;
     QBuffer buffer { &imageData };
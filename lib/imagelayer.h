@@ -27,14 +27,37 @@
 
 class QJsonObject;
 
+/*
+    A layer of a LayeredImageProject.
+
+    The layer's pixels are stored in a single QImage, as the tools paint into
+    image() directly with QPainter and scanLine(). Snapshots of the layer,
+    such as those taken by undo commands and LayerCompositor, share that
+    image until the layer is modified. To avoid holding on to whole copies,
+    commands store only what they change where they can: pen strokes store
+    the tiles they touched (see ApplyPixelLineCommand) and fills store an
+    ImageDelta. Commands that replace the whole image, such as resizing,
+    still store the whole previous image.
+*/
 class SLATE_EXPORT ImageLayer : public QObject
 {
     Q_OBJECT
     Q_PROPERTY(QString name READ name NOTIFY nameChanged)
     Q_PROPERTY(qreal opacity READ opacity NOTIFY opacityChanged)
     Q_PROPERTY(bool visible READ isVisible NOTIFY visibleChanged)
+    Q_PROPERTY(BlendMode blendMode READ blendMode NOTIFY blendModeChanged)
 
 public:
+    // How the layer's pixels are combined with those of the layers below it.
+    enum BlendMode {
+        NormalBlendMode,
+        MultiplyBlendMode,
+        ScreenBlendMode,
+        OverlayBlendMode,
+        AddBlendMode
+    };
+    Q_ENUM(BlendMode)
+
     ImageLayer();
     explicit ImageLayer(QObject *parent, const QImage &image = QImage());
     ~ImageLayer() override;
@@ -54,6 +77,9 @@ public:
     bool isVisible() const;
     void setVisible(bool visible);
 
+    BlendMode blendMode() const;
+    void setBlendMode(BlendMode blendMode);
+
     ImageLayer *clone();
 
     void read(const QJsonObject &jsonObject);
@@ -63,11 +89,13 @@ signals:
     void nameChanged();
     void opacityChanged();
     void visibleChanged();
+    void blendModeChanged();
 
 private:
     QString mName;
     bool mVisible = false;
     qreal mOpacity = 0.0;
+    BlendMode mBlendMode = NormalBlendMode;
     QImage mImage;
 };
 
@@ -26,12 +26,15 @@
 #include <QDir>
 #endif
 #include <QFile>
+#include <QHash>
 #include <QLoggingCategory>
 #include <QPainter>
 #include <QPainterPath>
 #include <QPainterPathStroker>
 #include <QScopeGuard>
+#include <QSemaphore>
 #include <QThread>
+#include <QThreadPool>
 #include <QTransform>
 
 // Need this otherwise we get linker errors.
@@ -367,44 +370,116 @@ QRect ImageUtils::ensureWithinArea(const QRect &rect, const QSize &boundsSize)
     return newArea;
 }
 
+static QColor modifiedHslColour(const QColor &rgb, qreal hue, qreal saturation, qreal lightness, qreal alpha,
+    bool doNotModifyFullyTransparentPixels, bool doNotModifyFullyOpaquePixels)
+{
+    QColor hsl = rgb.toHsl();
+
+    // By default, modify the alpha.
+    bool modifyAlpha = !doNotModifyFullyTransparentPixels && !doNotModifyFullyOpaquePixels;
+    qreal finalAlpha = hsl.alphaF();
+    if (!modifyAlpha) {
+        // At least one of the flags was set, so check further if we should modify.
+        const bool isFullyTransparent = qFuzzyCompare(hsl.alphaF(), 0.0f);
+        const bool isFullyOpaque = qFuzzyCompare(hsl.alphaF(), 1.0f);
+
+        if (doNotModifyFullyTransparentPixels && doNotModifyFullyOpaquePixels)
+            modifyAlpha = !isFullyTransparent && !isFullyOpaque;
+        else if (doNotModifyFullyTransparentPixels)
+            modifyAlpha = !isFullyTransparent;
+        else if (doNotModifyFullyOpaquePixels)
+            modifyAlpha = !isFullyOpaque;
+    }
+    if (modifyAlpha)
+        finalAlpha = hsl.alphaF() + alpha;
+
+    hsl.setHslF(
+        qBound(0.0, hsl.hslHueF() + hue, 1.0),
+        qBound(0.0, hsl.hslSaturationF() + saturation, 1.0),
+        qBound(0.0, hsl.lightnessF() + lightness, 1.0),
+        // Only increase the alpha if it's non-zero to prevent fully transparent
+        // pixels (#00000000) becoming black (#FF000000).
+        qBound(0.0, finalAlpha, 1.0));
+    return hsl.toRgb();
+}
+
 void ImageUtils::modifyHsl(QImage &image, qreal hue, qreal saturation, qreal lightness, qreal alpha,
     ImageCanvas::AlphaAdjustmentFlags alphaAdjustmentFlags)
 {
-    for (int y = 0; y < image.height(); ++y) {
-        for (int x = 0; x < image.width(); ++x) {
-            const QColor rgb = image.pixelColor(x, y);
-            QColor hsl = rgb.toHsl();
-
-            const bool doNotModifyFullyTransparentPixels = alphaAdjustmentFlags.testFlag(ImageCanvas::DoNotModifyFullyTransparentPixels);
-            const bool doNotModifyFullyOpaquePixels = alphaAdjustmentFlags.testFlag(ImageCanvas::DoNotModifyFullyOpaquePixels);
-            // By default, modify the alpha.
-            bool modifyAlpha = !doNotModifyFullyTransparentPixels && !doNotModifyFullyOpaquePixels;
-            qreal finalAlpha = hsl.alphaF();
-            if (!modifyAlpha) {
-                // At least one of the flags was set, so check further if we should modify.
-                const bool isFullyTransparent = qFuzzyCompare(hsl.alphaF(), 0.0f);
-                const bool isFullyOpaque = qFuzzyCompare(hsl.alphaF(), 1.0f);
-
-                if (doNotModifyFullyTransparentPixels && doNotModifyFullyOpaquePixels)
-                    modifyAlpha = !isFullyTransparent && !isFullyOpaque;
-                else if (doNotModifyFullyTransparentPixels)
-                    modifyAlpha = !isFullyTransparent;
-                else if (doNotModifyFullyOpaquePixels)
-                    modifyAlpha = !isFullyOpaque;
+    const bool doNotModifyFullyTransparentPixels = alphaAdjustmentFlags.testFlag(ImageCanvas::DoNotModifyFullyTransparentPixels);
+    const bool doNotModifyFullyOpaquePixels = alphaAdjustmentFlags.testFlag(ImageCanvas::DoNotModifyFullyOpaquePixels);
+    const auto modifiedColour = [=](const QColor &rgb) {
+        return modifiedHslColour(rgb, hue, saturation, lightness, alpha,
+            doNotModifyFullyTransparentPixels, doNotModifyFullyOpaquePixels);
+    };
+
+    if (image.depth() != 32) {
+        for (int y = 0; y < image.height(); ++y) {
+            for (int x = 0; x < image.width(); ++x)
+                image.setPixelColor(x, y, modifiedColour(image.pixelColor(x, y)));
+        }
+        return;
+    }
+
+    // The result for a pixel depends only on its value, and images usually have far fewer
+    // unique colours than pixels, so each unique value is converted once per block of rows
+    // and the result reused. The conversion itself still goes through QColor (via a 1x1 image
+    // of the same format) so that the results are identical to converting every pixel.
+    uchar *bits = image.bits();
+    const qsizetype bytesPerLine = image.bytesPerLine();
+    const int width = image.width();
+    const QImage::Format format = image.format();
+    forEachRowBlock(image.height(), width, [=](int firstRow, int endRow) {
+        QImage pixelImage(1, 1, format);
+        QRgb *pixelImageValue = reinterpret_cast<QRgb*>(pixelImage.bits());
+        QHash<QRgb, QRgb> modifiedPixels;
+        // Neighbouring pixels are often the same, so avoid hashing those.
+        QRgb lastPixel = 0;
+        QRgb lastModifiedPixel = 0;
+        bool hasLastPixel = false;
+        for (int y = firstRow; y < endRow; ++y) {
+            QRgb *pixels = reinterpret_cast<QRgb*>(bits + y * bytesPerLine);
+            for (int x = 0; x < width; ++x) {
+                const QRgb pixel = pixels[x];
+                if (!hasLastPixel || pixel != lastPixel) {
+                    const auto it = modifiedPixels.constFind(pixel);
+                    if (it != modifiedPixels.constEnd()) {
+                        lastModifiedPixel = it.value();
+                    } else {
+                        *pixelImageValue = pixel;
+                        pixelImage.setPixelColor(0, 0, modifiedColour(pixelImage.pixelColor(0, 0)));
+                        lastModifiedPixel = *pixelImageValue;
+                        modifiedPixels.insert(pixel, lastModifiedPixel);
+                    }
+                    lastPixel = pixel;
+                    hasLastPixel = true;
+                }
+                pixels[x] = lastModifiedPixel;
             }
-            if (modifyAlpha)
-                finalAlpha = hsl.alphaF() + alpha;
-
-            hsl.setHslF(
-                qBound(0.0, hsl.hslHueF() + hue, 1.0),
-                qBound(0.0, hsl.hslSaturationF() + saturation, 1.0),
-                qBound(0.0, hsl.lightnessF() + lightness, 1.0),
-                // Only increase the alpha if it's non-zero to prevent fully transparent
-                // pixels (#00000000) becoming black (#FF000000).
-                qBound(0.0, finalAlpha, 1.0));
-            image.setPixelColor(x, y, hsl.toRgb());
         }
+    });
+}
+
+void ImageUtils::forEachRowBlock(int rowCount, int rowLength, const std::function<void(int, int)> &function)
+{
+    // Below this many pixels per block, starting a thread costs more than it saves.
+    static const int minimumBlockPixelCount = 256 * 256;
+    const int maximumBlockCount = qMax(1, int(qint64(rowCount) * rowLength / minimumBlockPixelCount));
+    const int blockCount = qBound(1, QThread::idealThreadCount(), qMin(maximumBlockCount, rowCount));
+    const int rowsPerBlock = (rowCount + blockCount - 1) / blockCount;
+
+    QSemaphore finishedBlocks;
+    int startedBlockCount = 0;
+    for (int firstRow = rowsPerBlock; firstRow < rowCount; firstRow += rowsPerBlock) {
+        const int endRow = qMin(firstRow + rowsPerBlock, rowCount);
+        QThreadPool::globalInstance()->start([&function, &finishedBlocks, firstRow, endRow]() {
+            function(firstRow, endRow);
+            finishedBlocks.release();
+        });
+        ++startedBlockCount;
     }
+    function(0, qMin(rowsPerBlock, rowCount));
+    finishedBlocks.acquire(startedBlockCount);
 }
 
 bool ImageUtils::exportGif(const QImage &gifSourceImage, const QUrl &url, const AnimationPlayback &playback, QString &errorMessage)
@@ -464,27 +539,33 @@ bool ImageUtils::exportGif(const QImage &gifSourceImage, const QUrl &url, const
     return true;
 }
 
-QImage ImageUtils::imageForAnimationFrame(const QImage &sourceImage, const AnimationPlayback &playback, int relativeFrameIndex)
+QRect ImageUtils::rectForAnimationFrame(int sourceImageWidth, const AnimationPlayback &playback, int relativeFrameIndex)
 {
     const Animation *animation = playback.animation();
     const int frameWidth = animation->frameWidth();
     const int frameHeight = animation->frameHeight();
-    const int framesWide = animation->framesWide(sourceImage.width());
-    const int startIndex = animation->startIndex(sourceImage.width());
+    const int framesWide = animation->framesWide(sourceImageWidth);
+    const int startIndex = animation->startIndex(sourceImageWidth);
 
     const int absoluteCurrentIndex = startIndex + relativeFrameIndex;
     const int frameX = (absoluteCurrentIndex % framesWide) * frameWidth;
     const int frameY = (absoluteCurrentIndex / framesWide) * frameHeight;
+    return QRect(frameX, frameY, frameWidth, frameHeight);
+}
 
-    const QImage image = sourceImage.copy(frameX, frameY, frameWidth, frameHeight);
+QImage ImageUtils::imageForAnimationFrame(const QImage &sourceImage, const AnimationPlayback &playback, int relativeFrameIndex)
+{
+    const Animation *animation = playback.animation();
+    const QRect frameRect = rectForAnimationFrame(sourceImage.width(), playback, relativeFrameIndex);
+    const QImage image = sourceImage.copy(frameRect);
     qCDebug(lcUtils).nospace() << "returning image for animation:"
         << " frameX=" << animation->frameX()
         << " frameY=" << animation->frameY()
         << " currentFrameIndex=" << playback.currentFrameIndex()
-        << " x=" << frameX
-        << " y=" << frameY
-        << " w=" << frameWidth
-        << " h=" << frameHeight;
+        << " x=" << frameRect.x()
+        << " y=" << frameRect.y()
+        << " w=" << frameRect.width()
+        << " h=" << frameRect.height();
     return image;
 }
 
@@ -24,6 +24,8 @@
 #include <QImage>
 #include <QRect>
 
+#include <functional>
+
 #include "imagecanvas.h"
 
 class AnimationPlayback;
@@ -50,9 +52,15 @@ namespace ImageUtils {
     SLATE_EXPORT QVector<QImage> pasteAcrossLayers(const QVector<ImageLayer*> &layers,
         const QVector<QImage> &layerImagesBeforeLivePreview, int pasteX, int pasteY, bool onlyPasteIntoVisibleLayers);
 
-    void modifyHsl(QImage &image, qreal hue, qreal saturation, qreal lightness, qreal alpha,
+    // Each unique pixel value is converted once, and blocks of rows are modified in parallel.
+    SLATE_EXPORT void modifyHsl(QImage &image, qreal hue, qreal saturation, qreal lightness, qreal alpha,
         ImageCanvas::AlphaAdjustmentFlags alphaAdjustmentFlags);
 
+    // Calls function(firstRow, endRow) for blocks of rows on the global thread pool (and this thread),
+    // returning once every row has been processed. rowLength is used to avoid starting threads
+    // for blocks too small to benefit from them.
+    SLATE_EXPORT void forEachRowBlock(int rowCount, int rowLength, const std::function<void(int, int)> &function);
+
     void strokeRectWithDashes(QPainter *painter, const QRect &rect);
 
     SLATE_EXPORT QRect ensureWithinArea(const QRect &rect, const QSize &boundsSize);
@@ -69,6 +77,7 @@ namespace ImageUtils {
     QVarLengthArray<unsigned int> findMax256UniqueArgbColours(const QImage &image);
 
     // relativeFrameIndex is the index of the animation relative to animation.startIndex()
+    QRect rectForAnimationFrame(int sourceImageWidth, const AnimationPlayback &playback, int relativeFrameIndex);
     QImage imageForAnimationFrame(const QImage &sourceImage, const AnimationPlayback &playback, int relativeFrameIndex);
     bool exportGif(const QImage &gifSourceImage, const QUrl &url, const AnimationPlayback &playback, QString &errorMessage);
 }
@@ -0,0 +1,164 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "layercompositor.h"
+
+#include <QLoggingCategory>
+
+#include "compositing.h"
+#include "imageutils.h"
+
+Q_LOGGING_CATEGORY(lcLayerCompositor, "app.layerCompositor")
+
+qint64 LayerCompositorSnapshot::pixelCount() const
+{
+    return qint64(size.width()) * size.height() * layers.size();
+}
+
+// Flattens the layers from toIndex (the bottom-most) up to fromIndex, like LayeredImageProject::flattenedImage().
+static QImage flattenedLayers(const LayerCompositorSnapshot &snapshot, int fromIndex, int toIndex)
+{
+    Q_ASSERT(fromIndex >= 0 && fromIndex <= toIndex && toIndex < snapshot.layers.size());
+
+    QImage image = ImageUtils::filledImage(snapshot.size);
+    for (int i = toIndex; i >= fromIndex; --i) {
+        const LayerCompositorSnapshot::Layer &layer = snapshot.layers.at(i);
+        if (!layer.visible || qFuzzyIsNull(layer.opacity))
+            continue;
+
+        Compositing::blend(&image, layer.image, layer.opacity, layer.blendMode);
+    }
+    return image;
+}
+
+LayerCompositorWorker::LayerCompositorWorker(const QAtomicInteger<quint64> &latestRequestedGeneration, QObject *parent) :
+    QObject(parent),
+    mLatestRequestedGeneration(latestRequestedGeneration)
+{
+}
+
+LayerCompositorWorker::~LayerCompositorWorker()
+{
+}
+
+void LayerCompositorWorker::composite(const LayerCompositorSnapshot &snapshot)
+{
+    // Requests are queued, so there could be newer ones behind this one.
+    if (snapshot.generation != mLatestRequestedGeneration.loadAcquire()) {
+        qCDebug(lcLayerCompositor) << "skipping stale request for generation" << snapshot.generation;
+        return;
+    }
+
+    const LayerComposites composites = LayerCompositor::composite(snapshot);
+
+    if (snapshot.generation != mLatestRequestedGeneration.loadAcquire()) {
+        qCDebug(lcLayerCompositor) << "dropping composites for stale generation" << snapshot.generation;
+        return;
+    }
+
+    emit compositesReady(composites);
+}
+
+LayerCompositor::LayerCompositor(QObject *parent) :
+    QObject(parent),
+    mLatestRequestedGeneration(0),
+    mWorker(mLatestRequestedGeneration)
+{
+    qRegisterMetaType<LayerCompositorSnapshot>();
+    qRegisterMetaType<LayerComposites>();
+
+    mWorker.moveToThread(&mWorkerThread);
+
+    connect(&mWorker, &LayerCompositorWorker::compositesReady,
+        this, &LayerCompositor::onWorkerCompositesReady);
+}
+
+LayerCompositor::~LayerCompositor()
+{
+    cancel();
+    mWorkerThread.quit();
+    mWorkerThread.wait();
+}
+
+LayerComposites LayerCompositor::composite(const LayerCompositorSnapshot &snapshot)
+{
+    const int currentIndex = snapshot.currentIndex;
+    const int lastIndex = snapshot.layers.size() - 1;
+    Q_ASSERT(currentIndex >= 0 && currentIndex <= lastIndex);
+
+    LayerComposites composites;
+    composites.generation = snapshot.generation;
+    // Layers with lower indices are drawn on top.
+    composites.layersBelowCurrentImage = currentIndex < lastIndex
+        ? flattenedLayers(snapshot, currentIndex + 1, lastIndex) : ImageUtils::filledImage(snapshot.size);
+    bool layersAboveAreNormal = true;
+    for (int i = currentIndex - 1; i >= 0; --i) {
+        const LayerCompositorSnapshot::Layer &layer = snapshot.layers.at(i);
+        if (layer.visible && !qFuzzyIsNull(layer.opacity) && layer.blendMode != ImageLayer::NormalBlendMode) {
+            layersAboveAreNormal = false;
+            break;
+        }
+    }
+    if (currentIndex > 0 && layersAboveAreNormal) {
+        composites.layersAboveCurrentImage = flattenedLayers(snapshot, 0, currentIndex - 1);
+    } else {
+        for (int i = currentIndex - 1; i >= 0; --i) {
+            const LayerCompositorSnapshot::Layer &layer = snapshot.layers.at(i);
+            if (layer.visible && !qFuzzyIsNull(layer.opacity))
+                composites.layersAboveCurrent.append(layer);
+        }
+    }
+    return composites;
+}
+
+quint64 LayerCompositor::requestComposites(LayerCompositorSnapshot snapshot)
+{
+    snapshot.generation = mLatestRequestedGeneration.fetchAndAddOrdered(1) + 1;
+    qCDebug(lcLayerCompositor) << "requesting composites for generation" << snapshot.generation
+        << "with" << snapshot.layers.size() << "layers";
+
+    if (!mWorkerThread.isRunning())
+        mWorkerThread.start();
+
+    const bool invokeSucceeded = QMetaObject::invokeMethod(&mWorker, "composite",
+        Qt::QueuedConnection, Q_ARG(LayerCompositorSnapshot, snapshot));
+    Q_ASSERT(invokeSucceeded);
+    return snapshot.generation;
+}
+
+void LayerCompositor::cancel()
+{
+    mLatestRequestedGeneration.fetchAndAddOrdered(1);
+}
+
+quint64 LayerCompositor::latestRequestedGeneration() const
+{
+    return mLatestRequestedGeneration.loadAcquire();
+}
+
+void LayerCompositor::onWorkerCompositesReady(const LayerComposites &composites)
+{
+    // A newer request could have been made after the worker finished.
+    if (composites.generation != latestRequestedGeneration()) {
+        qCDebug(lcLayerCompositor) << "dropping composites for stale generation" << composites.generation;
+        return;
+    }
+
+    emit compositesReady(composites);
+}
@@ -0,0 +1,138 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LAYERCOMPOSITOR_H
+#define LAYERCOMPOSITOR_H
+
+#include <QAtomicInteger>
+#include <QImage>
+#include <QMetaType>
+#include <QObject>
+#include <QThread>
+#include <QVector>
+
+#include "imagelayer.h"
+#include "slate-global.h"
+
+/*
+    An immutable copy of everything needed to composite the layers of a project.
+    The images are implicitly shared with the project's layers, so creating a snapshot
+    is cheap, and modifying a layer afterwards detaches it rather than changing the snapshot.
+*/
+struct SLATE_EXPORT LayerCompositorSnapshot
+{
+    struct Layer
+    {
+        QImage image;
+        bool visible = true;
+        qreal opacity = 1.0;
+        ImageLayer::BlendMode blendMode = ImageLayer::NormalBlendMode;
+    };
+
+    // Set by LayerCompositor::requestComposites().
+    quint64 generation = 0;
+    QSize size;
+    int currentIndex = -1;
+    // In the same order as the project's layers; index 0 is the top-most layer.
+    QVector<Layer> layers;
+
+    qint64 pixelCount() const;
+};
+
+struct SLATE_EXPORT LayerComposites
+{
+    quint64 generation = 0;
+    // The layers below and above the current layer, each flattened into one image.
+    QImage layersBelowCurrentImage;
+    // Null if the current layer is the top-most layer, or if layersAboveCurrent is used instead.
+    QImage layersAboveCurrentImage;
+    // Layers that use blend modes other than normal depend on what's below them,
+    // so if any of the layers above the current layer do, they can't be flattened
+    // without it and have to be blended separately on top of it. From bottom to top.
+    QVector<LayerCompositorSnapshot::Layer> layersAboveCurrent;
+};
+
+Q_DECLARE_METATYPE(LayerCompositorSnapshot)
+Q_DECLARE_METATYPE(LayerComposites)
+
+class LayerCompositorWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LayerCompositorWorker(const QAtomicInteger<quint64> &latestRequestedGeneration, QObject *parent = nullptr);
+    ~LayerCompositorWorker() override;
+
+    Q_INVOKABLE void composite(const LayerCompositorSnapshot &snapshot);
+
+signals:
+    void compositesReady(const LayerComposites &composites);
+
+private:
+    const QAtomicInteger<quint64> &mLatestRequestedGeneration;
+};
+
+/*
+    Creates LayerComposites on a worker thread so that compositing
+    a large project doesn't block the GUI thread.
+
+    Only the most recent request matters: requests that are superseded
+    before they've started are skipped, and the results of those that are
+    superseded while compositing are dropped instead of being emitted.
+
+    Only the layers below and above the current layer are composited here.
+    Blending the current layer with them, the line preview and the selection
+    previews are still done on the GUI thread when the content image is
+    recreated, as that's the image that is being drawn on, and waiting for
+    the worker thread would delay the feedback for each stroke. There is no
+    separate frame buffer: the panes keep showing the last content image
+    until the new composites arrive.
+*/
+class SLATE_EXPORT LayerCompositor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LayerCompositor(QObject *parent = nullptr);
+    ~LayerCompositor() override;
+
+    // Composites snapshot on the calling thread.
+    static LayerComposites composite(const LayerCompositorSnapshot &snapshot);
+
+    // Composites snapshot on the worker thread, emitting compositesReady() when it's done,
+    // unless another request is made (or cancel() is called) in the meantime.
+    // Returns the generation that was assigned to the request.
+    quint64 requestComposites(LayerCompositorSnapshot snapshot);
+    // Makes any request that is in progress stale.
+    void cancel();
+    quint64 latestRequestedGeneration() const;
+
+signals:
+    void compositesReady(const LayerComposites &composites);
+
+private slots:
+    void onWorkerCompositesReady(const LayerComposites &composites);
+
+private:
+    QAtomicInteger<quint64> mLatestRequestedGeneration;
+    LayerCompositorWorker mWorker;
+    QThread mWorkerThread;
+};
+
+#endif // LAYERCOMPOSITOR_H
@@ -22,13 +22,19 @@
 #include <QLoggingCategory>
 #include <QPainter>
 
+#include "compositing.h"
 #include "imagelayer.h"
 #include "layeredimageproject.h"
 
 LayeredImageCanvas::LayeredImageCanvas() :
-    mLayeredImageProject(nullptr)
+    mLayeredImageProject(nullptr),
+    mLayerCompositesRequestPending(false),
+    mLayerCompositesInvalidationCount(0),
+    mAsyncCompositingPixelThreshold(4096 * 4096)
 {
     qCDebug(lcImageCanvasLifecycle) << "constructing LayeredImageCanvas" << this;
+
+    connect(&mLayerCompositor, &LayerCompositor::compositesReady, this, &LayeredImageCanvas::onLayerCompositesReady);
 }
 
 LayeredImageCanvas::~LayeredImageCanvas()
@@ -36,13 +42,25 @@ LayeredImageCanvas::~LayeredImageCanvas()
     qCDebug(lcImageCanvasLifecycle) << "destructing LayeredImageCanvas" << this;
 }
 
+qint64 LayeredImageCanvas::asyncCompositingPixelThreshold() const
+{
+    return mAsyncCompositingPixelThreshold;
+}
+
+void LayeredImageCanvas::setAsyncCompositingPixelThreshold(qint64 pixelThreshold)
+{
+    mAsyncCompositingPixelThreshold = pixelThreshold;
+}
+
 void LayeredImageCanvas::onPostLayerAdded(int index)
 {
     ImageLayer *layer = mLayeredImageProject->layerAt(index);
     // TODO: could we move these to LayeredImageProject and save a few connections?
     connect(layer, &ImageLayer::visibleChanged, this, &LayeredImageCanvas::onLayerVisibleChanged);
     connect(layer, &ImageLayer::opacityChanged, this, &LayeredImageCanvas::onLayerOpacityChanged);
-    requestContentPaint();
+    connect(layer, &ImageLayer::blendModeChanged, this, &LayeredImageCanvas::onLayerBlendModeChanged);
+    invalidateLayerComposites();
+    requestChangedContentPaint();
 }
 
 void LayeredImageCanvas::onPreLayerRemoved(int index)
@@ -50,26 +68,31 @@ void LayeredImageCanvas::onPreLayerRemoved(int index)
     ImageLayer *layer = mLayeredImageProject->layerAt(index);
     disconnect(layer, &ImageLayer::visibleChanged, this, &LayeredImageCanvas::onLayerVisibleChanged);
     disconnect(layer, &ImageLayer::opacityChanged, this, &LayeredImageCanvas::onLayerOpacityChanged);
+    disconnect(layer, &ImageLayer::blendModeChanged, this, &LayeredImageCanvas::onLayerBlendModeChanged);
 }
 
 void LayeredImageCanvas::onPostLayerRemoved()
 {
-    requestContentPaint();
+    invalidateLayerComposites();
+    requestChangedContentPaint();
 }
 
 void LayeredImageCanvas::onPostLayerMoved()
 {
-    requestContentPaint();
+    invalidateLayerComposites();
+    requestChangedContentPaint();
 }
 
 void LayeredImageCanvas::onPostLayerImageChanged()
 {
-    requestContentPaint();
+    invalidateLayerComposites();
+    requestChangedContentPaint();
 }
 
 void LayeredImageCanvas::onLayerVisibleChanged()
 {
-    requestContentPaint();
+    invalidateLayerComposites();
+    requestChangedContentPaint();
 
     ImageLayer *layer = qobject_cast<ImageLayer*>(sender());
     if (layer == mLayeredImageProject->currentLayer())
@@ -81,8 +104,20 @@ void LayeredImageCanvas::onLayerOpacityChanged()
     ImageLayer *layer = qobject_cast<ImageLayer*>(sender());
     Q_ASSERT(layer);
     // We don't care about opacity changes of invisible layers.
-    if (layer->isVisible())
-        requestContentPaint();
+    if (layer->isVisible()) {
+        invalidateLayerComposites();
+        requestChangedContentPaint();
+    }
+}
+
+void LayeredImageCanvas::onLayerBlendModeChanged()
+{
+    ImageLayer *layer = qobject_cast<ImageLayer*>(sender());
+    Q_ASSERT(layer);
+    if (layer->isVisible()) {
+        invalidateLayerComposites();
+        requestChangedContentPaint();
+    }
 }
 
 void LayeredImageCanvas::onPreCurrentLayerChanged()
@@ -98,9 +133,25 @@ void LayeredImageCanvas::onPreCurrentLayerChanged()
 
 void LayeredImageCanvas::onPostCurrentLayerChanged()
 {
+    // The layers that are above and below the current layer have changed.
+    invalidateLayerComposites();
     updateWindowCursorShape();
 }
 
+void LayeredImageCanvas::onLayerCompositesReady(const LayerComposites &composites)
+{
+    if (!mLayeredImageProject || !mLayerCompositesRequestPending)
+        return;
+
+    qCDebug(lcImageCanvas) << "received layer composites for generation" << composites.generation;
+    mLayersBelowCurrentImage = composites.layersBelowCurrentImage;
+    mLayersAboveCurrentImage = composites.layersAboveCurrentImage;
+    mLayersAboveCurrent = composites.layersAboveCurrent;
+    mLayerCompositesState = mRequestedLayerCompositesState;
+    mLayerCompositesRequestPending = false;
+    requestChangedContentPaint();
+}
+
 void LayeredImageCanvas::connectSignals()
 {
     ImageCanvas::connectSignals();
@@ -115,7 +166,7 @@ void LayeredImageCanvas::connectSignals()
     connect(mLayeredImageProject, &LayeredImageProject::postLayerImageChanged, this, &LayeredImageCanvas::onPostLayerImageChanged);
     connect(mLayeredImageProject, &LayeredImageProject::preCurrentLayerChanged, this, &LayeredImageCanvas::onPreCurrentLayerChanged);
     connect(mLayeredImageProject, &LayeredImageProject::postCurrentLayerChanged, this, &LayeredImageCanvas::onPostCurrentLayerChanged);
-    connect(mLayeredImageProject, &LayeredImageProject::contentsMoved, this, &LayeredImageCanvas::requestContentPaint);
+    connect(mLayeredImageProject, &LayeredImageProject::contentsMoved, this, &LayeredImageCanvas::requestChangedContentPaint);
 
     // Connect to all existing layers, as onPostLayerAdded() won't get called for them automatically.
     for (int i = 0; i < mLayeredImageProject->layerCount(); ++i) {
@@ -134,9 +185,16 @@ void LayeredImageCanvas::disconnectSignals()
     disconnect(mLayeredImageProject, &LayeredImageProject::postLayerImageChanged, this, &LayeredImageCanvas::onPostLayerImageChanged);
     disconnect(mLayeredImageProject, &LayeredImageProject::preCurrentLayerChanged, this, &LayeredImageCanvas::onPreCurrentLayerChanged);
     disconnect(mLayeredImageProject, &LayeredImageProject::postCurrentLayerChanged, this, &LayeredImageCanvas::onPostCurrentLayerChanged);
-    disconnect(mLayeredImageProject, &LayeredImageProject::contentsMoved, this, &LayeredImageCanvas::requestContentPaint);
+    disconnect(mLayeredImageProject, &LayeredImageProject::contentsMoved, this, &LayeredImageCanvas::requestChangedContentPaint);
 
     mLayeredImageProject = nullptr;
+    mLayerCompositor.cancel();
+    mLayerCompositesRequestPending = false;
+    // Don't show the old project's layers while the new project's are being composited.
+    mLayersBelowCurrentImage = QImage();
+    mLayersAboveCurrentImage = QImage();
+    mLayersAboveCurrent.clear();
+    invalidateLayerComposites();
 }
 
 QImage *LayeredImageCanvas::currentProjectImage()
@@ -159,30 +217,169 @@ int LayeredImageCanvas::currentLayerIndex() const
     return mLayeredImageProject->currentLayerIndex();
 }
 
+QVector<int> LayeredImageCanvas::greedyFillLayerIndices() const
+{
+    if (!isGreedyFillAllLayers())
+        return ImageCanvas::greedyFillLayerIndices();
+
+    QVector<int> layerIndices;
+    layerIndices.reserve(mLayeredImageProject->layerCount());
+    for (int i = 0; i < mLayeredImageProject->layerCount(); ++i)
+        layerIndices.append(i);
+    return layerIndices;
+}
+
 QImage LayeredImageCanvas::getContentImage()
 {
-    return mLayeredImageProject->flattenedImage([=](int index) {
-        QImage layerImage;
-        if (index == mLayeredImageProject->currentLayerIndex()) {
-            if (shouldDrawSelectionPreviewImage()) {
-                layerImage = mSelectionPreviewImage;
-            } else if (isLineVisible()) {
-                layerImage = *mLayeredImageProject->currentLayer()->image();
-                QPainter linePainter(&layerImage);
-                // Draw the line on top of what has already been painted using a special composition mode.
-                // This ensures that e.g. a translucent red overwrites whatever pixels it
-                // lies on, rather than blending with them.
-                drawLine(&linePainter, linePoint1(), linePoint2(), QPainter::CompositionMode_Source);
-            }
-        }
-        return layerImage;
-    });
+    return compositeAroundCurrentLayer(currentLayerContentImage(), mCachedContentImage);
+}
+
+bool LayeredImageCanvas::isContentImageCacheValid() const
+{
+    return ImageCanvas::isContentImageCacheValid() && areLayerCompositesValid();
+}
+
+QImage LayeredImageCanvas::getExportedContentImage()
+{
+    return compositeAroundCurrentLayer(*mLayeredImageProject->currentLayer()->image(), mCachedExportedContentImage);
+}
+
+bool LayeredImageCanvas::isExportedContentImageCacheValid() const
+{
+    return ImageCanvas::isExportedContentImageCacheValid() && areLayerCompositesValid();
+}
+
+// Blends currentLayerImage in between the cached composites of the layers below and above it.
+// lastImage is returned if the composites aren't ready yet.
+QImage LayeredImageCanvas::compositeAroundCurrentLayer(const QImage &currentLayerImage, const QImage &lastImage)
+{
+    if (!areLayerCompositesValid() && !updateLayerComposites()
+            && mLayerCompositesState.currentIndex != mLayeredImageProject->currentLayerIndex()) {
+        // The composites we have were created around a different layer, so blending
+        // the current layer with them would be wrong; show the last frame until the new ones are ready.
+        return lastImage;
+    }
+
+    QImage contentImage = mLayersBelowCurrentImage;
+    const ImageLayer *currentLayer = mLayeredImageProject->currentLayer();
+    if (currentLayer->isVisible() && !qFuzzyIsNull(currentLayer->opacity()))
+        Compositing::blend(&contentImage, currentLayerImage, currentLayer->opacity(), currentLayer->blendMode());
+    if (!mLayersAboveCurrentImage.isNull())
+        Compositing::sourceOver(&contentImage, mLayersAboveCurrentImage);
+    for (const LayerCompositorSnapshot::Layer &layer : std::as_const(mLayersAboveCurrent))
+        Compositing::blend(&contentImage, layer.image, layer.opacity, layer.blendMode);
+    return contentImage;
+}
+
+// Returns the image of the current layer as it should be displayed,
+// which could include e.g. the selection or line previews.
+QImage LayeredImageCanvas::currentLayerContentImage() const
+{
+    if (shouldDrawSelectionPreviewImage())
+        return mSelectionPreviewImage;
+
+    QImage layerImage = *mLayeredImageProject->currentLayer()->image();
+    if (isLineVisible()) {
+        // Draw the line on top of what has already been painted using a special composition mode.
+        // This ensures that e.g. a translucent red overwrites whatever pixels it
+        // lies on, rather than blending with them.
+        drawLine(&layerImage, layerImage.rect(), linePoint1(), linePoint2(), QPainter::CompositionMode_Source);
+    }
+    return layerImage;
+}
+
+bool LayeredImageCanvas::LayerCompositesState::matches(const LayerCompositesState &other) const
+{
+    if (invalidationCount != other.invalidationCount || currentIndex != other.currentIndex
+            || imageCacheKeys.size() != other.imageCacheKeys.size()) {
+        return false;
+    }
+
+    // The current layer isn't part of the composites, so changes to it don't matter.
+    for (int i = 0; i < imageCacheKeys.size(); ++i) {
+        if (i != currentIndex && imageCacheKeys.at(i) != other.imageCacheKeys.at(i))
+            return false;
+    }
+    return true;
+}
+
+void LayeredImageCanvas::invalidateLayerComposites()
+{
+    ++mLayerCompositesInvalidationCount;
+}
+
+LayeredImageCanvas::LayerCompositesState LayeredImageCanvas::currentLayerCompositesState() const
+{
+    LayerCompositesState state;
+    state.invalidationCount = mLayerCompositesInvalidationCount;
+    state.currentIndex = mLayeredImageProject->currentLayerIndex();
+    // QImage's cache key changes whenever it's detached or reassigned, so this lets
+    // us know if any non-current layer was modified without having to listen to every command.
+    state.imageCacheKeys.resize(mLayeredImageProject->layerCount());
+    for (int i = 0; i < mLayeredImageProject->layerCount(); ++i)
+        state.imageCacheKeys[i] = mLayeredImageProject->layerAt(i)->image()->cacheKey();
+    return state;
+}
+
+LayerCompositorSnapshot LayeredImageCanvas::layerCompositorSnapshot() const
+{
+    LayerCompositorSnapshot snapshot;
+    snapshot.size = mLayeredImageProject->size();
+    snapshot.currentIndex = mLayeredImageProject->currentLayerIndex();
+    snapshot.layers.reserve(mLayeredImageProject->layerCount());
+    for (int i = 0; i < mLayeredImageProject->layerCount(); ++i) {
+        const ImageLayer *layer = mLayeredImageProject->layerAt(i);
+        snapshot.layers.append({ *layer->image(), layer->isVisible(), layer->opacity(), layer->blendMode() });
+    }
+    return snapshot;
+}
+
+bool LayeredImageCanvas::areLayerCompositesValid() const
+{
+    return mLayerCompositesState.matches(currentLayerCompositesState());
+}
+
+// Returns true if the composites were updated, or false if they're being updated on the worker thread,
+// in which case onLayerCompositesReady() will be called once they're ready.
+bool LayeredImageCanvas::updateLayerComposites()
+{
+    const LayerCompositesState state = currentLayerCompositesState();
+    const QSize size = mLayeredImageProject->size();
+    const qint64 pixelCount = qint64(size.width()) * size.height() * mLayeredImageProject->layerCount();
+    // We need something to show in the meantime if we're going to composite asynchronously:
+    // either the composites are around the same layer, or we have the last frame.
+    const bool canShowStaleContent = mLayersBelowCurrentImage.size() == size
+        && (mLayerCompositesState.currentIndex == state.currentIndex || mCachedContentImage.size() == size);
+
+    if (!canShowStaleContent || pixelCount <= mAsyncCompositingPixelThreshold) {
+        qCDebug(lcImageCanvas) << "updating layer composites around current layer" << state.currentIndex;
+
+        // Results of any earlier request would be older than these.
+        mLayerCompositor.cancel();
+        mLayerCompositesRequestPending = false;
+
+        const LayerComposites composites = LayerCompositor::composite(layerCompositorSnapshot());
+        mLayersBelowCurrentImage = composites.layersBelowCurrentImage;
+        mLayersAboveCurrentImage = composites.layersAboveCurrentImage;
+        mLayersAboveCurrent = composites.layersAboveCurrent;
+        mLayerCompositesState = state;
+        return true;
+    }
+
+    if (!mLayerCompositesRequestPending || !mRequestedLayerCompositesState.matches(state)) {
+        const quint64 generation = mLayerCompositor.requestComposites(layerCompositorSnapshot());
+        qCDebug(lcImageCanvas) << "requested layer composites around current layer" << state.currentIndex
+            << "for generation" << generation;
+        mRequestedLayerCompositesState = state;
+        mLayerCompositesRequestPending = true;
+    }
+    return false;
 }
 
 void LayeredImageCanvas::replaceImage(int layerIndex, const QImage &replacementImage)
 {
     *mLayeredImageProject->layerAt(layerIndex)->image() = replacementImage;
-    requestContentPaint();
+    requestChangedContentPaint();
 }
 
 void LayeredImageCanvas::updateToolsForbidden()
@@ -21,6 +21,7 @@
 #define LAYEREDIMAGECANVAS_H
 
 #include "imagecanvas.h"
+#include "layercompositor.h"
 #include "slate-global.h"
 
 class LayeredImageProject;
@@ -34,6 +35,13 @@ public:
     LayeredImageCanvas();
     ~LayeredImageCanvas() override;
 
+    // Projects whose layers have more pixels (in total) than this are composited
+    // on a worker thread. Below 4096x4096, compositing on the GUI thread takes
+    // less time than showing stale content until the worker thread is done.
+    // Public for auto test access.
+    qint64 asyncCompositingPixelThreshold() const;
+    void setAsyncCompositingPixelThreshold(qint64 pixelThreshold);
+
 signals:
 
 public slots:
@@ -47,8 +55,10 @@ protected slots:
     void onPostLayerImageChanged();
     void onLayerVisibleChanged();
     void onLayerOpacityChanged();
+    void onLayerBlendModeChanged();
     void onPreCurrentLayerChanged();
     void onPostCurrentLayerChanged();
+    void onLayerCompositesReady(const LayerComposites &composites);
 
 protected:
     void connectSignals() override;
@@ -58,13 +68,54 @@ protected:
     QImage *imageForLayerAt(int layerIndex) override;
     int currentLayerIndex() const override;
     QImage getContentImage() override;
+    bool isContentImageCacheValid() const override;
+    QImage getExportedContentImage() override;
+    bool isExportedContentImageCacheValid() const override;
 
     void replaceImage(int layerIndex, const QImage &replacementImage) override;
 
     void updateToolsForbidden() override;
 
+    QVector<int> greedyFillLayerIndices() const override;
+
 private:
+    // What the layer composites were created from.
+    struct LayerCompositesState
+    {
+        quint64 invalidationCount = 0;
+        int currentIndex = -1;
+        // The cache keys of every layer's image at the time the composites were created.
+        // Used to catch modifications to non-current layers (e.g. through undo) that we weren't notified of.
+        QVector<qint64> imageCacheKeys;
+
+        bool matches(const LayerCompositesState &other) const;
+    };
+
+    QImage currentLayerContentImage() const;
+    QImage compositeAroundCurrentLayer(const QImage &currentLayerImage, const QImage &lastImage);
+    void invalidateLayerComposites();
+    LayerCompositesState currentLayerCompositesState() const;
+    LayerCompositorSnapshot layerCompositorSnapshot() const;
+    bool areLayerCompositesValid() const;
+    bool updateLayerComposites();
+
     LayeredImageProject *mLayeredImageProject;
+
+    // The layers below and above the current layer, flattened so that
+    // painting only needs to blend three images regardless of the layer count.
+    // The current layer is blended separately, as it's the one that is being drawn on.
+    // These are only ever replaced as a whole, so while new composites are being
+    // created on the worker thread, we keep painting with these ones.
+    QImage mLayersBelowCurrentImage;
+    QImage mLayersAboveCurrentImage;
+    QVector<LayerCompositorSnapshot::Layer> mLayersAboveCurrent;
+    LayerCompositesState mLayerCompositesState;
+    // The state of the latest request made to mLayerCompositor.
+    LayerCompositesState mRequestedLayerCompositesState;
+    bool mLayerCompositesRequestPending;
+    quint64 mLayerCompositesInvalidationCount;
+    qint64 mAsyncCompositingPixelThreshold;
+    LayerCompositor mLayerCompositor;
 };
 
 #endif // LAYEREDIMAGECANVAS_H
@@ -23,12 +23,12 @@
 
 #include <QJsonArray>
 #include <QJsonDocument>
-#include <QPainter>
 #include <QRegularExpression>
 
 #include "addanimationcommand.h"
 #include "addlayercommand.h"
 #include "changeanimationordercommand.h"
+#include "changelayerblendmodecommand.h"
 #include "changelayeredimagesizecommand.h"
 #include "changelayeredimagecanvassizecommand.h"
 #include "changelayernamecommand.h"
@@ -36,6 +36,7 @@
 #include "changelayerordercommand.h"
 #include "changelayervisiblecommand.h"
 #include "clipboard.h"
+#include "compositing.h"
 #include "deleteanimationcommand.h"
 #include "deletelayercommand.h"
 #include "duplicateanimationcommand.h"
@@ -186,13 +187,11 @@ QImage LayeredImageProject::flattenedImage(int fromIndex, int toIndex, const std
 {
     Q_ASSERT(isValidIndex(fromIndex));
     Q_ASSERT(isValidIndex(toIndex));
-    // If there's only one layer, the from and to indices will be the same.
-    if (fromIndex != 0 && toIndex != 0)
-        Q_ASSERT(fromIndex < toIndex);
+    // If there's only one layer (or we're flattening a single layer), the from and to indices will be the same.
+    Q_ASSERT(fromIndex <= toIndex);
 
     QImage finalImage = ImageUtils::filledImage(size());
 
-    QPainter painter(&finalImage);
     // Work backwards from the last layer so that it gets drawn at the "bottom".
     for (int i = toIndex; i >= fromIndex; --i) {
         const ImageLayer *layer = layerAt(i);
@@ -206,7 +205,7 @@ QImage LayeredImageProject::flattenedImage(int fromIndex, int toIndex, const std
         if (layerImage.isNull()) {
             layerImage = *layer->image();
         }
-        painter.drawImage(0, 0, layerImage);
+        Compositing::blend(&finalImage, layerImage, layer->opacity(), layer->blendMode());
     }
 
     return finalImage;
@@ -233,7 +232,7 @@ static bool shouldDraw(const ImageLayer *layer, const QString &layerFileName)
         return false;
     }
 
-    // On the other hand, all types of layer respect opacity (if/when we add support for it).
+    // On the other hand, all types of layer respect opacity.
     if (qFuzzyIsNull(layer->opacity())) {
         qCDebug(lcProject) << "  - layer" << layer->name() << "has 0 opacity; removing from remaining layers";
         return false;
@@ -291,12 +290,10 @@ QHash<QString, QImage> LayeredImageProject::flattenedImages() const
         // The final image that contains all of the matching layers combined.
         QImage finalImage = ImageUtils::filledImage(size());
 
-        QPainter painter(&finalImage);
         if (shouldDraw(layer, targetFileName)) {
             // Draw the last layer's image.
             qCDebug(lcProject) << "  - drawing bottom layer" << layer->name();
-            QImage layerImage = *layer->image();
-            painter.drawImage(0, 0, layerImage);
+            Compositing::blend(&finalImage, *layer->image(), layer->opacity(), layer->blendMode());
         }
 
         // Now we're going to go through every layer looking for that file name.
@@ -325,8 +322,7 @@ QHash<QString, QImage> LayeredImageProject::flattenedImages() const
             }
 
             qCDebug(lcProject) << "  - drawing layer" << layer->name();
-            QImage layerImage = *layer->image();
-            painter.drawImage(0, 0, layerImage);
+            Compositing::blend(&finalImage, *layer->image(), layer->opacity(), layer->blendMode());
 
             remainingLayers.removeAt(i);
         }
@@ -359,9 +355,19 @@ QVector<QImage> LayeredImageProject::layerImages() const
     return images;
 }
 
+QImage LayeredImageProject::layerImageBeforeLivePreview(int layerIndex) const
+{
+    // Layers that haven't been modified by the live preview still have their original image.
+    return mLayerImagesBeforeLivePreview.value(layerIndex, *mLayers.at(layerIndex)->image());
+}
+
 QVector<QImage> LayeredImageProject::layerImagesBeforeLivePreview() const
 {
-    return mLayerImagesBeforeLivePreview;
+    QVector<QImage> images;
+    images.reserve(mLayers.size());
+    for (int i = 0; i < mLayers.size(); ++i)
+        images.append(layerImageBeforeLivePreview(i));
+    return images;
 }
 
 bool LayeredImageProject::isAutoExportEnabled() const
@@ -466,11 +472,9 @@ void LayeredImageProject::beginLivePreview()
         return;
     }
 
-    // We could do this stuff lazily (when the first modification is made),
-    // but it's better to have any delay from copying happen when
-    // the dialog opens instead of as the sliders etc. are being interacted with.
-
-    mLayerImagesBeforeLivePreview = layerImages();
+    // The original image of each layer is recorded lazily in makeLivePreviewModification(),
+    // so that opening a dialog doesn't cost anything for layers that are never modified.
+    Q_ASSERT(mLayerImagesBeforeLivePreview.isEmpty());
 
     mLivePreviewActive = true;
 
@@ -504,28 +508,38 @@ void LayeredImageProject::endLivePreview(LivePreviewModificationAction modificat
         // Live preview does modifications directly to the project's images,
         // bypassing the undo framework until the changes are confirmed.
         // The undo commands still need to know the old and new images, though,
-        // so we gather them here.
-        const QVector<QImage> newImages = layerImages();
+        // so we gather them here. Layers whose image wasn't changed get a null
+        // image in both lists, so that the commands don't store anything for them.
+        QVector<QImage> previousImages(mLayers.size());
+        QVector<QImage> newImages(mLayers.size());
+        for (auto it = mLayerImagesBeforeLivePreview.cbegin(); it != mLayerImagesBeforeLivePreview.cend(); ++it) {
+            const QImage newImage = *mLayers.at(it.key())->image();
+            if (newImage.cacheKey() == it.value().cacheKey())
+                continue;
+
+            previousImages[it.key()] = it.value();
+            newImages[it.key()] = newImage;
+        }
 
         switch (mCurrentLivePreviewModification) {
         case LivePreviewModification::Resize:
             beginMacro(QLatin1String("ChangeLayeredImageSize"));
-            addChange(new ChangeLayeredImageSizeCommand(this, mLayerImagesBeforeLivePreview, newImages));
+            addChange(new ChangeLayeredImageSizeCommand(this, previousImages, newImages));
             endMacro();
             break;
         case LivePreviewModification::MoveContents:
             beginMacro(QLatin1String("MoveLayeredImageContents"));
-            addChange(new MoveLayeredImageContentsCommand(this, mLayerImagesBeforeLivePreview, newImages));
+            addChange(new MoveLayeredImageContentsCommand(this, previousImages, newImages));
             endMacro();
             break;
         case LivePreviewModification::RearrangeContentsIntoGrid:
             beginMacro(QLatin1String("RearrangeLayeredImageContentsIntoGrid"));
-            addChange(new RearrangeLayeredImageContentsIntoGridCommand(this, mLayerImagesBeforeLivePreview, newImages));
+            addChange(new RearrangeLayeredImageContentsIntoGridCommand(this, previousImages, newImages));
             endMacro();
             break;
         case LivePreviewModification::PasteAcrossLayers:
             beginMacro(QLatin1String("PasteAcrossLayers"));
-            addChange(new PasteAcrossLayersCommand(this, mLayerImagesBeforeLivePreview, newImages));
+            addChange(new PasteAcrossLayersCommand(this, previousImages, newImages));
             endMacro();
             break;
         case LivePreviewModification::None:
@@ -534,10 +548,8 @@ void LayeredImageProject::endLivePreview(LivePreviewModificationAction modificat
         }
     } else {
         // The dialog was cancelled.
-        for (int i = 0; i < mLayers.size(); ++i) {
-            ImageLayer *layer = mLayers.at(i);
-            *layer->image() = mLayerImagesBeforeLivePreview.at(i);
-        }
+        for (auto it = mLayerImagesBeforeLivePreview.cbegin(); it != mLayerImagesBeforeLivePreview.cend(); ++it)
+            *mLayers.at(it.key())->image() = it.value();
 
         // The canvas needs to repaint if the dialog was cancelled, since
         // we're modifying the contents directly.
@@ -777,8 +789,8 @@ void LayeredImageProject::resize(int width, int height, bool smooth)
     QVector<QImage> newImages;
     newImages.reserve(mLayers.size());
 
-    for (const QImage &originalLayerImage : std::as_const(mLayerImagesBeforeLivePreview)) {
-        const QImage resized = ImageUtils::resizeContents(originalLayerImage, newSize, smooth);
+    for (int layerIndex = 0; layerIndex < mLayers.size(); ++layerIndex) {
+        const QImage resized = ImageUtils::resizeContents(layerImageBeforeLivePreview(layerIndex), newSize, smooth);
         newImages.append(resized);
     }
 
@@ -823,10 +835,10 @@ void LayeredImageProject::moveContents(int xDistance, int yDistance, bool onlyVi
     QVector<QImage> newImages;
     for (int layerIndex = 0; layerIndex < mLayers.size(); ++layerIndex) {
         const bool layerVisible = mLayers.at(layerIndex)->isVisible();
-        const QImage oldImage = mLayerImagesBeforeLivePreview.at(layerIndex);
+        const QImage oldImage = layerImageBeforeLivePreview(layerIndex);
         if (onlyVisibleContents && !layerVisible) {
-            // This is lazy and inefficient (we could e.g. store a null QImage),
-            // but it avoids adding more code paths elsewhere.
+            // The layer keeps its original image, so it won't be recorded
+            // as modified nor stored in the undo command.
             newImages.append(oldImage);
         } else {
             newImages.append(ImageUtils::moveContents(oldImage, xDistance, yDistance));
@@ -845,7 +857,7 @@ void LayeredImageProject::rearrangeContentsIntoGrid(int cellWidth, int cellHeigh
         return;
 
     const QVector<QImage> newImages = ImageUtils::rearrangeContentsIntoGrid(
-        mLayerImagesBeforeLivePreview, cellWidth, cellHeight, columns, rows);
+        layerImagesBeforeLivePreview(), cellWidth, cellHeight, columns, rows);
     makeLivePreviewModification(LivePreviewModification::MoveContents, newImages);
 }
 
@@ -972,6 +984,16 @@ void LayeredImageProject::setLayerOpacity(int layerIndex, qreal opacity)
     endMacro();
 }
 
+void LayeredImageProject::setLayerBlendMode(int layerIndex, ImageLayer::BlendMode blendMode)
+{
+    if (!isValidIndex(layerIndex) || blendMode == layerAt(layerIndex)->blendMode())
+        return;
+
+    beginMacro(QLatin1String("ChangeLayerBlendModeCommand"));
+    addChange(new ChangeLayerBlendModeCommand(this, layerIndex, layerAt(layerIndex)->blendMode(), blendMode));
+    endMacro();
+}
+
 void LayeredImageProject::copyAcrossLayers(const QRect &copyArea)
 {
     QVector<QImage> copiedImages;
@@ -993,7 +1015,7 @@ void LayeredImageProject::pasteAcrossLayers(int pasteX, int pasteY, bool onlyPas
     if (pasteX == 0 && pasteY == 0)
         return;
 
-    const QVector<QImage> newImages = ImageUtils::pasteAcrossLayers(mLayers, mLayerImagesBeforeLivePreview,
+    const QVector<QImage> newImages = ImageUtils::pasteAcrossLayers(mLayers, layerImagesBeforeLivePreview(),
         pasteX, pasteY, onlyPasteIntoVisibleLayers);
     makeLivePreviewModification(LivePreviewModification::PasteAcrossLayers, newImages);
 }
@@ -1056,6 +1078,14 @@ void LayeredImageProject::makeLivePreviewModification(LivePreviewModification mo
 
     Q_ASSERT(newImages.size() == mLayers.size());
 
+    // Record the original image of each layer the first time it's replaced.
+    // Layers whose image is shared with the one they already have aren't modified.
+    for (int i = 0; i < newImages.size(); ++i) {
+        const QImage *currentImage = mLayers.at(i)->image();
+        if (newImages.at(i).cacheKey() != currentImage->cacheKey() && !mLayerImagesBeforeLivePreview.contains(i))
+            mLayerImagesBeforeLivePreview.insert(i, *currentImage);
+    }
+
     assignNewImagesToLayers(newImages);
 
     // Let the canvas know that it should repaint.
@@ -1066,7 +1096,9 @@ void LayeredImageProject::assignNewImagesToLayers(const QVector<QImage> &newImag
 {
     for (int i = 0; i < newImages.size(); ++i) {
         const QImage newImage = newImages.at(i);
-        Q_ASSERT(!newImage.isNull());
+        // Live preview commands use null images for the layers they didn't modify.
+        if (newImage.isNull())
+            continue;
 
         ImageLayer *layer = mLayers.at(i);
         *layer->image() = newImage;
@@ -1160,6 +1192,9 @@ void LayeredImageProject::mergeLayers(int sourceIndex, int targetIndex)
 
     // flattenedImage() merges the layers' images.
     setLayerImage(targetIndex, flattenedImage(fromIndex, toIndex));
+    // The opacity and blend mode of both layers are now part of the merged image.
+    layerAt(targetIndex)->setOpacity(1.0);
+    layerAt(targetIndex)->setBlendMode(ImageLayer::NormalBlendMode);
 
     // Remove the source layer as it has been merged into the target layer.
     takeLayer(sourceIndex);
@@ -1227,6 +1262,7 @@ QDebug operator<<(QDebug debug, const LayeredImageProject *project)
         debug << "\n    name=" << layer->name()
               << " visible=" << layer->isVisible()
               << " opacity=" << layer->opacity()
+              << " blendMode=" << layer->blendMode()
               << " image=" << *layer->image();
     }
     return debug.space();
@@ -21,16 +21,16 @@
 #define LAYEREDIMAGEPROJECT_H
 
 #include <QDebug>
+#include <QHash>
 #include <QImage>
 #include <QQmlEngine>
 
 #include "animationsystem.h"
+#include "imagelayer.h"
 #include "project.h"
 #include "projectanimationhelper.h"
 #include "slate-global.h"
 
-class ImageLayer;
-
 class SLATE_EXPORT LayeredImageProject : public Project
 {
     Q_OBJECT
@@ -56,6 +56,7 @@ public:
     const ImageLayer *layerAt(int index) const;
     const ImageLayer *layerAt(const QString &name) const;
     int layerCount() const;
+    QImage layerImageBeforeLivePreview(int layerIndex) const;
     QVector<QImage> layerImagesBeforeLivePreview() const;
 
     Type type() const override;
@@ -126,6 +127,7 @@ public slots:
     void setLayerName(int layerIndex, const QString &name);
     void setLayerVisible(int layerIndex, bool visible);
     void setLayerOpacity(int layerIndex, qreal opacity);
+    void setLayerBlendMode(int layerIndex, ImageLayer::BlendMode blendMode);
     void copyAcrossLayers(const QRect &copyArea);
     void pasteAcrossLayers(int pasteX, int pasteY, bool onlyPasteIntoVisibleLayers);
 
@@ -158,6 +160,7 @@ private:
     friend class ChangeLayerNameCommand;
     friend class ChangeLayerVisibleCommand;
     friend class ChangeLayerOpacityCommand;
+    friend class ChangeLayerBlendModeCommand;
     friend class DeleteLayerCommand;
     friend class MergeLayersCommand;
     friend class DuplicateLayerCommand;
@@ -199,7 +202,10 @@ private:
     // Only modifications that require dialogs are supported.
     // Modifications that affect anything besides the layer's image (like opacity)
     // are not supported; that would require us to store layers instead.
-    QList<QImage> mLayerImagesBeforeLivePreview;
+    // Only the layers that the live preview has replaced the image of are stored,
+    // keyed by layer index. Since QImage is implicitly shared, this doesn't copy
+    // any pixels, and the same data is later handed to the undo command.
+    QHash<int, QImage> mLayerImagesBeforeLivePreview;
 
     bool mAutoExportEnabled;
 
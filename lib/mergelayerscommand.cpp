@@ -35,7 +35,9 @@ MergeLayersCommand::MergeLayersCommand(LayeredImageProject *project,
     mSourceLayer(sourceLayer),
     mTargetIndex(targetIndex),
     mTargetLayer(targetLayer),
-    mPreviousTargetLayerImage(*mTargetLayer->image())
+    mPreviousTargetLayerImage(*mTargetLayer->image(), lcMergeLayersCommand),
+    mPreviousTargetLayerOpacity(mTargetLayer->opacity()),
+    mPreviousTargetLayerBlendMode(mTargetLayer->blendMode())
 {
     qCDebug(lcMergeLayersCommand) << "constructed" << this;
 }
@@ -43,18 +45,29 @@ MergeLayersCommand::MergeLayersCommand(LayeredImageProject *project,
 void MergeLayersCommand::undo()
 {
     qCDebug(lcMergeLayersCommand) << "undoing" << this;
+    bool restored = false;
+    const QImage previousTargetLayerImage = mPreviousTargetLayerImage.image(&restored);
+    if (!restored)
+        return;
+
     // Restore the source layer..
     mProject->addLayer(mSourceLayerGuard.release(), mSourceIndex);
     // The source layer is the layer that was current before the merge,
     // so restore the current layer index too.
     mProject->setCurrentLayerIndex(mSourceIndex, true);
     // .. and then restore the target layer.
-    mProject->setLayerImage(mTargetIndex, mPreviousTargetLayerImage);
+    mProject->setLayerImage(mTargetIndex, previousTargetLayerImage);
+    mTargetLayer->setOpacity(mPreviousTargetLayerOpacity);
+    mTargetLayer->setBlendMode(mPreviousTargetLayerBlendMode);
 }
 
 void MergeLayersCommand::redo()
 {
     qCDebug(lcMergeLayersCommand) << "redoing" << this;
+    // We still own the source layer if undoing failed, in which case the layers are still merged.
+    if (mSourceLayerGuard)
+        return;
+
     mProject->mergeLayers(mSourceIndex, mTargetIndex);
     // The source layer loses its QObject parent, so manage it to prevent leaks.
     mSourceLayerGuard.reset(mSourceLayer);
@@ -70,6 +83,31 @@ bool MergeLayersCommand::modifiesContents() const
     return true;
 }
 
+qint64 MergeLayersCommand::payloadByteCount() const
+{
+    qint64 byteCount = mPreviousTargetLayerImage.byteCount();
+    // We only own the source layer while it's not in the project.
+    if (mSourceLayerGuard)
+        byteCount += mSourceLayerGuard->image()->sizeInBytes();
+    return byteCount;
+}
+
+void MergeLayersCommand::compressPayload()
+{
+    mPreviousTargetLayerImage.compress();
+}
+
+void MergeLayersCommand::spillPayload(const QSharedPointer<UndoSpillFile> &spillFile)
+{
+    mPreviousTargetLayerImage.spill(spillFile);
+}
+
+void MergeLayersCommand::releasePayload()
+{
+    mPreviousTargetLayerImage.clear();
+    mSourceLayerGuard.reset();
+}
+
 QDebug operator<<(QDebug debug, const MergeLayersCommand *command)
 {
     QDebugStateSaver saver(debug);
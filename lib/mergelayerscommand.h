@@ -25,10 +25,11 @@
 #include <QDebug>
 #include <QImage>
 
+#include "imagelayer.h"
 #include "slate-global.h"
 #include "undocommand.h"
+#include "undoimage.h"
 
-class ImageLayer;
 class LayeredImageProject;
 
 class SLATE_EXPORT MergeLayersCommand : public UndoCommand
@@ -44,6 +45,10 @@ public:
     int id() const override;
 
     bool modifiesContents() const override;
+    qint64 payloadByteCount() const override;
+    void compressPayload() override;
+    void spillPayload(const QSharedPointer<UndoSpillFile> &spillFile) override;
+    void releasePayload() override;
 
 private:
     friend QDebug operator<<(QDebug debug, const MergeLayersCommand *command);
@@ -54,7 +59,9 @@ private:
     std::unique_ptr<ImageLayer> mSourceLayerGuard;
     int mTargetIndex;
     ImageLayer *mTargetLayer;
-    QImage mPreviousTargetLayerImage;
+    UndoImage mPreviousTargetLayerImage;
+    qreal mPreviousTargetLayerOpacity;
+    ImageLayer::BlendMode mPreviousTargetLayerBlendMode;
 };
 
 #endif // MERGELAYERSCOMMAND_H
@@ -0,0 +1,255 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mipmappyramid.h"
+
+#include <QtMath>
+
+MipmapPyramid::MipmapPyramid() :
+    mDownsampleMode(NearestDownsample),
+    mSourceCacheKey(0),
+    mCreatedTileCount(0)
+{
+}
+
+MipmapPyramid::DownsampleMode MipmapPyramid::downsampleMode() const
+{
+    return mDownsampleMode;
+}
+
+void MipmapPyramid::setDownsampleMode(DownsampleMode downsampleMode)
+{
+    if (downsampleMode == mDownsampleMode)
+        return;
+
+    mDownsampleMode = downsampleMode;
+    invalidate();
+}
+
+QImage MipmapPyramid::sourceImage() const
+{
+    return mSourceImage;
+}
+
+qint64 MipmapPyramid::sourceCacheKey() const
+{
+    return mSourceCacheKey;
+}
+
+void MipmapPyramid::setSourceImage(const QImage &image)
+{
+    if (image.cacheKey() == mSourceCacheKey)
+        return;
+
+    const bool sizeChanged = image.size() != mSourceImage.size();
+
+    // downsample() reads 32 bit pixels directly, so convert anything else
+    // (which the canvases don't use) up front.
+    const QImage::Format format = image.format();
+    if (image.isNull() || format == QImage::Format_ARGB32_Premultiplied
+            || format == QImage::Format_ARGB32 || format == QImage::Format_RGB32) {
+        mSourceImage = image;
+    } else {
+        mSourceImage = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+    mSourceCacheKey = image.cacheKey();
+
+    if (sizeChanged) {
+        invalidate();
+        mCreatedTileCount = 0;
+    }
+}
+
+void MipmapPyramid::invalidate()
+{
+    mLevels.clear();
+    mDirtySourceRegion = QRegion();
+}
+
+void MipmapPyramid::invalidate(const QRect &sourceArea)
+{
+    // Levels that haven't been created yet will be created from scratch anyway.
+    if (mLevels.isEmpty())
+        return;
+
+    mDirtySourceRegion += sourceArea.intersected(QRect(QPoint(0, 0), mSourceImage.size()));
+}
+
+int MipmapPyramid::levelCount() const
+{
+    if (mSourceImage.isNull())
+        return 0;
+
+    int count = 1;
+    QSize size = mSourceImage.size();
+    while (size.width() > 1 || size.height() > 1) {
+        size = QSize((size.width() + 1) / 2, (size.height() + 1) / 2);
+        ++count;
+    }
+    return count;
+}
+
+int MipmapPyramid::levelForScale(qreal scale)
+{
+    if (scale >= 1.0 || scale <= 0.0)
+        return 0;
+
+    // Allow for a little imprecision so that e.g. 0.25 gives us level 2 and not 1.
+    return qFloor(std::log2(1.0 / scale) + 0.0001);
+}
+
+QImage MipmapPyramid::level(int levelIndex)
+{
+    Q_ASSERT(levelIndex >= 0 && levelIndex < qMax(1, levelCount()));
+    if (levelIndex == 0 || mSourceImage.isNull())
+        return mSourceImage;
+
+    updateBuiltLevels();
+
+    while (mLevels.size() < levelIndex)
+        createLevel();
+
+    return mLevels.at(levelIndex - 1);
+}
+
+QRect MipmapPyramid::mapToLevel(const QRect &sourceArea, int levelIndex) const
+{
+    const QRect area = sourceArea.intersected(QRect(QPoint(0, 0), mSourceImage.size()));
+    if (area.isEmpty())
+        return QRect();
+
+    // Each pixel in a level is made from (up to) a 2x2 block in the level above it,
+    // so the pixels that an area contributes to are found by shifting both edges.
+    return QRect(QPoint(area.left() >> levelIndex, area.top() >> levelIndex),
+        QPoint(area.right() >> levelIndex, area.bottom() >> levelIndex));
+}
+
+int MipmapPyramid::createdTileCount() const
+{
+    return mCreatedTileCount;
+}
+
+void MipmapPyramid::updateBuiltLevels()
+{
+    if (mDirtySourceRegion.isEmpty())
+        return;
+
+    // Go from the largest level to the smallest, since each one is created from the one before it.
+    for (int levelIndex = 1; levelIndex <= mLevels.size(); ++levelIndex) {
+        const QRect levelBounds(QPoint(0, 0), mLevels.at(levelIndex - 1).size());
+        QRegion dirtyTiles;
+        for (const QRect &dirtySourceRect : mDirtySourceRegion) {
+            const QRect dirtyLevelRect = mapToLevel(dirtySourceRect, levelIndex);
+            if (dirtyLevelRect.isEmpty())
+                continue;
+
+            const QPoint tileTopLeft((dirtyLevelRect.left() / tileSize) * tileSize,
+                (dirtyLevelRect.top() / tileSize) * tileSize);
+            const QPoint tileBottomRight((dirtyLevelRect.right() / tileSize + 1) * tileSize - 1,
+                (dirtyLevelRect.bottom() / tileSize + 1) * tileSize - 1);
+            dirtyTiles += QRect(tileTopLeft, tileBottomRight).intersected(levelBounds);
+        }
+
+        for (const QRect &dirtyTileRect : dirtyTiles)
+            downsample(levelIndex, dirtyTileRect);
+    }
+
+    mDirtySourceRegion = QRegion();
+}
+
+void MipmapPyramid::createLevel()
+{
+    const QImage previousLevel = levelImage(mLevels.size());
+    const QSize size((previousLevel.width() + 1) / 2, (previousLevel.height() + 1) / 2);
+    mLevels.append(QImage(size, QImage::Format_ARGB32_Premultiplied));
+
+    for (int y = 0; y < size.height(); y += tileSize) {
+        for (int x = 0; x < size.width(); x += tileSize)
+            downsample(mLevels.size(), QRect(x, y, tileSize, tileSize).intersected(QRect(QPoint(0, 0), size)));
+    }
+}
+
+static inline QRgb premultipliedPixel(const QRgb *line, int x, bool premultiplied)
+{
+    return premultiplied ? line[x] : qPremultiply(line[x]);
+}
+
+void MipmapPyramid::downsample(int levelIndex, const QRect &levelArea)
+{
+    const QImage previousLevel = levelImage(levelIndex - 1);
+    QImage &level = mLevels[levelIndex - 1];
+    // Source images in Format_ARGB32 need to be premultiplied before averaging;
+    // RGB32 pixels are always opaque, so they're effectively premultiplied already.
+    const bool premultiplied = previousLevel.format() != QImage::Format_ARGB32;
+    const int lastPreviousX = previousLevel.width() - 1;
+    const int lastPreviousY = previousLevel.height() - 1;
+
+    for (int y = levelArea.top(); y <= levelArea.bottom(); ++y) {
+        // Images with odd dimensions repeat their last row/column.
+        const QRgb *line1 = reinterpret_cast<const QRgb*>(previousLevel.constScanLine(qMin(y * 2, lastPreviousY)));
+        const QRgb *line2 = reinterpret_cast<const QRgb*>(previousLevel.constScanLine(qMin(y * 2 + 1, lastPreviousY)));
+        QRgb *levelLine = reinterpret_cast<QRgb*>(level.scanLine(y));
+
+        for (int x = levelArea.left(); x <= levelArea.right(); ++x) {
+            const int x1 = x * 2;
+            const int x2 = qMin(x * 2 + 1, lastPreviousX);
+
+            if (mDownsampleMode == NearestDownsample) {
+                levelLine[x] = premultipliedPixel(line1, x1, premultiplied);
+                continue;
+            }
+
+            const QRgb pixels[] = {
+                premultipliedPixel(line1, x1, premultiplied),
+                premultipliedPixel(line1, x2, premultiplied),
+                premultipliedPixel(line2, x1, premultiplied),
+                premultipliedPixel(line2, x2, premultiplied)
+            };
+            int red = 2;
+            int green = 2;
+            int blue = 2;
+            int alpha = 2;
+            for (const QRgb pixel : pixels) {
+                red += qRed(pixel);
+                green += qGreen(pixel);
+                blue += qBlue(pixel);
+                alpha += qAlpha(pixel);
+            }
+            levelLine[x] = qRgba(red >> 2, green >> 2, blue >> 2, alpha >> 2);
+        }
+    }
+
+    mCreatedTileCount += ((levelArea.width() + tileSize - 1) / tileSize) * ((levelArea.height() + tileSize - 1) / tileSize);
+}
+
+QImage MipmapPyramid::levelImage(int levelIndex) const
+{
+    return levelIndex == 0 ? mSourceImage : mLevels.at(levelIndex - 1);
+}
+
+QDebug operator<<(QDebug debug, const MipmapPyramid &pyramid)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "(MipmapPyramid sourceSize=" << pyramid.mSourceImage.size()
+        << " builtLevels=" << pyramid.mLevels.size()
+        << " downsampleMode=" << pyramid.mDownsampleMode
+        << " dirtySourceRegion=" << pyramid.mDirtySourceRegion.boundingRect()
+        << ")";
+    return debug;
+}
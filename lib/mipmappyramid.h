@@ -0,0 +1,100 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MIPMAPPYRAMID_H
+#define MIPMAPPYRAMID_H
+
+#include <QDebug>
+#include <QImage>
+#include <QRegion>
+#include <QVector>
+
+#include "slate-global.h"
+
+/*
+    A series of progressively halved copies of a source image, used to draw
+    the image at less than its natural size without having to downsample
+    all of it every time.
+
+    Levels are built lazily the first time they're requested. When parts of
+    the source change, invalidate() those parts and only the tiles of each
+    built level that they affect will be recreated the next time a level is
+    requested.
+
+    Level 0 is the source image itself; every other level is stored as
+    Format_ARGB32_Premultiplied.
+*/
+class SLATE_EXPORT MipmapPyramid
+{
+public:
+    enum DownsampleMode {
+        // Use the top-left pixel of each 2x2 block, which keeps pixel art crisp.
+        NearestDownsample,
+        // Average each 2x2 block.
+        BoxDownsample
+    };
+
+    static constexpr int tileSize = 64;
+
+    MipmapPyramid();
+
+    DownsampleMode downsampleMode() const;
+    void setDownsampleMode(DownsampleMode downsampleMode);
+
+    QImage sourceImage() const;
+    qint64 sourceCacheKey() const;
+    // If image is the same size as the current source, already-built levels are kept;
+    // call invalidate() with the areas that differ between the two.
+    void setSourceImage(const QImage &image);
+
+    // Discards all built levels.
+    void invalidate();
+    // Marks sourceArea as needing to be recreated in each built level.
+    void invalidate(const QRect &sourceArea);
+
+    int levelCount() const;
+    // Returns the smallest level that is still at least as large as the source at scale.
+    // The result isn't limited to levelCount(), as it doesn't depend on the source.
+    static int levelForScale(qreal scale);
+    QImage level(int levelIndex);
+    // Returns the area in levelIndex that sourceArea contributes to.
+    QRect mapToLevel(const QRect &sourceArea, int levelIndex) const;
+
+    // The number of tiles that have been (re)created since the source was last set to an image of a different size.
+    int createdTileCount() const;
+
+private:
+    friend QDebug operator<<(QDebug debug, const MipmapPyramid &pyramid);
+
+    void updateBuiltLevels();
+    void createLevel();
+    void downsample(int levelIndex, const QRect &levelArea);
+    QImage levelImage(int levelIndex) const;
+
+    DownsampleMode mDownsampleMode;
+    QImage mSourceImage;
+    qint64 mSourceCacheKey;
+    // Levels from 1 onwards; only as many as have been requested are created.
+    QVector<QImage> mLevels;
+    // The areas of the source that have changed since the built levels were last updated.
+    QRegion mDirtySourceRegion;
+    int mCreatedTileCount;
+};
+
+#endif // MIPMAPPYRAMID_H
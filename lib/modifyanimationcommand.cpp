@@ -90,6 +90,11 @@ int ModifyAnimationCommand::id() const
     return -1;
 }
 
+qint64 ModifyAnimationCommand::payloadByteCount() const
+{
+    return (mNewName.size() + mOldName.size()) * qint64(sizeof(QChar));
+}
+
 QDebug operator<<(QDebug debug, const ModifyAnimationCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -44,12 +44,12 @@ ModifyImageCanvasSelectionCommand::ModifyImageCanvasSelectionCommand(ImageCanvas
     mLayerIndex(layerIndex),
     mModification(modification),
     mSourceArea(sourceArea),
-    mSouceAreaImage(sourceAreaImage),
+    mSouceAreaImage(sourceAreaImage, lcModifyImageCanvasSelectionCommand),
     mTargetArea(targetArea),
-    mTargetAreaImageBeforeModification(targetAreaImageBeforeModification),
-    mTargetAreaImageAfterModification(targetAreaImageAfterModification),
+    mTargetAreaImageBeforeModification(targetAreaImageBeforeModification, lcModifyImageCanvasSelectionCommand),
+    mTargetAreaImageAfterModification(targetAreaImageAfterModification, lcModifyImageCanvasSelectionCommand),
     mFromPaste(fromPaste),
-    mPasteContents(pasteContents),
+    mPasteContents(pasteContents, lcModifyImageCanvasSelectionCommand),
     mUsed(false)
 {
     qCDebug(lcModifyImageCanvasSelectionCommand) << "constructed" << this;
@@ -65,19 +65,25 @@ void ModifyImageCanvasSelectionCommand::undo()
     qCDebug(lcModifyImageCanvasSelectionCommand) << "replacing new/destination/undone area"
         << mTargetArea << "of canvas with" << mTargetAreaImageBeforeModification << "...";
 
+    // Restore both images before changing anything, so that a failure leaves the image as it is.
+    bool targetAreaImageRestored = false;
+    const QImage targetAreaImageBeforeModification = mTargetAreaImageBeforeModification.image(&targetAreaImageRestored);
+    bool sourceAreaImageRestored = false;
+    const QImage sourceAreaImage = (mFromPaste ? mPasteContents : mSouceAreaImage).image(&sourceAreaImageRestored);
+    if (!targetAreaImageRestored || !sourceAreaImageRestored)
+        return;
+
     // Probably makes sense to do this first so that we follow the reverse order of the operations we did in redo().
-    mCanvas->replacePortionOfImage(mLayerIndex, mTargetArea, mTargetAreaImageBeforeModification);
+    mCanvas->replacePortionOfImage(mLayerIndex, mTargetArea, targetAreaImageBeforeModification);
 
     if (mFromPaste) {
         qCDebug(lcModifyImageCanvasSelectionCommand) << "undoing" << this << "- ... and painting original/source/previous area"
             << mSourceArea << "of canvas with paste contents" << mPasteContents;
-
-        mCanvas->paintImageOntoPortionOfImage(mLayerIndex, mSourceArea, mPasteContents);
     } else {
         qCDebug(lcModifyImageCanvasSelectionCommand) << "undoing" << this << "- ... and painting original/source/previous area"
             << mSourceArea << "of canvas with" << mSouceAreaImage;
-        mCanvas->paintImageOntoPortionOfImage(mLayerIndex, mSourceArea, mSouceAreaImage);
     }
+    mCanvas->paintImageOntoPortionOfImage(mLayerIndex, mSourceArea, sourceAreaImage);
 
     // This matches what mspaint does; undoing a selection move causes the selection to be cleared.
     mCanvas->clearSelection();
@@ -86,17 +92,24 @@ void ModifyImageCanvasSelectionCommand::undo()
 void ModifyImageCanvasSelectionCommand::redo()
 {
     qCDebug(lcModifyImageCanvasSelectionCommand) << "redoing" << this;
+    bool targetAreaImageRestored = false;
+    const QImage targetAreaImageAfterModification
+        = (mFromPaste ? mPasteContents : mTargetAreaImageAfterModification).image(&targetAreaImageRestored);
+    bool sourceAreaImageRestored = true;
+    const QImage sourceAreaImage = mFromPaste && mUsed ? mSouceAreaImage.image(&sourceAreaImageRestored) : QImage();
+    if (!targetAreaImageRestored || !sourceAreaImageRestored)
+        return;
+
     if (!mFromPaste)
         mCanvas->erasePortionOfImage(mLayerIndex, mSourceArea);
     else if (mUsed) {
         // It is a paste and it has been redone already (moving contents that haven't been applied
         // to the canvas), so redoing it now means that we should apply the paste contents,
         // and not the previous area image portion.
-        mCanvas->paintImageOntoPortionOfImage(mLayerIndex, mSourceArea, mSouceAreaImage);
+        mCanvas->paintImageOntoPortionOfImage(mLayerIndex, mSourceArea, sourceAreaImage);
     }
 
-    mCanvas->paintImageOntoPortionOfImage(mLayerIndex, mTargetArea,
-        mFromPaste ? mPasteContents : mTargetAreaImageAfterModification);
+    mCanvas->paintImageOntoPortionOfImage(mLayerIndex, mTargetArea, targetAreaImageAfterModification);
 
     mUsed = true;
 }
@@ -111,6 +124,36 @@ bool ModifyImageCanvasSelectionCommand::modifiesContents() const
     return true;
 }
 
+qint64 ModifyImageCanvasSelectionCommand::payloadByteCount() const
+{
+    return mSouceAreaImage.byteCount() + mTargetAreaImageBeforeModification.byteCount()
+        + mTargetAreaImageAfterModification.byteCount() + mPasteContents.byteCount();
+}
+
+void ModifyImageCanvasSelectionCommand::compressPayload()
+{
+    mSouceAreaImage.compress();
+    mTargetAreaImageBeforeModification.compress();
+    mTargetAreaImageAfterModification.compress();
+    mPasteContents.compress();
+}
+
+void ModifyImageCanvasSelectionCommand::spillPayload(const QSharedPointer<UndoSpillFile> &spillFile)
+{
+    mSouceAreaImage.spill(spillFile);
+    mTargetAreaImageBeforeModification.spill(spillFile);
+    mTargetAreaImageAfterModification.spill(spillFile);
+    mPasteContents.spill(spillFile);
+}
+
+void ModifyImageCanvasSelectionCommand::releasePayload()
+{
+    mSouceAreaImage.clear();
+    mTargetAreaImageBeforeModification.clear();
+    mTargetAreaImageAfterModification.clear();
+    mPasteContents.clear();
+}
+
 QDebug operator<<(QDebug debug, const ModifyImageCanvasSelectionCommand *command)
 {
     QDebugStateSaver saver(debug);
@@ -27,6 +27,7 @@
 #include "imagecanvas.h"
 #include "slate-global.h"
 #include "undocommand.h"
+#include "undoimage.h"
 
 class SLATE_EXPORT ModifyImageCanvasSelectionCommand : public UndoCommand
 {
@@ -46,6 +47,10 @@ public:
     int id() const override;
 
     bool modifiesContents() const override;
+    qint64 payloadByteCount() const override;
+    void compressPayload() override;
+    void spillPayload(const QSharedPointer<UndoSpillFile> &spillFile) override;
+    void releasePayload() override;
 
 private:
     friend QDebug operator<<(QDebug debug, const ModifyImageCanvasSelectionCommand *command);
@@ -57,14 +62,14 @@ private:
     // The area that the selection started off at.
     QRect mSourceArea;
     // The portion of the image under the selection before the selection was moved.
-    QImage mSouceAreaImage;
+    UndoImage mSouceAreaImage;
     // The area that the selection finished at, due to moving, rotating, etc.
     QRect mTargetArea;
     // The portion of the image under the destination area, after the selection was moved.
-    QImage mTargetAreaImageBeforeModification;
-    QImage mTargetAreaImageAfterModification;
+    UndoImage mTargetAreaImageBeforeModification;
+    UndoImage mTargetAreaImageAfterModification;
     bool mFromPaste;
-    QImage mPasteContents;
+    UndoImage mPasteContents;
     bool mUsed;
 };
 
@@ -29,8 +29,8 @@ MoveLayeredImageContentsCommand::MoveLayeredImageContentsCommand(LayeredImagePro
     const QVector<QImage> &previousImages, const QVector<QImage> &newImages, UndoCommand *parent) :
     UndoCommand(parent),
     mProject(project),
-    mPreviousImages(previousImages),
-    mNewImages(newImages)
+    mPreviousImages(UndoImage::fromImages(previousImages, lcMoveLayeredImageContentsCommand)),
+    mNewImages(UndoImage::fromImages(newImages, lcMoveLayeredImageContentsCommand))
 {
     qCDebug(lcMoveLayeredImageContentsCommand) << "constructed" << this;
 }
@@ -38,13 +38,23 @@ MoveLayeredImageContentsCommand::MoveLayeredImageContentsCommand(LayeredImagePro
 void MoveLayeredImageContentsCommand::undo()
 {
     qCDebug(lcMoveLayeredImageContentsCommand) << "undoing" << this;
-    mProject->doMoveContents(mPreviousImages);
+    bool restored = false;
+    const QVector<QImage> previousImages = UndoImage::toImages(mPreviousImages, &restored);
+    if (!restored)
+        return;
+
+    mProject->doMoveContents(previousImages);
 }
 
 void MoveLayeredImageContentsCommand::redo()
 {
     qCDebug(lcMoveLayeredImageContentsCommand) << "redoing" << this;
-    mProject->doMoveContents(mNewImages);
+    bool restored = false;
+    const QVector<QImage> newImages = UndoImage::toImages(mNewImages, &restored);
+    if (!restored)
+        return;
+
+    mProject->doMoveContents(newImages);
 }
 
 int MoveLayeredImageContentsCommand::id() const
@@ -57,6 +67,38 @@ bool MoveLayeredImageContentsCommand::modifiesContents() const
     return true;
 }
 
+qint64 MoveLayeredImageContentsCommand::payloadByteCount() const
+{
+    qint64 byteCount = 0;
+    for (const UndoImage &image : mPreviousImages)
+        byteCount += image.byteCount();
+    for (const UndoImage &image : mNewImages)
+        byteCount += image.unsharedByteCount();
+    return byteCount;
+}
+
+void MoveLayeredImageContentsCommand::compressPayload()
+{
+    for (UndoImage &image : mPreviousImages)
+        image.compress();
+    for (UndoImage &image : mNewImages)
+        image.compress();
+}
+
+void MoveLayeredImageContentsCommand::spillPayload(const QSharedPointer<UndoSpillFile> &spillFile)
+{
+    for (UndoImage &image : mPreviousImages)
+        image.spill(spillFile);
+    for (UndoImage &image : mNewImages)
+        image.spill(spillFile);
+}
+
+void MoveLayeredImageContentsCommand::releasePayload()
+{
+    mPreviousImages.clear();
+    mNewImages.clear();
+}
+
 QDebug operator<<(QDebug debug, const MoveLayeredImageContentsCommand *)
 {
     debug.nospace() << "(MoveLayeredImageContentsCommand)";
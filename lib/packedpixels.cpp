@@ -0,0 +1,257 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "packedpixels.h"
+
+#include <algorithm>
+
+PackedPixels::PackedPixels()
+{
+}
+
+PackedPixels::PackedPixels(const QRect &bounds, const QVector<uchar> &mask, const QVector<QRgb> &pixels)
+{
+    Q_ASSERT(mask.size() == bounds.width() * bounds.height());
+    Q_ASSERT(pixels.size() == mask.size());
+
+    // Shrink the rect to fit the pixels that are actually stored.
+    int left = bounds.right() + 1;
+    int top = bounds.bottom() + 1;
+    int right = bounds.left() - 1;
+    int bottom = bounds.top() - 1;
+    int count = 0;
+    for (int y = 0; y < bounds.height(); ++y) {
+        for (int x = 0; x < bounds.width(); ++x) {
+            if (!mask.at(y * bounds.width() + x))
+                continue;
+
+            left = qMin(left, bounds.x() + x);
+            top = qMin(top, bounds.y() + y);
+            right = qMax(right, bounds.x() + x);
+            bottom = qMax(bottom, bounds.y() + y);
+            ++count;
+        }
+    }
+    if (count == 0)
+        return;
+
+    mBounds = QRect(QPoint(left, top), QPoint(right, bottom));
+    mMask.resize(mBounds.width() * mBounds.height());
+    mRowOffsets.resize(mBounds.height());
+    mPixels.reserve(count);
+    for (int y = 0; y < mBounds.height(); ++y) {
+        mRowOffsets[y] = mPixels.size();
+        const int sourceRowIndex = (mBounds.y() - bounds.y() + y) * bounds.width() + mBounds.x() - bounds.x();
+        for (int x = 0; x < mBounds.width(); ++x) {
+            if (mask.at(sourceRowIndex + x)) {
+                mMask.setBit(y * mBounds.width() + x);
+                mPixels.append(pixels.at(sourceRowIndex + x));
+            }
+        }
+    }
+}
+
+bool PackedPixels::isEmpty() const
+{
+    return mPixels.isEmpty();
+}
+
+QRect PackedPixels::bounds() const
+{
+    return mBounds;
+}
+
+int PackedPixels::count() const
+{
+    return mPixels.size();
+}
+
+bool PackedPixels::contains(const QPoint &pos) const
+{
+    return mBounds.contains(pos)
+        && mMask.testBit((pos.y() - mBounds.y()) * mBounds.width() + pos.x() - mBounds.x());
+}
+
+QPoint PackedPixels::lastPosition() const
+{
+    for (int i = mMask.size() - 1; i >= 0; --i) {
+        if (mMask.testBit(i))
+            return mBounds.topLeft() + QPoint(i % mBounds.width(), i / mBounds.width());
+    }
+    return QPoint();
+}
+
+// Calls function(x, y, length, pixels) for each run of consecutive stored pixels
+// in a row of area, where pixels points to the stored value of the first one.
+template<typename Function>
+void PackedPixels::forEachRun(const QRect &area, Function function) const
+{
+    const QRect clippedArea = mBounds.intersected(area);
+    for (int y = clippedArea.top(); y <= clippedArea.bottom(); ++y) {
+        const int rowIndex = (y - mBounds.y()) * mBounds.width() - mBounds.x();
+        int pixelIndex = mRowOffsets.at(y - mBounds.y());
+        // Skip the stored pixels to the left of the area.
+        for (int x = mBounds.left(); x < clippedArea.left(); ++x) {
+            if (mMask.testBit(rowIndex + x))
+                ++pixelIndex;
+        }
+
+        int x = clippedArea.left();
+        while (x <= clippedArea.right()) {
+            while (x <= clippedArea.right() && !mMask.testBit(rowIndex + x))
+                ++x;
+            if (x > clippedArea.right())
+                break;
+
+            const int runStart = x;
+            while (x <= clippedArea.right() && mMask.testBit(rowIndex + x))
+                ++x;
+            function(runStart, y, x - runStart, mPixels.constData() + pixelIndex);
+            pixelIndex += x - runStart;
+        }
+    }
+}
+
+static bool isArgb32Format(QImage::Format format)
+{
+    return format == QImage::Format_RGB32 || format == QImage::Format_ARGB32
+        || format == QImage::Format_ARGB32_Premultiplied;
+}
+
+// Returns what QImage::setPixelColor() stores for rgba64 in an image of the given format,
+// which must be one that isArgb32Format() accepts.
+static QRgb argb32PixelValue(QRgba64 rgba64, QImage::Format format)
+{
+    if (format == QImage::Format_RGB32)
+        rgba64.setAlpha(65535);
+    else if (format == QImage::Format_ARGB32_Premultiplied)
+        rgba64 = rgba64.premultiplied();
+    return rgba64.toArgb32();
+}
+
+void PackedPixels::write(QImage *image, const QRect &area, const QPoint &offset) const
+{
+    const QRect imageArea = area.intersected(image->rect().translated(-offset));
+    const QImage::Format format = image->format();
+    if (!isArgb32Format(format)) {
+        forEachRun(imageArea, [=](int x, int y, int length, const QRgb *pixels) {
+            for (int i = 0; i < length; ++i)
+                image->setPixelColor(offset.x() + x + i, offset.y() + y, QColor::fromRgba(pixels[i]));
+        });
+        return;
+    }
+
+    forEachRun(imageArea, [=](int x, int y, int length, const QRgb *pixels) {
+        QRgb *line = reinterpret_cast<QRgb*>(image->scanLine(offset.y() + y)) + offset.x() + x;
+        if (format == QImage::Format_ARGB32) {
+            std::copy_n(pixels, length, line);
+        } else {
+            for (int i = 0; i < length; ++i)
+                line[i] = argb32PixelValue(QRgba64::fromArgb32(pixels[i]), format);
+        }
+    });
+}
+
+void PackedPixels::fill(QImage *image, const QColor &colour, const QRect &area, const QPoint &offset) const
+{
+    const QRect imageArea = area.intersected(image->rect().translated(-offset));
+    const QImage::Format format = image->format();
+    if (!isArgb32Format(format)) {
+        forEachRun(imageArea, [=](int x, int y, int length, const QRgb *) {
+            for (int i = 0; i < length; ++i)
+                image->setPixelColor(offset.x() + x + i, offset.y() + y, colour);
+        });
+        return;
+    }
+
+    const QRgb pixel = argb32PixelValue(colour.rgba64(), format);
+    forEachRun(imageArea, [=](int x, int y, int length, const QRgb *) {
+        std::fill_n(reinterpret_cast<QRgb*>(image->scanLine(offset.y() + y)) + offset.x() + x, length, pixel);
+    });
+}
+
+PackedPixels PackedPixels::united(const QVector<PackedPixels> &pixelsList)
+{
+    if (pixelsList.size() == 1)
+        return pixelsList.first();
+
+    QRect bounds;
+    int maxCount = 0;
+    for (const PackedPixels &pixels : pixelsList) {
+        bounds = bounds.united(pixels.mBounds);
+        maxCount += pixels.count();
+    }
+    if (maxCount == 0)
+        return PackedPixels();
+
+    PackedPixels unitedPixels;
+    unitedPixels.mBounds = bounds;
+    unitedPixels.mMask.resize(bounds.width() * bounds.height());
+    // Only the set bits of each are visited, so this costs the number of stored pixels
+    // (plus clearing the mask) rather than the area of the bounds for each of them.
+    QVector<QPair<int, QRgb>> indexedPixels;
+    indexedPixels.reserve(maxCount);
+    for (const PackedPixels &pixels : pixelsList) {
+        pixels.forEachRun(pixels.mBounds, [&](int x, int y, int length, const QRgb *values) {
+            const int index = (y - bounds.y()) * bounds.width() + x - bounds.x();
+            for (int i = 0; i < length; ++i) {
+                if (unitedPixels.mMask.testBit(index + i))
+                    continue;
+
+                unitedPixels.mMask.setBit(index + i);
+                indexedPixels.append(qMakePair(index + i, values[i]));
+            }
+        });
+    }
+
+    // The pixels are stored row by row.
+    std::sort(indexedPixels.begin(), indexedPixels.end(),
+        [](const QPair<int, QRgb> &a, const QPair<int, QRgb> &b) { return a.first < b.first; });
+    unitedPixels.mRowOffsets.resize(bounds.height());
+    unitedPixels.mPixels.reserve(indexedPixels.size());
+    int y = 0;
+    for (const QPair<int, QRgb> &indexedPixel : std::as_const(indexedPixels)) {
+        for (; y <= indexedPixel.first / bounds.width(); ++y)
+            unitedPixels.mRowOffsets[y] = unitedPixels.mPixels.size();
+        unitedPixels.mPixels.append(indexedPixel.second);
+    }
+    for (; y < bounds.height(); ++y)
+        unitedPixels.mRowOffsets[y] = unitedPixels.mPixels.size();
+    return unitedPixels;
+}
+
+qint64 PackedPixels::byteCount() const
+{
+    return (mMask.size() + 7) / 8 + mRowOffsets.size() * qint64(sizeof(int)) + mPixels.size() * qint64(sizeof(QRgb));
+}
+
+bool PackedPixels::operator==(const PackedPixels &other) const
+{
+    return mBounds == other.mBounds && mMask == other.mMask && mPixels == other.mPixels;
+}
+
+QDebug operator<<(QDebug debug, const PackedPixels &packedPixels)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "PackedPixels(bounds=" << packedPixels.mBounds
+        << " count=" << packedPixels.count()
+        << " byteCount=" << packedPixels.byteCount()
+        << ")";
+    return debug;
+}
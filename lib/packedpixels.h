@@ -0,0 +1,84 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PACKEDPIXELS_H
+#define PACKEDPIXELS_H
+
+#include <QBitArray>
+#include <QColor>
+#include <QDebug>
+#include <QImage>
+#include <QRect>
+#include <QVector>
+
+#include "slate-global.h"
+
+/*
+    Pixels at arbitrary positions within a rectangle, stored as one bit per
+    pixel of the rectangle plus the ARGB32 value of each pixel whose bit is set,
+    so e.g. an eraser stroke costs a little over four bytes per erased pixel
+    rather than a QPoint and a QColor each.
+
+    The pixels are written back into an image a run of consecutive set bits
+    at a time.
+*/
+class SLATE_EXPORT PackedPixels
+{
+public:
+    PackedPixels();
+    // mask and pixels have one value per pixel in bounds (row by row); only the pixels
+    // whose mask value is non-zero are kept. The pixels are (non-premultiplied) ARGB32 values.
+    PackedPixels(const QRect &bounds, const QVector<uchar> &mask, const QVector<QRgb> &pixels);
+
+    bool isEmpty() const;
+    // The bounding rect of the stored pixels.
+    QRect bounds() const;
+    int count() const;
+    bool contains(const QPoint &pos) const;
+    // The position of the last stored pixel (row by row).
+    QPoint lastPosition() const;
+
+    // Writes each stored pixel that is within area into image at its position plus offset.
+    void write(QImage *image, const QRect &area, const QPoint &offset = QPoint()) const;
+    // Like write(), but writes colour in place of each stored pixel.
+    void fill(QImage *image, const QColor &colour, const QRect &area, const QPoint &offset = QPoint()) const;
+
+    // Returns the pixels of each item in pixelsList as one PackedPixels. Where more
+    // than one of them stores a pixel, the value of the earliest one in the list is kept.
+    static PackedPixels united(const QVector<PackedPixels> &pixelsList);
+
+    // The amount of bytes used to store the pixels.
+    qint64 byteCount() const;
+
+    bool operator==(const PackedPixels &other) const;
+
+private:
+    friend QDebug operator<<(QDebug debug, const PackedPixels &packedPixels);
+
+    template<typename Function>
+    void forEachRun(const QRect &area, Function function) const;
+
+    QRect mBounds;
+    QBitArray mMask;
+    // The index into mPixels of the first stored pixel of each row in mBounds.
+    QVector<int> mRowOffsets;
+    QVector<QRgb> mPixels;
+};
+
+#endif // PACKEDPIXELS_H
@@ -35,7 +35,10 @@ PaneDrawingHelper::PaneDrawingHelper(const ImageCanvas *canvas, QPainter *painte
     painter->translate(translateDistance);
 
     const int paneWidth = mCanvas->width() * mPane->size();
-    painter->setClipRect(-pane->integerOffset().x(), -pane->integerOffset().y(), paneWidth, mCanvas->height());
+    // Intersect rather than replace the clip so that we respect the area
+    // that was requested to be repainted (see CanvasPaneItem::onContentAreaPaintRequested()).
+    painter->setClipRect(-pane->integerOffset().x(), -pane->integerOffset().y(), paneWidth, mCanvas->height(),
+        Qt::IntersectClip);
 }
 
 PaneDrawingHelper::~PaneDrawingHelper()
@@ -30,8 +30,8 @@ PasteAcrossLayersCommand::PasteAcrossLayersCommand(LayeredImageProject *project,
         const QVector<QImage> &previousImages, const QVector<QImage> &newImages, UndoCommand *parent) :
     UndoCommand(parent),
     mProject(project),
-    mPreviousImages(previousImages),
-    mNewImages(newImages)
+    mPreviousImages(UndoImage::fromImages(previousImages, lcPasteAcrossLayersCommand)),
+    mNewImages(UndoImage::fromImages(newImages, lcPasteAcrossLayersCommand))
 {
     qCDebug(lcPasteAcrossLayersCommand) << "constructed" << this;
 }
@@ -39,13 +39,23 @@ PasteAcrossLayersCommand::PasteAcrossLayersCommand(LayeredImageProject *project,
 void PasteAcrossLayersCommand::undo()
 {
     qCDebug(lcPasteAcrossLayersCommand) << "undoing" << this;
-    mProject->doPasteAcrossLayers(mPreviousImages);
+    bool restored = false;
+    const QVector<QImage> previousImages = UndoImage::toImages(mPreviousImages, &restored);
+    if (!restored)
+        return;
+
+    mProject->doPasteAcrossLayers(previousImages);
 }
 
 void PasteAcrossLayersCommand::redo()
 {
     qCDebug(lcPasteAcrossLayersCommand) << "redoing" << this;
-    mProject->doPasteAcrossLayers(mNewImages);
+    bool restored = false;
+    const QVector<QImage> newImages = UndoImage::toImages(mNewImages, &restored);
+    if (!restored)
+        return;
+
+    mProject->doPasteAcrossLayers(newImages);
 }
 
 int PasteAcrossLayersCommand::id() const
@@ -58,6 +68,38 @@ bool PasteAcrossLayersCommand::modifiesContents() const
     return true;
 }
 
+qint64 PasteAcrossLayersCommand::payloadByteCount() const
+{
+    qint64 byteCount = 0;
+    for (const UndoImage &image : mPreviousImages)
+        byteCount += image.byteCount();
+    for (const UndoImage &image : mNewImages)
+        byteCount += image.unsharedByteCount();
+    return byteCount;
+}
+
+void PasteAcrossLayersCommand::compressPayload()
+{
+    for (UndoImage &image : mPreviousImages)
+        image.compress();
+    for (UndoImage &image : mNewImages)
+        image.compress();
+}
+
+void PasteAcrossLayersCommand::spillPayload(const QSharedPointer<UndoSpillFile> &spillFile)
+{
+    for (UndoImage &image : mPreviousImages)
+        image.spill(spillFile);
+    for (UndoImage &image : mNewImages)
+        image.spill(spillFile);
+}
+
+void PasteAcrossLayersCommand::releasePayload()
+{
+    mPreviousImages.clear();
+    mNewImages.clear();
+}
+
 QDebug operator<<(QDebug debug, const PasteAcrossLayersCommand *)
 {
     debug.nospace() << "(PasteAcrossLayersCommand)";
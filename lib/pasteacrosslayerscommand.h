@@ -26,6 +26,7 @@
 
 #include "slate-global.h"
 #include "undocommand.h"
+#include "undoimage.h"
 
 class ImageLayer;
 class LayeredImageProject;
@@ -42,13 +43,17 @@ public:
     int id() const override;
 
     bool modifiesContents() const override;
+    qint64 payloadByteCount() const override;
+    void compressPayload() override;
+    void spillPayload(const QSharedPointer<UndoSpillFile> &spillFile) override;
+    void releasePayload() override;
 
 private:
     friend QDebug operator<<(QDebug debug, const PasteAcrossLayersCommand *command);
 
     LayeredImageProject *mProject = nullptr;
-    QVector<QImage> mPreviousImages;
-    QVector<QImage> mNewImages;
+    QVector<UndoImage> mPreviousImages;
+    QVector<UndoImage> mNewImages;
 };
 
 #endif // PASTEACROSSLAYERSCOMMAND_H
@@ -29,8 +29,8 @@ PasteImageCanvasCommand::PasteImageCanvasCommand(ImageCanvas *canvas, int layerI
     UndoCommand(parent),
     mCanvas(canvas),
     mLayerIndex(layerIndex),
-    mNewImage(image),
-    mPreviousImage(canvas->imageForLayerAt(layerIndex)->copy(QRect(position, image.size()))),
+    mNewImage(image, lcPasteImageCanvasCommand),
+    mPreviousImage(canvas->imageForLayerAt(layerIndex)->copy(QRect(position, image.size())), lcPasteImageCanvasCommand),
     mArea(QRect(position, image.size())),
     mUsed(false)
 {
@@ -40,7 +40,12 @@ PasteImageCanvasCommand::PasteImageCanvasCommand(ImageCanvas *canvas, int layerI
 void PasteImageCanvasCommand::undo()
 {
     qCDebug(lcPasteImageCanvasCommand) << "undoing" << this;
-    mCanvas->replacePortionOfImage(mLayerIndex, mArea, mPreviousImage);
+    bool restored = false;
+    const QImage previousImage = mPreviousImage.image(&restored);
+    if (!restored)
+        return;
+
+    mCanvas->replacePortionOfImage(mLayerIndex, mArea, previousImage);
     mCanvas->clearSelection();
 }
 
@@ -51,7 +56,12 @@ void PasteImageCanvasCommand::redo()
         // ImageCanvas handles everything for us for the initial paste,
         // as we need a selection area on that occasion. However,
         // for every other redo and undo, we can do the following.
-        mCanvas->paintImageOntoPortionOfImage(mLayerIndex, mArea, mNewImage);
+        bool restored = false;
+        const QImage newImage = mNewImage.image(&restored);
+        if (!restored)
+            return;
+
+        mCanvas->paintImageOntoPortionOfImage(mLayerIndex, mArea, newImage);
         mCanvas->clearSelection();
     } else {
         // Although this special-casing might seem odd, the whole thing allows
@@ -73,6 +83,29 @@ bool PasteImageCanvasCommand::modifiesContents() const
     return true;
 }
 
+qint64 PasteImageCanvasCommand::payloadByteCount() const
+{
+    return mPreviousImage.byteCount() + mNewImage.byteCount();
+}
+
+void PasteImageCanvasCommand::compressPayload()
+{
+    mPreviousImage.compress();
+    mNewImage.compress();
+}
+
+void PasteImageCanvasCommand::spillPayload(const QSharedPointer<UndoSpillFile> &spillFile)
+{
+    mPreviousImage.spill(spillFile);
+    mNewImage.spill(spillFile);
+}
+
+void PasteImageCanvasCommand::releasePayload()
+{
+    mPreviousImage.clear();
+    mNewImage.clear();
+}
+
 QDebug operator<<(QDebug debug, const PasteImageCanvasCommand *command)
 {
     QDebugStateSaver saver(debug);
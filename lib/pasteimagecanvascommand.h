@@ -26,6 +26,7 @@
 
 #include "slate-global.h"
 #include "undocommand.h"
+#include "undoimage.h"
 
 class ImageCanvas;
 
@@ -41,14 +42,18 @@ public:
     int id() const override;
 
     bool modifiesContents() const override;
+    qint64 payloadByteCount() const override;
+    void compressPayload() override;
+    void spillPayload(const QSharedPointer<UndoSpillFile> &spillFile) override;
+    void releasePayload() override;
 
 private:
     friend QDebug operator<<(QDebug debug, const PasteImageCanvasCommand *command);
 
     ImageCanvas *mCanvas;
     int mLayerIndex;
-    QImage mNewImage;
-    QImage mPreviousImage;
+    UndoImage mNewImage;
+    UndoImage mPreviousImage;
     QRect mArea;
 
     bool mUsed;
@@ -21,6 +21,7 @@
 
 #include <QCoreApplication>
 #include <QDateTime>
+#include <QElapsedTimer>
 #include <QImage>
 #include <QJsonArray>
 #include <QJsonDocument>
@@ -31,6 +32,7 @@
 #include "applicationsettings.h"
 #include "imageutils.h"
 #include "qtutils.h"
+#include "undospillfile.h"
 
 Q_LOGGING_CATEGORY(lcProject, "app.project")
 Q_LOGGING_CATEGORY(lcProjectGuides, "app.project.guides")
@@ -43,10 +45,27 @@ Project::Project() :
     mUsingTempImage(false),
     mLivePreviewActive(false),
     mCurrentLivePreviewModification(LivePreviewModification::None),
+    mSpilledUndoCommandCount(0),
+    mUndoPayloadByteCount(0),
     mComposingMacro(false),
     mHadUnsavedChangesBeforeMacroBegan(false)
 {
     connect(&mUndoStack, SIGNAL(cleanChanged(bool)), this, SIGNAL(unsavedChangesChanged()));
+    connect(&mUndoStack, SIGNAL(indexChanged(int)), this, SIGNAL(canUndoChanged()));
+    // Changes that are undone can be replaced by new ones, which haven't been spilled.
+    // Undoing and redoing can also change the payload of changes.
+    connect(&mUndoStack, &QUndoStack::indexChanged, this, [this](int index) {
+        mSpilledUndoCommandCount = qMin(mSpilledUndoCommandCount, index);
+        updateInMemoryUndoPayloadByteCounts();
+    });
+
+    mUndoPayloadByteCountChangedTimer.setSingleShot(true);
+    mUndoPayloadByteCountChangedTimer.setInterval(250);
+    connect(&mUndoPayloadByteCountChangedTimer, &QTimer::timeout, this, &Project::undoPayloadByteCountChanged);
+
+    mUndoSpillTimer.setSingleShot(true);
+    mUndoSpillTimer.setInterval(500);
+    connect(&mUndoSpillTimer, &QTimer::timeout, this, &Project::spillOlderUndoPayloads);
 }
 
 Project::Type Project::type() const
@@ -183,6 +202,8 @@ void Project::close()
     setUrl(QUrl());
     mLivePreviewActive = false;
     mUndoStack.clear();
+    mUndoSpillFile.clear();
+    emit undoPayloadByteCountChanged();
     mUiState.reset(QVariantMap());
 
     doClose();
@@ -516,7 +537,16 @@ void Project::setSettings(ApplicationSettings *settings)
     if (settings == mSettings)
         return;
 
+    if (mSettings)
+        mSettings->disconnect(this);
+
     mSettings = settings;
+
+    if (mSettings) {
+        connect(mSettings, &ApplicationSettings::undoMemoryBudgetChanged, this, &Project::enforceUndoMemoryBudget);
+        connect(mSettings, &ApplicationSettings::inMemoryUndoCommandCountChanged, this, &Project::scheduleUndoPayloadSpill);
+    }
+
     emit settingsChanged();
 }
 
@@ -683,6 +713,16 @@ QUndoStack *Project::undoStack()
     return &mUndoStack;
 }
 
+bool Project::canUndo() const
+{
+    if (!mUndoStack.canUndo())
+        return false;
+
+    // Discarded changes are always the oldest ones, so if the next change
+    // to be undone was discarded, so were all of the ones before it.
+    return !mUndoStack.command(mUndoStack.index() - 1)->isObsolete();
+}
+
 bool Project::isComposingMacro() const
 {
     return mComposingMacro;
@@ -729,9 +769,16 @@ void Project::endMacro()
     qCDebug(lcProject) << "ending macro";
 
     mUndoStack.endMacro();
+    if (mUndoStack.index() > 0)
+        UndoCommand::forEach(mUndoStack.command(mUndoStack.index() - 1), [](UndoCommand *command) { command->macroEnded(); });
+    updateInMemoryUndoPayloadByteCounts();
     // This handles the emission of the canSaveChanged signal.
     setComposingMacro(false);
 
+    scheduleUndoPayloadSpill();
+    enforceUndoMemoryBudget();
+    scheduleUndoPayloadByteCountChanged();
+
     // It's not enough to rely on the cleanChanged signal to cause
     // our unchangedChangesSignal to be called, because cleanChanged
     // apparently does not get emitted when a macro ends. So, we do it ourselves here.
@@ -759,10 +806,59 @@ void Project::addChange(UndoCommand *undoCommand)
 
     const bool modifiedContents = undoCommand->modifiesContents();
 
+    // QUndoStack deletes the command if it was merged into the previous one,
+    // so we time the push and then find the command that the time belongs to.
+    QElapsedTimer applyTimer;
+    applyTimer.start();
+    undoCommand->accountPayloadByteCountIn(&mUndoPayloadByteCount);
     mUndoStack.push(undoCommand);
+    const qint64 applyDuration = applyTimer.nsecsElapsed();
+    if (UndoCommand *appliedCommand = mostRecentUndoCommand())
+        appliedCommand->addApplyDuration(applyDuration);
+    // Merging doesn't change the index, so this isn't done for us.
+    updateInMemoryUndoPayloadByteCounts();
 
     if (modifiedContents)
         emit contentsModified();
+
+    scheduleUndoPayloadSpill();
+    enforceUndoMemoryBudget();
+    // Changes added while composing a macro are accounted for when it ends.
+    if (!mComposingMacro)
+        scheduleUndoPayloadByteCountChanged();
+}
+
+// Returns the command that was most recently pushed or merged into, which is
+// the last descendant of the macro that is being composed, if there is one.
+UndoCommand *Project::mostRecentUndoCommand() const
+{
+    if (mUndoStack.count() == 0)
+        return nullptr;
+
+    // While composing a macro, the macro is the last command but the index hasn't moved past it yet.
+    const QUndoCommand *command = mUndoStack.command(mComposingMacro ? mUndoStack.count() - 1 : mUndoStack.index() - 1);
+    while (command && !dynamic_cast<const UndoCommand*>(command) && command->childCount() > 0)
+        command = command->child(command->childCount() - 1);
+    // See UndoCommand::forEach() for why this is OK.
+    return const_cast<UndoCommand*>(dynamic_cast<const UndoCommand*>(command));
+}
+
+qint64 Project::undoPayloadByteCount() const
+{
+    return mUndoPayloadByteCount;
+}
+
+// Changes whose payloads are still in memory can stop sharing images with the project
+// when it's modified (see e.g. UndoImage::unsharedByteCount()), and their payloads change
+// when something is merged into them or they're undone, so their byte counts are updated
+// whenever a change is made. The payloads of spilled changes only change when we do it.
+void Project::updateInMemoryUndoPayloadByteCounts()
+{
+    for (int i = mSpilledUndoCommandCount; i < mUndoStack.count(); ++i) {
+        UndoCommand::forEach(mUndoStack.command(i), [](UndoCommand *undoCommand) {
+            undoCommand->updateAccountedPayloadByteCount();
+        });
+    }
 }
 
 void Project::clearChanges()
@@ -776,3 +872,109 @@ void Project::clearChanges()
         emit unsavedChangesChanged();
     }
 }
+
+// Unlike scheduleUndoPayloadSpill(), the timer isn't restarted if it's already running,
+// so that the signal is still emitted regularly while changes are being made.
+void Project::scheduleUndoPayloadByteCountChanged()
+{
+    if (!mUndoPayloadByteCountChangedTimer.isActive())
+        mUndoPayloadByteCountChangedTimer.start();
+}
+
+// Restarts the timer rather than spilling straight away, so that e.g. each segment
+// of a pen stroke doesn't have to wait for older changes to be written out.
+void Project::scheduleUndoPayloadSpill()
+{
+    mUndoSpillTimer.start();
+}
+
+// Moves the payloads of all but the most recent changes into a file, which
+// they're mapped back in from when they're undone or redone. Unlike compressing
+// and discarding, this happens regardless of the undo memory budget.
+void Project::spillOlderUndoPayloads()
+{
+    if (!mSettings || !mTempDir.isValid())
+        return;
+
+    if (mComposingMacro) {
+        // Try again once the macro has ended.
+        scheduleUndoPayloadSpill();
+        return;
+    }
+
+    const int olderCommandCount = mUndoStack.index() - qMax(1, mSettings->inMemoryUndoCommandCount());
+    if (olderCommandCount <= mSpilledUndoCommandCount)
+        return;
+
+    if (!mUndoSpillFile)
+        mUndoSpillFile.reset(new UndoSpillFile(mTempDir.filePath(QLatin1String("undo-history"))));
+    if (!mUndoSpillFile->isOpen())
+        return;
+
+    QElapsedTimer spillTimer;
+    spillTimer.start();
+
+    for (int i = mSpilledUndoCommandCount; i < olderCommandCount; ++i) {
+        UndoCommand::forEach(mUndoStack.command(i), [this](UndoCommand *undoCommand) {
+            undoCommand->spillPayload(mUndoSpillFile);
+            undoCommand->updateAccountedPayloadByteCount();
+        });
+    }
+
+    qCDebug(lcProject) << "spilled changes" << mSpilledUndoCommandCount << "to" << olderCommandCount - 1
+        << "in" << spillTimer.elapsed() << "ms";
+    mSpilledUndoCommandCount = olderCommandCount;
+    emit undoPayloadByteCountChanged();
+}
+
+// Keeps the memory used by the undo history within the budget by first compressing
+// the payloads of the oldest changes, and then discarding them if that wasn't enough.
+void Project::enforceUndoMemoryBudget()
+{
+    if (!mSettings || mComposingMacro)
+        return;
+
+    const qint64 budget = qint64(mSettings->undoMemoryBudget()) * 1024 * 1024;
+    if (budget <= 0)
+        return;
+
+    if (mUndoPayloadByteCount <= budget)
+        return;
+
+    // Leave the most recent change alone, as it's the most likely to be undone,
+    // as well as the changes that can be redone.
+    const int oldCommandCount = mUndoStack.index() - 1;
+    for (int i = 0; i < oldCommandCount && mUndoPayloadByteCount > budget; ++i) {
+        UndoCommand::forEach(mUndoStack.command(i), [](UndoCommand *undoCommand) {
+            undoCommand->compressPayload();
+            undoCommand->updateAccountedPayloadByteCount();
+        });
+    }
+
+    if (mUndoPayloadByteCount <= budget) {
+        qCDebug(lcProject) << "compressed undo history to" << mUndoPayloadByteCount << "bytes";
+        emit undoPayloadByteCountChanged();
+        return;
+    }
+
+    // Compressing wasn't enough, so discard the oldest changes. QUndoStack deletes obsolete
+    // commands instead of undoing them, so undoing past the oldest remaining change does nothing.
+    int discardedCommandCount = 0;
+    for (; discardedCommandCount < oldCommandCount && mUndoPayloadByteCount > budget; ++discardedCommandCount) {
+        QUndoCommand *command = const_cast<QUndoCommand*>(mUndoStack.command(discardedCommandCount));
+        // Commands whose payloads are too small to be worth releasing (e.g. names) keep them.
+        UndoCommand::forEach(command, [](UndoCommand *undoCommand) {
+            undoCommand->releasePayload();
+            undoCommand->updateAccountedPayloadByteCount();
+        });
+        command->setObsolete(true);
+    }
+
+    // The saved state can't be returned to if it came before the discarded changes.
+    if (mUndoStack.cleanIndex() >= 0 && mUndoStack.cleanIndex() < discardedCommandCount)
+        mUndoStack.resetClean();
+
+    qCDebug(lcProject) << "discarded the oldest" << discardedCommandCount
+        << "changes to reduce undo history to" << mUndoPayloadByteCount << "bytes";
+    emit undoPayloadByteCountChanged();
+}
@@ -24,8 +24,10 @@
 #include <QJsonObject>
 #include <QLoggingCategory>
 #include <QObject>
+#include <QSharedPointer>
 #include <QSize>
 #include <QTemporaryDir>
+#include <QTimer>
 #include <QVersionNumber>
 #include <QUrl>
 
@@ -42,6 +44,7 @@ Q_DECLARE_LOGGING_CATEGORY(lcProject)
 Q_DECLARE_LOGGING_CATEGORY(lcProjectLifecycle)
 
 class ApplicationSettings;
+class UndoSpillFile;
 
 class SLATE_EXPORT Project : public QObject
 {
@@ -57,6 +60,8 @@ class SLATE_EXPORT Project : public QObject
     Q_PROPERTY(QString displayUrl READ displayUrl NOTIFY urlChanged)
     Q_PROPERTY(QSize size READ size WRITE setSize NOTIFY sizeChanged)
     Q_PROPERTY(QUndoStack *undoStack READ undoStack CONSTANT)
+    Q_PROPERTY(bool canUndo READ canUndo NOTIFY canUndoChanged)
+    Q_PROPERTY(qint64 undoPayloadByteCount READ undoPayloadByteCount NOTIFY undoPayloadByteCountChanged)
     Q_PROPERTY(ApplicationSettings *settings READ settings WRITE setSettings NOTIFY settingsChanged)
     Q_PROPERTY(Swatch *swatch READ swatch CONSTANT)
     Q_PROPERTY(SerialisableState *uiState READ uiState CONSTANT)
@@ -125,6 +130,9 @@ public:
     Q_INVOKABLE virtual QImage exportedImage() const;
 
     QUndoStack *undoStack();
+    // Like QUndoStack::canUndo(), except that changes discarded to stay within
+    // the undo memory budget can't be undone.
+    bool canUndo() const;
 
     bool isComposingMacro() const;
     void beginMacro(const QString &text);
@@ -132,6 +140,9 @@ public:
     void addChange(UndoCommand *undoCommand);
     void clearChanges();
 
+    // The amount of bytes used by the images etc. stored in the undo history.
+    qint64 undoPayloadByteCount() const;
+
     ApplicationSettings *settings() const;
     void setSettings(ApplicationSettings *settings);
 
@@ -182,6 +193,8 @@ signals:
     void postGuidesRemoved();
     void notesChanged();
     void aboutToBeginMacro(const QString &text);
+    void undoPayloadByteCountChanged();
+    void canUndoChanged();
     /*
         Emitted whenever the image contents are modified
         through a command (e.g. pixels drawn, layers added, etc.)
@@ -219,6 +232,13 @@ protected:
 
     void setComposingMacro(bool composingMacro, const QString &macroText = QString());
 
+    UndoCommand *mostRecentUndoCommand() const;
+    void scheduleUndoPayloadByteCountChanged();
+    void scheduleUndoPayloadSpill();
+    void spillOlderUndoPayloads();
+    void updateInMemoryUndoPayloadByteCounts();
+    void enforceUndoMemoryBudget();
+
     QUrl createTemporaryImage(int width, int height, const QColor &colour);
 
     void readVersionNumbers(const QJsonObject &projectJson);
@@ -253,6 +273,18 @@ protected:
     bool mLivePreviewActive;
     LivePreviewModification mCurrentLivePreviewModification;
 
+    // Declared before mUndoStack so that it outlives the commands that use it.
+    QSharedPointer<UndoSpillFile> mUndoSpillFile;
+    // Changes can be added for each segment of a pen stroke, so undoPayloadByteCountChanged
+    // is emitted at most once per interval of this timer rather than once per change.
+    QTimer mUndoPayloadByteCountChangedTimer;
+    // Spilling is done once the user has stopped making changes for a moment.
+    QTimer mUndoSpillTimer;
+    // The changes below this index have already been spilled.
+    int mSpilledUndoCommandCount;
+    // The payload byte count of every change, which they keep up to date
+    // as they're added, modified and deleted. Declared before mUndoStack for that reason.
+    qint64 mUndoPayloadByteCount;
     QUndoStack mUndoStack;
     bool mComposingMacro;
     QString mCurrentlyComposingMacroText;
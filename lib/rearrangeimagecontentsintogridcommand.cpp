@@ -29,8 +29,8 @@ RearrangeImageContentsIntoGridCommand::RearrangeImageContentsIntoGridCommand(Ima
     const QImage &newImage, UndoCommand *parent) :
     UndoCommand(parent),
     mProject(project),
-    mPreviousImage(previousImage),
-    mNewImage(newImage)
+    mPreviousImage(previousImage, lcRearrangeImageContentsIntoGridCommand),
+    mNewImage(newImage, lcRearrangeImageContentsIntoGridCommand)
 {
     qCDebug(lcRearrangeImageContentsIntoGridCommand) << "constructed" << this;
 }
@@ -38,13 +38,23 @@ RearrangeImageContentsIntoGridCommand::RearrangeImageContentsIntoGridCommand(Ima
 void RearrangeImageContentsIntoGridCommand::undo()
 {
     qCDebug(lcRearrangeImageContentsIntoGridCommand) << "undoing" << this;
-    mProject->setImage(mPreviousImage);
+    bool restored = false;
+    const QImage previousImage = mPreviousImage.image(&restored);
+    if (!restored)
+        return;
+
+    mProject->setImage(previousImage);
 }
 
 void RearrangeImageContentsIntoGridCommand::redo()
 {
     qCDebug(lcRearrangeImageContentsIntoGridCommand) << "redoing" << this;
-    mProject->setImage(mNewImage);
+    bool restored = false;
+    const QImage newImage = mNewImage.image(&restored);
+    if (!restored)
+        return;
+
+    mProject->setImage(newImage);
 }
 
 int RearrangeImageContentsIntoGridCommand::id() const
@@ -57,6 +67,29 @@ bool RearrangeImageContentsIntoGridCommand::modifiesContents() const
     return true;
 }
 
+qint64 RearrangeImageContentsIntoGridCommand::payloadByteCount() const
+{
+    return mPreviousImage.byteCount() + mNewImage.unsharedByteCount();
+}
+
+void RearrangeImageContentsIntoGridCommand::compressPayload()
+{
+    mPreviousImage.compress();
+    mNewImage.compress();
+}
+
+void RearrangeImageContentsIntoGridCommand::spillPayload(const QSharedPointer<UndoSpillFile> &spillFile)
+{
+    mPreviousImage.spill(spillFile);
+    mNewImage.spill(spillFile);
+}
+
+void RearrangeImageContentsIntoGridCommand::releasePayload()
+{
+    mPreviousImage.clear();
+    mNewImage.clear();
+}
+
 QDebug operator<<(QDebug debug, const RearrangeImageContentsIntoGridCommand *command)
 {
     QDebugStateSaver saver(debug);
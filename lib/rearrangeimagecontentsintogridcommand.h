@@ -25,6 +25,7 @@
 
 #include "slate-global.h"
 #include "undocommand.h"
+#include "undoimage.h"
 
 class ImageProject;
 
@@ -40,13 +41,17 @@ public:
     int id() const override;
 
     bool modifiesContents() const override;
+    qint64 payloadByteCount() const override;
+    void compressPayload() override;
+    void spillPayload(const QSharedPointer<UndoSpillFile> &spillFile) override;
+    void releasePayload() override;
 
 private:
     friend QDebug operator<<(QDebug debug, const RearrangeImageContentsIntoGridCommand *command);
 
     ImageProject *mProject;
-    QImage mPreviousImage;
-    QImage mNewImage;
+    UndoImage mPreviousImage;
+    UndoImage mNewImage;
 };
 
 #endif // REARRANGEIMAGECONTENTSINTOGRIDCOMMAND_H
@@ -29,8 +29,8 @@ RearrangeLayeredImageContentsIntoGridCommand::RearrangeLayeredImageContentsIntoG
     const QVector<QImage> &previousImages, const QVector<QImage> &newImages, UndoCommand *parent) :
     UndoCommand(parent),
     mProject(project),
-    mPreviousImages(previousImages),
-    mNewImages(newImages)
+    mPreviousImages(UndoImage::fromImages(previousImages, lcRearrangeLayeredImageContentsIntoGridCommand)),
+    mNewImages(UndoImage::fromImages(newImages, lcRearrangeLayeredImageContentsIntoGridCommand))
 {
     qCDebug(lcRearrangeLayeredImageContentsIntoGridCommand) << "constructed" << this;
 }
@@ -38,13 +38,23 @@ RearrangeLayeredImageContentsIntoGridCommand::RearrangeLayeredImageContentsIntoG
 void RearrangeLayeredImageContentsIntoGridCommand::undo()
 {
     qCDebug(lcRearrangeLayeredImageContentsIntoGridCommand) << "undoing" << this;
-    mProject->doRearrangeContentsIntoGrid(mPreviousImages);
+    bool restored = false;
+    const QVector<QImage> previousImages = UndoImage::toImages(mPreviousImages, &restored);
+    if (!restored)
+        return;
+
+    mProject->doRearrangeContentsIntoGrid(previousImages);
 }
 
 void RearrangeLayeredImageContentsIntoGridCommand::redo()
 {
     qCDebug(lcRearrangeLayeredImageContentsIntoGridCommand) << "redoing" << this;
-    mProject->doRearrangeContentsIntoGrid(mNewImages);
+    bool restored = false;
+    const QVector<QImage> newImages = UndoImage::toImages(mNewImages, &restored);
+    if (!restored)
+        return;
+
+    mProject->doRearrangeContentsIntoGrid(newImages);
 }
 
 int RearrangeLayeredImageContentsIntoGridCommand::id() const
@@ -57,6 +67,38 @@ bool RearrangeLayeredImageContentsIntoGridCommand::modifiesContents() const
     return true;
 }
 
+qint64 RearrangeLayeredImageContentsIntoGridCommand::payloadByteCount() const
+{
+    qint64 byteCount = 0;
+    for (const UndoImage &image : mPreviousImages)
+        byteCount += image.byteCount();
+    for (const UndoImage &image : mNewImages)
+        byteCount += image.unsharedByteCount();
+    return byteCount;
+}
+
+void RearrangeLayeredImageContentsIntoGridCommand::compressPayload()
+{
+    for (UndoImage &image : mPreviousImages)
+        image.compress();
+    for (UndoImage &image : mNewImages)
+        image.compress();
+}
+
+void RearrangeLayeredImageContentsIntoGridCommand::spillPayload(const QSharedPointer<UndoSpillFile> &spillFile)
+{
+    for (UndoImage &image : mPreviousImages)
+        image.spill(spillFile);
+    for (UndoImage &image : mNewImages)
+        image.spill(spillFile);
+}
+
+void RearrangeLayeredImageContentsIntoGridCommand::releasePayload()
+{
+    mPreviousImages.clear();
+    mNewImages.clear();
+}
+
 QDebug operator<<(QDebug debug, const RearrangeLayeredImageContentsIntoGridCommand *)
 {
     debug.nospace() << "(RearrangeLayeredImageContentsIntoGridCommand)";
@@ -22,9 +22,11 @@
 #include <QDebug>
 #include <QLoggingCategory>
 #include <QPainter>
+#include <QQuickWindow>
 
 #include "animation.h"
 #include "animationplayback.h"
+#include "imagecanvas.h"
 #include "imageutils.h"
 #include "project.h"
 
@@ -32,7 +34,9 @@ Q_LOGGING_CATEGORY(lcSpriteImage, "app.spriteImage")
 
 SpriteImage::SpriteImage() :
     mProject(nullptr),
-    mAnimationPlayback(nullptr)
+    mAnimationPlayback(nullptr),
+    mCanvas(nullptr),
+    mSmoothDownsampling(false)
 {
 }
 
@@ -41,18 +45,42 @@ void SpriteImage::paint(QPainter *painter)
     if (!mProject || !mAnimationPlayback)
         return;
 
-    const QImage exportedImage = mProject->exportedImage();
+    const int currentFrameIndex = mAnimationPlayback->currentFrameIndex();
+    const int levelIndex = mipmapLevelIndex();
+    if (levelIndex > 0) {
+        // We're scaled down, so rather than downsampling the full-size frame every time
+        // it changes, draw the frame from the smallest mipmap level that is still at least
+        // as large as we are. updateTextureSize() made our texture the size of that level.
+        MipmapPyramid &pyramid = mCanvas->contentMipmapPyramid(mSmoothDownsampling
+            ? MipmapPyramid::BoxDownsample : MipmapPyramid::NearestDownsample);
+        if (levelIndex >= pyramid.levelCount())
+            return;
+
+        const QRect frameRect = ImageUtils::rectForAnimationFrame(pyramid.sourceImage().width(),
+            *mAnimationPlayback, currentFrameIndex);
+        const QRect levelFrameRect(QPoint(frameRect.x() >> levelIndex, frameRect.y() >> levelIndex),
+            levelFrameSize(levelIndex));
+
+        qCDebug(lcSpriteImage).nospace() << "painting sprite animation from mipmap level " << levelIndex
+            << " frameRect=" << frameRect << " levelFrameRect=" << levelFrameRect
+            << " currentFrameIndex=" << currentFrameIndex;
+
+        painter->drawImage(QRectF(0, 0, width(), height()), pyramid.level(levelIndex), levelFrameRect);
+        return;
+    }
+
+    const QImage exportedImage = canUseCanvas() ? mCanvas->exportedContentImage() : mProject->exportedImage();
     if (exportedImage.isNull())
         return;
 
     const QImage copy = ImageUtils::imageForAnimationFrame(exportedImage,
-        *mAnimationPlayback, mAnimationPlayback->currentFrameIndex());
+        *mAnimationPlayback, currentFrameIndex);
     Q_ASSERT(!copy.isNull());
 
     qCDebug(lcSpriteImage).nospace() << "painting sprite animation starting at"
         << " frameX=" << mAnimationPlayback->animation()->frameX()
         << " frameY=" << mAnimationPlayback->animation()->frameY()
-        << " currentFrameIndex=" << mAnimationPlayback->currentFrameIndex();
+        << " currentFrameIndex=" << currentFrameIndex;
 
     painter->drawImage(0, 0, copy);
 }
@@ -75,6 +103,7 @@ void SpriteImage::setProject(Project *project)
     if (mProject)
         connect(mProject, &Project::contentsModified, this, &SpriteImage::onNeedsUpdate);
 
+    updateTextureSize();
     update();
 
     emit projectChanged();
@@ -98,6 +127,7 @@ void SpriteImage::setAnimationPlayback(AnimationPlayback *animationPlayback)
     if (mAnimationPlayback) {
         connect(mAnimationPlayback, &AnimationPlayback::animationChanged, this, &SpriteImage::onAnimationChanged);
         connect(mAnimationPlayback, &AnimationPlayback::currentFrameIndexChanged, this, &SpriteImage::onNeedsUpdate);
+        connect(mAnimationPlayback, &AnimationPlayback::scaleChanged, this, &SpriteImage::onNeedsUpdate);
     }
 
     // Force implicit size change & repaint.
@@ -108,8 +138,41 @@ void SpriteImage::setAnimationPlayback(AnimationPlayback *animationPlayback)
     emit animationPlaybackChanged();
 }
 
+ImageCanvas *SpriteImage::canvas() const
+{
+    return mCanvas;
+}
+
+void SpriteImage::setCanvas(ImageCanvas *canvas)
+{
+    if (canvas == mCanvas)
+        return;
+
+    mCanvas = canvas;
+    updateTextureSize();
+    update();
+    emit canvasChanged();
+}
+
+bool SpriteImage::smoothDownsampling() const
+{
+    return mSmoothDownsampling;
+}
+
+void SpriteImage::setSmoothDownsampling(bool smoothDownsampling)
+{
+    if (smoothDownsampling == mSmoothDownsampling)
+        return;
+
+    mSmoothDownsampling = smoothDownsampling;
+    update();
+    emit smoothDownsamplingChanged();
+}
+
 void SpriteImage::onNeedsUpdate()
 {
+    // The project could have (re)loaded, which affects whether we can use the canvas.
+    updateTextureSize();
     update();
 }
 
@@ -118,6 +181,7 @@ void SpriteImage::onFrameSizeChanged()
     const auto animation = mAnimationPlayback ? mAnimationPlayback->animation() : nullptr;
     setImplicitWidth(animation ? animation->frameWidth() : 0);
     setImplicitHeight(animation ? animation->frameHeight() : 0);
+    updateTextureSize();
     update();
 }
 
@@ -135,3 +199,45 @@ void SpriteImage::onAnimationChanged(Animation *oldAnimation)
         connect(mAnimationPlayback->animation(), &Animation::frameHeightChanged, this, &SpriteImage::onFrameSizeChanged);
     }
 }
+
+void SpriteImage::updateTextureSize()
+{
+    const int levelIndex = mipmapLevelIndex();
+    if (levelIndex == 0) {
+        // Go back to the default, which is our size.
+        setTextureSize(QSize());
+    } else {
+        setTextureSize(levelFrameSize(levelIndex));
+    }
+}
+
+QSize SpriteImage::levelFrameSize(int levelIndex) const
+{
+    const Animation *animation = mAnimationPlayback->animation();
+    const int levelScale = 1 << levelIndex;
+    return QSize((animation->frameWidth() + levelScale - 1) / levelScale,
+        (animation->frameHeight() + levelScale - 1) / levelScale);
+}
+
+bool SpriteImage::canUseCanvas() const
+{
+    return mCanvas && mProject && mCanvas->project() == mProject && mProject->hasLoaded();
+}
+
+int SpriteImage::mipmapLevelIndex() const
+{
+    if (!canUseCanvas() || !mAnimationPlayback || !mAnimationPlayback->animation())
+        return 0;
+
+    const Animation *animation = mAnimationPlayback->animation();
+    const int largestFrameDimension = qMax(animation->frameWidth(), animation->frameHeight());
+    if (largestFrameDimension <= 0)
+        return 0;
+
+    const qreal devicePixelRatio = window() ? window()->effectiveDevicePixelRatio() : 1.0;
+    int levelIndex = MipmapPyramid::levelForScale(mAnimationPlayback->scale() * devicePixelRatio);
+    // Don't go below a single pixel.
+    while (levelIndex > 0 && (largestFrameDimension >> levelIndex) == 0)
+        --levelIndex;
+    return levelIndex;
+}
@@ -20,12 +20,14 @@
 #ifndef SPRITEIMAGE_H
 #define SPRITEIMAGE_H
 
+#include <QPointer>
 #include <QQuickPaintedItem>
 
 #include "slate-global.h"
 
 class Animation;
 class AnimationPlayback;
+class ImageCanvas;
 class Project;
 
 class SLATE_EXPORT SpriteImage : public QQuickPaintedItem
@@ -33,9 +35,12 @@ class SLATE_EXPORT SpriteImage : public QQuickPaintedItem
     Q_OBJECT
     Q_PROPERTY(Project *project READ project WRITE setProject NOTIFY projectChanged)
     Q_PROPERTY(AnimationPlayback *animationPlayback READ animationPlayback WRITE setAnimationPlayback NOTIFY animationPlaybackChanged)
+    Q_PROPERTY(ImageCanvas *canvas READ canvas WRITE setCanvas NOTIFY canvasChanged)
+    Q_PROPERTY(bool smoothDownsampling READ smoothDownsampling WRITE setSmoothDownsampling NOTIFY smoothDownsamplingChanged)
     QML_ELEMENT
     Q_MOC_INCLUDE("animation.h")
     Q_MOC_INCLUDE("animationplayback.h")
+    Q_MOC_INCLUDE("imagecanvas.h")
     Q_MOC_INCLUDE("project.h")
 
 public:
@@ -49,9 +54,17 @@ public:
     AnimationPlayback *animationPlayback() const;
     void setAnimationPlayback(AnimationPlayback *animationPlayback);
 
+    ImageCanvas *canvas() const;
+    void setCanvas(ImageCanvas *canvas);
+
+    bool smoothDownsampling() const;
+    void setSmoothDownsampling(bool smoothDownsampling);
+
 signals:
     void projectChanged();
     void animationPlaybackChanged();
+    void canvasChanged();
+    void smoothDownsamplingChanged();
 
 private slots:
     void onNeedsUpdate();
@@ -59,8 +72,19 @@ private slots:
     void onAnimationChanged(Animation *oldAnimation);
 
 private:
+    bool canUseCanvas() const;
+    int mipmapLevelIndex() const;
+    QSize levelFrameSize(int levelIndex) const;
+    void updateTextureSize();
+
     Project *mProject;
     AnimationPlayback *mAnimationPlayback;
+    // Optional; when set (and showing our project), we use its cached exported content image
+    // instead of having the project flatten its layers again. The canvas can be destroyed before us.
+    QPointer<ImageCanvas> mCanvas;
+    // When we're scaled down and using the canvas, we draw from its mipmap pyramid;
+    // this determines how that is created. Nearest is best for pixel art, so it's the default.
+    bool mSmoothDownsampling;
 };
 
 #endif // SPRITEIMAGE_H
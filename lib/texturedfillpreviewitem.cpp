@@ -59,7 +59,8 @@ void TexturedFillPreviewItem::paint(QPainter *painter)
     }
 
     mPreviewImage = ImageUtils::filledImage(w, h, targetColour);
-    mPreviewImage = texturedFill(&mPreviewImage, QPoint(0, 0), targetColour, mCanvas->penForegroundColour(), mParameters);
+    // Use the same seed each time so that the preview only changes when the parameters do.
+    mPreviewImage = texturedFill(&mPreviewImage, QPoint(0, 0), targetColour, mCanvas->penForegroundColour(), mParameters, 0);
     painter->drawImage(0, 0, mPreviewImage);
 }
 
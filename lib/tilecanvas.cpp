@@ -140,7 +140,7 @@ void TileCanvas::reset()
     // - tool
     // - toolSize
 
-    requestContentPaint();
+    requestChangedContentPaint();
 }
 
 void TileCanvas::swatchLeft()
@@ -178,11 +178,11 @@ void TileCanvas::swatchDown()
 void TileCanvas::onTilesetChanged(Tileset *oldTileset, Tileset *newTileset)
 {
     if (oldTileset) {
-        disconnect(oldTileset, &Tileset::imageChanged, this, &TileCanvas::requestContentPaint);
+        disconnect(oldTileset, &Tileset::imageChanged, this, &TileCanvas::requestChangedContentPaint);
     }
 
     if (newTileset) {
-        connect(newTileset, &Tileset::imageChanged, this, &TileCanvas::requestContentPaint);
+        connect(newTileset, &Tileset::imageChanged, this, &TileCanvas::requestChangedContentPaint);
     }
 }
 
@@ -208,7 +208,7 @@ void TileCanvas::connectSignals()
     mTilesetProject = qobject_cast<TilesetProject*>(mProject);
     Q_ASSERT_X(mTilesetProject, Q_FUNC_INFO, "Non-tileset project set on TileCanvas");
 
-    connect(mTilesetProject, &TilesetProject::tilesCleared, this, &TileCanvas::requestContentPaint);
+    connect(mTilesetProject, &TilesetProject::tilesCleared, this, &TileCanvas::requestChangedContentPaint);
     connect(mTilesetProject, &TilesetProject::tilesetChanged, this, &TileCanvas::onTilesetChanged);
 
     setPenTile(mTilesetProject->tilesetTileAt(0, 0));
@@ -222,7 +222,7 @@ void TileCanvas::disconnectSignals()
 {
     ImageCanvas::disconnectSignals();
 
-    disconnect(mTilesetProject, &TilesetProject::tilesCleared, this, &TileCanvas::requestContentPaint);
+    disconnect(mTilesetProject, &TilesetProject::tilesCleared, this, &TileCanvas::requestChangedContentPaint);
     disconnect(mTilesetProject, &TilesetProject::tilesetChanged, this, &TileCanvas::onTilesetChanged);
 
     setPenTile(nullptr);
@@ -246,20 +246,35 @@ TileCanvas::PixelCandidateData TileCanvas::penEraserPixelCandidates(Tool tool) c
 
     const QPoint topLeft(qRound(mCursorSceneFX - mToolSize / 2.0), qRound(mCursorSceneFY - mToolSize / 2.0));
     const QPoint bottomRight(qRound(mCursorSceneFX + mToolSize / 2.0), qRound(mCursorSceneFY + mToolSize / 2.0));
-    QPoint scenePos(topLeft);
-    for (; scenePos.y() < bottomRight.y(); ++scenePos.ry()) {
-        for (scenePos.rx() = topLeft.x(); scenePos.x() < bottomRight.x(); ++scenePos.rx()) {
-            const Tile *tile = mTilesetProject->tileAt(scenePos);
-            if (tile) {
-                const QPoint tilePixelPos = scenePosToTilePixelPos(scenePos);
-                const QColor previousColour = tile->pixelColor(tilePixelPos);
+    const QRect bounds(topLeft, QSize(bottomRight.x() - topLeft.x(), bottomRight.y() - topLeft.y()));
+    if (bounds.isEmpty())
+        return candidateData;
+
+    candidateData.bounds = bounds;
+    candidateData.mask.resize(bounds.width() * bounds.height());
+    candidateData.previousPixels.resize(bounds.width() * bounds.height());
+
+    const QRgb penPixel = penColour().rgba();
+    const QImage *tilesetImage = mTilesetProject->tileset()->image();
+    // Read each tile's part of the brush a scan line at a time. Pixels that aren't over a tile stay unmasked.
+    const QList<SubImage> subImages = subImagesInBounds(bounds);
+    for (const SubImage &subImage : subImages) {
+        const QPoint sceneToTilesetOffset = subImage.bounds.topLeft() - subImage.offset;
+        const QRect sceneArea = subImage.bounds.translated(-sceneToTilesetOffset).intersected(bounds);
+        if (sceneArea.isEmpty())
+            continue;
+
+        const QImage previousImage = tilesetImage->copy(sceneArea.translated(sceneToTilesetOffset))
+            .convertToFormat(QImage::Format_ARGB32);
+        for (int y = 0; y < sceneArea.height(); ++y) {
+            const QRgb *scanLine = reinterpret_cast<const QRgb*>(previousImage.constScanLine(y));
+            const int rowIndex = (sceneArea.y() - bounds.y() + y) * bounds.width() + sceneArea.x() - bounds.x();
+            for (int x = 0; x < sceneArea.width(); ++x) {
+                const QRgb previousPixel = scanLine[x];
+                candidateData.previousPixels[rowIndex + x] = previousPixel;
                 // Don't do anything if the colours are the same; this prevents issues
                 // with undos not undoing everything across tiles.
-                const bool hasEffect = tool == PenTool ? penColour() != previousColour : previousColour != QColor(Qt::transparent);
-                if (hasEffect) {
-                    candidateData.scenePositions.append(scenePos);
-                    candidateData.previousColours.append(previousColour);
-                }
+                candidateData.mask[rowIndex + x] = tool == PenTool ? penPixel != previousPixel : previousPixel != 0;
             }
         }
     }
@@ -267,9 +282,9 @@ TileCanvas::PixelCandidateData TileCanvas::penEraserPixelCandidates(Tool tool) c
     return candidateData;
 }
 
-TileCanvas::PixelCandidateData TileCanvas::fillPixelCandidates() const
+TileCanvas::PixelFillCandidateData TileCanvas::fillPixelCandidates(bool greedy) const
 {
-    PixelCandidateData candidateData;
+    PixelFillCandidateData candidateData;
 
     const QPoint tilePos = QPoint(mCursorSceneX, mCursorSceneY);
     Tile *tile = mTilesetProject->tileAt(tilePos);
@@ -286,23 +301,21 @@ TileCanvas::PixelCandidateData TileCanvas::fillPixelCandidates() const
     }
 
     QVector<QPoint> tilePixelPositions;
-    tilesetPixelFloodFill(tile, tilePixelPos, previousColour, penColour(), tilePixelPositions);
+    if (greedy)
+        tilesetGreedyPixelFill(tile, previousColour, penColour(), tilePixelPositions);
+    else
+        tilesetPixelFloodFill(tile, tilePixelPos, previousColour, penColour(), tilePixelPositions);
 
+    candidateData.scenePositions.reserve(tilePixelPositions.size());
     for (const QPoint &pixelPos : tilePixelPositions) {
         candidateData.scenePositions.append(tileTopLeftScenePos + pixelPos);
     }
 
-    candidateData.previousColours.append(previousColour);
+    candidateData.previousColour = previousColour;
     return candidateData;
 }
 
-ImageCanvas::PixelCandidateData TileCanvas::greedyFillPixelCandidates() const
-{
-    // TODO
-    return PixelCandidateData();
-}
-
-TileCanvas::TileCandidateData TileCanvas::fillTileCandidates() const
+TileCanvas::TileCandidateData TileCanvas::fillTileCandidates(bool greedy) const
 {
     TileCandidateData candidateData;
 
@@ -317,7 +330,10 @@ TileCanvas::TileCandidateData TileCanvas::fillTileCandidates() const
 
     const int xTile = scenePos.x() / mTilesetProject->tileWidth();
     const int yTile = scenePos.y() / mTilesetProject->tileHeight();
-    tilesetTileFloodFill(mTilesetProject, tile, QPoint(xTile, yTile), previousTileId, newTileId, candidateData.tilePositions);
+    if (greedy)
+        tilesetGreedyTileFill(mTilesetProject, previousTileId, newTileId, candidateData.tilePositions);
+    else
+        tilesetTileFloodFill(mTilesetProject, QPoint(xTile, yTile), previousTileId, newTileId, candidateData.tilePositions);
 
     candidateData.previousTile = previousTileId;
     candidateData.newTileId = newTileId;
@@ -368,12 +384,12 @@ void TileCanvas::applyCurrentTool()
     case EraserTool: {
         if (mMode == PixelMode) {
             const PixelCandidateData candidateData = penEraserPixelCandidates(EraserTool);
-            if (candidateData.scenePositions.isEmpty()) {
+            if (candidateData.isEmpty()) {
                 return;
             }
 
             mTilesetProject->beginMacro(QLatin1String("PixelEraserTool"));
-            mTilesetProject->addChange(new ApplyPixelEraserCommand(this, -1, candidateData.scenePositions, candidateData.previousColours));
+            mTilesetProject->addChange(new ApplyPixelEraserCommand(this, -1, candidateData.packedPreviousPixels()));
         } else {
             const QPoint scenePos = QPoint(mCursorSceneX, mCursorSceneY);
             const Tile *tile = mTilesetProject->tileAt(scenePos);
@@ -391,21 +407,21 @@ void TileCanvas::applyCurrentTool()
     }
     case FillTool: {
         if (mMode == PixelMode) {
-            const PixelCandidateData candidateData = fillPixelCandidates();
+            const PixelFillCandidateData candidateData = fillPixelCandidates(mShiftPressed);
             if (candidateData.scenePositions.isEmpty()) {
                 return;
             }
 
-            mTilesetProject->beginMacro(QLatin1String("PixelFillTool"));
+            mTilesetProject->beginMacro(mShiftPressed ? QLatin1String("GreedyPixelFillTool") : QLatin1String("PixelFillTool"));
             mTilesetProject->addChange(new ApplyTileCanvasPixelFillCommand(this, candidateData.scenePositions,
-                candidateData.previousColours.first(), penColour()));
+                candidateData.previousColour, penColour()));
         } else {
-            const TileCandidateData candidateData = fillTileCandidates();
+            const TileCandidateData candidateData = fillTileCandidates(mShiftPressed);
             if (candidateData.tilePositions.isEmpty()) {
                 return;
             }
 
-            mTilesetProject->beginMacro(QLatin1String("TileFillTool"));
+            mTilesetProject->beginMacro(mShiftPressed ? QLatin1String("GreedyTileFillTool") : QLatin1String("TileFillTool"));
             mTilesetProject->addChange(new ApplyTileFillCommand(this, candidateData.tilePositions,
                 candidateData.previousTile, candidateData.newTileId));
         }
@@ -444,34 +460,79 @@ QList<ImageCanvas::SubImage> TileCanvas::subImagesInBounds(const QRect &bounds)
 }
 
 // This function actually operates on the image.
-void TileCanvas::applyPixelPenTool(int layerIndex, const QPoint &scenePos, const QColor &colour, bool markAsLastRelease)
+void TileCanvas::applyPixelPenTool(int layerIndex, const QVector<QPoint> &scenePositions, const QVector<QColor> &colours,
+    bool markAsLastRelease)
 {
     Q_ASSERT(layerIndex == -1);
+    if (scenePositions.isEmpty())
+        return;
 
-    Tile *tile = mTilesetProject->tileAt(scenePos);
-    Q_ASSERT_X(tile, Q_FUNC_INFO, qPrintable(QString::fromLatin1(
-        "No tile at scene pos {%1, %2}").arg(scenePos.x()).arg(scenePos.y())));
-    const QPoint pixelPos = scenePosToTilePixelPos(scenePos);
-    const QPoint tilsetPixelPos = tile->sourceRect().topLeft() + pixelPos;
-    mTilesetProject->tileset()->setPixelColor(tilsetPixelPos.x(), tilsetPixelPos.y(), colour);
+    Q_ASSERT(colours.size() == 1 || colours.size() == scenePositions.size());
+    // Modify the image directly rather than through Tileset::setPixelColor(),
+    // so that the image is only reported as changed once.
+    QImage *tilesetImage = mTilesetProject->tileset()->image();
+    for (int i = 0; i < scenePositions.size(); ++i) {
+        const QPoint &scenePos = scenePositions.at(i);
+        Tile *tile = mTilesetProject->tileAt(scenePos);
+        Q_ASSERT_X(tile, Q_FUNC_INFO, qPrintable(QString::fromLatin1(
+            "No tile at scene pos {%1, %2}").arg(scenePos.x()).arg(scenePos.y())));
+        const QPoint pixelPos = scenePosToTilePixelPos(scenePos);
+        const QPoint tilsetPixelPos = tile->sourceRect().topLeft() + pixelPos;
+        tilesetImage->setPixelColor(tilsetPixelPos, colours.size() == 1 ? colours.first() : colours.at(i));
+    }
     if (markAsLastRelease)
-        mLastPixelPenPressScenePositionF = scenePos;
-    requestContentPaint();
+        mLastPixelPenPressScenePositionF = scenePositions.last();
+    requestChangedContentPaint();
+    mTilesetProject->tileset()->notifyImageChanged();
+}
+
+void TileCanvas::applyPackedPixels(int layerIndex, const QVector<PackedPixels> &pixelsList, const QColor &colour,
+    bool markAsLastRelease)
+{
+    Q_ASSERT(layerIndex == -1);
+    if (pixelsList.isEmpty())
+        return;
+
+    // Write each tile's part of the pixels into the tileset a run at a time.
+    QImage *tilesetImage = mTilesetProject->tileset()->image();
+    for (const PackedPixels &pixels : pixelsList) {
+        const QList<SubImage> subImages = subImagesInBounds(pixels.bounds());
+        for (const SubImage &subImage : subImages) {
+            const QPoint sceneToTilesetOffset = subImage.bounds.topLeft() - subImage.offset;
+            const QRect sceneArea = subImage.bounds.translated(-sceneToTilesetOffset);
+            if (colour.isValid())
+                pixels.fill(tilesetImage, colour, sceneArea, sceneToTilesetOffset);
+            else
+                pixels.write(tilesetImage, sceneArea, sceneToTilesetOffset);
+        }
+    }
+    if (markAsLastRelease)
+        mLastPixelPenPressScenePositionF = pixelsList.last().lastPosition();
+    requestChangedContentPaint();
+    mTilesetProject->tileset()->notifyImageChanged();
 }
 
 void TileCanvas::applyTilePenTool(const QPoint &tilePos, int id)
 {
     mTilesetProject->setTileAtPixelPos(tilePos, id);
-    requestContentPaint();
+    requestChangedContentPaint();
+}
+
+QImage *TileCanvas::imageForLayerAt(int)
+{
+    return mTilesetProject->tileset()->image();
 }
 
-void TileCanvas::applyPixelLineTool(int, const QImage &lineImage, const QRect &lineRect, const QPointF &lastPixelPenReleaseScenePosition)
+void TileCanvas::applyPixelLineTool(int, const QHash<QPoint, QImage> &tiles, const QRect &, const QPointF &lastPixelPenReleaseScenePosition)
 {
     mLastPixelPenPressScenePositionF = lastPixelPenReleaseScenePosition;
-    QPainter painter(mTilesetProject->tileset()->image());
-    painter.setCompositionMode(QPainter::CompositionMode_Source);
-    painter.drawImage(lineRect, lineImage);
-    requestContentPaint();
+    if (!tiles.isEmpty()) {
+        QPainter painter(mTilesetProject->tileset()->image());
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        for (auto it = tiles.constBegin(); it != tiles.constEnd(); ++it)
+            painter.drawImage(it.key(), it.value());
+    }
+    requestChangedContentPaint();
     mTilesetProject->tileset()->notifyImageChanged();
 }
 
@@ -534,7 +595,16 @@ void TileCanvas::updateCursorPos(const QPoint &eventPos)
         }
 
         if (mTilePenPreview) {
-            requestContentPaint();
+            // Only the tile that the preview was over and the one that it's over now need to be repainted,
+            // and nothing at all if it's still over the same tile.
+            const QRect tileRect = sceneRectToTileRect(QRect(cursorScenePos, QSize(1, 1)));
+            const QRect previewSceneRect(tileRect.x() * mTilesetProject->tileWidth(),
+                tileRect.y() * mTilesetProject->tileHeight(), mTilesetProject->tileWidth(), mTilesetProject->tileHeight());
+            if (previewSceneRect != mTilePenPreviewSceneRect) {
+                requestContentAreaPaint(mTilePenPreviewSceneRect);
+                requestContentAreaPaint(previewSceneRect);
+                mTilePenPreviewSceneRect = previewSceneRect;
+            }
         }
     }
 }
@@ -568,6 +638,8 @@ void TileCanvas::setTilePenPreview(bool tilePenPreview)
         return;
 
     mTilePenPreview = tilePenPreview;
+    // The whole pane is repainted, so updateCursorPos() has nothing to repaint for the old preview.
+    mTilePenPreviewSceneRect = QRect();
     requestContentPaint();
 }
 
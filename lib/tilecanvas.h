@@ -79,6 +79,9 @@ public:
 
     QList<SubImage> subImagesInBounds(const QRect &bounds) const override;
 
+    // The tileset's image is the only image that we draw on, regardless of layerIndex.
+    QImage *imageForLayerAt(int layerIndex) override;
+
 signals:
     void cursorTilePixelXChanged();
     void cursorTilePixelYChanged();
@@ -119,8 +122,15 @@ private:
     friend class ApplyTileCanvasPixelFillCommand;
 
     PixelCandidateData penEraserPixelCandidates(Tool tool) const override;
-    PixelCandidateData fillPixelCandidates() const;
-    PixelCandidateData greedyFillPixelCandidates() const;
+
+    struct PixelFillCandidateData
+    {
+        QVector<QPoint> scenePositions;
+        QColor previousColour;
+    };
+    // If greedy is true, every pixel in the tile that is the target colour is a candidate,
+    // rather than only the contiguous ones.
+    PixelFillCandidateData fillPixelCandidates(bool greedy) const;
 
     struct TileCandidateData
     {
@@ -130,12 +140,17 @@ private:
 
         TileCandidateData() : previousTile(-1), newTileId(-1) {}
     };
-    TileCandidateData fillTileCandidates() const;
+    // If greedy is true, every tile in the map that is the target tile is a candidate.
+    TileCandidateData fillTileCandidates(bool greedy) const;
 
     void applyCurrentTool() override;
-    void applyPixelPenTool(int layerIndex, const QPoint &scenePos, const QColor &colour, bool markAsLastRelease = false) override;
+    void applyPixelPenTool(int layerIndex, const QVector<QPoint> &scenePositions, const QVector<QColor> &colours,
+        bool markAsLastRelease = false) override;
+    void applyPackedPixels(int layerIndex, const QVector<PackedPixels> &pixelsList, const QColor &colour = QColor(),
+        bool markAsLastRelease = false) override;
     void applyTilePenTool(const QPoint &tilePos, int id);
-    void applyPixelLineTool(int layerIndex, const QImage &lineImage, const QRect &lineRect, const QPointF &lastPixelPenReleaseScenePosition) override;
+    void applyPixelLineTool(int layerIndex, const QHash<QPoint, QImage> &tiles, const QRect &changedArea,
+        const QPointF &lastPixelPenReleaseScenePosition) override;
 
     void updateCursorPos(const QPoint &eventPos) override;
     QColor penColour() const;
@@ -154,6 +169,8 @@ private:
     Mode mMode;
     Tile *mPenTile;
     bool mTilePenPreview;
+    // The area (in scene coordinates) of the tile that the tile pen preview was last drawn over.
+    QRect mTilePenPreviewSceneRect;
     bool mGridVisible;
 };
 
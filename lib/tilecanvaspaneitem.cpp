@@ -21,6 +21,7 @@
 
 #include "canvaspane.h"
 #include "panedrawinghelper.h"
+#include "qtutils.h"
 #include "tilecanvas.h"
 #include "tilesetproject.h"
 
@@ -46,8 +47,6 @@ void TileCanvasPaneItem::paint(QPainter *painter)
     if (!mCanvas->project() || !mCanvas->project()->hasLoaded())
         return;
 
-    PaneDrawingHelper paneDrawingHelper(mCanvas, painter, mPane, mPaneIndex);
-
     TileCanvas *tileCanvas = qobject_cast<TileCanvas*>(mCanvas);
     Q_ASSERT(tileCanvas);
 
@@ -55,31 +54,44 @@ void TileCanvasPaneItem::paint(QPainter *painter)
     Q_ASSERT(tilesetProject);
 
     const QSize zoomedTileSize = mPane->zoomedSize(tilesetProject->tileSize());
-    // Try to only draw as much as could possibly fit within the pane.
-//    const int horizontalStartTile = pane.offset().x() < 0 ? qFloor(qAbs(pane.offset().x()) / zoomedTileSize.width()) : 0;
-//    const int verticalStartTile = pane.offset().y() < 0 ? qFloor(qAbs(pane.offset().y()) / zoomedTileSize.height()) : 0;
-    const int tilesAcross = tilesetProject->tilesWide();//qMin(mProject->tilesWide(), qCeil(paneWidth / zoomedTileSize.width()) + 1);
-    const int tilesDown = tilesetProject->tilesHigh();//qMin(mProject->tilesHigh(), qCeil(height() / zoomedTileSize.width()) + 1);
+    if (zoomedTileSize.isEmpty())
+        return;
 
-    // Draw the checkered pixmap that acts as an indicator for transparency.
-    // We use the unbounded canvas size here, otherwise the drawn area is too small past a certain zoom level.
-    painter->drawTiledPixmap(0, 0, zoomedTileSize.width() * tilesAcross, zoomedTileSize.height() * tilesDown, mCanvas->mCheckerPixmap);
+    // Only draw the tiles that are within the area being painted; QQuickPaintedItem
+    // only clips the painter when specific areas were passed to update().
+    const QRectF paintedArea = painter->hasClipping() ? painter->clipBoundingRect() : boundingRect();
+    const QRect visibleTiles = tilesWithin(paintedArea.intersected(boundingRect()).toAlignedRect(), zoomedTileSize);
+    if (visibleTiles.isEmpty())
+        return;
+
+    PaneDrawingHelper paneDrawingHelper(mCanvas, painter, mPane, mPaneIndex);
 
-    for (int y = 0; y < tilesDown; ++y) {
-        for (int x = 0; x < tilesAcross; ++x) {
+    // Draw the checkered pixmap that acts as an indicator for transparency.
+    // The offset keeps the checkers aligned as if all tiles were drawn.
+    const QRect zoomedVisibleArea(visibleTiles.left() * zoomedTileSize.width(), visibleTiles.top() * zoomedTileSize.height(),
+        visibleTiles.width() * zoomedTileSize.width(), visibleTiles.height() * zoomedTileSize.height());
+    painter->drawTiledPixmap(zoomedVisibleArea, mCanvas->mCheckerPixmap, zoomedVisibleArea.topLeft());
+
+    // If the tile pen is in use, draw it over the tile that the cursor is in instead of the tile that's there.
+    const QPoint previewTilePos = tileCanvas->mTilePenPreview
+        ? tileCanvas->sceneRectToTileRect(QRect(tileCanvas->cursorSceneX(), tileCanvas->cursorSceneY(), 1, 1)).topLeft()
+        : QPoint(-1, -1);
+
+    const int tilesAcross = tilesetProject->tilesWide();
+    const int tilesDown = tilesetProject->tilesHigh();
+    const bool gridVisible = tileCanvas->mGridVisible;
+    // Collect the grid lines so that they can all be drawn at once.
+    QVector<QLine> gridLines;
+    if (gridVisible)
+        gridLines.reserve(visibleTiles.width() * visibleTiles.height() * 2 + visibleTiles.width() + visibleTiles.height());
+
+    for (int y = visibleTiles.top(); y <= visibleTiles.bottom(); ++y) {
+        for (int x = visibleTiles.left(); x <= visibleTiles.right(); ++x) {
             const QPoint topLeftInScene(x * tilesetProject->tileWidth(), y * tilesetProject->tileHeight());
             const QRect rect(x * zoomedTileSize.width(), y * zoomedTileSize.height(),
                 zoomedTileSize.width(), zoomedTileSize.height());
 
-            // If the tile pen is in use and it's over this tile, draw it, otherwise draw the current tile
-            // at that location as usual.
-            bool previewTile = false;
-            if (tileCanvas->mTilePenPreview) {
-                QRect tileSceneRect(topLeftInScene.x(), topLeftInScene.y(), tilesetProject->tileWidth(), tilesetProject->tileHeight());
-                previewTile = tileSceneRect.contains(tileCanvas->cursorSceneX(), tileCanvas->cursorSceneY());
-            }
-
-            if (previewTile) {
+            if (QPoint(x, y) == previewTilePos) {
                 painter->drawImage(rect, *tileCanvas->mPenTile->tileset()->image(), tileCanvas->mPenTile->sourceRect());
             } else {
                 const Tile *tile = tilesetProject->tileAt(topLeftInScene);
@@ -88,26 +100,43 @@ void TileCanvasPaneItem::paint(QPainter *painter)
                 }
             }
 
-            if (tileCanvas->mGridVisible) {
-                QPen pen(tileCanvas->mGridColour);
-                painter->setPen(pen);
-
-                painter->drawLine(rect.x(), rect.y(), rect.x(), rect.y() + rect.height() - 1);
+            if (gridVisible) {
+                gridLines.append(QLine(rect.x(), rect.y(), rect.x(), rect.y() + rect.height() - 1));
 
                 if (x == tilesAcross - 1) {
                     // If this is the right-most edge tile, draw a line on the outside of it.
-                    painter->drawLine(rect.x() + zoomedTileSize.width(), rect.y(),
-                        rect.x() + zoomedTileSize.width(), rect.y() + rect.height() - 1);
+                    gridLines.append(QLine(rect.x() + zoomedTileSize.width(), rect.y(),
+                        rect.x() + zoomedTileSize.width(), rect.y() + rect.height() - 1));
                 }
 
-                painter->drawLine(rect.x() + 1, rect.y(), rect.x() + rect.width() - 1, rect.y());
+                gridLines.append(QLine(rect.x() + 1, rect.y(), rect.x() + rect.width() - 1, rect.y()));
 
                 if (y == tilesDown - 1) {
                     // If this is the bottom-most edge tile, draw a line on the outside of it.
-                    painter->drawLine(rect.x(), rect.y() + zoomedTileSize.height(),
-                        rect.x() + rect.width(), rect.y() + zoomedTileSize.width());
+                    gridLines.append(QLine(rect.x(), rect.y() + zoomedTileSize.height(),
+                        rect.x() + rect.width(), rect.y() + zoomedTileSize.height()));
                 }
             }
         }
     }
+
+    if (!gridLines.isEmpty()) {
+        painter->setPen(QPen(tileCanvas->mGridColour));
+        painter->drawLines(gridLines);
+    }
+}
+
+// Returns the range of tiles (in tile coordinates) that are covered by itemArea.
+QRect TileCanvasPaneItem::tilesWithin(const QRect &itemArea, const QSize &zoomedTileSize) const
+{
+    const TilesetProject *tilesetProject = qobject_cast<const TilesetProject*>(mCanvas->project());
+    const QPoint integerOffset = mPane->integerOffset();
+    // The outer grid lines are drawn just past the right and bottom edges of the last tiles,
+    // so extend the area by a pixel to make sure that those tiles are included.
+    const QRect area = itemArea.adjusted(-1, -1, 0, 0).translated(-integerOffset);
+    const QPoint firstTile(QtUtils::divFloor(area.left(), zoomedTileSize.width()),
+        QtUtils::divFloor(area.top(), zoomedTileSize.height()));
+    const QPoint lastTile(QtUtils::divFloor(area.right(), zoomedTileSize.width()),
+        QtUtils::divFloor(area.bottom(), zoomedTileSize.height()));
+    return QRect(firstTile, lastTile).intersected(QRect(0, 0, tilesetProject->tilesWide(), tilesetProject->tilesHigh()));
 }
@@ -34,6 +34,9 @@ public:
     ~TileCanvasPaneItem() override;
 
     void paint(QPainter *painter) override;
+
+protected:
+    QRect tilesWithin(const QRect &itemArea, const QSize &zoomedTileSize) const;
 };
 
 #endif
@@ -20,15 +20,92 @@
 #include "undocommand.h"
 
 UndoCommand::UndoCommand(QUndoCommand *parent) :
-    QUndoCommand(parent)
+    QUndoCommand(parent),
+    mCreationTime(QDateTime::currentDateTime())
 {
 }
 
 UndoCommand::~UndoCommand()
 {
+    if (mPayloadByteCountTotal)
+        *mPayloadByteCountTotal -= mAccountedPayloadByteCount;
 }
 
 bool UndoCommand::modifiesContents() const
 {
     return false;
 }
+
+qint64 UndoCommand::payloadByteCount() const
+{
+    return 0;
+}
+
+void UndoCommand::compressPayload()
+{
+}
+
+void UndoCommand::spillPayload(const QSharedPointer<UndoSpillFile> &)
+{
+}
+
+void UndoCommand::releasePayload()
+{
+}
+
+void UndoCommand::macroEnded()
+{
+}
+
+void UndoCommand::forEach(const QUndoCommand *command, const std::function<void(UndoCommand*)> &function)
+{
+    // QUndoStack only gives out const commands, but changing how a command
+    // stores its payload doesn't change what it does when it's undone or redone.
+    if (auto undoCommand = dynamic_cast<const UndoCommand*>(command))
+        function(const_cast<UndoCommand*>(undoCommand));
+
+    for (int i = 0; i < command->childCount(); ++i)
+        forEach(command->child(i), function);
+}
+
+qint64 UndoCommand::totalPayloadByteCount(const QUndoCommand *command)
+{
+    qint64 byteCount = 0;
+    forEach(command, [&byteCount](UndoCommand *undoCommand) {
+        byteCount += undoCommand->payloadByteCount();
+    });
+    return byteCount;
+}
+
+void UndoCommand::accountPayloadByteCountIn(qint64 *total)
+{
+    Q_ASSERT(!mPayloadByteCountTotal);
+    mPayloadByteCountTotal = total;
+    mAccountedPayloadByteCount = payloadByteCount();
+    *mPayloadByteCountTotal += mAccountedPayloadByteCount;
+}
+
+void UndoCommand::updateAccountedPayloadByteCount()
+{
+    if (!mPayloadByteCountTotal)
+        return;
+
+    const qint64 byteCount = payloadByteCount();
+    *mPayloadByteCountTotal += byteCount - mAccountedPayloadByteCount;
+    mAccountedPayloadByteCount = byteCount;
+}
+
+QDateTime UndoCommand::creationTime() const
+{
+    return mCreationTime;
+}
+
+qint64 UndoCommand::applyDurationInNsecs() const
+{
+    return mApplyDurationInNsecs;
+}
+
+void UndoCommand::addApplyDuration(qint64 nsecs)
+{
+    mApplyDurationInNsecs += nsecs;
+}
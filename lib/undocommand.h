@@ -20,10 +20,16 @@
 #ifndef UNDOCOMMAND_H
 #define UNDOCOMMAND_H
 
+#include <QDateTime>
+#include <QSharedPointer>
 #include <QUndoCommand>
 
+#include <functional>
+
 #include "slate-global.h"
 
+class UndoSpillFile;
+
 class SLATE_EXPORT UndoCommand : public QUndoCommand
 {
 public:
@@ -32,6 +38,47 @@ public:
 
     // Returns true if this undo command should cause the Project::contentsModified() signal to be emitted.
     virtual bool modifiesContents() const;
+
+    // The amount of bytes used to store the images etc. that this command needs to undo and redo.
+    virtual qint64 payloadByteCount() const;
+    // Compresses the stored images. Called on older commands when the
+    // project's undo history uses more memory than the budget allows.
+    virtual void compressPayload();
+    // Moves the stored images into spillFile. Called on commands that
+    // are no longer among the most recent in the project's undo history.
+    virtual void spillPayload(const QSharedPointer<UndoSpillFile> &spillFile);
+    // Frees the stored images. Called on the oldest commands when compressing wasn't enough;
+    // the command will never be undone or redone afterwards.
+    virtual void releasePayload();
+    // Called when the macro that the command is part of has ended,
+    // after which nothing else will be merged into it.
+    virtual void macroEnded();
+
+    // Calls function for command and each of its descendants that is an UndoCommand.
+    // Commands that were added while composing a macro are children of a plain QUndoCommand.
+    static void forEach(const QUndoCommand *command, const std::function<void(UndoCommand*)> &function);
+    // The payload byte count of command and its descendants.
+    static qint64 totalPayloadByteCount(const QUndoCommand *command);
+
+    // Adds the payload byte count of the command to total, and keeps total up to date
+    // (see updateAccountedPayloadByteCount()) until the command is deleted.
+    void accountPayloadByteCountIn(qint64 *total);
+    // Updates the total that was passed to accountPayloadByteCountIn()
+    // for any changes to the payload byte count since it was last accounted for.
+    void updateAccountedPayloadByteCount();
+
+    // When the command was created.
+    QDateTime creationTime() const;
+    // How long it took to apply the command when it was added to the project,
+    // including the time taken by any commands that were merged into it.
+    qint64 applyDurationInNsecs() const;
+    void addApplyDuration(qint64 nsecs);
+
+private:
+    QDateTime mCreationTime;
+    qint64 mApplyDurationInNsecs = 0;
+    qint64 *mPayloadByteCountTotal = nullptr;
+    qint64 mAccountedPayloadByteCount = 0;
 };
 
 
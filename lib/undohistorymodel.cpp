@@ -0,0 +1,144 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "undohistorymodel.h"
+
+#include <QDateTime>
+#include <QLoggingCategory>
+
+#include "project.h"
+#include "undocommand.h"
+
+Q_LOGGING_CATEGORY(lcUndoHistoryModel, "app.undoHistoryModel")
+
+UndoHistoryModel::UndoHistoryModel(QObject *parent) :
+    QAbstractListModel(parent),
+    mProject(nullptr)
+{
+    qCDebug(lcUndoHistoryModel) << "constructing" << this;
+}
+
+UndoHistoryModel::~UndoHistoryModel()
+{
+    qCDebug(lcUndoHistoryModel) << "destroying" << this;
+}
+
+Project *UndoHistoryModel::project() const
+{
+    return mProject;
+}
+
+void UndoHistoryModel::setProject(Project *project)
+{
+    qCDebug(lcUndoHistoryModel) << "setProject called on" << this << "with" << project;
+    if (project == mProject)
+        return;
+
+    if (mProject) {
+        mProject->disconnect(this);
+        mProject->undoStack()->disconnect(this);
+    }
+
+    beginResetModel();
+    mProject = project;
+    endResetModel();
+    emit projectChanged();
+
+    if (mProject) {
+        // The history is small enough and changes rarely enough (compared to e.g. painting)
+        // that it's simpler to reset the whole model than to work out what changed.
+        connect(mProject->undoStack(), &QUndoStack::indexChanged, this, &UndoHistoryModel::onUndoHistoryChanged);
+        // Payloads change more often (e.g. as pen segments are merged), but only the byte counts change then.
+        connect(mProject, &Project::undoPayloadByteCountChanged, this, &UndoHistoryModel::onUndoPayloadByteCountChanged);
+    }
+}
+
+QVariant UndoHistoryModel::data(const QModelIndex &index, int role) const
+{
+    if (!mProject || !checkIndex(index, CheckIndexOption::IndexIsValid))
+        return QVariant();
+
+    const QUndoStack *undoStack = mProject->undoStack();
+    const QUndoCommand *command = undoStack->command(index.row());
+    if (!command)
+        return QVariant();
+
+    switch (role) {
+    case TextRole:
+        return command->text();
+    case PayloadByteCountRole:
+        // Discarded changes are only deleted by QUndoStack once they're undone.
+        return command->isObsolete() ? 0 : UndoCommand::totalPayloadByteCount(command);
+    case CreationTimeRole: {
+        // Macros are plain QUndoCommands, so use the time of their first change.
+        QDateTime creationTime;
+        UndoCommand::forEach(command, [&creationTime](UndoCommand *undoCommand) {
+            if (!creationTime.isValid())
+                creationTime = undoCommand->creationTime();
+        });
+        return creationTime;
+    }
+    case ApplyDurationRole: {
+        qint64 applyDurationInNsecs = 0;
+        UndoCommand::forEach(command, [&applyDurationInNsecs](UndoCommand *undoCommand) {
+            applyDurationInNsecs += undoCommand->applyDurationInNsecs();
+        });
+        return applyDurationInNsecs / 1000000.0;
+    }
+    case UndoneRole:
+        return index.row() >= undoStack->index();
+    }
+    return QVariant();
+}
+
+int UndoHistoryModel::rowCount(const QModelIndex &) const
+{
+    if (!mProject)
+        return 0;
+
+    // While a macro is being composed it's already in the stack, but it's not
+    // in the history until it's finished, so don't show it until then.
+    return mProject->isComposingMacro() ? mProject->undoStack()->index() : mProject->undoStack()->count();
+}
+
+QHash<int, QByteArray> UndoHistoryModel::roleNames() const
+{
+    QHash<int, QByteArray> names;
+    names.insert(TextRole, "text");
+    names.insert(PayloadByteCountRole, "payloadByteCount");
+    names.insert(CreationTimeRole, "creationTime");
+    names.insert(ApplyDurationRole, "applyDuration");
+    names.insert(UndoneRole, "undone");
+    return names;
+}
+
+void UndoHistoryModel::onUndoHistoryChanged()
+{
+    beginResetModel();
+    endResetModel();
+}
+
+void UndoHistoryModel::onUndoPayloadByteCountChanged()
+{
+    const int count = rowCount();
+    if (count == 0)
+        return;
+
+    emit dataChanged(index(0), index(count - 1), { PayloadByteCountRole });
+}
@@ -0,0 +1,71 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UNDOHISTORYMODEL_H
+#define UNDOHISTORYMODEL_H
+
+#include <QAbstractListModel>
+#include <QQmlEngine>
+
+#include "slate-global.h"
+
+class Project;
+
+// Lists the changes in a project's undo history along with
+// how much memory each one uses and how long it took to apply.
+class SLATE_EXPORT UndoHistoryModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(Project *project READ project WRITE setProject NOTIFY projectChanged)
+    QML_ELEMENT
+    Q_MOC_INCLUDE("project.h")
+
+public:
+    enum UndoHistoryModelRoles {
+        TextRole = Qt::UserRole,
+        PayloadByteCountRole,
+        CreationTimeRole,
+        // In milliseconds.
+        ApplyDurationRole,
+        // True if the change has been undone and can be redone.
+        UndoneRole
+    };
+
+    explicit UndoHistoryModel(QObject *parent = nullptr);
+    ~UndoHistoryModel() override;
+
+    Project *project() const;
+    void setProject(Project *project);
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+signals:
+    void projectChanged();
+
+private slots:
+    void onUndoHistoryChanged();
+    void onUndoPayloadByteCountChanged();
+
+private:
+    Project *mProject;
+};
+
+#endif // UNDOHISTORYMODEL_H
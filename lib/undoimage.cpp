@@ -0,0 +1,230 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "undoimage.h"
+
+#include <QElapsedTimer>
+
+#include <cstring>
+
+#include "undospillfile.h"
+
+Q_LOGGING_CATEGORY(lcUndoImage, "app.undo.undoImage")
+
+UndoImage::UndoImage() :
+    mLoggingCategory(lcUndoImage),
+    mFormat(QImage::Format_Invalid)
+{
+}
+
+UndoImage::UndoImage(const QImage &image, LoggingCategory loggingCategory) :
+    mImage(image),
+    mLoggingCategory(loggingCategory ? loggingCategory : lcUndoImage),
+    mSize(image.size()),
+    mFormat(image.format())
+{
+}
+
+// The amount of bytes in each row of pixels, without the padding that QImage adds.
+static qsizetype rowByteCount(const QSize &size, QImage::Format format)
+{
+    return (qsizetype(size.width()) * QImage::toPixelFormat(format).bitsPerPixel() + 7) / 8;
+}
+
+QImage UndoImage::image(bool *ok) const
+{
+    if (ok)
+        *ok = true;
+
+    if (isSpilled()) {
+        QElapsedTimer timer;
+        timer.start();
+
+        const uchar *compressedData = mSpillBlock->map();
+        if (!compressedData) {
+            if (ok)
+                *ok = false;
+            return QImage();
+        }
+
+        const QImage image = decompressedImage(compressedData, mSpillBlock->size());
+        mSpillBlock->unmap(compressedData);
+        if (image.isNull()) {
+            if (ok)
+                *ok = false;
+            return QImage();
+        }
+
+        qCDebug(mLoggingCategory) << "restored spilled" << *this << "in" << timer.elapsed() << "ms";
+        return image;
+    }
+
+    if (isCompressed()) {
+        QElapsedTimer timer;
+        timer.start();
+
+        const QImage image = decompressedImage(reinterpret_cast<const uchar*>(mCompressedData.constData()),
+            mCompressedData.size());
+        if (image.isNull()) {
+            if (ok)
+                *ok = false;
+            return QImage();
+        }
+
+        qCDebug(mLoggingCategory) << "decompressed" << *this << "in" << timer.elapsed() << "ms";
+        return image;
+    }
+
+    return mImage;
+}
+
+QImage UndoImage::decompressedImage(const uchar *compressedData, qsizetype compressedSize) const
+{
+    // qUncompress() returns an empty array if the data is corrupt.
+    const QByteArray data = qUncompress(compressedData, compressedSize);
+    const qsizetype rowSize = rowByteCount(mSize, mFormat);
+    if (data.size() != rowSize * mSize.height()) {
+        qWarning().nospace() << "Failed to restore undo image " << *this << ": expected "
+            << rowSize * mSize.height() << " bytes but got " << data.size();
+        return QImage();
+    }
+
+    QImage image(mSize, mFormat);
+    if (image.isNull()) {
+        qWarning() << "Failed to allocate memory to restore undo image" << *this;
+        return QImage();
+    }
+
+    image.setColorTable(mColorTable);
+    for (int y = 0; y < mSize.height(); ++y)
+        std::memcpy(image.scanLine(y), data.constData() + y * rowSize, rowSize);
+    return image;
+}
+
+QSize UndoImage::size() const
+{
+    return mSize;
+}
+
+bool UndoImage::isCompressed() const
+{
+    return !mCompressedData.isEmpty() || isSpilled();
+}
+
+void UndoImage::compress()
+{
+    if (isCompressed() || mImage.isNull())
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const qsizetype rowSize = rowByteCount(mSize, mFormat);
+    QByteArray data(rowSize * mSize.height(), Qt::Uninitialized);
+    for (int y = 0; y < mSize.height(); ++y)
+        std::memcpy(data.data() + y * rowSize, mImage.constScanLine(y), rowSize);
+
+    // Pixel art is mostly runs of the same colour, so even the
+    // fastest compression level shrinks it considerably.
+    mCompressedData = qCompress(data, 1);
+    mColorTable = mImage.colorTable();
+    mImage = QImage();
+    qCDebug(mLoggingCategory) << "compressed" << *this << "in" << timer.elapsed() << "ms";
+}
+
+bool UndoImage::isSpilled() const
+{
+    return !mSpillBlock.isNull();
+}
+
+bool UndoImage::spill(const QSharedPointer<UndoSpillFile> &spillFile)
+{
+    if (isSpilled() || (mImage.isNull() && !isCompressed()))
+        return true;
+
+    compress();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const QSharedPointer<UndoSpillBlock> spillBlock = spillFile->write(mCompressedData);
+    if (!spillBlock)
+        return false;
+
+    mSpillBlock = spillBlock;
+    mCompressedData.clear();
+    qCDebug(mLoggingCategory) << "spilled" << *this << "in" << timer.elapsed() << "ms";
+    return true;
+}
+
+void UndoImage::clear()
+{
+    mImage = QImage();
+    mCompressedData.clear();
+    mColorTable.clear();
+    mSpillBlock.clear();
+}
+
+qint64 UndoImage::byteCount() const
+{
+    return isCompressed() ? mCompressedData.size() : mImage.sizeInBytes();
+}
+
+qint64 UndoImage::unsharedByteCount() const
+{
+    return isCompressed() || mImage.isDetached() ? byteCount() : 0;
+}
+
+QVector<UndoImage> UndoImage::fromImages(const QVector<QImage> &images, LoggingCategory loggingCategory)
+{
+    QVector<UndoImage> undoImages;
+    undoImages.reserve(images.size());
+    for (const QImage &image : images)
+        undoImages.append(UndoImage(image, loggingCategory));
+    return undoImages;
+}
+
+QVector<QImage> UndoImage::toImages(const QVector<UndoImage> &undoImages, bool *ok)
+{
+    if (ok)
+        *ok = true;
+
+    QVector<QImage> images;
+    images.reserve(undoImages.size());
+    for (const UndoImage &undoImage : undoImages) {
+        bool restored = false;
+        images.append(undoImage.image(&restored));
+        if (!restored && ok)
+            *ok = false;
+    }
+    return images;
+}
+
+QDebug operator<<(QDebug debug, const UndoImage &undoImage)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "UndoImage(size=" << undoImage.mSize
+        << " compressed=" << undoImage.isCompressed()
+        << " spilled=" << undoImage.isSpilled()
+        << " byteCount=" << undoImage.byteCount();
+    if (undoImage.isSpilled())
+        debug << " spillSize=" << undoImage.mSpillBlock->size();
+    debug << ")";
+    return debug;
+}
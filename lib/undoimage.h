@@ -0,0 +1,100 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UNDOIMAGE_H
+#define UNDOIMAGE_H
+
+#include <QByteArray>
+#include <QDebug>
+#include <QImage>
+#include <QLoggingCategory>
+#include <QSharedPointer>
+#include <QVector>
+
+#include "slate-global.h"
+
+class UndoSpillBlock;
+class UndoSpillFile;
+
+/*
+    An image stored by an undo command so that it can undo or redo.
+
+    Commands that are unlikely to be undone any time soon can have their
+    images compressed, or moved into a file, to save memory. Such images
+    are restored each time image() is called, and are otherwise used exactly
+    as before. The time taken to do so is logged to the owning command's
+    logging category.
+*/
+class SLATE_EXPORT UndoImage
+{
+public:
+    // The function that Q_LOGGING_CATEGORY() defines.
+    typedef const QLoggingCategory &(*LoggingCategory)();
+
+    UndoImage();
+    UndoImage(const QImage &image, LoggingCategory loggingCategory = nullptr);
+
+    // Returns the image, restoring it if necessary. If it can't be restored
+    // (e.g. the spill file was modified), a null image is returned and ok is set
+    // to false; commands should then leave the project as it is.
+    QImage image(bool *ok = nullptr) const;
+    QSize size() const;
+
+    bool isCompressed() const;
+    void compress();
+
+    bool isSpilled() const;
+    // Compresses the image and moves it into spillFile.
+    // Returns false (and keeps the image in memory) if it couldn't be written.
+    bool spill(const QSharedPointer<UndoSpillFile> &spillFile);
+
+    // Frees the image. image() returns a null image afterwards.
+    void clear();
+
+    // The amount of bytes of memory used to store the image.
+    qint64 byteCount() const;
+    // Like byteCount(), but doesn't count an image that is still shared with another
+    // QImage, as it doesn't use any memory of its own. Commands that set images on the
+    // project use this for the images they set, which are then shared with the project,
+    // and, once it changes, with the previous images of the next command, which count them.
+    qint64 unsharedByteCount() const;
+
+    static QVector<UndoImage> fromImages(const QVector<QImage> &images, LoggingCategory loggingCategory = nullptr);
+    // Sets ok to false if any of the images couldn't be restored.
+    static QVector<QImage> toImages(const QVector<UndoImage> &undoImages, bool *ok = nullptr);
+
+private:
+    friend QDebug operator<<(QDebug debug, const UndoImage &undoImage);
+
+    QImage decompressedImage(const uchar *compressedData, qsizetype compressedSize) const;
+
+    QImage mImage;
+    LoggingCategory mLoggingCategory;
+
+    // Only used when compressed.
+    QByteArray mCompressedData;
+    QSize mSize;
+    QImage::Format mFormat;
+    QList<QRgb> mColorTable;
+
+    // Only used when spilled; the compressed data is stored in the file instead of mCompressedData.
+    QSharedPointer<UndoSpillBlock> mSpillBlock;
+};
+
+#endif // UNDOIMAGE_H
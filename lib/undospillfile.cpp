@@ -0,0 +1,167 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "undospillfile.h"
+
+#include <QLoggingCategory>
+
+#include <iterator>
+
+Q_LOGGING_CATEGORY(lcUndoSpillFile, "app.undo.undoSpillFile")
+
+UndoSpillFile::UndoSpillFile(const QString &filePath) :
+    mFile(filePath)
+{
+    if (!mFile.open(QIODevice::ReadWrite | QIODevice::Truncate))
+        qWarning() << "Failed to open undo spill file" << filePath << "-" << mFile.errorString();
+    else
+        qCDebug(lcUndoSpillFile) << "opened" << filePath;
+}
+
+UndoSpillFile::~UndoSpillFile()
+{
+    qCDebug(lcUndoSpillFile) << "removing" << mFile.fileName() << "of size" << mFile.size();
+    mFile.remove();
+}
+
+bool UndoSpillFile::isOpen() const
+{
+    return mFile.isOpen();
+}
+
+QSharedPointer<UndoSpillBlock> UndoSpillFile::write(const QByteArray &data)
+{
+    if (!mFile.isOpen() || data.isEmpty())
+        return nullptr;
+
+    // Use the first free range that's big enough, or append to the file if there isn't one.
+    qint64 offset = mFile.size();
+    auto freeRangeIt = mFreeRanges.begin();
+    for (; freeRangeIt != mFreeRanges.end(); ++freeRangeIt) {
+        if (freeRangeIt.value() >= data.size()) {
+            offset = freeRangeIt.key();
+            break;
+        }
+    }
+
+    // Flush so that the data can be mapped straight away.
+    if (!mFile.seek(offset) || mFile.write(data) != data.size() || !mFile.flush()) {
+        qWarning() << "Failed to write" << data.size() << "bytes to undo spill file" << mFile.fileName()
+            << "-" << mFile.errorString();
+        return nullptr;
+    }
+
+    if (freeRangeIt != mFreeRanges.end()) {
+        const qint64 remainingSize = freeRangeIt.value() - data.size();
+        mFreeRanges.erase(freeRangeIt);
+        if (remainingSize > 0)
+            mFreeRanges.insert(offset + data.size(), remainingSize);
+        qCDebug(lcUndoSpillFile) << "reused" << data.size() << "free bytes at offset" << offset;
+    }
+
+    return QSharedPointer<UndoSpillBlock>::create(sharedFromThis(), offset, data.size());
+}
+
+qint64 UndoSpillFile::size() const
+{
+    return mFile.size();
+}
+
+qint64 UndoSpillFile::freeByteCount() const
+{
+    qint64 byteCount = 0;
+    for (const qint64 size : mFreeRanges)
+        byteCount += size;
+    return byteCount;
+}
+
+const uchar *UndoSpillFile::map(qint64 offset, qint64 size)
+{
+    const uchar *address = mFile.map(offset, size);
+    if (!address) {
+        qWarning() << "Failed to map" << size << "bytes at offset" << offset << "of undo spill file"
+            << mFile.fileName() << "-" << mFile.errorString();
+    }
+    return address;
+}
+
+void UndoSpillFile::unmap(const uchar *address)
+{
+    mFile.unmap(const_cast<uchar*>(address));
+}
+
+void UndoSpillFile::release(qint64 offset, qint64 size)
+{
+    // Merge the range with the free ranges on either side of it.
+    auto nextIt = mFreeRanges.lowerBound(offset);
+    if (nextIt != mFreeRanges.end() && offset + size == nextIt.key()) {
+        size += nextIt.value();
+        nextIt = mFreeRanges.erase(nextIt);
+    }
+    if (nextIt != mFreeRanges.begin()) {
+        auto previousIt = std::prev(nextIt);
+        if (previousIt.key() + previousIt.value() == offset) {
+            offset = previousIt.key();
+            size += previousIt.value();
+            mFreeRanges.erase(previousIt);
+        }
+    }
+
+    if (offset + size == mFile.size()) {
+        qCDebug(lcUndoSpillFile) << "truncating" << mFile.fileName() << "to" << offset << "bytes";
+        if (mFile.resize(offset))
+            return;
+
+        qWarning() << "Failed to truncate undo spill file" << mFile.fileName() << "-" << mFile.errorString();
+    }
+
+    mFreeRanges.insert(offset, size);
+}
+
+UndoSpillBlock::UndoSpillBlock(const QSharedPointer<UndoSpillFile> &file, qint64 offset, qint64 size) :
+    mFile(file),
+    mOffset(offset),
+    mSize(size)
+{
+}
+
+UndoSpillBlock::~UndoSpillBlock()
+{
+    mFile->release(mOffset, mSize);
+}
+
+qint64 UndoSpillBlock::offset() const
+{
+    return mOffset;
+}
+
+qint64 UndoSpillBlock::size() const
+{
+    return mSize;
+}
+
+const uchar *UndoSpillBlock::map() const
+{
+    return mFile->map(mOffset, mSize);
+}
+
+void UndoSpillBlock::unmap(const uchar *address) const
+{
+    mFile->unmap(address);
+}
@@ -0,0 +1,101 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UNDOSPILLFILE_H
+#define UNDOSPILLFILE_H
+
+#include <QByteArray>
+#include <QEnableSharedFromThis>
+#include <QFile>
+#include <QMap>
+#include <QSharedPointer>
+#include <QString>
+
+#include "slate-global.h"
+
+class UndoSpillBlock;
+
+/*
+    A scratch file that the images of older undo commands are moved into
+    so that they don't take up memory, and which they're mapped back in from
+    when they're needed.
+
+    The space taken by data that nothing refers to anymore (e.g. that of
+    commands that were deleted) is reused by later writes, and the file is
+    removed once nothing refers to it anymore (e.g. when the project is closed).
+*/
+class SLATE_EXPORT UndoSpillFile : public QEnableSharedFromThis<UndoSpillFile>
+{
+public:
+    explicit UndoSpillFile(const QString &filePath);
+    ~UndoSpillFile();
+
+    bool isOpen() const;
+
+    // Writes data to the file, returning the block it was written to, or null on failure.
+    // Must only be called on files that are owned by a QSharedPointer.
+    QSharedPointer<UndoSpillBlock> write(const QByteArray &data);
+
+    qint64 size() const;
+    // The amount of bytes in the file that are free to be reused.
+    qint64 freeByteCount() const;
+
+private:
+    Q_DISABLE_COPY(UndoSpillFile)
+
+    friend class UndoSpillBlock;
+
+    const uchar *map(qint64 offset, qint64 size);
+    void unmap(const uchar *address);
+    void release(qint64 offset, qint64 size);
+
+    QFile mFile;
+    // The offset and size of each range of the file that isn't used.
+    // Adjacent ranges are merged, and the file is truncated instead of
+    // adding a range at the end of it.
+    QMap<qint64, qint64> mFreeRanges;
+};
+
+/*
+    Data that was written to an UndoSpillFile. Copies of e.g. a spilled UndoImage
+    share the block, and its space in the file is released once the last of them is gone.
+*/
+class SLATE_EXPORT UndoSpillBlock
+{
+public:
+    UndoSpillBlock(const QSharedPointer<UndoSpillFile> &file, qint64 offset, qint64 size);
+    ~UndoSpillBlock();
+
+    qint64 offset() const;
+    qint64 size() const;
+
+    // Maps the data into memory, returning nullptr on failure.
+    // The returned address must be passed to unmap() when done with it.
+    const uchar *map() const;
+    void unmap(const uchar *address) const;
+
+private:
+    Q_DISABLE_COPY(UndoSpillBlock)
+
+    QSharedPointer<UndoSpillFile> mFile;
+    qint64 mOffset;
+    qint64 mSize;
+};
+
+#endif // UNDOSPILLFILE_H
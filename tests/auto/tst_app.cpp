@@ -36,17 +36,31 @@ extern "C" {
 }
 
 #include "application.h"
+#include "applygreedypixelfillcommand.h"
+#include "applypixelfillcommand.h"
 #include "applypixelpencommand.h"
+#include "canvaspaneitem.h"
+#include "compositing.h"
+#include "fillalgorithms.h"
+#include "imagedelta.h"
 #include "imagelayer.h"
 #include "imageutils.h"
+#include "layercompositor.h"
+#include "mipmappyramid.h"
+#include "packedpixels.h"
 #include "tilecanvas.h"
 #include "probabilityswatch.h"
 #include "project.h"
 #include "projectmanager.h"
 #include "qtutils.h"
 #include "swatch.h"
+#include "texturedfillparameters.h"
 #include "testhelper.h"
 #include "tileset.h"
+#include "undocommand.h"
+#include "undohistorymodel.h"
+#include "undoimage.h"
+#include "undospillfile.h"
 
 Q_LOGGING_CATEGORY(lcModels, "tests.models")
 
@@ -97,7 +111,22 @@ private Q_SLOTS:
     void undoRearrangeContentsIntoGridChange_data();
     void undoRearrangeContentsIntoGridChange();
     void undoPixelFill();
+    void imageDeltaStoresOnlyChanges_data();
+    void imageDeltaStoresOnlyChanges();
+    void pixelFillMask();
+    void packedPixels_data();
+    void packedPixels();
+    void undoMemoryBudget();
+    void releaseUndoPayloads();
+    void spillOlderUndoPayloads();
+    void corruptUndoSpillFile();
+    void reuseFreedUndoSpillFileSpace();
+    void undoHistoryModel();
+    void livePreviewOnlyStoresModifiedLayers();
+    void mipmapPyramid();
     void undoTileFill();
+    void greedyTileFill();
+    void greedyPixelFillTileset();
     void undoThickSquarePen();
     void undoThickRoundPen();
     void penSubpixelPosition();
@@ -118,6 +147,7 @@ private Q_SLOTS:
     void useTilesetSwatch();
     void tilesetSwatchContextMenu();
     void tilesetSwatchNavigation();
+    void tilePenPreviewRepaintsOnlyAffectedTiles();
     void cursorShapeAfterClickingLighter();
     void colourPickerHexField();
     void colourPickerHexFieldTranslucent();
@@ -130,18 +160,29 @@ private Q_SLOTS:
     void fillLayeredImageCanvas();
     void greedyPixelFillImageCanvas_data();
     void greedyPixelFillImageCanvas();
+    void greedyPixelFillAllLayers();
     void texturedFillVariance_data();
     void texturedFillVariance();
     void texturedFillSwatch_data();
     void texturedFillSwatch();
+    void texturedFillSeed();
+    void texturedFillReproducibleFromCommand();
     void pixelLineToolImageCanvas_data();
     void pixelLineToolImageCanvas();
     void pixelLineToolTransparent_data();
     void pixelLineToolTransparent();
+    void penStrokeUndo_data();
+    void penStrokeUndo();
     void lineMiddleMouseButton();
     void penToolRightClickBehaviour_data();
     void penToolRightClickBehaviour();
     void splitScreenRendering();
+    void partialRepaintAfterDrawing_data();
+    void partialRepaintAfterDrawing();
+    void sceneGraphRendererUploadsChangedTiles_data();
+    void sceneGraphRendererUploadsChangedTiles();
+    void contentImageCached_data();
+    void contentImageCached();
     void formatNotModifiable();
     void models();
 
@@ -194,6 +235,9 @@ private Q_SLOTS:
     void rotateSelectionTransparentBackground();
     void hueSaturation_data();
     void hueSaturation();
+    void hueSaturationPreview();
+    void modifyHsl_data();
+    void modifyHsl();
     void opacityDialog_data();
     void opacityDialog();
     void cropToSelection_data();
@@ -221,6 +265,12 @@ private Q_SLOTS:
     void addAndRemoveLayers();
     void newLayerIndex();
     void layerVisibility();
+    void layerCompositesAroundCurrentLayer();
+    void asyncLayerComposites();
+    void compositingMatchesQPainter_data();
+    void compositingMatchesQPainter();
+    void layerOpacity();
+    void layerBlendModes();
     void moveLayerUpAndDown();
     void mergeLayerUpAndDown();
     void renameLayers();
@@ -1277,6 +1327,17 @@ void tst_App::undoLargePixelPen()
     QVERIFY2(clickButton(undoToolButton), failureMessage);
 
     QCOMPARE(*tilesetProject->tileset()->image(), originalTilesetImage);
+
+    // Erase a large square over both tiles. The tileset image should only be reported as changed once.
+    QVERIFY2(switchTool(ImageCanvas::EraserTool), failureMessage);
+    QSignalSpy tilesetImageChangedSpy(tilesetProject->tileset(), SIGNAL(imageChanged()));
+    QTest::mouseClick(window, Qt::LeftButton, Qt::NoModifier, cursorWindowPos);
+    QCOMPARE(tilesetImageChangedSpy.count(), 1);
+    QCOMPARE(tilesetProject->tileAt(sceneTopLeft)->pixelColor(halfToolSize, 0), QColor(Qt::transparent));
+    QCOMPARE(tilesetProject->tileAt(sceneBottomRight)->pixelColor(halfToolSize - 1, halfToolSize - 1), QColor(Qt::transparent));
+
+    QVERIFY2(clickButton(undoToolButton), failureMessage);
+    QCOMPARE(*tilesetProject->tileset()->image(), originalTilesetImage);
 }
 
 void tst_App::undoTiles()
@@ -1740,6 +1801,585 @@ void tst_App::undoPixelFill()
     QCOMPARE(targetTile->pixelColor(0, 1), black);
 }
 
+void tst_App::imageDeltaStoresOnlyChanges_data()
+{
+    QTest::addColumn<QImage::Format>("format");
+
+    QTest::newRow("ARGB32_Premultiplied") << QImage::Format_ARGB32_Premultiplied;
+    QTest::newRow("RGB888") << QImage::Format_RGB888;
+    // Stored as copies of the changed area rather than spans.
+    QTest::newRow("RGBA64") << QImage::Format_RGBA64;
+}
+
+void tst_App::imageDeltaStoresOnlyChanges()
+{
+    QFETCH(QImage::Format, format);
+
+    const QImage previousImage = ImageUtils::filledImage(200, 150, Qt::white).convertToFormat(format);
+    QImage newImage = previousImage;
+    {
+        QPainter painter(&newImage);
+        painter.fillRect(10, 20, 30, 40, Qt::red);
+        painter.fillRect(60, 30, 5, 5, Qt::blue);
+    }
+
+    const ImageDelta delta(previousImage, newImage);
+    QCOMPARE(delta.bounds(), QRect(10, 20, 55, 40));
+    QVERIFY(delta.byteCount() < previousImage.sizeInBytes() / 4);
+
+    QImage image = newImage;
+    delta.apply(&image, ImageDelta::PreviousVersion);
+    QCOMPARE(image, previousImage);
+    delta.apply(&image, ImageDelta::NewVersion);
+    QCOMPARE(image, newImage);
+
+    QVERIFY(ImageDelta(previousImage, previousImage).isEmpty());
+}
+
+// Tests that a flood fill around a hole only reports (and changes) the pixels
+// that it filled, and that the filled area can be stored as a delta on its own.
+void tst_App::pixelFillMask()
+{
+    // A black ring with a white hole in the middle, on a white background.
+    QImage image = ImageUtils::filledImage(16, 16, Qt::white);
+    {
+        QPainter painter(&image);
+        painter.fillRect(2, 3, 6, 5, Qt::black);
+        painter.fillRect(4, 5, 2, 1, Qt::white);
+    }
+
+    PixelFillMask mask = imagePixelFloodFillMask(&image, QPoint(2, 3), Qt::black, Qt::red);
+    QCOMPARE(mask.bounds, QRect(2, 3, 6, 5));
+    QCOMPARE(mask.count(), 6 * 5 - 2);
+    QCOMPARE(mask.bits.size(), 6 * 5);
+    QVERIFY(mask.bits.testBit(0));
+    // The hole is at (4, 5) and (5, 5), which is the third and fourth bit of the third row.
+    QVERIFY(!mask.bits.testBit(2 * 6 + 2));
+    QVERIFY(!mask.bits.testBit(2 * 6 + 3));
+    QVERIFY(mask.bits.testBit(2 * 6 + 4));
+    QVERIFY(mask.contains(QPoint(7, 7)));
+    QVERIFY(!mask.contains(QPoint(4, 5)));
+    QVERIFY(!mask.contains(QPoint(8, 3)));
+
+    // Only the area within the bounds is returned, with the hole left alone.
+    const QImage filledArea = imagePixelFloodFillArea(&image, QPoint(2, 3), Qt::black, Qt::red, &mask);
+    QCOMPARE(filledArea.size(), QSize(6, 5));
+    QCOMPARE(filledArea.pixelColor(0, 0), QColor(Qt::red));
+    QCOMPARE(filledArea.pixelColor(2, 2), QColor(Qt::white));
+    QCOMPARE(filledArea.pixelColor(5, 4), QColor(Qt::red));
+
+    const ImageDelta delta(image.copy(mask.bounds), filledArea, mask.bounds.topLeft());
+    QCOMPARE(delta.bounds(), mask.bounds);
+    QImage filledImage = image;
+    delta.apply(&filledImage, ImageDelta::NewVersion);
+    QCOMPARE(filledImage, imagePixelFloodFill(&image, QPoint(2, 3), Qt::black, Qt::red));
+    delta.apply(&filledImage, ImageDelta::PreviousVersion);
+    QCOMPARE(filledImage, image);
+
+    // Nothing should be filled if the start pixel isn't the target colour.
+    QVERIFY(imagePixelFloodFillMask(&image, QPoint(0, 0), Qt::black, Qt::red).isEmpty());
+}
+
+void tst_App::packedPixels_data()
+{
+    QTest::addColumn<QImage::Format>("format");
+
+    QTest::newRow("ARGB32") << QImage::Format_ARGB32;
+    QTest::newRow("ARGB32_Premultiplied") << QImage::Format_ARGB32_Premultiplied;
+    QTest::newRow("RGB888") << QImage::Format_RGB888;
+}
+
+void tst_App::packedPixels()
+{
+    QFETCH(QImage::Format, format);
+
+    // Every other pixel of the right half of the rect; the left half isn't stored at all.
+    const QRect bounds(10, 20, 8, 4);
+    QVector<uchar> mask(bounds.width() * bounds.height());
+    QVector<QRgb> pixels(mask.size());
+    for (int y = 0; y < bounds.height(); ++y) {
+        for (int x = bounds.width() / 2; x < bounds.width(); ++x) {
+            mask[y * bounds.width() + x] = (x + y) % 2;
+            pixels[y * bounds.width() + x] = qRgb(x * 16, y * 32, 255);
+        }
+    }
+
+    const PackedPixels packedPixels(bounds, mask, pixels);
+    QCOMPARE(packedPixels.count(), 8);
+    QCOMPARE(packedPixels.bounds(), QRect(14, 20, 4, 4));
+    QVERIFY(packedPixels.contains(QPoint(15, 20)));
+    QVERIFY(!packedPixels.contains(QPoint(14, 20)));
+    QCOMPARE(packedPixels.lastPosition(), QPoint(16, 23));
+    QVERIFY(packedPixels.byteCount() < packedPixels.count() * qint64(sizeof(QPoint) + sizeof(QColor)));
+
+    QImage image = ImageUtils::filledImage(32, 32, Qt::white).convertToFormat(format);
+    packedPixels.write(&image, packedPixels.bounds());
+    for (int y = 0; y < bounds.height(); ++y) {
+        for (int x = 0; x < bounds.width(); ++x) {
+            const QPoint pos = bounds.topLeft() + QPoint(x, y);
+            const QColor expectedColour = mask.at(y * bounds.width() + x)
+                ? QColor::fromRgba(pixels.at(y * bounds.width() + x)) : QColor(Qt::white);
+            QCOMPARE(image.pixelColor(pos), expectedColour);
+        }
+    }
+
+    // Only the pixels within the area are written, and they're offset.
+    image.fill(Qt::white);
+    packedPixels.fill(&image, Qt::black, QRect(16, 20, 2, 4), QPoint(-10, 5));
+    QCOMPARE(image.pixelColor(QPoint(7, 25)), QColor(Qt::black));
+    QCOMPARE(image.pixelColor(QPoint(6, 25)), QColor(Qt::white));
+    QCOMPARE(image.pixelColor(QPoint(6, 26)), QColor(Qt::black));
+    QCOMPARE(image.pixelColor(QPoint(7, 26)), QColor(Qt::white));
+    QCOMPARE(image.pixelColor(QPoint(5, 25)), QColor(Qt::white));
+
+    QVERIFY(PackedPixels(bounds, QVector<uchar>(mask.size()), pixels).isEmpty());
+
+    // Uniting adds the pixels that the first doesn't have and keeps its value for the ones it does.
+    const PackedPixels duplicatePixel(QRect(15, 20, 1, 1), { 1 }, { qRgb(0, 0, 0) });
+    QCOMPARE(PackedPixels::united({ packedPixels, duplicatePixel }), packedPixels);
+    const PackedPixels newPixels(QRect(12, 19, 4, 2), { 1, 0, 0, 0, 0, 0, 0, 1 }, { qRgb(1, 2, 3), 0, 0, 0, 0, 0, 0, qRgb(0, 0, 0) });
+    const PackedPixels united = PackedPixels::united({ packedPixels, newPixels, duplicatePixel, newPixels });
+    QCOMPARE(united.bounds(), QRect(12, 19, 6, 5));
+    QCOMPARE(united.count(), packedPixels.count() + 1);
+    QCOMPARE(united.lastPosition(), packedPixels.lastPosition());
+    QCOMPARE(PackedPixels::united({ united, newPixels }), united);
+    QVERIFY(PackedPixels::united({ PackedPixels(), PackedPixels() }).isEmpty());
+
+    image.fill(Qt::white);
+    united.write(&image, united.bounds());
+    QCOMPARE(image.pixelColor(QPoint(12, 19)), QColor(qRgb(1, 2, 3)));
+    QCOMPARE(image.pixelColor(QPoint(15, 20)), QColor::fromRgba(pixels.at(5)));
+    QCOMPARE(image.pixelColor(QPoint(16, 23)), QColor::fromRgba(pixels.at(3 * bounds.width() + 6)));
+}
+
+// Tests that the oldest changes are compressed and then discarded once
+// the undo history uses more memory than the budget allows.
+void tst_App::undoMemoryBudget()
+{
+    QVERIFY2(createNewImageProject(256, 256), failureMessage);
+
+    const int oldBudget = app.settings()->undoMemoryBudget();
+    auto budgetCleanup = qScopeGuard([=](){ app.settings()->setUndoMemoryBudget(oldBudget); });
+    app.settings()->setUndoMemoryBudget(5);
+
+    // Give the image some contents so that it isn't trivially compressible.
+    QPainter painter(imageProject->image());
+    painter.fillRect(0, 0, 128, 256, Qt::red);
+    painter.fillRect(64, 64, 128, 64, Qt::blue);
+    painter.end();
+    const QImage originalImage = *imageProject->image();
+
+    const auto resize = [=](int width, int height) {
+        project->beginLivePreview();
+        imageProject->resize(width, height, false);
+        project->endLivePreview(Project::CommitModificaton);
+    };
+
+    // The resized image is shared with the project, so only the 256x256 32-bit image counts: 256 KB.
+    resize(1024, 1024);
+    const QImage largeImage = *imageProject->image();
+    QCOMPARE(project->undoPayloadByteCount(), 256 * 256 * 4);
+
+    // The 1024x1024 image is now only used by the undo history: another 4 MB.
+    resize(256, 256);
+    const QImage smallImage = *imageProject->image();
+    QCOMPARE(project->undoPayloadByteCount(), 17 * 256 * 256 * 4);
+
+    resize(512, 512);
+    const QImage mediumImage = *imageProject->image();
+    QCOMPARE(project->undoStack()->count(), 3);
+    QCOMPARE(project->undoPayloadByteCount(), 18 * 256 * 256 * 4);
+
+    // That's over 2 MB, so the first two resizes' images should be compressed.
+    app.settings()->setUndoMemoryBudget(2);
+    QCOMPARE(project->undoStack()->count(), 3);
+    QVERIFY(project->undoPayloadByteCount() < 2 * 1024 * 1024);
+
+    // Undoing should still give the exact images back.
+    project->undoStack()->undo();
+    QCOMPARE(*imageProject->image(), smallImage);
+    project->undoStack()->undo();
+    QCOMPARE(*imageProject->image(), largeImage);
+    project->undoStack()->undo();
+    QCOMPARE(*imageProject->image(), originalImage);
+    project->undoStack()->redo();
+    project->undoStack()->redo();
+    project->undoStack()->redo();
+    QCOMPARE(*imageProject->image(), mediumImage);
+
+    // The 512x512 image of the next resize takes up 1 MB by itself, so compressing isn't
+    // enough to stay within 1 MB and the older resizes should be discarded.
+    app.settings()->setUndoMemoryBudget(1);
+    resize(1024, 1024);
+    QCOMPARE(project->undoPayloadByteCount(), 4 * 256 * 256 * 4);
+
+    QVERIFY(project->canUndo());
+    project->undoStack()->undo();
+    QCOMPARE(*imageProject->image(), mediumImage);
+    // The discarded changes are still in the stack, but they can't be undone from the UI.
+    QVERIFY(project->undoStack()->canUndo());
+    QVERIFY(!project->canUndo());
+    QTRY_VERIFY(!undoToolButton->isEnabled());
+    // Undoing the discarded changes does nothing.
+    while (project->undoStack()->canUndo())
+        project->undoStack()->undo();
+    QCOMPARE(*imageProject->image(), mediumImage);
+    QCOMPARE(project->undoStack()->count(), 1);
+}
+
+// Tests that the commands that store images can actually free them when they're discarded,
+// as the undo memory budget assumes that releasing a command's payload frees that memory.
+void tst_App::releaseUndoPayloads()
+{
+    QVERIFY2(createNewLayeredImageProject(), failureMessage);
+
+    QVERIFY2(switchTool(ImageCanvas::PenTool), failureMessage);
+    setCursorPosInScenePixels(0, 0);
+    QVERIFY2(drawPixelAtCursorPos(), failureMessage);
+
+    QVERIFY2(selectArea(QRect(0, 0, 10, 10)), failureMessage);
+    QTest::keyClick(window, Qt::Key_Delete);
+    QVERIFY(!canvas->hasSelection());
+
+    layeredImageProject->addNewLayer();
+    layeredImageProject->addNewLayer();
+    QCOMPARE(layeredImageProject->layerCount(), 3);
+    layeredImageProject->setCurrentLayerIndex(0);
+    layeredImageProject->mergeCurrentLayerDown();
+    QCOMPARE(layeredImageProject->layerCount(), 2);
+    layeredImageProject->deleteCurrentLayer();
+    QCOMPARE(layeredImageProject->layerCount(), 1);
+
+    QVERIFY(project->undoPayloadByteCount() > 0);
+    for (int i = 0; i < project->undoStack()->count(); ++i) {
+        const QUndoCommand *command = project->undoStack()->command(i);
+        UndoCommand::forEach(command, [](UndoCommand *undoCommand) {
+            undoCommand->releasePayload();
+            undoCommand->updateAccountedPayloadByteCount();
+        });
+        QCOMPARE(UndoCommand::totalPayloadByteCount(command), 0);
+    }
+    QCOMPARE(project->undoPayloadByteCount(), 0);
+}
+
+// Tests that changes older than the most recent few have their images
+// moved into a file, and that they're restored exactly when undone.
+void tst_App::spillOlderUndoPayloads()
+{
+    QVERIFY2(createNewImageProject(256, 256), failureMessage);
+
+    const int oldInMemoryUndoCommandCount = app.settings()->inMemoryUndoCommandCount();
+    auto countCleanup = qScopeGuard([=](){ app.settings()->setInMemoryUndoCommandCount(oldInMemoryUndoCommandCount); });
+    app.settings()->setInMemoryUndoCommandCount(1);
+
+    QPainter painter(imageProject->image());
+    painter.fillRect(0, 0, 128, 256, Qt::red);
+    painter.fillRect(64, 64, 128, 64, Qt::blue);
+    painter.end();
+    const QImage originalImage = *imageProject->image();
+
+    const auto resize = [=](int width, int height) {
+        project->beginLivePreview();
+        imageProject->resize(width, height, false);
+        project->endLivePreview(Project::CommitModificaton);
+    };
+
+    // The resized image is shared with the project, so only the 256x256 32-bit image counts.
+    resize(512, 512);
+    const QImage largeImage = *imageProject->image();
+    QCOMPARE(project->undoPayloadByteCount(), 256 * 256 * 4);
+
+    // The first resize's images should no longer be in memory once the user stops making changes,
+    // leaving only the 512x512 image of the second resize.
+    resize(256, 256);
+    QCOMPARE(project->undoStack()->count(), 2);
+    QTRY_COMPARE(project->undoPayloadByteCount(), 4 * 256 * 256 * 4);
+
+    project->undoStack()->undo();
+    QCOMPARE(*imageProject->image(), largeImage);
+    project->undoStack()->undo();
+    QCOMPARE(*imageProject->image(), originalImage);
+    project->undoStack()->redo();
+    QCOMPARE(*imageProject->image(), largeImage);
+    project->undoStack()->redo();
+    QCOMPARE(imageProject->image()->size(), QSize(256, 256));
+    const QImage resizedImage = *imageProject->image();
+
+    // Fills and pen strokes should be spilled too.
+    QVERIFY2(switchTool(ImageCanvas::FillTool), failureMessage);
+    QVERIFY2(setPenForegroundColour("#123456"), failureMessage);
+    setCursorPosInScenePixels(0, 0);
+    mouseEvent(canvas, cursorWindowPos, MouseClick);
+    const QImage filledImage = *imageProject->image();
+
+    QVERIFY2(switchTool(ImageCanvas::PenTool), failureMessage);
+    setCursorPosInScenePixels(200, 200);
+    QVERIFY2(drawPixelAtCursorPos(), failureMessage);
+    const QImage drawnImage = *imageProject->image();
+
+    QVERIFY2(switchTool(ImageCanvas::FillTool), failureMessage);
+    QVERIFY2(setPenForegroundColour("#654321"), failureMessage);
+    setCursorPosInScenePixels(0, 0);
+    mouseEvent(canvas, cursorWindowPos, MouseClick);
+    QCOMPARE(project->undoStack()->count(), 5);
+    const qint64 lastFillByteCount = UndoCommand::totalPayloadByteCount(project->undoStack()->command(4));
+    QVERIFY(lastFillByteCount > 0);
+    QTRY_COMPARE(project->undoPayloadByteCount(), lastFillByteCount);
+
+    project->undoStack()->undo();
+    QCOMPARE(*imageProject->image(), drawnImage);
+    project->undoStack()->undo();
+    QCOMPARE(*imageProject->image(), filledImage);
+    project->undoStack()->undo();
+    QCOMPARE(*imageProject->image(), resizedImage);
+    project->undoStack()->redo();
+    QCOMPARE(*imageProject->image(), filledImage);
+    project->undoStack()->redo();
+    QCOMPARE(*imageProject->image(), drawnImage);
+}
+
+// Tests that spilled images that can't be read back are reported as such,
+// rather than reading past the end of the data.
+void tst_App::corruptUndoSpillFile()
+{
+    QTemporaryDir tempDir;
+    QVERIFY2(tempDir.isValid(), qPrintable(tempDir.errorString()));
+    const QString spillFilePath = tempDir.filePath(QLatin1String("undo-spill"));
+    QSharedPointer<UndoSpillFile> spillFile(new UndoSpillFile(spillFilePath));
+    QVERIFY(spillFile->isOpen());
+
+    const QImage image = ImageUtils::filledImage(64, 64, Qt::red);
+    UndoImage undoImage(image);
+    QVERIFY(undoImage.spill(spillFile));
+    QImage previousImage = image;
+    previousImage.setPixelColor(1, 1, Qt::blue);
+    const ImageDelta delta(previousImage, image);
+    ImageDelta spilledDelta = delta;
+    QVERIFY(spilledDelta.spill(spillFile));
+
+    bool restored = false;
+    QCOMPARE(undoImage.image(&restored), image);
+    QVERIFY(restored);
+    QImage deltaImage = image;
+    QVERIFY(spilledDelta.apply(&deltaImage, ImageDelta::PreviousVersion));
+    QCOMPARE(deltaImage, previousImage);
+
+    // Overwrite everything that was spilled.
+    QFile file(spillFilePath);
+    QVERIFY2(file.open(QIODevice::ReadWrite), qPrintable(file.errorString()));
+    QCOMPARE(file.write(QByteArray(file.size(), char(0xff))), spillFile->size());
+    file.close();
+
+    QVERIFY(undoImage.image(&restored).isNull());
+    QVERIFY(!restored);
+    bool allRestored = true;
+    UndoImage::toImages({ UndoImage(image), undoImage }, &allRestored);
+    QVERIFY(!allRestored);
+    deltaImage = image;
+    QVERIFY(!spilledDelta.apply(&deltaImage, ImageDelta::PreviousVersion));
+    QCOMPARE(deltaImage, image);
+}
+
+// Tests that the space taken by spilled data that's no longer used is reused.
+void tst_App::reuseFreedUndoSpillFileSpace()
+{
+    QTemporaryDir tempDir;
+    QVERIFY2(tempDir.isValid(), qPrintable(tempDir.errorString()));
+    QSharedPointer<UndoSpillFile> spillFile(new UndoSpillFile(tempDir.filePath(QLatin1String("undo-spill"))));
+    QVERIFY(spillFile->isOpen());
+
+    QSharedPointer<UndoSpillBlock> block1 = spillFile->write(QByteArray(100, 'a'));
+    QSharedPointer<UndoSpillBlock> block2 = spillFile->write(QByteArray(200, 'b'));
+    QSharedPointer<UndoSpillBlock> block3 = spillFile->write(QByteArray(300, 'c'));
+    QVERIFY(block1 && block2 && block3);
+    QCOMPARE(block3->offset(), 300);
+    QCOMPARE(spillFile->size(), 600);
+
+    // A smaller block should go where the freed one was, leaving the rest of its space free.
+    block2.clear();
+    QCOMPARE(spillFile->freeByteCount(), 200);
+    QSharedPointer<UndoSpillBlock> block4 = spillFile->write(QByteArray(50, 'd'));
+    QCOMPARE(block4->offset(), 100);
+    QCOMPARE(spillFile->size(), 600);
+    QCOMPARE(spillFile->freeByteCount(), 150);
+    const uchar *data = block4->map();
+    QVERIFY(data);
+    QCOMPARE(QByteArray(reinterpret_cast<const char*>(data), block4->size()), QByteArray(50, 'd'));
+    block4->unmap(data);
+
+    // A block that doesn't fit in any free range goes at the end.
+    QSharedPointer<UndoSpillBlock> block5 = spillFile->write(QByteArray(400, 'e'));
+    QCOMPARE(block5->offset(), 600);
+
+    // Free ranges at the end of the file are truncated, along with those next to them.
+    block4.clear();
+    QCOMPARE(spillFile->freeByteCount(), 200);
+    block3.clear();
+    block5.clear();
+    QCOMPARE(spillFile->size(), 100);
+    QCOMPARE(spillFile->freeByteCount(), 0);
+    block1.clear();
+    QCOMPARE(spillFile->size(), 0);
+}
+
+void tst_App::undoHistoryModel()
+{
+    QVERIFY2(createNewImageProject(256, 256), failureMessage);
+
+    UndoHistoryModel model;
+    model.setProject(project);
+    QCOMPARE(model.rowCount(), 0);
+
+    // A pen stroke, which stores copies of the tiles it touched.
+    QVERIFY2(switchTool(ImageCanvas::PenTool), failureMessage);
+    setCursorPosInScenePixels(0, 0);
+    QVERIFY2(drawPixelAtCursorPos(), failureMessage);
+    QCOMPARE(model.rowCount(), 1);
+
+    // A fill, which only stores the pixels that changed.
+    QVERIFY2(switchTool(ImageCanvas::FillTool), failureMessage);
+    setCursorPosInScenePixels(128, 128);
+    mouseEvent(canvas, cursorWindowPos, MouseClick);
+    QCOMPARE(model.rowCount(), 2);
+
+    qint64 totalByteCount = 0;
+    for (int row = 0; row < model.rowCount(); ++row) {
+        const QModelIndex index = model.index(row);
+        QVERIFY(!index.data(UndoHistoryModel::TextRole).toString().isEmpty());
+        QVERIFY(index.data(UndoHistoryModel::CreationTimeRole).toDateTime().isValid());
+        QVERIFY(index.data(UndoHistoryModel::ApplyDurationRole).toReal() > 0);
+        QVERIFY(!index.data(UndoHistoryModel::UndoneRole).toBool());
+        const qint64 byteCount = index.data(UndoHistoryModel::PayloadByteCountRole).toLongLong();
+        QVERIFY(byteCount > 0);
+        totalByteCount += byteCount;
+    }
+    QCOMPARE(project->undoPayloadByteCount(), totalByteCount);
+
+    // Undone changes are still listed, as they can be redone.
+    project->undoStack()->undo();
+    QCOMPARE(model.rowCount(), 2);
+    QVERIFY(!model.index(0).data(UndoHistoryModel::UndoneRole).toBool());
+    QVERIFY(model.index(1).data(UndoHistoryModel::UndoneRole).toBool());
+    project->undoStack()->redo();
+
+    // A stroke with many segments should only reset the model once, when it's added to
+    // the history, and the byte counts shouldn't be updated for every segment.
+    QSignalSpy modelResetSpy(&model, &UndoHistoryModel::modelReset);
+    QSignalSpy dataChangedSpy(&model, &UndoHistoryModel::dataChanged);
+    QSignalSpy undoPayloadByteCountChangedSpy(project.data(), &Project::undoPayloadByteCountChanged);
+    QVERIFY2(switchTool(ImageCanvas::PenTool), failureMessage);
+    setCursorPosInScenePixels(10, 10);
+    QTest::mouseMove(window, cursorWindowPos);
+    QTest::mousePress(window, Qt::LeftButton, Qt::NoModifier, cursorWindowPos);
+    for (int x = 20; x <= 200; x += 20) {
+        setCursorPosInScenePixels(x, 10);
+        QTest::mouseMove(window, cursorWindowPos);
+    }
+    QTest::mouseRelease(window, Qt::LeftButton, Qt::NoModifier, cursorWindowPos);
+    QCOMPARE(model.rowCount(), 3);
+    QCOMPARE(modelResetSpy.count(), 1);
+    // The fill's notification may still have been pending when the stroke started.
+    QTRY_VERIFY(undoPayloadByteCountChangedSpy.count() >= 1);
+    QVERIFY(undoPayloadByteCountChangedSpy.count() <= 2);
+    QCOMPARE(dataChangedSpy.count(), undoPayloadByteCountChangedSpy.count());
+    QCOMPARE(modelResetSpy.count(), 1);
+}
+
+// Tests that live preview only records the layers that it modifies,
+// and that the undo command doesn't store anything for the rest.
+void tst_App::livePreviewOnlyStoresModifiedLayers()
+{
+    QVERIFY2(createNewLayeredImageProject(), failureMessage);
+
+    layeredImageProject->addNewLayer();
+    QCOMPARE(layeredImageProject->layerCount(), 2);
+    ImageLayer *layer1 = layeredImageProject->layerAt(1);
+    ImageLayer *layer2 = layeredImageProject->layerAt(0);
+    layer2->image()->setPixelColor(0, 0, Qt::red);
+    layer1->setVisible(false);
+    const QImage originalLayer1Image = *layer1->image();
+    const QImage originalLayer2Image = *layer2->image();
+    const int originalUndoCount = project->undoStack()->count();
+    const qint64 originalPayloadByteCount = project->undoPayloadByteCount();
+
+    // Cancelling restores the modified layer and leaves the hidden one alone.
+    project->beginLivePreview();
+    layeredImageProject->moveContents(1, 0, true);
+    QCOMPARE(layer2->image()->pixelColor(1, 0), QColor(Qt::red));
+    QCOMPARE(layer1->image()->cacheKey(), originalLayer1Image.cacheKey());
+    project->endLivePreview(Project::RollbackModification);
+    QCOMPARE(*layer2->image(), originalLayer2Image);
+    QCOMPARE(project->undoStack()->count(), originalUndoCount);
+
+    // Only the visible layer's previous and new images should be stored, and
+    // the new image doesn't count towards the budget while the layer uses it.
+    project->beginLivePreview();
+    layeredImageProject->moveContents(1, 0, true);
+    layeredImageProject->moveContents(2, 0, true);
+    project->endLivePreview(Project::CommitModificaton);
+    QCOMPARE(layer2->image()->pixelColor(2, 0), QColor(Qt::red));
+    QCOMPARE(project->undoStack()->count(), originalUndoCount + 1);
+    QCOMPARE(project->undoPayloadByteCount() - originalPayloadByteCount, originalLayer2Image.sizeInBytes());
+
+    project->undoStack()->undo();
+    QCOMPARE(*layer2->image(), originalLayer2Image);
+    QCOMPARE(layer1->image()->cacheKey(), originalLayer1Image.cacheKey());
+    project->undoStack()->redo();
+    QCOMPARE(layer2->image()->pixelColor(2, 0), QColor(Qt::red));
+    QCOMPARE(layer1->image()->cacheKey(), originalLayer1Image.cacheKey());
+
+    // The stored images can be compressed, and still give the exact images back.
+    const QImage movedLayer2Image = *layer2->image();
+    UndoCommand::forEach(project->undoStack()->command(originalUndoCount), [](UndoCommand *undoCommand) {
+        undoCommand->compressPayload();
+    });
+    QVERIFY(UndoCommand::totalPayloadByteCount(project->undoStack()->command(originalUndoCount)) < originalLayer2Image.sizeInBytes());
+    project->undoStack()->undo();
+    QCOMPARE(*layer2->image(), originalLayer2Image);
+    project->undoStack()->redo();
+    QCOMPARE(*layer2->image(), movedLayer2Image);
+}
+
+void tst_App::mipmapPyramid()
+{
+    QImage image = ImageUtils::filledImage(300, 200, Qt::transparent);
+    image.setPixelColor(0, 0, Qt::red);
+    image.setPixelColor(1, 1, Qt::blue);
+
+    MipmapPyramid pyramid;
+    pyramid.setSourceImage(image);
+    // 300x200, 150x100, 75x50, 38x25, 19x13, 10x7, 5x4, 3x2, 2x1, 1x1
+    QCOMPARE(pyramid.levelCount(), 10);
+    QCOMPARE(pyramid.level(0), image);
+    QCOMPARE(pyramid.level(3).size(), QSize(38, 25));
+    QCOMPARE(MipmapPyramid::levelForScale(1.0), 0);
+    QCOMPARE(MipmapPyramid::levelForScale(0.5), 1);
+    QCOMPARE(MipmapPyramid::levelForScale(0.3), 1);
+    QCOMPARE(MipmapPyramid::levelForScale(0.25), 2);
+
+    // Nearest uses the top-left pixel of each 2x2 block.
+    QCOMPARE(pyramid.level(1).pixelColor(0, 0), QColor(Qt::red));
+
+    // Box averages them (in premultiplied form).
+    pyramid.setDownsampleMode(MipmapPyramid::BoxDownsample);
+    QCOMPARE(pyramid.level(1).pixel(0, 0), qRgba(64, 0, 64, 128));
+
+    // Only the tiles that a change affects should be recreated.
+    pyramid.level(3);
+    const int createdTileCount = pyramid.createdTileCount();
+    image.setPixelColor(250, 150, Qt::green);
+    pyramid.invalidate(QRect(250, 150, 1, 1));
+    pyramid.setSourceImage(image);
+    const QImage updatedLevel = pyramid.level(3);
+    // One tile for each of the three built levels.
+    QCOMPARE(pyramid.createdTileCount(), createdTileCount + 3);
+
+    MipmapPyramid freshPyramid;
+    freshPyramid.setDownsampleMode(MipmapPyramid::BoxDownsample);
+    freshPyramid.setSourceImage(image);
+    QCOMPARE(updatedLevel, freshPyramid.level(3));
+}
+
 void tst_App::undoTileFill()
 {
     QVERIFY2(createNewTilesetProject(), failureMessage);
@@ -1777,6 +2417,88 @@ void tst_App::undoTileFill()
     QCOMPARE(tilesetProject->tileAtTilePos(QPoint(1, 0)), targetTile);
 }
 
+void tst_App::greedyTileFill()
+{
+    QVERIFY2(createNewTilesetProject(), failureMessage);
+    QVERIFY2(togglePanel("tilesetSwatchPanel", true), failureMessage);
+
+    // Draw two tiles that aren't next to each other.
+    setCursorPosInTiles(0, 0);
+    QVERIFY2(drawTileAtCursorPos(), failureMessage);
+
+    setCursorPosInTiles(2, 0);
+    QVERIFY2(drawTileAtCursorPos(), failureMessage);
+
+    const Tile *targetTile = tilesetProject->tileAt(cursorPos);
+    QVERIFY(targetTile);
+    const Tile *untouchedTile = tilesetProject->tileAtTilePos(QPoint(1, 0));
+    QVERIFY(untouchedTile != targetTile);
+
+    QVERIFY2(switchTool(TileCanvas::FillTool), failureMessage);
+
+    // Select the second tile from the top-left in the swatch.
+    QTest::mouseMove(window, tilesetTileSceneCentre(1, 0));
+    QTest::mouseClick(window, Qt::LeftButton, Qt::NoModifier, tilesetTileSceneCentre(1, 0));
+    const QPoint tilesetCentre = tilesetTileCentre(1, 0);
+    const Tile *replacementTile = tilesetProject->tilesetTileAt(tilesetCentre.x(), tilesetCentre.y());
+    QCOMPARE(tileCanvas->penTile(), replacementTile);
+
+    // A greedy fill should replace both of them.
+    QTest::mouseMove(window, cursorWindowPos);
+    QTest::keyPress(window, Qt::Key_Shift);
+    // For some reason there must be a delay in order for the shift modifier to work.
+    QTest::mouseClick(window, Qt::LeftButton, Qt::NoModifier, cursorWindowPos, 100);
+    QTest::keyRelease(window, Qt::Key_Shift);
+    QCOMPARE(tilesetProject->tileAtTilePos(QPoint(0, 0)), replacementTile);
+    QCOMPARE(tilesetProject->tileAtTilePos(QPoint(1, 0)), untouchedTile);
+    QCOMPARE(tilesetProject->tileAtTilePos(QPoint(2, 0)), replacementTile);
+
+    // Undo it.
+    QVERIFY2(clickButton(undoToolButton), failureMessage);
+    QCOMPARE(tilesetProject->tileAtTilePos(QPoint(0, 0)), targetTile);
+    QCOMPARE(tilesetProject->tileAtTilePos(QPoint(1, 0)), untouchedTile);
+    QCOMPARE(tilesetProject->tileAtTilePos(QPoint(2, 0)), targetTile);
+}
+
+void tst_App::greedyPixelFillTileset()
+{
+    QVERIFY2(createNewTilesetProject(), failureMessage);
+
+    setCursorPosInTiles(0, 0);
+    QVERIFY2(drawTileAtCursorPos(), failureMessage);
+    const Tile *tile = tilesetProject->tileAt(cursorPos);
+    QVERIFY(tile);
+
+    // Every pixel of the target colour should be filled, whether or not it's contiguous.
+    const QImage tileImage = tile->image();
+    const QColor targetColour = tileImage.pixelColor(0, 0);
+    const QColor replacementColour = targetColour == QColor(Qt::red) ? QColor(Qt::blue) : QColor(Qt::red);
+    QVector<QPoint> expectedPositions;
+    for (int y = 0; y < tileImage.height(); ++y) {
+        for (int x = 0; x < tileImage.width(); ++x) {
+            if (tileImage.pixelColor(x, y) == targetColour)
+                expectedPositions.append(QPoint(x, y));
+        }
+    }
+
+    QVector<QPoint> filledPositions;
+    tilesetGreedyPixelFill(tile, targetColour, replacementColour, filledPositions);
+    QCOMPARE(filledPositions, expectedPositions);
+
+    // A flood fill from the same pixel can only fill a subset of those.
+    QVector<QPoint> floodFilledPositions;
+    tilesetPixelFloodFill(tile, QPoint(0, 0), targetColour, replacementColour, floodFilledPositions);
+    QVERIFY(!floodFilledPositions.isEmpty());
+    QVERIFY(floodFilledPositions.size() <= filledPositions.size());
+    for (const QPoint &position : std::as_const(floodFilledPositions))
+        QVERIFY(filledPositions.contains(position));
+
+    // Nothing should be filled if the target and replacement colours are the same.
+    filledPositions.clear();
+    tilesetGreedyPixelFill(tile, targetColour, targetColour, filledPositions);
+    QVERIFY(filledPositions.isEmpty());
+}
+
 void tst_App::undoThickSquarePen()
 {
     QVERIFY2(createNewImageProject(), failureMessage);
@@ -2587,6 +3309,36 @@ void tst_App::tilesetSwatchNavigation()
     QCOMPARE(tileCanvas->penTile(), tilesetProject->tilesetTileAtTilePos(tilePos));
 }
 
+// Tests that moving the tile pen preview only repaints the tiles it moves between.
+void tst_App::tilePenPreviewRepaintsOnlyAffectedTiles()
+{
+    QVERIFY2(createNewTilesetProject(), failureMessage);
+    QVERIFY2(switchMode(TileCanvas::TileMode), failureMessage);
+    QVERIFY2(switchTool(TileCanvas::PenTool), failureMessage);
+
+    setCursorPosInTiles(0, 0);
+    QTest::mouseMove(window, cursorWindowPos);
+
+    QSignalSpy contentPaintRequestedSpy(tileCanvas, SIGNAL(contentPaintRequested(int)));
+    QVERIFY(contentPaintRequestedSpy.isValid());
+    QSignalSpy contentAreaPaintRequestedSpy(tileCanvas, SIGNAL(contentAreaPaintRequested(QRect)));
+    QVERIFY(contentAreaPaintRequestedSpy.isValid());
+
+    // Moving within the same tile shouldn't repaint anything.
+    QTest::mouseMove(window, cursorWindowPos + QPoint(1, 1));
+    QCOMPARE(contentPaintRequestedSpy.size(), 0);
+    QCOMPARE(contentAreaPaintRequestedSpy.size(), 0);
+
+    // Moving to the next tile should repaint it and the previous one.
+    setCursorPosInTiles(1, 0);
+    QTest::mouseMove(window, cursorWindowPos);
+    QCOMPARE(contentPaintRequestedSpy.size(), 0);
+    QCOMPARE(contentAreaPaintRequestedSpy.size(), 2);
+    const QSize tileSize = tilesetProject->tileSize();
+    QCOMPARE(contentAreaPaintRequestedSpy.at(0).at(0).toRect(), QRect(QPoint(0, 0), tileSize));
+    QCOMPARE(contentAreaPaintRequestedSpy.at(1).at(0).toRect(), QRect(QPoint(tileSize.width(), 0), tileSize));
+}
+
 void tst_App::cursorShapeAfterClickingLighter()
 {
 //    createNewProject();
@@ -2851,6 +3603,55 @@ void tst_App::greedyPixelFillImageCanvas()
     QCOMPARE(canvas->currentProjectImage()->pixelColor(4, 35), QColor(Qt::black));
 }
 
+void tst_App::greedyPixelFillAllLayers()
+{
+    QVERIFY2(createNewLayeredImageProject(), failureMessage);
+    QVERIFY2(togglePanel("layerPanel", true), failureMessage);
+
+    // Add a new layer and draw a white pixel on it.
+    QVERIFY2(clickButton(newLayerButton), failureMessage);
+    QCOMPARE(layeredImageProject->layerCount(), 2);
+    ImageLayer *layer1 = layeredImageProject->layerAt(1);
+    ImageLayer *layer2 = layeredImageProject->layerAt(0);
+    QVERIFY2(selectLayer("Layer 2", 0), failureMessage);
+    layeredImageCanvas->setPenForegroundColour(Qt::white);
+    setCursorPosInScenePixels(4, 4);
+    QVERIFY2(drawPixelAtCursorPos(), failureMessage);
+    QCOMPARE(layer2->image()->pixelColor(4, 4), QColor(Qt::white));
+
+    // Greedily fill the white of layer 1 in every layer.
+    QVERIFY2(selectLayer("Layer 1", 1), failureMessage);
+    QVERIFY2(switchTool(ImageCanvas::FillTool), failureMessage);
+    layeredImageCanvas->setGreedyFillAllLayers(true);
+    auto greedyFillAllLayersCleanup = qScopeGuard([=](){ layeredImageCanvas->setGreedyFillAllLayers(false); });
+    layeredImageCanvas->setPenForegroundColour(Qt::blue);
+    setCursorPosInScenePixels(0, 0);
+    QTest::mouseMove(window, cursorWindowPos);
+    QTest::keyPress(window, Qt::Key_Shift);
+    QTest::mouseClick(window, Qt::LeftButton, Qt::NoModifier, cursorWindowPos, 100);
+    QTest::keyRelease(window, Qt::Key_Shift);
+    QCOMPARE(layer1->image()->pixelColor(0, 0), QColor(Qt::blue));
+    QCOMPARE(layer1->image()->pixelColor(255, 255), QColor(Qt::blue));
+    QCOMPARE(layer2->image()->pixelColor(4, 4), QColor(Qt::blue));
+    QCOMPARE(layer2->image()->pixelColor(0, 0), QColor(Qt::transparent));
+
+    // Both layers should be restored with one undo.
+    QVERIFY2(clickButton(undoToolButton), failureMessage);
+    QCOMPARE(layer1->image()->pixelColor(0, 0), QColor(Qt::white));
+    QCOMPARE(layer1->image()->pixelColor(255, 255), QColor(Qt::white));
+    QCOMPARE(layer2->image()->pixelColor(4, 4), QColor(Qt::white));
+
+    // A textured fill of identical layers shouldn't give each layer the same noise.
+    layer2->image()->fill(Qt::white);
+    QVERIFY2(switchTool(ImageCanvas::TexturedFillTool), failureMessage);
+    QTest::keyPress(window, Qt::Key_Shift);
+    QTest::mouseClick(window, Qt::LeftButton, Qt::NoModifier, cursorWindowPos, 100);
+    QTest::keyRelease(window, Qt::Key_Shift);
+    QVERIFY(layer1->image()->pixelColor(0, 0) != QColor(Qt::white));
+    QVERIFY(layer2->image()->pixelColor(0, 0) != QColor(Qt::white));
+    QVERIFY(*layer1->image() != *layer2->image());
+}
+
 void tst_App::texturedFillVariance_data()
 {
     addImageProjectTypes();
@@ -3032,6 +3833,80 @@ void tst_App::texturedFillSwatch()
     QCOMPARE(canvas->texturedFillParameters()->swatch()->probabilities().size(), 2);
 }
 
+void tst_App::texturedFillSeed()
+{
+    TexturedFillParameters parameters;
+    parameters.setType(TexturedFillParameters::SwatchFillType);
+    parameters.swatch()->addColoursWithProbabilities({ QColor(Qt::red), QColor(Qt::green), QColor(Qt::blue) },
+        { 1.0, 0.0, 0.5 });
+
+    // The same seed should always produce the same image, and a different seed a different one.
+    const QImage image = ImageUtils::filledImage(64, 64, Qt::white);
+    const QImage filledImage = texturedFill(&image, QPoint(0, 0), Qt::white, Qt::black, parameters, 1);
+    QVERIFY(!filledImage.isNull());
+    QCOMPARE(texturedFill(&image, QPoint(0, 0), Qt::white, Qt::black, parameters, 1), filledImage);
+    QVERIFY(texturedFill(&image, QPoint(0, 0), Qt::white, Qt::black, parameters, 2) != filledImage);
+    QCOMPARE(greedyTexturedFill(&image, Qt::white, Qt::black, parameters, 3),
+        greedyTexturedFill(&image, Qt::white, Qt::black, parameters, 3));
+
+    // Colours with no probability should never be chosen, and red is twice as likely as blue.
+    int redCount = 0;
+    for (int y = 0; y < filledImage.height(); ++y) {
+        for (int x = 0; x < filledImage.width(); ++x) {
+            const QColor colour = filledImage.pixelColor(x, y);
+            QVERIFY2(colour == Qt::red || colour == Qt::blue, qPrintable(colour.name()));
+            if (colour == Qt::red)
+                ++redCount;
+        }
+    }
+    QVERIFY(redCount > filledImage.width() * filledImage.height() / 2);
+
+    parameters.setType(TexturedFillParameters::VarianceFillType);
+    parameters.lightness()->setEnabled(true);
+    parameters.lightness()->setVarianceLowerBound(-0.5);
+    parameters.lightness()->setVarianceUpperBound(0.5);
+    QCOMPARE(texturedFill(&image, QPoint(0, 0), Qt::white, Qt::red, parameters, 4),
+        texturedFill(&image, QPoint(0, 0), Qt::white, Qt::red, parameters, 4));
+}
+
+void tst_App::texturedFillReproducibleFromCommand()
+{
+    QVERIFY2(createNewProject(Project::ImageType), failureMessage);
+    QVERIFY2(switchTool(ImageCanvas::TexturedFillTool), failureMessage);
+    QVERIFY2(setPenForegroundColour("#123456"), failureMessage);
+    const QImage imageBeforeFill = *canvas->currentProjectImage();
+    const QColor targetColour = imageBeforeFill.pixelColor(0, 0);
+
+    // The seed stored in the fill command should reproduce the fill exactly.
+    setCursorPosInScenePixels(0, 0);
+    const int commandCountBeforeFill = project->undoStack()->count();
+    mouseEvent(canvas, cursorWindowPos, MouseClick);
+    QCOMPARE(project->undoStack()->count(), commandCountBeforeFill + 1);
+    const QUndoCommand *fillMacro = project->undoStack()->command(commandCountBeforeFill);
+    QVERIFY(fillMacro);
+    QCOMPARE(fillMacro->childCount(), 1);
+    const auto fillCommand = dynamic_cast<const ApplyPixelFillCommand*>(fillMacro->child(0));
+    QVERIFY(fillCommand);
+    QCOMPARE(*canvas->currentProjectImage(), texturedFill(&imageBeforeFill, QPoint(0, 0), targetColour,
+        canvas->penForegroundColour(), *canvas->texturedFillParameters(), fillCommand->texturedFillSeed()));
+
+    // The same goes for greedy fills.
+    QVERIFY2(clickButton(undoToolButton), failureMessage);
+    QCOMPARE(*canvas->currentProjectImage(), imageBeforeFill);
+    QTest::mouseMove(window, cursorWindowPos);
+    QTest::keyPress(window, Qt::Key_Shift);
+    QTest::mouseClick(window, Qt::LeftButton, Qt::NoModifier, cursorWindowPos, 100);
+    QTest::keyRelease(window, Qt::Key_Shift);
+    QCOMPARE(project->undoStack()->count(), commandCountBeforeFill + 1);
+    const QUndoCommand *greedyFillMacro = project->undoStack()->command(commandCountBeforeFill);
+    QVERIFY(greedyFillMacro);
+    QCOMPARE(greedyFillMacro->childCount(), 1);
+    const auto greedyFillCommand = dynamic_cast<const ApplyGreedyPixelFillCommand*>(greedyFillMacro->child(0));
+    QVERIFY(greedyFillCommand);
+    QCOMPARE(*canvas->currentProjectImage(), greedyTexturedFill(&imageBeforeFill, targetColour,
+        canvas->penForegroundColour(), *canvas->texturedFillParameters(), greedyFillCommand->texturedFillSeed()));
+}
+
 void tst_App::pixelLineToolImageCanvas_data()
 {
     addImageProjectTypes();
@@ -3178,6 +4053,54 @@ void tst_App::pixelLineToolTransparent()
     QCOMPARE(canvas->currentProjectImage()->pixelColor(2, 2), translucentRed);
 }
 
+void tst_App::penStrokeUndo_data()
+{
+    addImageProjectTypes();
+}
+
+void tst_App::penStrokeUndo()
+{
+    QFETCH(Project::Type, projectType);
+
+    QVERIFY2(createNewProject(projectType), failureMessage);
+    QVERIFY2(panTopLeftTo(0, 0), failureMessage);
+    QVERIFY2(switchTool(ImageCanvas::PenTool), failureMessage);
+
+    const QImage imageBeforeStroke = *canvas->currentProjectImage();
+    const int undoCommandCountBeforeStroke = project->undoStack()->count();
+
+    // Draw a stroke with several segments that crosses tile boundaries.
+    setCursorPosInScenePixels(10, 10);
+    QTest::mouseMove(window, cursorWindowPos);
+    QTest::mousePress(window, Qt::LeftButton, Qt::NoModifier, cursorWindowPos);
+    setCursorPosInScenePixels(70, 10);
+    QTest::mouseMove(window, cursorWindowPos);
+    setCursorPosInScenePixels(70, 70);
+    QTest::mouseMove(window, cursorWindowPos);
+    setCursorPosInScenePixels(130, 70);
+    QTest::mouseMove(window, cursorWindowPos);
+    QTest::mouseRelease(window, Qt::LeftButton, Qt::NoModifier, cursorWindowPos);
+    QCOMPARE(canvas->currentProjectImage()->pixelColor(10, 10), QColor(Qt::black));
+    QCOMPARE(canvas->currentProjectImage()->pixelColor(70, 40), QColor(Qt::black));
+    QCOMPARE(canvas->currentProjectImage()->pixelColor(130, 70), QColor(Qt::black));
+    const QImage imageAfterStroke = *canvas->currentProjectImage();
+
+    // The whole stroke should be merged into one command.
+    QCOMPARE(project->undoStack()->count(), undoCommandCountBeforeStroke + 1);
+    const QUndoCommand *strokeMacro = project->undoStack()->command(undoCommandCountBeforeStroke);
+    QVERIFY(strokeMacro);
+    QCOMPARE(strokeMacro->childCount(), 1);
+
+    QVERIFY2(clickButton(undoToolButton), failureMessage);
+    QCOMPARE(*canvas->currentProjectImage(), imageBeforeStroke);
+
+    QVERIFY2(clickButton(redoToolButton), failureMessage);
+    QCOMPARE(*canvas->currentProjectImage(), imageAfterStroke);
+
+    QVERIFY2(clickButton(undoToolButton), failureMessage);
+    QCOMPARE(*canvas->currentProjectImage(), imageBeforeStroke);
+}
+
 void tst_App::lineMiddleMouseButton()
 {
     QVERIFY2(createNewProject(Project::LayeredImageType), failureMessage);
@@ -3320,6 +4243,148 @@ void tst_App::splitScreenRendering()
     QCOMPARE(canvasGrab.pixelColor(layeredImageCanvas->width() * 0.75, layeredImageCanvas->height() / 2), QColor(Qt::white));
 }
 
+void tst_App::partialRepaintAfterDrawing_data()
+{
+    addImageProjectTypes();
+}
+
+// Tests that drawing pixels only causes the affected area of the canvas to be repainted.
+void tst_App::partialRepaintAfterDrawing()
+{
+    QFETCH(Project::Type, projectType);
+
+    QVERIFY2(createNewProject(projectType), failureMessage);
+    QVERIFY2(switchTool(ImageCanvas::PenTool), failureMessage);
+
+    auto firstPaneItem = qobject_cast<CanvasPaneItem*>(findChildItem(canvas, canvas->objectName() + "PaneItem0"));
+    QVERIFY(firstPaneItem);
+    // The scene graph renderer doesn't paint at all; it's tested in sceneGraphRendererUploadsChangedTiles().
+    QCOMPARE(firstPaneItem->renderer(), CanvasPaneItem::SceneGraphRenderer);
+    firstPaneItem->setRenderer(CanvasPaneItem::PainterRenderer);
+    auto rendererRollback = qScopeGuard([=](){ firstPaneItem->setRenderer(CanvasPaneItem::SceneGraphRenderer); });
+
+    // Ensure that everything has been rendered before we start counting.
+    QVERIFY(imageGrabber.requestImage(canvas));
+    QTRY_VERIFY(imageGrabber.isReady());
+    QCOMPARE(imageGrabber.takeImage().isNull(), false);
+    const int fullPaintCountBeforeDrawing = firstPaneItem->fullPaintCount();
+
+    QSignalSpy contentAreaPaintRequestedSpy(canvas.data(), SIGNAL(contentAreaPaintRequested(QRect)));
+    QVERIFY(contentAreaPaintRequestedSpy.isValid());
+
+    setCursorPosInScenePixels(10, 10);
+    QVERIFY2(drawPixelAtCursorPos(), failureMessage);
+    QVERIFY(!contentAreaPaintRequestedSpy.isEmpty());
+    const QRect requestedArea = contentAreaPaintRequestedSpy.first().first().toRect();
+    QVERIFY(requestedArea.contains(cursorPos));
+    QVERIFY(!requestedArea.contains(project->bounds()));
+
+    // The pixel should have been rendered without repainting the entire pane.
+    QVERIFY(imageGrabber.requestImage(canvas));
+    QTRY_VERIFY(imageGrabber.isReady());
+    const QImage canvasGrab = imageGrabber.takeImage();
+    const QPoint pixelPosInCanvas = canvas->mapFromScene(cursorWindowPos).toPoint();
+    QCOMPARE(canvasGrab.pixelColor(pixelPosInCanvas), canvas->penForegroundColour());
+    QCOMPARE(firstPaneItem->fullPaintCount(), fullPaintCountBeforeDrawing);
+}
+
+void tst_App::sceneGraphRendererUploadsChangedTiles_data()
+{
+    addImageProjectTypes();
+}
+
+// Tests that the scene graph renderer only uploads the tiles that drawing changes,
+// and doesn't upload anything when panning.
+void tst_App::sceneGraphRendererUploadsChangedTiles()
+{
+    QFETCH(Project::Type, projectType);
+
+    QVERIFY2(createNewProject(projectType), failureMessage);
+    QVERIFY2(switchTool(ImageCanvas::PenTool), failureMessage);
+
+    auto firstPaneItem = qobject_cast<CanvasPaneItem*>(findChildItem(canvas, canvas->objectName() + "PaneItem0"));
+    QVERIFY(firstPaneItem);
+    QCOMPARE(firstPaneItem->renderer(), CanvasPaneItem::SceneGraphRenderer);
+
+    // Ensure that everything has been rendered before we start counting.
+    QVERIFY(imageGrabber.requestImage(canvas));
+    QTRY_VERIFY(imageGrabber.isReady());
+    QCOMPARE(imageGrabber.takeImage().isNull(), false);
+    const int uploadedTileCountBeforeDrawing = firstPaneItem->uploadedTileCount();
+    QVERIFY(uploadedTileCountBeforeDrawing > 0);
+
+    setCursorPosInScenePixels(10, 10);
+    QVERIFY2(drawPixelAtCursorPos(), failureMessage);
+
+    QVERIFY(imageGrabber.requestImage(canvas));
+    QTRY_VERIFY(imageGrabber.isReady());
+    QImage canvasGrab = imageGrabber.takeImage();
+    QPoint pixelPosInCanvas = canvas->mapFromScene(cursorWindowPos).toPoint();
+    QCOMPARE(canvasGrab.pixelColor(pixelPosInCanvas), canvas->penForegroundColour());
+    // The new project is smaller than a tile, so only one should have been uploaded.
+    QCOMPARE(firstPaneItem->uploadedTileCount(), uploadedTileCountBeforeDrawing + 1);
+
+    // Panning shouldn't require anything to be uploaded.
+    const int uploadedTileCountBeforePanning = firstPaneItem->uploadedTileCount();
+    CanvasPane *firstPane = canvas->firstPane();
+    firstPane->setIntegerOffset(firstPane->integerOffset() + QPoint(10, 10));
+    QVERIFY(imageGrabber.requestImage(canvas));
+    QTRY_VERIFY(imageGrabber.isReady());
+    canvasGrab = imageGrabber.takeImage();
+    pixelPosInCanvas += QPoint(10, 10);
+    QCOMPARE(canvasGrab.pixelColor(pixelPosInCanvas), canvas->penForegroundColour());
+    QCOMPARE(firstPaneItem->uploadedTileCount(), uploadedTileCountBeforePanning);
+}
+
+void tst_App::contentImageCached_data()
+{
+    addImageProjectTypes();
+}
+
+// Tests that the content image is only recreated when the content changes,
+// so that it can be shared between panes and the animation preview.
+void tst_App::contentImageCached()
+{
+    QFETCH(Project::Type, projectType);
+
+    QVERIFY2(createNewProject(projectType), failureMessage);
+
+    const QImage contentImageBeforeDrawing = canvas->contentImage();
+    QCOMPARE(canvas->contentImage().cacheKey(), contentImageBeforeDrawing.cacheKey());
+    const quint64 generationBeforeDrawing = canvas->contentGeneration();
+
+    setCursorPosInScenePixels(10, 10);
+    QVERIFY2(drawPixelAtCursorPos(), failureMessage);
+    QVERIFY(canvas->contentGeneration() > generationBeforeDrawing);
+
+    const QImage contentImageAfterDrawing = canvas->contentImage();
+    QVERIFY(contentImageAfterDrawing.cacheKey() != contentImageBeforeDrawing.cacheKey());
+    QCOMPARE(contentImageAfterDrawing.pixelColor(cursorPos), canvas->penForegroundColour());
+    QCOMPARE(canvas->contentImage().cacheKey(), contentImageAfterDrawing.cacheKey());
+
+    // Changes to the view don't change the content.
+    const quint64 generationAfterDrawing = canvas->contentGeneration();
+    const qreal oldZoomLevel = canvas->currentPane()->zoomLevel();
+    canvas->currentPane()->setZoomLevel(oldZoomLevel + 1);
+    canvas->currentPane()->setZoomLevel(oldZoomLevel);
+    const QColor oldGridColour = canvas->gridColour();
+    canvas->setGridColour(Qt::red);
+    canvas->setGridColour(oldGridColour);
+    QCOMPARE(canvas->contentGeneration(), generationAfterDrawing);
+    QCOMPARE(canvas->contentImage().cacheKey(), contentImageAfterDrawing.cacheKey());
+
+    // The line preview is part of the content image, but not the exported content image,
+    // which is what the animation preview shows.
+    QTest::keyPress(window, Qt::Key_Shift);
+    setCursorPosInScenePixels(20, 10);
+    QTest::mouseMove(window, cursorWindowPos);
+    QCOMPARE(canvas->isLineVisible(), true);
+    QCOMPARE(canvas->contentImage().pixelColor(15, 10), canvas->penForegroundColour());
+    QVERIFY(canvas->exportedContentImage().pixelColor(15, 10) != canvas->penForegroundColour());
+    QCOMPARE(canvas->exportedContentImage().pixelColor(10, 10), canvas->penForegroundColour());
+    QTest::keyRelease(window, Qt::Key_Shift);
+}
+
 // Distinct from a read-only file, this test checks that the UI prevents images with formats like Format_Indexed8
 // from being modified, as QPainter doesn't support it.
 void tst_App::formatNotModifiable()
@@ -5226,6 +6291,90 @@ void tst_App::hueSaturation()
     QCOMPARE(canvas->currentProjectImage()->convertToFormat(QImage::Format_ARGB32), expectedImage);
 }
 
+// Tests that HSL adjustments of large selections are previewed at a lower resolution
+// and then refined, and that committing an unrefined adjustment commits the full result.
+void tst_App::hueSaturationPreview()
+{
+    QVariantMap args;
+    args.insert("imageWidth", QVariant(10));
+    args.insert("imageHeight", QVariant(10));
+    args.insert("transparentImageBackground", QVariant(true));
+    QVERIFY2(createNewProject(Project::ImageType, args), failureMessage);
+
+    const QImage originalImage(QLatin1String(":/resources/hueSaturation-original.png"));
+    QVERIFY(!originalImage.isNull());
+    qGuiApp->clipboard()->setImage(originalImage);
+    QVERIFY2(triggerPaste(), failureMessage);
+    QTest::keyClick(window, Qt::Key_Escape);
+
+    const QImage expectedImage(QLatin1String(":/resources/hueSaturation-hue-increased.png"));
+    QVERIFY(!expectedImage.isNull());
+
+    // Make the 10x10 selection large enough to be previewed.
+    canvas->setHslPreviewPixelThreshold(16);
+    QTest::keySequence(window, QKeySequence::SelectAll);
+
+    canvas->beginModifyingSelectionHsl();
+    QVERIFY(canvas->isAdjustingImage());
+    canvas->modifySelectionHsl(0.1, 0, 0);
+    QTRY_COMPARE(canvas->contentImage().convertToFormat(QImage::Format_ARGB32), expectedImage);
+
+    // Adjust and commit before the refinement has had a chance to happen.
+    canvas->modifySelectionHsl(0.1, 0, 0);
+    canvas->endModifyingSelectionHsl(ImageCanvas::CommitAdjustment);
+    QVERIFY(!canvas->isAdjustingImage());
+    QTest::keyClick(window, Qt::Key_Escape);
+    QCOMPARE(canvas->currentProjectImage()->convertToFormat(QImage::Format_ARGB32), expectedImage);
+}
+
+void tst_App::modifyHsl_data()
+{
+    QTest::addColumn<QImage::Format>("format");
+
+    QTest::newRow("ARGB32") << QImage::Format_ARGB32;
+    QTest::newRow("ARGB32_Premultiplied") << QImage::Format_ARGB32_Premultiplied;
+    QTest::newRow("RGBA8888") << QImage::Format_RGBA8888;
+    QTest::newRow("RGB888") << QImage::Format_RGB888;
+}
+
+// Tests that modifyHsl() gives the same results as converting each pixel through QColor.
+void tst_App::modifyHsl()
+{
+    QFETCH(QImage::Format, format);
+
+    QImage image(64, 64, format);
+    QRandomGenerator random(64);
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            // Use a small palette so that there are plenty of repeated pixels, as well as some unique ones.
+            image.setPixelColor(x, y, random.bounded(4) == 0
+                ? QColor::fromRgba(random.generate()) : QColor::fromRgba(0x80102030 * random.bounded(8)));
+        }
+    }
+
+    const qreal hue = 0.1;
+    const qreal saturation = -0.2;
+    const qreal lightness = 0.05;
+    const qreal alpha = 0.1;
+    const ImageCanvas::AlphaAdjustmentFlags alphaAdjustmentFlags = ImageCanvas::DoNotModifyFullyTransparentPixels;
+    QImage expectedImage = image;
+    for (int y = 0; y < expectedImage.height(); ++y) {
+        for (int x = 0; x < expectedImage.width(); ++x) {
+            QColor hsl = expectedImage.pixelColor(x, y).toHsl();
+            const bool isFullyTransparent = qFuzzyCompare(hsl.alphaF(), 0.0f);
+            hsl.setHslF(
+                qBound(0.0, hsl.hslHueF() + hue, 1.0),
+                qBound(0.0, hsl.hslSaturationF() + saturation, 1.0),
+                qBound(0.0, hsl.lightnessF() + lightness, 1.0),
+                qBound(0.0, isFullyTransparent ? hsl.alphaF() : hsl.alphaF() + alpha, 1.0));
+            expectedImage.setPixelColor(x, y, hsl.toRgb());
+        }
+    }
+
+    ImageUtils::modifyHsl(image, hue, saturation, lightness, alpha, alphaAdjustmentFlags);
+    QCOMPARE(image, expectedImage);
+}
+
 void tst_App::opacityDialog_data()
 {
     QTest::addColumn<Project::Type>("projectType");
@@ -6198,6 +7347,260 @@ void tst_App::layerVisibility()
     QCOMPARE(imageGrabber.takeImage(), grabWithRedDot);
 }
 
+// Tests that the cached composites of the layers above and below the current layer are kept up-to-date.
+void tst_App::layerCompositesAroundCurrentLayer()
+{
+    QVERIFY2(createNewLayeredImageProject(), failureMessage);
+    QVERIFY2(togglePanel("layerPanel", true), failureMessage);
+
+    // Add a new layer and draw a red dot on it.
+    QVERIFY2(clickButton(newLayerButton), failureMessage);
+    QCOMPARE(layeredImageProject->layerCount(), 2);
+    QVERIFY2(selectLayer("Layer 2", 0), failureMessage);
+    setCursorPosInScenePixels(10, 10);
+    layeredImageCanvas->setPenForegroundColour(Qt::red);
+    QVERIFY2(drawPixelAtCursorPos(), failureMessage);
+    QCOMPARE(layeredImageCanvas->contentImage().pixelColor(10, 10), QColor(Qt::red));
+
+    // Make the bottom layer current. The red dot is now part of the composite above it,
+    // so drawing at the same position on the bottom layer shouldn't be visible.
+    QVERIFY2(selectLayer("Layer 1", 1), failureMessage);
+    layeredImageCanvas->setPenForegroundColour(Qt::blue);
+    QVERIFY2(drawPixelAtCursorPos(), failureMessage);
+    QCOMPARE(layeredImageCanvas->contentImage().pixelColor(10, 10), QColor(Qt::red));
+    setCursorPosInScenePixels(11, 10);
+    QVERIFY2(drawPixelAtCursorPos(), failureMessage);
+    QCOMPARE(layeredImageCanvas->contentImage().pixelColor(11, 10), QColor(Qt::blue));
+
+    // Hiding the layer above should reveal the blue dot.
+    layeredImageProject->layerAt(0)->setVisible(false);
+    QCOMPARE(layeredImageCanvas->contentImage().pixelColor(10, 10), QColor(Qt::blue));
+    layeredImageProject->layerAt(0)->setVisible(true);
+    QCOMPARE(layeredImageCanvas->contentImage().pixelColor(10, 10), QColor(Qt::red));
+
+    // Modifications to non-current layers that don't emit any signals should still be picked up.
+    layeredImageProject->layerAt(0)->image()->setPixelColor(12, 10, Qt::green);
+    QCOMPARE(layeredImageCanvas->contentImage().pixelColor(12, 10), QColor(Qt::green));
+
+    // Undoing the blue dots shouldn't affect the red one.
+    QVERIFY2(clickButton(undoToolButton), failureMessage);
+    QCOMPARE(layeredImageCanvas->contentImage().pixelColor(11, 10), QColor(Qt::white));
+    QCOMPARE(layeredImageCanvas->contentImage().pixelColor(10, 10), QColor(Qt::red));
+}
+
+// Tests that layer composites created on the worker thread are only delivered if they're still current.
+void tst_App::asyncLayerComposites()
+{
+    QVERIFY2(createNewLayeredImageProject(), failureMessage);
+    QVERIFY2(togglePanel("layerPanel", true), failureMessage);
+
+    // Add a new layer and draw a red dot on it.
+    QVERIFY2(clickButton(newLayerButton), failureMessage);
+    QCOMPARE(layeredImageProject->layerCount(), 2);
+    QVERIFY2(selectLayer("Layer 2", 0), failureMessage);
+    setCursorPosInScenePixels(10, 10);
+    layeredImageCanvas->setPenForegroundColour(Qt::red);
+    QVERIFY2(drawPixelAtCursorPos(), failureMessage);
+
+    // Only the second of two back-to-back requests should result in composites.
+    LayerCompositorSnapshot snapshot;
+    snapshot.size = layeredImageProject->size();
+    snapshot.currentIndex = 1;
+    for (int i = 0; i < layeredImageProject->layerCount(); ++i)
+        snapshot.layers.append({ *layeredImageProject->layerAt(i)->image(), true, 1.0 });
+
+    LayerCompositor compositor;
+    QSignalSpy compositesReadySpy(&compositor, &LayerCompositor::compositesReady);
+    QVERIFY(compositesReadySpy.isValid());
+    compositor.requestComposites(snapshot);
+    const quint64 latestGeneration = compositor.requestComposites(snapshot);
+    // Stale results are also dropped on this thread, so once the latest request's
+    // composites have arrived, there can't be any others still on their way.
+    QTRY_COMPARE(compositesReadySpy.size(), 1);
+    const LayerComposites composites = compositesReadySpy.first().first().value<LayerComposites>();
+    QCOMPARE(composites.generation, latestGeneration);
+    QCOMPARE(composites.layersAboveCurrentImage.pixelColor(10, 10), QColor(Qt::red));
+    QCOMPARE(composites.layersBelowCurrentImage.pixelColor(10, 10), QColor(Qt::transparent));
+
+    // Make the canvas composite every change on the worker thread.
+    const qint64 oldThreshold = layeredImageCanvas->asyncCompositingPixelThreshold();
+    layeredImageCanvas->setAsyncCompositingPixelThreshold(0);
+    auto thresholdCleanup = qScopeGuard([=](){ layeredImageCanvas->setAsyncCompositingPixelThreshold(oldThreshold); });
+    QVERIFY2(selectLayer("Layer 1", 1), failureMessage);
+    QTRY_COMPARE(layeredImageCanvas->contentImage().pixelColor(10, 10), QColor(Qt::red));
+
+    // The new composites should eventually be shown, and the latest change should win.
+    layeredImageProject->layerAt(0)->setVisible(false);
+    layeredImageProject->layerAt(0)->setVisible(true);
+    layeredImageProject->layerAt(0)->setVisible(false);
+    // Composites of the earlier changes are stale by the time they're ready, so they're
+    // dropped rather than delivered; only the hidden layer's composites can be shown.
+    QTRY_COMPARE(layeredImageCanvas->contentImage().pixelColor(10, 10), QColor(Qt::white));
+    layeredImageProject->layerAt(0)->setVisible(true);
+    QTRY_COMPARE(layeredImageCanvas->contentImage().pixelColor(10, 10), QColor(Qt::red));
+}
+
+void tst_App::compositingMatchesQPainter_data()
+{
+    QTest::addColumn<ImageLayer::BlendMode>("blendMode");
+    QTest::addColumn<int>("compositionMode");
+    QTest::addColumn<qreal>("opacity");
+    QTest::addColumn<int>("fuzz");
+
+    // Only normal blending rounds exactly as QPainter does.
+    QTest::newRow("normal, 1.0") << ImageLayer::NormalBlendMode << int(QPainter::CompositionMode_SourceOver) << 1.0 << 0;
+    QTest::newRow("normal, 0.5") << ImageLayer::NormalBlendMode << int(QPainter::CompositionMode_SourceOver) << 0.5 << 0;
+    QTest::newRow("normal, 0.13") << ImageLayer::NormalBlendMode << int(QPainter::CompositionMode_SourceOver) << 0.13 << 0;
+    QTest::newRow("multiply, 1.0") << ImageLayer::MultiplyBlendMode << int(QPainter::CompositionMode_Multiply) << 1.0 << 1;
+    QTest::newRow("multiply, 0.5") << ImageLayer::MultiplyBlendMode << int(QPainter::CompositionMode_Multiply) << 0.5 << 2;
+    QTest::newRow("screen, 1.0") << ImageLayer::ScreenBlendMode << int(QPainter::CompositionMode_Screen) << 1.0 << 1;
+    QTest::newRow("screen, 0.5") << ImageLayer::ScreenBlendMode << int(QPainter::CompositionMode_Screen) << 0.5 << 2;
+    QTest::newRow("overlay, 1.0") << ImageLayer::OverlayBlendMode << int(QPainter::CompositionMode_Overlay) << 1.0 << 1;
+    QTest::newRow("overlay, 0.5") << ImageLayer::OverlayBlendMode << int(QPainter::CompositionMode_Overlay) << 0.5 << 2;
+    // QPainter interpolates the saturated result by the opacity, whereas we scale the source
+    // before adding it, so only compare against it when it's fully opaque.
+    QTest::newRow("add, 1.0") << ImageLayer::AddBlendMode << int(QPainter::CompositionMode_Plus) << 1.0 << 1;
+}
+
+void tst_App::compositingMatchesQPainter()
+{
+    QFETCH(ImageLayer::BlendMode, blendMode);
+    QFETCH(int, compositionMode);
+    QFETCH(qreal, opacity);
+    QFETCH(int, fuzz);
+
+    // Use an odd width so that the SIMD implementation has to deal with leftover pixels.
+    const QSize size(37, 5);
+    QImage sourceImage(size, QImage::Format_ARGB32_Premultiplied);
+    QImage destinationImage(size, QImage::Format_ARGB32_Premultiplied);
+    QRandomGenerator random(123);
+    for (int y = 0; y < size.height(); ++y) {
+        for (int x = 0; x < size.width(); ++x) {
+            // Include fully transparent and fully opaque pixels, as they take shortcuts.
+            const int sourceAlpha = x % 3 == 0 ? 255 : (x % 5 == 0 ? 0 : random.bounded(256));
+            sourceImage.setPixelColor(x, y, QColor(random.bounded(256), random.bounded(256), random.bounded(256), sourceAlpha));
+            destinationImage.setPixelColor(x, y, QColor(random.bounded(256), random.bounded(256), random.bounded(256), random.bounded(256)));
+        }
+    }
+
+    QImage expectedImage = destinationImage;
+    QPainter painter(&expectedImage);
+    painter.setCompositionMode(static_cast<QPainter::CompositionMode>(compositionMode));
+    painter.setOpacity(opacity);
+    painter.drawImage(0, 0, sourceImage);
+    painter.end();
+
+    QImage scalarImage = destinationImage;
+    Compositing::blend(&scalarImage, sourceImage, opacity, blendMode, Compositing::ScalarImplementation);
+    QVERIFY2(fuzzyImageCompare(scalarImage, expectedImage, fuzz), failureMessage);
+
+    // The SIMD implementation should produce exactly the same results as the scalar one.
+    QImage simdImage = destinationImage;
+    Compositing::blend(&simdImage, sourceImage, opacity, blendMode, Compositing::SimdImplementation);
+    QVERIFY2(compareImages(simdImage, scalarImage), failureMessage);
+}
+
+void tst_App::layerOpacity()
+{
+    QVERIFY2(createNewLayeredImageProject(), failureMessage);
+    QVERIFY2(togglePanel("layerPanel", true), failureMessage);
+
+    // Add a new layer and draw a red dot on it.
+    QVERIFY2(clickButton(newLayerButton), failureMessage);
+    QCOMPARE(layeredImageProject->layerCount(), 2);
+    QVERIFY2(selectLayer("Layer 2", 0), failureMessage);
+    setCursorPosInScenePixels(10, 10);
+    layeredImageCanvas->setPenForegroundColour(Qt::red);
+    QVERIFY2(drawPixelAtCursorPos(), failureMessage);
+
+    // Half of the red should be blended with the white of the layer below,
+    // both in the exported image and on the canvas.
+    layeredImageProject->setLayerOpacity(0, 0.5);
+    QImage expectedImage = layeredImageProject->layerAt(1)->image()->convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    QPainter painter(&expectedImage);
+    painter.setOpacity(0.5);
+    painter.drawImage(0, 0, *layeredImageProject->layerAt(0)->image());
+    painter.end();
+    QVERIFY2(compareImages(layeredImageProject->exportedImage(), expectedImage), failureMessage);
+    QVERIFY(layeredImageProject->exportedImage().pixelColor(10, 10) != QColor(Qt::red));
+    QCOMPARE(layeredImageCanvas->contentImage().pixelColor(10, 10), expectedImage.pixelColor(10, 10));
+
+    // Merging the layers should bake the opacity into the merged layer.
+    layeredImageProject->mergeCurrentLayerDown();
+    QCOMPARE(layeredImageProject->layerCount(), 1);
+    QCOMPARE(layeredImageProject->layerAt(0)->opacity(), 1.0);
+    QVERIFY2(compareImages(layeredImageProject->exportedImage(), expectedImage), failureMessage);
+
+    // Undoing the merge should restore it.
+    QVERIFY2(clickButton(undoToolButton), failureMessage);
+    QCOMPARE(layeredImageProject->layerCount(), 2);
+    QCOMPARE(layeredImageProject->layerAt(0)->opacity(), 0.5);
+    QVERIFY2(compareImages(layeredImageProject->exportedImage(), expectedImage), failureMessage);
+}
+
+void tst_App::layerBlendModes()
+{
+    QVERIFY2(createNewLayeredImageProject(), failureMessage);
+    QVERIFY2(togglePanel("layerPanel", true), failureMessage);
+
+    // Draw a blue dot on the bottom layer.
+    setCursorPosInScenePixels(10, 10);
+    layeredImageCanvas->setPenForegroundColour(Qt::blue);
+    QVERIFY2(drawPixelAtCursorPos(), failureMessage);
+
+    // Add a new layer and draw a red dot over it.
+    QVERIFY2(clickButton(newLayerButton), failureMessage);
+    QCOMPARE(layeredImageProject->layerCount(), 2);
+    QVERIFY2(selectLayer("Layer 2", 0), failureMessage);
+    layeredImageCanvas->setPenForegroundColour(Qt::red);
+    QVERIFY2(drawPixelAtCursorPos(), failureMessage);
+    QCOMPARE(layeredImageProject->exportedImage().pixelColor(10, 10), QColor(Qt::red));
+
+    // Red multiplied by blue is black; white is left as it is.
+    layeredImageProject->setLayerBlendMode(0, ImageLayer::MultiplyBlendMode);
+    QCOMPARE(layeredImageProject->layerAt(0)->blendMode(), ImageLayer::MultiplyBlendMode);
+    QCOMPARE(layeredImageProject->exportedImage().pixelColor(10, 10), QColor(Qt::black));
+    QCOMPARE(layeredImageProject->exportedImage().pixelColor(11, 10), QColor(Qt::white));
+    QCOMPARE(layeredImageCanvas->contentImage().pixelColor(10, 10), QColor(Qt::black));
+
+    // The canvas should also get it right when the layer is above the current layer.
+    QVERIFY2(selectLayer("Layer 1", 1), failureMessage);
+    QCOMPARE(layeredImageCanvas->contentImage().pixelColor(10, 10), QColor(Qt::black));
+    QVERIFY2(compareImages(layeredImageCanvas->contentImage(), layeredImageProject->exportedImage()), failureMessage);
+
+    // Undo the blend mode change.
+    QVERIFY2(clickButton(undoToolButton), failureMessage);
+    QCOMPARE(layeredImageProject->layerAt(0)->blendMode(), ImageLayer::NormalBlendMode);
+    QCOMPARE(layeredImageCanvas->contentImage().pixelColor(10, 10), QColor(Qt::red));
+
+    // Merging bakes the blend mode of the target layer into the merged image,
+    // so the merged layer must go back to normal rather than blending its pixels again.
+    layeredImageProject->setLayerBlendMode(0, ImageLayer::ScreenBlendMode);
+    layeredImageProject->mergeCurrentLayerUp();
+    QCOMPARE(layeredImageProject->layerCount(), 1);
+    QCOMPARE(layeredImageProject->layerAt(0)->blendMode(), ImageLayer::NormalBlendMode);
+    // Red screened with blue is magenta.
+    QCOMPARE(layeredImageProject->exportedImage().pixelColor(10, 10), QColor(Qt::magenta));
+
+    // Undoing the merge restores the target layer's blend mode.
+    QVERIFY2(clickButton(undoToolButton), failureMessage);
+    QCOMPARE(layeredImageProject->layerCount(), 2);
+    QCOMPARE(layeredImageProject->layerAt(0)->blendMode(), ImageLayer::ScreenBlendMode);
+    QVERIFY2(clickButton(undoToolButton), failureMessage);
+    QCOMPARE(layeredImageProject->layerAt(0)->blendMode(), ImageLayer::NormalBlendMode);
+
+    // Blend modes should be saved and loaded.
+    layeredImageProject->setLayerBlendMode(0, ImageLayer::ScreenBlendMode);
+    const QString savedProjectPath = tempProjectDir->path() + QLatin1String("/layerBlendModes.slp");
+    QVERIFY(layeredImageProject->saveAs(QUrl::fromLocalFile(savedProjectPath)));
+    QVERIFY2(triggerCloseProject(), failureMessage);
+    QVERIFY2(loadProject(QUrl::fromLocalFile(savedProjectPath)), failureMessage);
+    QCOMPARE(layeredImageProject->layerAt(0)->blendMode(), ImageLayer::ScreenBlendMode);
+    QCOMPARE(layeredImageProject->layerAt(1)->blendMode(), ImageLayer::NormalBlendMode);
+    // Red screened with blue is magenta.
+    QCOMPARE(layeredImageProject->exportedImage().pixelColor(10, 10), QColor(Qt::magenta));
+}
+
 void tst_App::moveLayerUpAndDown()
 {
     QVERIFY2(createNewLayeredImageProject(), failureMessage);
@@ -0,0 +1,164 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QGuiApplication>
+#include <QPainter>
+#include <QRandomGenerator>
+#include <QtTest>
+
+#include "compositing.h"
+#include "imageutils.h"
+
+// Compares flattening layers with the Compositing kernels against QPainter.
+class tst_Compositing : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void flatten_data();
+    void flatten();
+    void flattenMixedBlendModes_data();
+    void flattenMixedBlendModes();
+
+private:
+    QVector<QImage> createLayerImages(const QSize &size, int layerCount);
+};
+
+enum Method {
+    QPainterMethod,
+    ScalarMethod,
+    SimdMethod
+};
+
+void tst_Compositing::flatten_data()
+{
+    QTest::addColumn<int>("method");
+    QTest::addColumn<int>("layerCount");
+    QTest::addColumn<qreal>("opacity");
+
+    static const QVector<QPair<Method, QString>> methods = {
+        { QPainterMethod, QLatin1String("qpainter") },
+        { ScalarMethod, QLatin1String("scalar") },
+        { SimdMethod, QLatin1String("simd") }
+    };
+    for (const auto &method : methods) {
+        for (int layerCount = 1; layerCount <= 64; layerCount *= 2) {
+            for (const qreal opacity : { 1.0, 0.5 }) {
+                QTest::newRow(qPrintable(QString::fromLatin1("%1, %2 layers, opacity %3")
+                    .arg(method.second).arg(layerCount).arg(opacity))) << int(method.first) << layerCount << opacity;
+            }
+        }
+    }
+}
+
+void tst_Compositing::flatten()
+{
+    QFETCH(int, method);
+    QFETCH(int, layerCount);
+    QFETCH(qreal, opacity);
+
+    const QSize size(1024, 1024);
+    const QVector<QImage> layerImages = createLayerImages(size, layerCount);
+
+    QImage finalImage;
+    QBENCHMARK {
+        finalImage = ImageUtils::filledImage(size);
+        if (method == QPainterMethod) {
+            QPainter painter(&finalImage);
+            painter.setOpacity(opacity);
+            for (int i = layerCount - 1; i >= 0; --i)
+                painter.drawImage(0, 0, layerImages.at(i));
+        } else {
+            const auto implementation = method == SimdMethod
+                ? Compositing::SimdImplementation : Compositing::ScalarImplementation;
+            for (int i = layerCount - 1; i >= 0; --i)
+                Compositing::sourceOver(&finalImage, layerImages.at(i), opacity, implementation);
+        }
+    }
+}
+
+void tst_Compositing::flattenMixedBlendModes_data()
+{
+    QTest::addColumn<int>("method");
+
+    QTest::newRow("qpainter") << int(QPainterMethod);
+    QTest::newRow("scalar") << int(ScalarMethod);
+    QTest::newRow("simd") << int(SimdMethod);
+}
+
+// 20 layers, cycling through every blend mode.
+void tst_Compositing::flattenMixedBlendModes()
+{
+    QFETCH(int, method);
+
+    static const QVector<QPair<ImageLayer::BlendMode, QPainter::CompositionMode>> modes = {
+        { ImageLayer::NormalBlendMode, QPainter::CompositionMode_SourceOver },
+        { ImageLayer::MultiplyBlendMode, QPainter::CompositionMode_Multiply },
+        { ImageLayer::ScreenBlendMode, QPainter::CompositionMode_Screen },
+        { ImageLayer::OverlayBlendMode, QPainter::CompositionMode_Overlay },
+        { ImageLayer::AddBlendMode, QPainter::CompositionMode_Plus }
+    };
+
+    const int layerCount = 20;
+    const QSize size(1024, 1024);
+    const QVector<QImage> layerImages = createLayerImages(size, layerCount);
+
+    QImage finalImage;
+    QBENCHMARK {
+        finalImage = ImageUtils::filledImage(size);
+        if (method == QPainterMethod) {
+            QPainter painter(&finalImage);
+            for (int i = layerCount - 1; i >= 0; --i) {
+                painter.setCompositionMode(modes.at(i % modes.size()).second);
+                painter.drawImage(0, 0, layerImages.at(i));
+            }
+        } else {
+            const auto implementation = method == SimdMethod
+                ? Compositing::SimdImplementation : Compositing::ScalarImplementation;
+            for (int i = layerCount - 1; i >= 0; --i) {
+                Compositing::blend(&finalImage, layerImages.at(i), 1.0,
+                    modes.at(i % modes.size()).first, implementation);
+            }
+        }
+    }
+}
+
+// Typical pixel art layers: mostly transparent or opaque, with some translucent areas.
+QVector<QImage> tst_Compositing::createLayerImages(const QSize &size, int layerCount)
+{
+    QVector<QImage> layerImages;
+    QRandomGenerator random(layerCount);
+    for (int i = 0; i < layerCount; ++i) {
+        QImage layerImage = ImageUtils::filledImage(size);
+        QPainter painter(&layerImage);
+        for (int rectIndex = 0; rectIndex < 32; ++rectIndex) {
+            const QRect rect(random.bounded(size.width()), random.bounded(size.height()),
+                random.bounded(1, 256), random.bounded(1, 256));
+            painter.fillRect(rect, QColor(random.bounded(256), random.bounded(256), random.bounded(256),
+                rectIndex % 4 == 0 ? 128 : 255));
+        }
+        painter.end();
+        layerImages.append(layerImage);
+    }
+    return layerImages;
+}
+
+QTEST_MAIN(tst_Compositing)
+
+#include "compositing.moc"
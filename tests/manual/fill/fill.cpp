@@ -0,0 +1,163 @@
+/*
+    Copyright 2023, Mitch Curtis
+
+    This file is part of Slate.
+
+    Slate is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Slate is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Slate. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QGuiApplication>
+#include <QPainter>
+#include <QRandomGenerator>
+#include <QtTest>
+
+#include "fillalgorithms.h"
+#include "imageutils.h"
+#include "texturedfillparameters.h"
+#include "tilesetproject.h"
+
+// Measures flood and greedy fills of 256x256 tile maps and tiles, and textured fills of large images.
+class tst_Fill : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void tileFill_data();
+    void tileFill();
+    void tilePixelFill_data();
+    void tilePixelFill();
+    void texturedFill_data();
+    void texturedFill();
+};
+
+static const int mapSize = 256;
+
+void tst_Fill::tileFill_data()
+{
+    QTest::addColumn<bool>("greedy");
+
+    QTest::newRow("flood") << false;
+    QTest::newRow("greedy") << true;
+}
+
+// A 256x256 tile map where roughly one in ten tiles differs from the rest,
+// so that the area being filled has plenty of holes to go around.
+void tst_Fill::tileFill()
+{
+    QFETCH(bool, greedy);
+
+    TilesetProject project;
+    project.createNew(QUrl(), 8, 8, 2, 1, mapSize, mapSize, false);
+    QVERIFY(project.hasLoaded());
+
+    const int targetTileId = project.tilesetTileAtTilePos(QPoint(0, 0))->id();
+    const int obstacleTileId = project.tilesetTileAtTilePos(QPoint(1, 0))->id();
+    QRandomGenerator random(mapSize);
+    for (int y = 0; y < mapSize; ++y) {
+        for (int x = 0; x < mapSize; ++x)
+            project.setTileAtPixelPos(QPoint(x, y), random.bounded(10) == 0 ? obstacleTileId : targetTileId);
+    }
+    project.setTileAtPixelPos(QPoint(0, 0), targetTileId);
+
+    QVector<QPoint> filledTilePositions;
+    QBENCHMARK {
+        filledTilePositions.clear();
+        if (greedy)
+            tilesetGreedyTileFill(&project, targetTileId, Tile::invalidId(), filledTilePositions);
+        else
+            tilesetTileFloodFill(&project, QPoint(0, 0), targetTileId, Tile::invalidId(), filledTilePositions);
+    }
+    QVERIFY(!filledTilePositions.isEmpty());
+}
+
+void tst_Fill::tilePixelFill_data()
+{
+    QTest::addColumn<bool>("greedy");
+
+    QTest::newRow("flood") << false;
+    QTest::newRow("greedy") << true;
+}
+
+// A single 256x256 tile with some rects of other colours drawn over it.
+void tst_Fill::tilePixelFill()
+{
+    QFETCH(bool, greedy);
+
+    TilesetProject project;
+    project.createNew(QUrl(), mapSize, mapSize, 1, 1, 1, 1, false);
+    QVERIFY(project.hasLoaded());
+
+    QRandomGenerator random(mapSize);
+    QPainter painter(project.tileset()->image());
+    for (int rectIndex = 0; rectIndex < 64; ++rectIndex) {
+        const QRect rect(random.bounded(1, mapSize), random.bounded(1, mapSize),
+            random.bounded(1, 32), random.bounded(1, 32));
+        painter.fillRect(rect, QColor(random.bounded(256), random.bounded(256), random.bounded(256)));
+    }
+    painter.end();
+
+    const Tile *tile = project.tilesetTileAtTilePos(QPoint(0, 0));
+    const QColor targetColour = tile->pixelColor(0, 0);
+    QVector<QPoint> filledPositions;
+    QBENCHMARK {
+        filledPositions.clear();
+        if (greedy)
+            tilesetGreedyPixelFill(tile, targetColour, Qt::transparent, filledPositions);
+        else
+            tilesetPixelFloodFill(tile, QPoint(0, 0), targetColour, Qt::transparent, filledPositions);
+    }
+    QVERIFY(!filledPositions.isEmpty());
+}
+
+void tst_Fill::texturedFill_data()
+{
+    QTest::addColumn<int>("type");
+    QTest::addColumn<bool>("greedy");
+
+    QTest::newRow("variance, flood") << int(TexturedFillParameters::VarianceFillType) << false;
+    QTest::newRow("variance, greedy") << int(TexturedFillParameters::VarianceFillType) << true;
+    QTest::newRow("swatch, flood") << int(TexturedFillParameters::SwatchFillType) << false;
+    QTest::newRow("swatch, greedy") << int(TexturedFillParameters::SwatchFillType) << true;
+}
+
+void tst_Fill::texturedFill()
+{
+    QFETCH(int, type);
+    QFETCH(bool, greedy);
+
+    TexturedFillParameters parameters;
+    parameters.setType(TexturedFillParameters::TexturedFillType(type));
+    parameters.hue()->setEnabled(true);
+    parameters.hue()->setVarianceLowerBound(-0.1);
+    parameters.hue()->setVarianceUpperBound(0.1);
+    parameters.lightness()->setEnabled(true);
+    parameters.lightness()->setVarianceLowerBound(-0.2);
+    parameters.lightness()->setVarianceUpperBound(0.2);
+    parameters.swatch()->addColoursWithProbabilities({ Qt::red, Qt::green, Qt::blue, Qt::yellow },
+        { 1.0, 0.5, 0.25, 0.125 });
+
+    const QImage image = ImageUtils::filledImage(1024, 1024, Qt::white);
+    QImage filledImage;
+    QBENCHMARK {
+        if (greedy)
+            filledImage = greedyTexturedFill(&image, Qt::white, Qt::black, parameters, 0);
+        else
+            filledImage = ::texturedFill(&image, QPoint(0, 0), Qt::white, Qt::black, parameters, 0);
+    }
+    QVERIFY(!filledImage.isNull());
+}
+
+QTEST_MAIN(tst_Fill)
+
+#include "fill.moc"
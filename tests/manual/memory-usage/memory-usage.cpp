@@ -21,6 +21,10 @@
 #include <QtTest>
 
 #include "application.h"
+#include "applicationsettings.h"
+#include "applypixellinecommand.h"
+#include "imagecanvas.h"
+#include "layeredimageproject.h"
 #include "project.h"
 #include "testhelper.h"
 
@@ -34,6 +38,11 @@ public:
 
 private Q_SLOTS:
     void pen();
+    void undoHistoryBudget_data();
+    void undoHistoryBudget();
+
+private:
+    QString undoHistoryBreakdown() const;
 };
 
 tst_MemoryUsage::tst_MemoryUsage(int &argc, char **argv) :
@@ -72,6 +81,82 @@ void tst_MemoryUsage::pen()
     }
 }
 
+void tst_MemoryUsage::undoHistoryBudget_data()
+{
+    QTest::addColumn<QString>("workflow");
+    QTest::addColumn<qint64>("budget");
+
+    const qint64 tileByteCount = ApplyPixelLineCommand::tileSize * ApplyPixelLineCommand::tileSize * 4;
+    const int tilesPerRow = (1000 + ApplyPixelLineCommand::tileSize - 1) / ApplyPixelLineCommand::tileSize;
+    // Each stroke keeps a copy of the row of tiles it touched before and after it was drawn.
+    QTest::newRow("pen strokes") << QString::fromLatin1("pen strokes") << 10 * 2 * tilesPerRow * tileByteCount;
+    // Fills only store the pixels that changed, which are a couple of runs per row here.
+    QTest::newRow("fills") << QString::fromLatin1("fills") << qint64(10 * 1000 * 64);
+    // Each resize stores the layer's image before and after, which would be 50 MB
+    // for these resizes, so the undo memory budget of 16 MB has to be enforced.
+    QTest::newRow("resizes") << QString::fromLatin1("resizes") << qint64(16 * 1024 * 1024);
+}
+
+// Checks that common workflows keep the undo history within the memory we expect it to use.
+void tst_MemoryUsage::undoHistoryBudget()
+{
+    QFETCH(QString, workflow);
+    QFETCH(qint64, budget);
+
+    QVERIFY2(createNewLayeredImageProject(1000, 1000), failureMessage);
+
+    const int oldUndoMemoryBudget = app.settings()->undoMemoryBudget();
+    auto undoMemoryBudgetCleanup = qScopeGuard([=](){ app.settings()->setUndoMemoryBudget(oldUndoMemoryBudget); });
+    app.settings()->setUndoMemoryBudget(16);
+
+    if (workflow == QLatin1String("pen strokes")) {
+        QVERIFY2(switchTool(ImageCanvas::PenTool), failureMessage);
+        for (int strokeIndex = 0; strokeIndex < 10; ++strokeIndex) {
+            const int y = strokeIndex * 90;
+            setCursorPosInScenePixels(0, y);
+            QTest::mousePress(window, Qt::LeftButton, Qt::NoModifier, cursorWindowPos);
+            setCursorPosInScenePixels(project->widthInPixels() - 1, y);
+            QTest::mouseMove(window, cursorWindowPos);
+            QTest::mouseRelease(window, Qt::LeftButton, Qt::NoModifier, cursorWindowPos);
+        }
+        // The copies of the tiles after each stroke are only taken once they're undone.
+        for (int strokeIndex = 0; strokeIndex < 10; ++strokeIndex)
+            project->undoStack()->undo();
+        QCOMPARE(project->undoStack()->count(), 10);
+    } else if (workflow == QLatin1String("fills")) {
+        QVERIFY2(switchTool(ImageCanvas::FillTool), failureMessage);
+        setCursorPosInScenePixels(0, 0);
+        for (int fillIndex = 0; fillIndex < 10; ++fillIndex) {
+            canvas->setPenForegroundColour(fillIndex % 2 == 0 ? Qt::red : Qt::blue);
+            mouseEvent(canvas, cursorWindowPos, MouseClick);
+        }
+        QCOMPARE(project->undoStack()->count(), 10);
+    } else if (workflow == QLatin1String("resizes")) {
+        for (int resizeIndex = 0; resizeIndex < 10; ++resizeIndex) {
+            const int size = resizeIndex % 2 == 0 ? 500 : 1000;
+            project->beginLivePreview();
+            layeredImageProject->resize(size, size, false);
+            project->endLivePreview(Project::CommitModificaton);
+        }
+    }
+
+    QVERIFY2(project->undoPayloadByteCount() <= budget, qPrintable(QString::fromLatin1(
+        "Expected undo history to use at most %1 bytes, but it uses %2:\n%3")
+            .arg(budget).arg(project->undoPayloadByteCount()).arg(undoHistoryBreakdown())));
+}
+
+QString tst_MemoryUsage::undoHistoryBreakdown() const
+{
+    QString breakdown;
+    const QUndoStack *undoStack = project->undoStack();
+    for (int i = 0; i < undoStack->count(); ++i) {
+        const QUndoCommand *command = undoStack->command(i);
+        breakdown += QString::fromLatin1("    %1: %2 bytes\n").arg(command->text())
+            .arg(UndoCommand::totalPayloadByteCount(command));
+    }
+    return breakdown;
+}
+
 int main(int argc, char *argv[])
 {
     tst_MemoryUsage test(argc, argv);